@@ -22,22 +22,41 @@
 #include <math.h>
 #else
 #include <dlfcn.h>
+#include <spawn.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #endif /* _WIN32 */
 
+#ifdef __APPLE__
+#include <crt_externs.h>
+#define environ (*_NSGetEnviron())
+#elif !defined(_WIN32)
+extern char** environ;
+#endif
+
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <ctime>
 #include <iostream>
 #include <fstream>
 #include <cerrno>
+#include <vector>
 
 #include "Cc.hpp" 
+#include "CcCache.hpp" 
+#include "CcThreads.hpp" 
 #include "Debug.hpp" 
+#include "FileMemory.hpp"
 #include "Stream.hpp" 
 #include "Variant.hpp"
 #include "VariantFactory.hpp"
 #include "TypeInfo.hpp"
 #include "Optimizations.hpp"
+#include "Context.hpp"
+#include "Eval.hpp"
+#include "Evaluate.hpp"
+#include "Internals.hpp"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -55,6 +74,115 @@ namespace Cc {
 using namespace SH;
 
 #include "CcTexturesString.hpp"
+#include "CcLanesString.hpp"
+#include "CcTypesString.hpp"
+
+namespace {
+
+// 128-bit vectors, which SSE, AltiVec and NEON all provide without any
+// -march flags
+const int DefaultLanes = 4;
+
+/// Interned id of host storages, for cheap lookups
+const int HostStorageId = SH::Storage::intern("host");
+
+int read_lane_count()
+{
+  int lanes = DefaultLanes;
+  const char* env = getenv("SH_CC_LANES");
+  if (env) {
+    lanes = atoi(env);
+    if (lanes != 0 && lanes != 4 && lanes != 8 && lanes != 16) {
+      SH_DEBUG_WARN("SH_CC_LANES must be 0, 4, 8 or 16, not " << env);
+      lanes = 0;
+    }
+  }
+  return lanes;
+}
+
+// Width of the vectorized kernels, from $SH_CC_LANES (0 disables them)
+int lane_count()
+{
+  static const int lanes = read_lane_count();
+  return lanes;
+}
+
+#ifndef _WIN32
+// Background compiles in progress, which the process waits for when it
+// exits so that no half-written libraries are left in the kernel cache
+pthread_mutex_t compiles_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t compiles_done = PTHREAD_COND_INITIALIZER;
+int compiles_running = 0;
+
+void wait_for_compiles()
+{
+  pthread_mutex_lock(&compiles_mutex);
+  while (compiles_running > 0) {
+    pthread_cond_wait(&compiles_done, &compiles_mutex);
+  }
+  pthread_mutex_unlock(&compiles_mutex);
+}
+
+// Runs the compiler command line args and waits for it.  Returns true
+// if it exited successfully.
+bool run_compiler(const std::vector<std::string>& args)
+{
+  std::vector<char*> argv;
+  for (std::vector<std::string>::const_iterator I = args.begin(); 
+       I != args.end(); ++I) {
+    argv.push_back(const_cast<char*>(I->c_str()));
+  }
+  argv.push_back(NULL);
+
+  // Unlike fork(), posix_spawn() does not copy the page tables of the
+  // process, which matters when several compilers are started at once
+  pid_t pid;
+  int error = posix_spawnp(&pid, argv[0], NULL, NULL, &argv[0], environ);
+  if (error != 0) {
+    SH_CC_DEBUG_PRINT("posix_spawnp failed (" << error << ")");
+    return false;
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) == -1) {
+    SH_CC_DEBUG_PRINT("wait failed...");
+    return false;
+  }
+  SH_CC_DEBUG_PRINT("status = " << status);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+#endif /* _WIN32 */
+
+template<typename T>
+std::string encode_fixed(const VariantCPtr& variant)
+{
+  const T* data = reinterpret_cast<const T*>(variant->array());
+  std::ostringstream out;
+  for (int i = 0; i < variant->size(); ++i) {
+    if (i != 0) out << ", ";
+    out << static_cast<long long>(data[i]);
+  }
+  return out.str();
+}
+
+// The fixed-point values of a fraction variant, which encodeArray()
+// would print as reals
+std::string encode_fixed(const VariantCPtr& variant)
+{
+  switch (variant->valueType()) {
+  case SH_FBYTE:   return encode_fixed<signed char>(variant);
+  case SH_FSHORT:  return encode_fixed<short>(variant);
+  case SH_FINT:    return encode_fixed<int>(variant);
+  case SH_FUBYTE:  return encode_fixed<unsigned char>(variant);
+  case SH_FUSHORT: return encode_fixed<unsigned short>(variant);
+  case SH_FUINT:   return encode_fixed<unsigned int>(variant);
+  default:
+    SH_DEBUG_ASSERT(0);
+  }
+  return "";
+}
+
+}
 
 std::string encode(const Variable& v)
 {
@@ -68,7 +196,7 @@ std::string encode(const Variable& v)
 // internal use only 
 const char* makeVarname(const char* prefix, int suffix)
 {
-  static char buffer[128];
+  static SH_THREAD_LOCAL char buffer[128];
   sprintf(buffer, "%s%d", prefix, suffix); 
   return buffer;
 }
@@ -116,30 +244,40 @@ void CcBackendCode::EmitFunctor::operator()(CtrlGraphNode* node)
 CcBackendCode::CcBackendCode(const ProgramNodeCPtr& program) 
   : m_original_program(program),
     m_program(0),
+    m_lanes(-1),
 #ifdef _WIN32
     m_hmodule(NULL),
 #else
     m_handle(NULL),
 #endif
     m_shader_func(NULL),
+    m_shader_batch_func(NULL),
+#ifndef _WIN32
+    m_deferred(false),
+    m_compiling(false),
+    m_compile_done(false),
+    m_compile_failed(false),
+    m_profile(Context::current()->compile_profile()),
+    m_tuned(false),
+    m_candidate(false),
+#endif
     m_cur_temp(0),
+    m_writes_uniforms(false),
     m_params(NULL) 
 {
   SH_CC_DEBUG_PRINT(__FUNCTION__);
-
-  // convert half floats, fractionals to types we can use
-  m_convertMap[SH_HALF] = SH_FLOAT;
-  m_convertMap[SH_FINT] = SH_FLOAT;
-  m_convertMap[SH_FSHORT] = SH_FLOAT;
-  m_convertMap[SH_FBYTE] = SH_FLOAT;
-  m_convertMap[SH_FUINT] = SH_FLOAT;
-  m_convertMap[SH_FUSHORT] = SH_FLOAT;
-  m_convertMap[SH_FUBYTE] = SH_FLOAT;
 }
 
 CcBackendCode::~CcBackendCode(void) 
 {
   SH_CC_DEBUG_PRINT(__FUNCTION__);
+#ifndef _WIN32
+  if (m_compiling) {
+    finish_compile();
+    delete_temporary_files();
+  }
+  if (m_handle) dlclose(m_handle);
+#endif
 }
 
 bool CcBackendCode::allocateRegister(const VariableNodePtr& var) 
@@ -208,11 +346,21 @@ void CcBackendCode::allocate_varlist(const std::list<T> &varList, const char* va
 
     const char* name = makeVarname(varPrefix, num);
     const char* type = ctype(node->valueType());
+    m_varmap[node] = CcVariable(num, name, node->size(), node->valueType()); 
+
+    if (node->valueType() == SH_HALF &&
+        (node->kind() == SH_INPUT || node->kind() == SH_OUTPUT)) {
+      // Halves are computed in a float copy of their 16 bit memory
+      m_code << "  " << typePrefix << " unsigned short *" << name 
+             << "_mem = ((" << typePrefix << " unsigned short*) " << arrayName 
+             << "[" << num << "]); // " << node->name() << std::endl; 
+      m_code << "  " << type << " " << name << "[" << node->size() << "];" << std::endl;
+      continue;
+    }
+
     m_code << "  " << typePrefix << " " << type << " *" << name 
 	   << " = ((" << type << "*) " << arrayName << "[" << num << "]); // " 
 	   << node->name() << std::endl; 
-
-    m_varmap[node] = CcVariable(num, name, node->size(), node->valueType()); 
   }
   m_code << std::endl;
 
@@ -229,8 +377,13 @@ void CcBackendCode::allocate_consts(void)
     VariableNodePtr node = (*I);
     const char* name = makeVarname(ConstPrefix, num);
       
-    m_code << "const " << ctype(node->valueType()) << " " << name << "[" << node->size() << "] = {" 
-	   << node->getVariant()->encodeArray() << "}; // " << node->name() << std::endl;
+    m_code << "const " << ctype(node->valueType()) << " " << name << "[" << node->size() << "] = {";
+    if (isFraction(node->valueType())) {
+      m_code << encode_fixed(node->getVariant());
+    } else {
+      m_code << node->getVariant()->encodeArray();
+    }
+    m_code << "}; // " << node->name() << std::endl;
 
     m_varmap[node] = CcVariable(num, name, node->size(), node->valueType()); 
   }
@@ -242,6 +395,19 @@ void CcBackendCode::allocate_consts(void)
 void CcBackendCode::allocate_inputs(void) 
 {
   allocate_varlist(m_program->inputs, InputPrefix, "inputs"); 
+
+  int num = 0;
+  for (ProgramNode::VarList::const_iterator I = m_program->inputs.begin(); 
+       I != m_program->inputs.end(); ++I, ++num) {
+    VariableNodePtr node = *I; 
+    if (node->valueType() != SH_HALF) continue;
+
+    const char* name = makeVarname(InputPrefix, num);
+    for (int i = 0; i < node->size(); i++) {
+      m_code << "  " << name << "[" << i << "] = sh_cc_half_get(" 
+             << name << "_mem[" << i << "]);" << std::endl;
+    }
+  }
 }
 
 void CcBackendCode::allocate_outputs(void) 
@@ -326,22 +492,22 @@ std::string CcBackendCode::resolve(const Variable& v, int idx)
 const char* CcBackendCode::ctype(ValueType valueType)
 {
   switch(valueType) {
-  case SH_HALF:
-  case SH_FLOAT:
+  case SH_HALF: // only stored as 16 bits
+  case SH_FLOAT:  return "float";
+  case SH_DOUBLE: return "double";
+
+  // Fractions are held in fixed point
   case SH_FBYTE:
+  case SH_BYTE:   return "signed char";
   case SH_FSHORT:
-  case SH_FINT:
-  case SH_FUBYTE:
-  case SH_FUSHORT:
-  case SH_FUINT:
-    return "float";
-
-  case SH_DOUBLE: return "double";
-  case SH_BYTE:   return "char";
   case SH_SHORT:  return "short";
+  case SH_FINT:
   case SH_INT:    return "int";
+  case SH_FUBYTE:
   case SH_UBYTE:  return "unsigned char";
+  case SH_FUSHORT:
   case SH_USHORT: return "unsigned short";
+  case SH_FUINT:
   case SH_UINT:   return "unsigned int";
   default:
     SH_DEBUG_PRINT("Invalid value type: " << valueTypeName(valueType));
@@ -350,6 +516,34 @@ const char* CcBackendCode::ctype(ValueType valueType)
   return "unknown"; 
 }
 
+ValueType CcBackendCode::value_type(const Variable& v)
+{
+  return m_varmap[v.node()].m_valueType;
+}
+
+const char* CcBackendCode::fraction_type(ValueType valueType)
+{
+  switch(valueType) {
+  case SH_FBYTE:   return "sh_cc_fb";
+  case SH_FSHORT:  return "sh_cc_fs";
+  case SH_FINT:    return "sh_cc_fi";
+  case SH_FUBYTE:  return "sh_cc_fub";
+  case SH_FUSHORT: return "sh_cc_fus";
+  case SH_FUINT:   return "sh_cc_fui";
+  default:
+    SH_DEBUG_PRINT("Not a fraction type: " << valueTypeName(valueType));
+    SH_DEBUG_ASSERT(0); 
+  }
+  return "unknown"; 
+}
+
+std::string CcBackendCode::texel_type(ValueType valueType)
+{
+  if (valueType == SH_HALF) return "sh_cc_half";
+  if (isFraction(valueType)) return std::string(fraction_type(valueType)) + "::texel";
+  return ctype(valueType);
+}
+
 void CcBackendCode::emit(const BasicBlockPtr& block) 
 {
   if (!block) {
@@ -398,10 +592,27 @@ void CcBackendCode::emit(CtrlGraphNode* node)
 
   if (node->successors_empty() && !node->follower()) {
     // Last block, need to return from the function
-    m_code << "  return;" << std::endl;
+    emit_return("  ");
   }
 }
 
+void CcBackendCode::emit_return(const std::string& indent)
+{
+  int num = 0;
+  for (ProgramNode::VarList::const_iterator I = m_program->outputs.begin(); 
+       I != m_program->outputs.end(); ++I, ++num) {
+    VariableNodePtr node = *I; 
+    if (node->valueType() != SH_HALF) continue;
+
+    const char* name = makeVarname(OutputPrefix, num);
+    for (int i = 0; i < node->size(); i++) {
+      m_code << indent << name << "_mem[" << i << "] = sh_cc_half_make(" 
+             << name << "[" << i << "]);" << std::endl;
+    }
+  }
+  m_code << indent << "return;" << std::endl;
+}
+
 bool CcBackendCode::generate(void) 
 {
   // Transform the code to remove types this backend cannot handle
@@ -410,7 +621,6 @@ bool CcBackendCode::generate(void)
   Transformer transform(m_program);
 
   transform.convertInputOutput();
-  transform.convertToFloat(m_convertMap);
   transform.stripDummyOps();
   if(transform.changed()) {
     optimize(m_program);
@@ -445,20 +655,57 @@ bool CcBackendCode::generate(void)
   EmitFunctor fe(this);
   m_program->ctrlGraph->dfs(fe);
 
+  if (m_lanes < 0) m_lanes = lane_count();
+  bool lanes = emit_lanes();
+
   // prologue
   std::stringstream prologue;
   prologue << "#include <math.h>" << std::endl;
   prologue << "#ifdef __APPLE__" << std::endl;
-  prologue << "double exp10(double a) { return pow(10.0, a); }" << std::endl;
+  prologue << "static double exp10(double a) { return pow(10.0, a); }" << std::endl;
   prologue << "#endif" << std::endl;
 
+  for (std::map<VariableNodePtr, CcVariable>::const_iterator I = m_varmap.begin();
+       I != m_varmap.end(); ++I) {
+    if (I->second.m_valueType == SH_HALF || isFraction(I->second.m_valueType)) {
+      for(int i = 0; cc_types_string[i][0] != 0; ++i) {
+        prologue << cc_types_string[i]; 
+      }
+      break;
+    }
+  }
   for(int i = 0; cc_texture_string[i][0] != 0; ++i) {
     prologue << cc_texture_string[i]; 
   }
+  if (lanes) {
+    prologue << std::endl;
+    prologue << "#define SH_CC_LANES " << m_lanes << std::endl;
+    for(int i = 0; cc_lanes_string[i][0] != 0; ++i) {
+      prologue << cc_lanes_string[i]; 
+    }
+  }
   // @todo output the CcTextures.hpp file here
   prologue << std::endl;
   prologue << std::endl;
-  prologue << "extern \"C\" "
+  // The kernel body computes a single element.  It is wrapped by the
+  // two entry points below, and the compiler inlines it into both.
+  prologue << "static inline void cc_shader_element("
+	   << "void** inputs, "
+	   << "void** params, "
+	   << "void** channels, "
+	   << "void** textures, "
+	   << "void** outputs)" << std::endl;
+  prologue << "{" << std::endl;
+
+
+  // epilogue
+  int num_inputs = m_program->inputs.size();
+  int num_outputs = m_program->outputs.size();
+
+  std::stringstream epilogue;
+  epilogue << "}" << std::endl;
+  epilogue << std::endl;
+  epilogue << "extern \"C\" "
 #ifdef _WIN32
 	   << " void __declspec(dllexport) cc_shader("
 #else
@@ -469,11 +716,75 @@ bool CcBackendCode::generate(void)
 	   << "void** channels, "
 	   << "void** textures, "
 	   << "void** outputs)" << std::endl;
-  prologue << "{" << std::endl;
-
+  epilogue << "{" << std::endl;
+  epilogue << "  cc_shader_element(inputs, params, channels, textures, outputs);" << std::endl;
+  epilogue << "}" << std::endl;
+  epilogue << std::endl;
+
+  if (lanes) {
+    epilogue << "static inline void cc_shader_lanes("
+             << "const int* input_strides, "
+             << "const int* output_strides, "
+             << "void** inputs, "
+             << "void** params, "
+             << "void** channels, "
+             << "void** textures, "
+             << "void** outputs)" << std::endl;
+    epilogue << "{" << std::endl;
+    epilogue << m_lanes_code.str();
+    epilogue << "}" << std::endl;
+    epilogue << std::endl;
+  }
 
-  // epilogue
-  std::stringstream epilogue;
+  // Keeping the element loop in the generated code lets the compiler
+  // hoist loads of uniforms and constants out of it and vectorize it
+  epilogue << "extern \"C\" "
+#ifdef _WIN32
+	   << " void __declspec(dllexport) cc_shader_batch("
+#else
+	   << " void cc_shader_batch("
+#endif /* _WIN32 */
+	   << "int count, "
+	   << "const int* input_strides, "
+	   << "const int* output_strides, "
+	   << "void** inputs, "
+	   << "void** params, "
+	   << "void** channels, "
+	   << "void** textures, "
+	   << "void** outputs)" << std::endl;
+  epilogue << "{" << std::endl;
+  epilogue << "  void* in[" << (num_inputs ? num_inputs : 1) << "];" << std::endl;
+  epilogue << "  void* out[" << (num_outputs ? num_outputs : 1) << "];" << std::endl;
+  for (int i = 0; i < num_inputs; ++i) {
+    epilogue << "  in[" << i << "] = inputs[" << i << "];" << std::endl;
+  }
+  for (int i = 0; i < num_outputs; ++i) {
+    epilogue << "  out[" << i << "] = outputs[" << i << "];" << std::endl;
+  }
+  epilogue << "  int i = 0;" << std::endl;
+  if (lanes) {
+    epilogue << "  for (; i + " << m_lanes << " <= count; i += " << m_lanes << ") {" << std::endl;
+    epilogue << "    cc_shader_lanes(input_strides, output_strides, in, params, channels, textures, out);" << std::endl;
+    for (int i = 0; i < num_inputs; ++i) {
+      epilogue << "    in[" << i << "] = (char*)in[" << i << "] + " << m_lanes 
+               << " * input_strides[" << i << "];" << std::endl;
+    }
+    for (int i = 0; i < num_outputs; ++i) {
+      epilogue << "    out[" << i << "] = (char*)out[" << i << "] + " << m_lanes 
+               << " * output_strides[" << i << "];" << std::endl;
+    }
+    epilogue << "  }" << std::endl;
+  }
+  // The elements left over by the vectorized loop
+  epilogue << "  for (; i < count; ++i) {" << std::endl;
+  epilogue << "    cc_shader_element(in, params, channels, textures, out);" << std::endl;
+  for (int i = 0; i < num_inputs; ++i) {
+    epilogue << "    in[" << i << "] = (char*)in[" << i << "] + input_strides[" << i << "];" << std::endl;
+  }
+  for (int i = 0; i < num_outputs; ++i) {
+    epilogue << "    out[" << i << "] = (char*)out[" << i << "] + output_strides[" << i << "];" << std::endl;
+  }
+  epilogue << "  }" << std::endl;
   epilogue << "}" << std::endl;
 
 #ifdef SH_CC_DEBUG
@@ -549,73 +860,217 @@ bool CcBackendCode::load_shader_func(const std::stringstream& prologue,
       SH_CC_DEBUG_PRINT("GetProcAddress failed: " << GetLastError());
       return false;
     }
+    m_shader_batch_func = (CcShaderBatchFunc)GetProcAddress(m_hmodule, "cc_shader_batch");
   }
 
   return true;
 
 #else
-  char name[32];
-  tmpnam(name);
-  char ccfile[32];
-  char sofile[32];
-  sprintf(ccfile, "%s.cc", name);
-  #ifdef __APPLE__
-  sprintf(sofile, "%s.dylib", name);
-  #else
-  sprintf(sofile, "%s.so", name);
-  #endif
+  std::string source = prologue.str() + m_code.str() + epilogue.str();
+
+  std::vector<std::string> args;
+  args.push_back("cc");
+  std::string flags = Context::current()->compile_flags(m_profile);
+  if (flags.empty()) {
+    SH_DEBUG_WARN("Unknown compile profile " << m_profile << ", using the default one");
+    m_profile = "default";
+    flags = Context::current()->compile_flags(m_profile);
+  }
+  std::istringstream flag_stream(flags);
+  for (std::string flag; flag_stream >> flag; ) {
+    args.push_back(flag);
+  }
+  args.push_back("-fPIC");
+  // Integer tuples wrap around on overflow
+  args.push_back("-fwrapv");
+#ifdef __APPLE__
+  args.push_back("-bundle");
+#else
+  args.push_back("-shared");
+#endif // __APPLE__
+
+  // Look for a library built by an earlier run first
+  KernelCache* cache = KernelCache::instance();
+  std::string key = KernelCache::key(source, args);
+  std::string name;
+  m_cache_key = key;
+
+  // Every kernel gets its own entry points, so that several of them can
+  // be linked into one library (see CcBackend::compile_set()).  The
+  // command line heading the source is checked by the kernel cache
+  // along with the rest of it.
+  std::string command;
+  for (std::vector<std::string>::const_iterator I = args.begin(); I != args.end(); ++I) {
+    command += *I + " ";
+  }
+  source = "// " + command + "(" + KernelCache::compiler_version(args) + ")\n" +
+           "#define cc_shader cc_shader_" + key + "\n" +
+           "#define cc_shader_batch cc_shader_batch_" + key + "\n" + source;
+
+  if (cache) {
+    if (cache->lookup(key, source) && open_shader_func(cache->path(key))) {
+      return true;
+    }
+    name = cache->temp_name(key);
+  } else {
+    char buffer[L_tmpnam];
+    tmpnam(buffer);
+    name = buffer;
+  }
+
+  std::string ccfile = name + ".cc";
+#ifdef __APPLE__
+  std::string sofile = name + ".dylib";
+#else
+  std::string sofile = name + ".so";
+#endif
   m_code_filename = ccfile;
   m_lib_filename  = sofile;
 
-  std::ofstream fout(ccfile);
-  fout << prologue.str();
-  fout << m_code.str();
-  fout << epilogue.str();
+  std::ofstream fout(ccfile.c_str());
+  fout << source;
   fout.flush();
   fout.close();
 
-  pid_t pid = fork();
-  if (pid == 0) {
-    // child
-#ifdef __APPLE__
-    execlp("cc", "cc", "-O2", "-fPIC", "-bundle", "-o", sofile, ccfile, (void*)NULL);
-#else
-    execlp("cc", "cc", "-O2", "-fPIC", "-shared", "-o", sofile, ccfile, (void*)NULL);
-#endif // __APPLE__
-    SH_CC_DEBUG_PRINT("exec failed (" << errno << ")");
-    exit(-1);
-  } else if (pid > 0) {
-    int status;
-    pid_t ret = waitpid(pid, &status, 0);
-    if (ret == -1) {
-      SH_CC_DEBUG_PRINT("wait failed...");
-      return false;
-    } else {
-      SH_CC_DEBUG_PRINT("status = " << status);
+  m_compile_args = args;
+  if (m_deferred) return true;
+
+  // Until the kernel is ready, execute() runs the program in the host
+  // evaluator instead
+  if (Context::current()->async_compile() && !m_candidate && interpretable()) {
+    static bool registered = false;
+    m_compile_done = false;
+    pthread_mutex_lock(&compiles_mutex);
+    if (!registered) {
+      atexit(wait_for_compiles);
+      registered = true;
     }
+    int error = pthread_create(&m_compile_thread, NULL, compile_thread, this);
+    if (error == 0) ++compiles_running;
+    pthread_mutex_unlock(&compiles_mutex);
+    if (error == 0) {
+      m_compiling = true;
+      return true;
+    }
+    SH_CC_DEBUG_PRINT("pthread_create failed (" << error << ")");
+  }
+  return compile_shader_func();
+#endif /* _WIN32 */
+}
 
-    m_handle = dlopen(sofile, RTLD_NOW);
-    if (m_handle == NULL) {
-      SH_CC_DEBUG_PRINT("dlopen failed: " << dlerror());
-      return false;
-    } else {
-      m_shader_func = (CcShaderFunc)dlsym(m_handle, "cc_shader");
-      if (m_shader_func == NULL) {
-	SH_CC_DEBUG_PRINT("dlsym failed: " << dlerror());
-	return false;
-      }
+#ifndef _WIN32
+bool CcBackendCode::compile_shader_func()
+{
+  std::vector<std::string> args(m_compile_args);
+  args.push_back("-o");
+  args.push_back(m_lib_filename);
+  args.push_back(m_code_filename);
+  if (!run_compiler(args)) return false;
+
+  if (!open_shader_func(m_lib_filename)) return false;
+
+  // The library is mapped now, so it can be moved into the cache
+  // without racing against eviction by other processes
+  KernelCache* cache = KernelCache::instance();
+  if (cache && cache->insert(m_cache_key, m_lib_filename, m_code_filename)) {
+    m_code_filename = "";
+    m_lib_filename = "";
+  }
+  return true;
+}
+
+namespace {
+
+/// Looks for statements the host evaluator cannot run
+struct EvaluatorSupport {
+  EvaluatorSupport() : supported(true) { }
+
+  void operator()(CtrlGraphNode* node)
+  {
+    if (!node->block) return;
+    for (BasicBlock::StmtList::const_iterator I = node->block->begin();
+         I != node->block->end(); ++I) {
+      // evaluate() skips kills, along with everything without a dest
+      if (I->op == OP_KIL) supported = false;
+      if (I->dest.null()) continue;
+      if (!Eval::instance()->getEvalOpInfo(*I)) supported = false;
     }
-    return true;
-  } else  {
-    // fork failed
-    SH_CC_DEBUG_PRINT("fork failed...");
-    return false;
   }
+
+  bool supported;
+};
+
+}
+
+bool CcBackendCode::interpretable()
+{
+  EvaluatorSupport support;
+  m_original_program->ctrlGraph->dfs(support);
+  return support.supported;
+}
+
+void* CcBackendCode::compile_thread(void* code)
+{
+  CcBackendCode* self = static_cast<CcBackendCode*>(code);
+  self->compile_shader_func();
+
+  pthread_mutex_lock(&compiles_mutex);
+  self->m_compile_done = true;
+  --compiles_running;
+  pthread_cond_broadcast(&compiles_done);
+  pthread_mutex_unlock(&compiles_mutex);
+  return NULL;
+}
+
+bool CcBackendCode::compile_finished()
+{
+  pthread_mutex_lock(&compiles_mutex);
+  bool done = m_compile_done;
+  pthread_mutex_unlock(&compiles_mutex);
+  return done;
+}
+
+void CcBackendCode::finish_compile()
+{
+  pthread_join(m_compile_thread, NULL);
+  m_compiling = false;
+  m_compile_failed = !m_shader_func;
+  if (m_compile_failed) {
+    SH_DEBUG_WARN("Could not compile a cc kernel, the host evaluator keeps running it");
+  }
+}
 #endif /* _WIN32 */
+
+#ifndef _WIN32
+bool CcBackendCode::open_shader_func(const std::string& sofile)
+{
+  m_handle = dlopen(sofile.c_str(), RTLD_NOW);
+  if (m_handle == NULL) {
+    SH_CC_DEBUG_PRINT("dlopen failed: " << dlerror());
+    return false;
+  }
+
+  std::string name = "cc_shader_" + m_cache_key;
+  m_shader_func = (CcShaderFunc)dlsym(m_handle, name.c_str());
+  if (m_shader_func == NULL) {
+    SH_CC_DEBUG_PRINT("dlsym failed: " << dlerror());
+    return false;
+  }
+
+  // optional, the per-element entry point is enough to run the kernel
+  name = "cc_shader_batch_" + m_cache_key;
+  m_shader_batch_func = (CcShaderBatchFunc)dlsym(m_handle, name.c_str());
+  return true;
 }
+#endif /* _WIN32 */
 
 void CcBackendCode::delete_temporary_files()
 {
+#ifndef _WIN32
+  // still needed by the background compile
+  if (m_compiling) return;
+#endif
+
   if (!m_code_filename.empty()) {
     remove(m_code_filename.c_str());
     m_code_filename = "";
@@ -642,9 +1097,313 @@ struct SecondUpToDateStorage : std::binary_function<StoragePtr, MemoryPtr, bool>
   mutable bool m_second;
 };
 
+/// Returns the host storage a FileMemory maps its file to, so that
+/// outputs go straight into the file, or 0 if mem is not a FileMemory
+/// or program reads it too
+HostStoragePtr mapped_storage(const MemoryPtr& mem, const Program& prg,
+                              const ProgramNodePtr& program)
+{
+  FileMemoryPtr file = shref_dynamic_cast<FileMemory>(mem);
+  if (!file) return 0;
+  for (Stream::const_iterator I = prg.stream_inputs.begin(); I != prg.stream_inputs.end(); ++I) {
+    if (I->node()->memory(0) == mem) return 0;
+  }
+  for (ProgramNode::TexList::const_iterator I = program->begin_textures();
+       I != program->end_textures(); ++I) {
+    if ((*I)->memory(0) == mem) return 0;
+  }
+  return file->hostStorage();
+}
+
+/// Everything a thread needs to compute a range of stream elements
+struct StreamJob {
+  CcShaderFunc func;
+  CcShaderBatchFunc batch_func; ///< may be null
+  void** params;
+  void** streams;
+  void** textures;
+  std::vector<void*> inputs;   ///< pointers to element 0
+  std::vector<void*> outputs;
+  std::vector<int> input_sizes; ///< strides in bytes (0 for uniforms)
+  std::vector<int> output_sizes;
+  int count;  ///< number of elements
+  int chunks; ///< number of equal ranges count is split into
+};
+
+namespace {
+
+/// Streams shorter than this per thread are computed serially, since
+/// handing them to the worker pool costs more than it saves
+const int MinElementsPerThread = 4096;
+
+/// Number of elements autotune() times the candidate kernels on
+const int TuningSampleElements = 4096;
+
+void run_chunk(void* data, int index)
+{
+  const StreamJob& job = *static_cast<StreamJob*>(data);
+  int begin = static_cast<int>(static_cast<long long>(job.count) * index / job.chunks);
+  int end = static_cast<int>(static_cast<long long>(job.count) * (index + 1) / job.chunks);
+
+  // per-thread copies of the pointer arrays, advanced to this range
+  std::vector<void*> inputs(job.inputs.size());
+  std::vector<void*> outputs(job.outputs.size());
+  for(unsigned int j = 0; j < inputs.size(); j++) {
+    inputs[j] = reinterpret_cast<char*>(job.inputs[j]) 
+      + static_cast<long long>(begin) * job.input_sizes[j];
+  }
+  for(unsigned int j = 0; j < outputs.size(); j++) {
+    outputs[j] = reinterpret_cast<char*>(job.outputs[j]) 
+      + static_cast<long long>(begin) * job.output_sizes[j];
+  }
+  void** in = inputs.empty() ? 0 : &inputs[0];
+  void** out = outputs.empty() ? 0 : &outputs[0];
+
+  if (job.batch_func) {
+    job.batch_func(end - begin, 
+                   job.input_sizes.empty() ? 0 : &job.input_sizes[0],
+                   job.output_sizes.empty() ? 0 : &job.output_sizes[0],
+                   in, job.params, job.streams, job.textures, out);
+    return;
+  }
+
+  for(int i = begin; i < end; i++) {
+    job.func(in, job.params, job.streams, job.textures, out);
+
+    for(unsigned int j = 0; j < inputs.size(); j++) {
+      inputs[j] = reinterpret_cast<char*>(inputs[j]) + job.input_sizes[j]; 
+    }
+    for(unsigned int j = 0; j < outputs.size(); j++) {
+      outputs[j] = reinterpret_cast<char*>(outputs[j]) + job.output_sizes[j]; 
+    }
+  }
+}
+
+/// Returns a copy of program with inputs, outputs and temporaries of its
+/// own, whose values the evaluator can change without touching the
+/// program the user built or racing with another thread interpreting it
+ProgramNodePtr private_copy(const ProgramNodeCPtr& program)
+{
+  ProgramNodePtr result = program->clone();
+  ProgramNode::VarList inputs = result->inputs;
+  ProgramNode::VarList outputs = result->outputs;
+
+  VarMap varMap;
+  Context::current()->enter(result);
+  ProgramNode::VarList::const_iterator I;
+  for (I = inputs.begin(); I != inputs.end(); ++I) {
+    varMap[*I] = (*I)->clone();
+  }
+  for (I = outputs.begin(); I != outputs.end(); ++I) {
+    if (varMap.find(*I) == varMap.end()) varMap[*I] = (*I)->clone();
+  }
+  for (I = result->temps.begin(); I != result->temps.end(); ++I) {
+    if (varMap.find(*I) == varMap.end()) varMap[*I] = (*I)->clone();
+  }
+  Context::current()->exit();
+
+  VariableReplacer replacer(varMap);
+  replacer(inputs);
+  replacer(outputs);
+  result->inputs = inputs;
+  result->outputs = outputs;
+  result->ctrlGraph->dfs(replacer);
+  result->collectVariables();
+  return result;
+}
+
+/// Computes the elements of job one at a time in the host evaluator.
+/// Stream elements are read and written through MEM variants wrapping
+/// them, which convert from and to the host types of the variables.
+void interpret(const ProgramNodeCPtr& original, const StreamJob& job,
+               const std::vector<int>& input_types,
+               const std::vector<int>& output_types)
+{
+  ProgramNodePtr program = private_copy(original);
+  ProgramNode::VarList::const_iterator I;
+  for (int i = 0; i < job.count; ++i) {
+    int j = 0;
+    for (I = program->begin_inputs(); I != program->end_inputs(); ++I, ++j) {
+      void* data = reinterpret_cast<char*>(job.inputs[j]) 
+        + static_cast<long long>(i) * job.input_sizes[j];
+      VariantPtr value = variantFactory(static_cast<ValueType>(input_types[j]), MEM)
+        ->generate((*I)->size(), data, false);
+      (*I)->addVariant();
+      (*I)->setVariant(value);
+    }
+
+    evaluate(program);
+
+    j = 0;
+    for (I = program->begin_outputs(); I != program->end_outputs(); ++I, ++j) {
+      void* data = reinterpret_cast<char*>(job.outputs[j]) 
+        + static_cast<long long>(i) * job.output_sizes[j];
+      VariantPtr value = variantFactory(static_cast<ValueType>(output_types[j]), MEM)
+        ->generate((*I)->size(), data, false);
+      (*I)->addVariant();
+      value->set((*I)->getVariant());
+    }
+  }
+}
+
+}
+
+#ifndef _WIN32
+namespace {
+
+/// Returns the time one run of job takes in clock ticks, averaged over
+/// enough runs to get past the resolution of clock()
+double time_job(StreamJob& job)
+{
+  run_chunk(&job, 0); // warm up the caches
+  int runs = 0;
+  clock_t start = clock();
+  clock_t elapsed;
+  do {
+    run_chunk(&job, 0);
+    ++runs;
+    elapsed = clock() - start;
+  } while (elapsed < CLOCKS_PER_SEC / 100);
+  return static_cast<double>(elapsed) / runs;
+}
+
+std::string tuning_choice(const std::string& profile, int lanes)
+{
+  std::ostringstream choice;
+  choice << lanes << " " << profile;
+  return choice.str();
+}
+
+/// Choices made by autotune() in this process, by kernel cache key
+std::map<std::string, std::string> tunings;
+pthread_mutex_t tunings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+std::string remembered_tuning(const std::string& key)
+{
+  pthread_mutex_lock(&tunings_mutex);
+  std::map<std::string, std::string>::const_iterator I = tunings.find(key);
+  std::string choice = I == tunings.end() ? std::string() : I->second;
+  pthread_mutex_unlock(&tunings_mutex);
+  return choice;
+}
+
+void remember_tuning(const std::string& key, const std::string& choice)
+{
+  pthread_mutex_lock(&tunings_mutex);
+  tunings[key] = choice;
+  pthread_mutex_unlock(&tunings_mutex);
+}
+
+}
+
+void CcBackendCode::autotune(const StreamJob& job)
+{
+  m_tuned = true;
+  // the sample runs would change the uniforms
+  if (m_writes_uniforms) return;
+
+  KernelCache* cache = KernelCache::instance();
+  std::string choice = remembered_tuning(m_cache_key);
+  if (choice.empty() && cache) choice = cache->tuning(m_cache_key);
+
+  std::string current = tuning_choice(m_profile, m_lanes);
+  if (choice == current) return;
+
+  // The sample goes to scratch memory, since outputs may alias inputs
+  StreamJob sample = job;
+  sample.count = std::min(job.count, TuningSampleElements);
+  sample.chunks = 1;
+  std::vector< std::vector<char> > scratch(job.outputs.size());
+  for (unsigned int j = 0; j < scratch.size(); ++j) {
+    scratch[j].resize(sample.count * job.output_sizes[j] + 1);
+    sample.outputs[j] = &scratch[j][0];
+  }
+
+  std::vector<std::string> candidates;
+  bool tuning = choice.empty();
+  double best_time = 0;
+  if (tuning) {
+    SH_CC_DEBUG_PRINT("Autotuning " << m_cache_key);
+    for (Context::CompileProfileMap::const_iterator I = Context::current()->begin_compile_profiles();
+         I != Context::current()->end_compile_profiles(); ++I) {
+      candidates.push_back(tuning_choice(I->first, lane_count()));
+      if (lane_count() > 0) candidates.push_back(tuning_choice(I->first, 0));
+    }
+    best_time = time_job(sample);
+    choice = current;
+  } else {
+    candidates.push_back(choice);
+  }
+
+  CcBackendCodePtr best;
+  for (std::vector<std::string>::const_iterator I = candidates.begin();
+       I != candidates.end(); ++I) {
+    if (*I == current) continue;
+
+    CcBackendCodePtr candidate = new CcBackendCode(m_original_program);
+    std::istringstream in(*I);
+    in >> candidate->m_lanes;
+    in.ignore(1);
+    std::getline(in, candidate->m_profile);
+    if (Context::current()->compile_flags(candidate->m_profile).empty()) continue;
+    candidate->m_candidate = true;
+
+    bool compiled = candidate->generate();
+    candidate->delete_temporary_files();
+    if (!compiled) continue;
+
+    if (tuning) {
+      sample.func = candidate->m_shader_func;
+      sample.batch_func = candidate->m_shader_batch_func;
+      sample.params = candidate->m_params;
+      double time = time_job(sample);
+      SH_CC_DEBUG_PRINT("  " << *I << ": " << time << " ticks");
+      if (time >= best_time) continue;
+      best_time = time;
+    }
+    best = candidate;
+    choice = *I;
+  }
+
+  if (tuning) {
+    remember_tuning(m_cache_key, choice);
+    if (cache) cache->record_tuning(m_cache_key, choice);
+  }
+
+  // The candidates lay out the parameters the same way, so m_params
+  // works with their kernels.  The losing candidates close their
+  // libraries when they go away.
+  if (best) {
+    SH_CC_DEBUG_PRINT("Switching " << m_cache_key << " to " << choice);
+    if (m_handle) dlclose(m_handle);
+    m_handle = best->m_handle;
+    best->m_handle = NULL;
+    m_shader_func = best->m_shader_func;
+    m_shader_batch_func = best->m_shader_batch_func;
+    m_profile = best->m_profile;
+    m_lanes = best->m_lanes;
+  }
+}
+#endif /* _WIN32 */
+
 bool CcBackendCode::execute(const Program& prg, Stream& dest) 
 {
-  if (!m_shader_func) {
+  // While the kernel compiles in the background, the host evaluator
+  // computes the stream
+  bool interpreting = false;
+#ifndef _WIN32
+  if (m_compiling) {
+    if (compile_finished()) {
+      finish_compile();
+    } else {
+      interpreting = true;
+    }
+  }
+  // Generating and compiling the same source again would fail again
+  if (m_compile_failed) interpreting = true;
+#endif
+
+  if (!interpreting && !m_shader_func) {
     if (!generate()) {
       SH_CC_DEBUG_PRINT("failed to generate program..."); 
       return false;
@@ -662,6 +1421,7 @@ bool CcBackendCode::execute(const Program& prg, Stream& dest)
   std::vector<int> output_types(num_outputs);
   std::vector<int> input_sizes(num_inputs); // sizes of each stream element in bytes 
   std::vector<int> input_types(num_inputs);
+  std::vector<VariantPtr> uniform_halves;
     
   int iidx = 0;
     
@@ -672,7 +1432,7 @@ bool CcBackendCode::execute(const Program& prg, Stream& dest)
   for(; I != prg.binding_spec.end(); ++I, ++iidx) {
     if (*I == Program::STREAM) {
       MemoryPtr mem = stream->node()->memory(0);
-      StoragePtr s = mem->findStorage("host", std::bind2nd(StorageUpToDate(), mem));
+      StoragePtr s = mem->findStorage(HostStorageId, std::bind2nd(StorageUpToDate(), mem));
       HostStoragePtr storage = shref_dynamic_cast<HostStorage>(s);
         
       int datasize = typeInfo(stream->node()->valueType(), MEM)->datasize();
@@ -693,7 +1453,15 @@ bool CcBackendCode::execute(const Program& prg, Stream& dest)
       ++stream;
     }
     else {
-      inputs[iidx] = uniform->node()->getVariant()->array();
+      VariantPtr variant = uniform->node()->getVariant();
+      if (variant->valueType() == SH_HALF) {
+        // Kernels read halves in their 16 bit memory format
+        VariantPtr half = variantFactory(SH_HALF, MEM)->generate(variant->size());
+        half->set(variant);
+        uniform_halves.push_back(half);
+        variant = half;
+      }
+      inputs[iidx] = variant->array();
       input_sizes[iidx] = 0;
       input_types[iidx] = uniform->node()->valueType();
       ++uniform;
@@ -701,15 +1469,21 @@ bool CcBackendCode::execute(const Program& prg, Stream& dest)
   }
 
   int tidx = 0;
+  std::vector<CcTexture> texture_descriptors(num_textures);
   for(ProgramNode::TexList::const_iterator I = m_program->begin_textures()
         ;I != m_program->end_textures(); ++I, ++tidx) {
     TextureNodePtr texture = (*I);
 
-    HostStoragePtr storage = shref_dynamic_cast<HostStorage>(texture->memory(0)->findStorage("host"));
+    HostStoragePtr storage = shref_dynamic_cast<HostStorage>(texture->memory(0)->findStorage(HostStorageId));
 
     // @todo type this doesn't work with cube maps
     // but should be taken care of
-    textures[tidx] = storage->data(); 
+    CcTexture& descriptor = texture_descriptors[tidx];
+    descriptor.data = storage->data(); 
+    descriptor.width = texture->width();
+    descriptor.height = texture->height();
+    descriptor.depth = texture->depth();
+    textures[tidx] = &descriptor;
   }
 
   // @todo code below is *exactly* the same as the code above for streams...
@@ -722,10 +1496,11 @@ bool CcBackendCode::execute(const Program& prg, Stream& dest)
   for(Stream::NodeList::iterator I = dest.begin()
         ;I != dest.end(); ++I, ++oidx) {
     MemoryPtr mem = I->node()->memory(0);
-    StoragePtr s = mem->findStorage("host", std::not1(std::bind2nd(StorageUpToDate(), mem)));
+    StoragePtr s = mem->findStorage(HostStorageId, std::not1(std::bind2nd(StorageUpToDate(), mem)));
     if (!s) {
-      s = mem->findStorage("host", std::bind2nd(SecondUpToDateStorage(), mem));
+      s = mem->findStorage(HostStorageId, std::bind2nd(SecondUpToDateStorage(), mem));
     }
+    if (!s) s = mapped_storage(mem, prg, m_program);
     HostStoragePtr storage = shref_dynamic_cast<HostStorage>(s);
 
     int stride, count, offset;
@@ -742,7 +1517,10 @@ bool CcBackendCode::execute(const Program& prg, Stream& dest)
       storage = new HostStorage(I->node()->memory(0).object(),
 				  datasize * I->node()->size() * I->node()->width(), I->node()->valueType());
     }
-    storage->dirty();
+    // Only the elements of the stream are written
+    std::size_t written_offset, written_length;
+    I->get_byte_range(written_offset, written_length);
+    storage->dirty(written_offset, written_length);
     outputs[oidx] = reinterpret_cast<char*>(storage->data()) +
                     datasize * I->node()->size() * offset;
     SH_CC_DEBUG_PRINT("  outputs[" << oidx << "] = " << outputs[oidx]);
@@ -755,34 +1533,66 @@ bool CcBackendCode::execute(const Program& prg, Stream& dest)
     }
   }
 
-      
-  for(int i = 0; i < dest_count; i++) {
-    m_shader_func(inputs, m_params, streams, textures, outputs);
 
-    for(int j = 0; j < num_inputs; j++) {
-      SH_CC_DEBUG_PRINT("advancing input stream "
-			<< j
-			<< " by "
-			<< input_sizes[j] 
-			<< " bytes." );
-      // @todo type - not sure if void pointers inc by 1 byte,
-      // so cast
-      inputs[j] = reinterpret_cast<char*>(inputs[j]) + input_sizes[j]; 
-    }
-    for(int j = 0; j < num_outputs; j++) {
-      SH_CC_DEBUG_PRINT("advancing output stream "
-			<< j
-			<< " by "
-			<< output_sizes[j]
-			<< " bytes." );
-      outputs[j] = reinterpret_cast<char*>(outputs[j]) + output_sizes[j]; 
-    }
+  StreamJob job;
+  job.func = m_shader_func;
+  job.batch_func = m_shader_batch_func;
+  job.params = m_params;
+  job.streams = streams;
+  job.textures = textures;
+  job.inputs.assign(inputs, inputs + num_inputs);
+  job.outputs.assign(outputs, outputs + num_outputs);
+  job.input_sizes = input_sizes;
+  job.output_sizes = output_sizes;
+  job.count = dest_count;
+
+  int threads = Context::current()->threads();
+  if (threads <= 0) threads = WorkerPool::processors();
+  if (threads > dest_count / MinElementsPerThread) {
+    threads = dest_count / MinElementsPerThread;
   }
+  if (m_writes_uniforms) threads = 1;
+
+#ifndef _WIN32
+  if (!interpreting && !m_tuned && Context::current()->autotune()) {
+    autotune(job);
+    job.func = m_shader_func;
+    job.batch_func = m_shader_batch_func;
+  }
+#endif
+
+  if (interpreting) {
+    SH_CC_DEBUG_PRINT("Interpreting " << dest_count << " elements until the kernel is compiled");
+    interpret(m_original_program, job, input_types, output_types);
+  } else if (threads <= 1) {
+    job.chunks = 1;
+    run_chunk(&job, 0);
+  } else {
+    SH_CC_DEBUG_PRINT("Splitting " << dest_count << " elements over " 
+                      << threads << " threads");
+    job.chunks = threads;
+    WorkerPool::instance()->run(run_chunk, &job, job.chunks, threads);
+  }
+
+  delete [] inputs;
+  delete [] outputs;
+  delete [] textures;
 
   return true;
 }
 
 
+#ifndef _WIN32
+namespace {
+
+// Kernels generate_code() leaves for the compile_set() running on this
+// thread to compile, or 0 if none is running.  Per thread, since all
+// threads share the backend.
+SH_THREAD_LOCAL std::vector<CcBackendCodePtr>* pending_kernels = 0;
+
+}
+#endif
+
 CcBackend::CcBackend(void)
   : Backend("cc", "1.0")
 {
@@ -799,10 +1609,127 @@ BackendCodePtr CcBackend::generate_code(const std::string& target,
 {
   SH_CC_DEBUG_PRINT(__FUNCTION__);
   CcBackendCodePtr backendcode = new CcBackendCode(program);
+#ifndef _WIN32
+  std::vector<CcBackendCodePtr>* pending = pending_kernels;
+  backendcode->m_deferred = pending != 0;
+#endif
   backendcode->generate();
+#ifndef _WIN32
+  // Not found in the kernel cache, so compile_set() has to build it
+  if (pending && !backendcode->m_shader_func &&
+      !backendcode->m_code_filename.empty()) {
+    pending->push_back(backendcode);
+  }
+  backendcode->m_deferred = false;
+#endif
   return backendcode;
 }
 
+#ifndef _WIN32
+namespace {
+
+// Kernels sharing a compiler command line, which one compiler run
+// builds into a single library
+struct CompileBatch {
+  std::vector<CcBackendCodePtr> kernels;
+  std::vector<std::string> args;
+  std::vector<std::string> code_filenames;
+  std::string lib_filename;
+  bool succeeded;
+};
+
+void compile_batch(void* data, int index)
+{
+  CompileBatch& batch = (*static_cast<std::vector<CompileBatch>*>(data))[index];
+  std::vector<std::string> args(batch.args);
+  args.push_back("-o");
+  args.push_back(batch.lib_filename);
+  args.insert(args.end(), batch.code_filenames.begin(), batch.code_filenames.end());
+  batch.succeeded = run_compiler(args);
+}
+
+}
+
+void CcBackend::compile_set(const std::string& target, const ProgramSet& s)
+{
+  SH_CC_DEBUG_PRINT(__FUNCTION__);
+
+  // Write out the sources of the kernels that are not in the cache yet
+  std::vector<CcBackendCodePtr> pending;
+  pending_kernels = &pending;
+  try {
+    for (ProgramSet::const_iterator I = s.begin(); I != s.end(); ++I) {
+      (*I)->compile(target, this);
+    }
+  } catch (...) {
+    pending_kernels = 0;
+    throw;
+  }
+  pending_kernels = 0;
+  if (pending.empty()) return;
+
+  int threads = Context::current()->threads();
+  if (threads <= 0) threads = WorkerPool::processors();
+
+  // Kernels compiled under different profiles need separate compiler
+  // runs, and so do kernels of different lane widths, whose inline lane
+  // functions differ.  The others are dealt round robin to one batch
+  // per thread.
+  typedef std::pair<int, std::vector<std::string> > BatchKey;
+  typedef std::map<BatchKey, std::vector<CcBackendCodePtr> > ArgsMap;
+  ArgsMap groups;
+  for (std::vector<CcBackendCodePtr>::const_iterator I = pending.begin();
+       I != pending.end(); ++I) {
+    groups[BatchKey((*I)->m_lanes, (*I)->m_compile_args)].push_back(*I);
+  }
+
+  std::vector<CompileBatch> batches;
+  for (ArgsMap::const_iterator I = groups.begin(); I != groups.end(); ++I) {
+    int count = std::min(threads, static_cast<int>(I->second.size()));
+    std::vector<CompileBatch>::size_type first = batches.size();
+    batches.resize(first + count);
+    for (std::vector<CcBackendCodePtr>::size_type i = 0; i < I->second.size(); ++i) {
+      batches[first + i % count].kernels.push_back(I->second[i]);
+      batches[first + i % count].code_filenames.push_back(I->second[i]->m_code_filename);
+    }
+    for (int i = 0; i < count; ++i) {
+      CompileBatch& batch = batches[first + i];
+      batch.args = I->first.second;
+      batch.succeeded = false;
+      // named after its first kernel, whose library it would be if it
+      // were compiled on its own
+      batch.lib_filename = batch.kernels.front()->m_lib_filename;
+    }
+  }
+
+  SH_CC_DEBUG_PRINT("Compiling " << pending.size() << " kernels in "
+                    << batches.size() << " batches");
+  WorkerPool::instance()->run(compile_batch, &batches, batches.size(), threads);
+
+  KernelCache* cache = KernelCache::instance();
+  for (std::vector<CompileBatch>::iterator I = batches.begin(); I != batches.end(); ++I) {
+    for (std::vector<CcBackendCodePtr>::iterator J = I->kernels.begin();
+         J != I->kernels.end(); ++J) {
+      CcBackendCode* code = J->object();
+      if (!I->succeeded || !code->open_shader_func(I->lib_filename)) {
+        // possibly a kernel the others do not link with, so try it alone
+        SH_CC_DEBUG_PRINT("Batch compile failed, compiling " << code->m_cache_key << " alone");
+        code->compile_shader_func();
+        continue;
+      }
+
+      if (cache && cache->insert_link(code->m_cache_key, I->lib_filename,
+                                      code->m_code_filename)) {
+        code->m_code_filename = "";
+      }
+      // the batch library is removed below, once every kernel has it open
+      if (code->m_lib_filename == I->lib_filename) code->m_lib_filename = "";
+    }
+    if (I->succeeded) remove(I->lib_filename.c_str());
+  }
+}
+#endif /* _WIN32 */
+
 void CcBackend::execute(const Program& program, Stream& dest) 
 {
   SH_CC_DEBUG_PRINT(__FUNCTION__);
@@ -22,11 +22,14 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
 #endif
 
 #include <map>
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "Variant.hpp"
 #include "Backend.hpp"
@@ -44,8 +47,33 @@ extern "C" typedef void (*CcShaderFunc)(void** inputs,
 			                                  void** textures,
 			                                  void** outputs);
 
+// function computing count consecutive elements of a kernel, where
+// input_strides[i] and output_strides[i] give the distance in bytes
+// between the elements of inputs[i] and outputs[i]
+extern "C" typedef void (*CcShaderBatchFunc)(int count,
+                                             const int* input_strides,
+                                             const int* output_strides,
+                                             void** inputs, 
+                                             void** params,
+                                             void** channels,
+                                             void** textures,
+                                             void** outputs);
+
+// what the kernels get in their textures array for each texture, so that
+// the size of the textures is not compiled into them
+// (must match sh_cc_backend_texture in CcTextures.hpp)
+struct CcTexture
+{
+  const void* data;
+  int width;
+  int height;
+  int depth;
+};
+
 namespace Cc {
 
+struct StreamJob;
+
 struct CcVariable
 {
   CcVariable(void);
@@ -111,6 +139,17 @@ private:
   std::string resolve(const SH::Variable& v, int idx);
   const char* ctype(SH::ValueType valueType);
 
+  /// Type of the C variable v is held in, which differs from the type of
+  /// v while a statement is computed in float by emit_in_float()
+  SH::ValueType value_type(const SH::Variable& v);
+
+  /// Name of the sh_cc_fraction type (see CcTypes.hpp) implementing the
+  /// arithmetic of a fraction type
+  const char* fraction_type(SH::ValueType valueType);
+
+  /// Type of the elements of a texture of the given value type in memory
+  std::string texel_type(SH::ValueType valueType);
+
   class LabelFunctor
   {
   public:
@@ -136,8 +175,31 @@ private:
         
   void emit(const SH::Statement& stmt);
   void emitTexLookup(const SH::Statement &stmt, const char* texfunc);
+
+  /// Whether stmt reads or writes fractions, which saturate
+  bool fraction_operands(const SH::Statement& stmt);
+  /// Emits stmt on fractions of a single type in that type.  Returns
+  /// false if stmt mixes types or the op has no fixed-point version.
+  bool emit_fraction(const SH::Statement& stmt);
+  /// Emits an op that has no entry in the op table on float copies of
+  /// the fraction operands of stmt
+  void emit_in_float(const SH::Statement& stmt);
+
+  /// Stores the outputs held in a different type than their memory
+  /// and returns from the kernel
+  void emit_return(const std::string& indent);
+
   void emit(const SH::BasicBlockPtr& block);
   void emit(SH::CtrlGraphNode* node);
+
+  /// Emits into m_lanes_code a version of the kernel that computes
+  /// m_lanes consecutive elements at once.  Returns false if the program
+  /// cannot be vectorized, in which case only the scalar kernel is used.
+  bool emit_lanes();
+  bool lanes_supported(const SH::Statement& stmt);
+  /// Emits a statement whose result is only kept in the lanes of mask,
+  /// or in all of them if mask is empty
+  void emit_lanes(const SH::Statement& stmt, const std::string& mask);
       
 private:
   SH::ProgramNodeCPtr m_original_program;
@@ -146,13 +208,12 @@ private:
   std::map<SH::CtrlGraphNode*, int> m_label_map;
   std::map<SH::VariableNodePtr, CcVariable> m_varmap;
 
-  /// The conversions done to change types not handled in hardware into
-  // floating point types
-  //
-  // @todo may want more intelligent conversion if hardware 
-  SH::Transformer::ValueTypeMap m_convertMap;
-
   std::stringstream m_code;
+  std::stringstream m_lanes_code;
+
+  /// Number of elements computed at once by the vectorized kernel, 
+  /// or 0 to only generate the scalar one
+  int m_lanes;
 
 #ifdef _WIN32
   HMODULE m_hmodule;
@@ -161,15 +222,67 @@ private:
 #endif /* _WIN32 */
 
   CcShaderFunc m_shader_func;
+  CcShaderBatchFunc m_shader_batch_func;
 
   std::string m_code_filename;
   std::string m_lib_filename;
 
   void delete_temporary_files();
   bool load_shader_func(const std::stringstream& prologue, const std::stringstream& epilogue);
+#ifndef _WIN32
+  /// dlopen()s sofile and looks up the kernel entry point in it
+  bool open_shader_func(const std::string& sofile);
+
+  /// Runs cc with m_compile_args on m_code_filename and loads the
+  /// library it produces
+  bool compile_shader_func();
+
+  /// Whether the host evaluator can run every statement of the program,
+  /// so that it can stand in for the kernel while it compiles
+  bool interpretable();
+
+  static void* compile_thread(void* code);
+  /// Whether the background compile is over, so that finish_compile()
+  /// returns without waiting
+  bool compile_finished();
+  /// Waits for the background compile, after which m_shader_func is set
+  /// if it succeeded
+  void finish_compile();
+
+  /// Compiler command line, up to the output and source files
+  std::vector<std::string> m_compile_args;
+  std::string m_cache_key;
+
+  /// Set by CcBackend::compile_set(), in which case load_shader_func()
+  /// only writes the source out and leaves compiling it to the backend
+  bool m_deferred;
+
+  /// The thread compiling the kernel when Context::async_compile() is on
+  pthread_t m_compile_thread;
+  bool m_compiling;     ///< m_compile_thread is running or not joined yet
+  bool m_compile_done;  ///< set by m_compile_thread, see compile_finished()
+  bool m_compile_failed; ///< the background compile produced no kernel
+
+  /// The compile profile (see Context::compile_profile()) used for the kernel
+  std::string m_profile;
+  /// Whether autotune() has run for this kernel
+  bool m_tuned;
+  /// Whether this is one of the kernels autotune() compares
+  bool m_candidate;
+
+  /// Builds the kernel under every compile profile, with and without
+  /// vectorized lanes, times each on a sample of job and switches to the
+  /// fastest.  The choice is recorded, so that later runs of the same
+  /// program go straight to it.
+  void autotune(const StreamJob& job);
+#endif
 
   int m_cur_temp;
 
+  /// Whether the kernel assigns to a uniform, in which case stream
+  /// elements cannot be computed concurrently
+  bool m_writes_uniforms;
+
   void** m_params;
   std::vector<SH::VariantPtr> m_paramVariants;
 
@@ -188,6 +301,13 @@ public:
 				     const SH::ProgramNodeCPtr& program);
   
   void execute(const SH::Program& program, SH::Stream& dest);
+
+#ifndef _WIN32
+  /// Generates the kernels of all the programs first, then compiles
+  /// them with up to one compiler per processor (see
+  /// Context::threads()), several kernels to a library
+  void compile_set(const std::string& target, const SH::ProgramSet& s);
+#endif
 };
 
 
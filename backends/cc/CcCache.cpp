@@ -0,0 +1,400 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <pthread.h>
+#endif /* _WIN32 */
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "CcCache.hpp"
+#include "Debug.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef SH_CC_DEBUG
+#  define SH_CC_DEBUG_PRINT(x) SH_DEBUG_PRINT(x)
+#else
+#  define SH_CC_DEBUG_PRINT(x) do { } while(0)
+#endif
+
+namespace {
+
+#ifdef __APPLE__
+const char* LibraryExtension = ".dylib";
+#else
+const char* LibraryExtension = ".so";
+#endif
+
+const char* TuningExtension = ".tune";
+const char* SourceExtension = ".cc";
+
+const int KeyLength = 16;
+const unsigned long DefaultMaxSize = 64; // megabytes
+const time_t TempFileAge = 3600; // seconds before a temporary file is stale
+
+// 64-bit FNV-1a
+typedef unsigned long long Hash;
+
+void hash_bytes(Hash& h, const std::string& str)
+{
+  for (std::string::size_type i = 0; i < str.size(); ++i) {
+    h ^= static_cast<unsigned char>(str[i]);
+    h *= 0x100000001b3ULL;
+  }
+  // separator, so that ("ab", "c") and ("a", "bc") differ
+  h ^= 0xff;
+  h *= 0x100000001b3ULL;
+}
+
+bool is_entry(const std::string& name, const std::string& ext)
+{
+  if (name.size() != KeyLength + ext.size()) return false;
+  if (name.compare(KeyLength, ext.size(), ext) != 0) return false;
+  for (int i = 0; i < KeyLength; ++i) {
+    if (!isxdigit(name[i])) return false;
+  }
+  return true;
+}
+
+// Returns true if the filename looks like a complete cache entry
+bool is_entry(const std::string& name)
+{
+  return is_entry(name, LibraryExtension) || is_entry(name, TuningExtension) ||
+         is_entry(name, SourceExtension);
+}
+
+// Returns true if the filename looks like one made by temp_name()
+bool is_temp(const std::string& name)
+{
+  if (name.size() <= KeyLength || name[KeyLength] != '-') return false;
+  for (int i = 0; i < KeyLength; ++i) {
+    if (!isxdigit(name[i])) return false;
+  }
+  return true;
+}
+
+#ifndef _WIN32
+pthread_mutex_t versions_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Creates dir and any missing parent directories
+bool make_dirs(const std::string& dir)
+{
+  std::string::size_type pos = 0;
+  while (pos != std::string::npos) {
+    pos = dir.find('/', pos + 1);
+    std::string prefix = dir.substr(0, pos);
+    if (mkdir(prefix.c_str(), 0755) != 0) {
+      struct stat st;
+      if (stat(prefix.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+    }
+  }
+  return true;
+}
+
+struct Entry {
+  std::string path;
+  time_t mtime;
+  unsigned long size;
+
+  bool operator<(const Entry& other) const
+  {
+    return mtime < other.mtime;
+  }
+};
+#endif /* _WIN32 */
+
+}
+
+namespace Cc {
+
+KernelCache::KernelCache(const std::string& dir, unsigned long max_size)
+  : m_dir(dir),
+    m_max_size(max_size),
+    m_counter(0)
+{
+}
+
+namespace {
+// Set up when the backend is loaded, before programs compile on
+// several threads
+KernelCache* const loaded_cache = KernelCache::instance();
+}
+
+KernelCache* KernelCache::instance()
+{
+  static KernelCache* cache = create();
+  return cache;
+}
+
+KernelCache* KernelCache::create()
+{
+#ifndef _WIN32
+  // Only asked for, so that nothing is written outside the temporary
+  // directory otherwise
+  const char* env_dir = getenv("SH_CC_CACHE_DIR");
+  if (!env_dir || !*env_dir) return 0;
+  std::string dir = env_dir;
+
+  unsigned long max_size = DefaultMaxSize;
+  const char* env_size = getenv("SH_CC_CACHE_SIZE");
+  if (env_size) {
+    max_size = strtoul(env_size, 0, 10);
+  }
+
+  if (!make_dirs(dir)) {
+    SH_DEBUG_WARN("Could not create the cc kernel cache in " << dir);
+    return 0;
+  }
+
+  return new KernelCache(dir, max_size * 1024 * 1024);
+#else
+  return 0;
+#endif /* _WIN32 */
+}
+
+std::string KernelCache::key(const std::string& source,
+                             const std::vector<std::string>& args)
+{
+  Hash h = 0xcbf29ce484222325ULL;
+  for (std::vector<std::string>::const_iterator I = args.begin();
+       I != args.end(); ++I) {
+    hash_bytes(h, *I);
+  }
+  hash_bytes(h, compiler_version(args));
+  hash_bytes(h, source);
+
+  char buffer[KeyLength + 1];
+  sprintf(buffer, "%016llx", h);
+  return buffer;
+}
+
+std::string KernelCache::compiler_version(const std::vector<std::string>& args)
+{
+#ifdef _WIN32
+  return "";
+#else
+  if (args.empty()) return "";
+
+  // Asked once per compiler; the lock keeps threads compiling at once
+  // from racing on the map
+  static std::map<std::string, std::string> versions;
+  pthread_mutex_lock(&versions_mutex);
+  std::map<std::string, std::string>::iterator I = versions.find(args[0]);
+  if (I == versions.end()) {
+    std::string version;
+    std::string command = args[0] + " --version 2>/dev/null";
+    if (FILE* pipe = popen(command.c_str(), "r")) {
+      char buffer[256];
+      if (fgets(buffer, sizeof(buffer), pipe)) version = buffer;
+      pclose(pipe);
+    }
+    std::string::size_type end = version.find('\n');
+    if (end != std::string::npos) version.erase(end);
+    I = versions.insert(std::make_pair(args[0], version)).first;
+  }
+  std::string version = I->second;
+  pthread_mutex_unlock(&versions_mutex);
+  return version;
+#endif /* _WIN32 */
+}
+
+std::string KernelCache::path(const std::string& key) const
+{
+  return m_dir + "/" + key + LibraryExtension;
+}
+
+std::string KernelCache::temp_name(const std::string& key)
+{
+  std::ostringstream name;
+#ifdef _WIN32
+  name << m_dir << "/" << key << "-" << (SH::atomic_increment(m_counter) - 1);
+#else
+  name << m_dir << "/" << key << "-" << getpid() << "-" << (SH::atomic_increment(m_counter) - 1);
+#endif
+  return name.str();
+}
+
+bool KernelCache::lookup(const std::string& key, const std::string& source)
+{
+#ifdef _WIN32
+  return false;
+#else
+  std::string filename = path(key);
+  if (access(filename.c_str(), R_OK) != 0) return false;
+
+  // Make sure the entry really is this kernel and not one whose key
+  // happens to be the same
+  std::string sourcename = m_dir + "/" + key + SourceExtension;
+  std::ifstream in(sourcename.c_str(), std::ios::in | std::ios::binary);
+  std::ostringstream stored;
+  stored << in.rdbuf();
+  if (!in || stored.str() != source) {
+    SH_CC_DEBUG_PRINT("kernel cache entry " << filename << " is for another source");
+    return false;
+  }
+
+  // bump the modification times, which is what eviction goes by
+  utime(filename.c_str(), 0);
+  utime(sourcename.c_str(), 0);
+  SH_CC_DEBUG_PRINT("kernel cache hit: " << filename);
+  return true;
+#endif /* _WIN32 */
+}
+
+bool KernelCache::insert(const std::string& key, const std::string& libfile,
+                         const std::string& sourcefile)
+{
+#ifdef _WIN32
+  return false;
+#else
+  // rename() atomically replaces any entry another process may have
+  // produced in the meantime, so readers never see a partial library.
+  // The source goes first, lookup() only trusts a library whose source
+  // matches.
+  std::string sourcename = m_dir + "/" + key + SourceExtension;
+  if (rename(sourcefile.c_str(), sourcename.c_str()) != 0) {
+    SH_CC_DEBUG_PRINT("could not move " << sourcefile << " into the kernel cache");
+    return false;
+  }
+  std::string filename = path(key);
+  if (rename(libfile.c_str(), filename.c_str()) != 0) {
+    SH_CC_DEBUG_PRINT("could not move " << libfile << " into the kernel cache");
+    return false;
+  }
+  evict();
+  return true;
+#endif /* _WIN32 */
+}
+
+bool KernelCache::insert_link(const std::string& key, const std::string& libfile,
+                              const std::string& sourcefile)
+{
+#ifdef _WIN32
+  return false;
+#else
+  std::string tempfile = temp_name(key) + LibraryExtension;
+  if (link(libfile.c_str(), tempfile.c_str()) != 0) {
+    SH_CC_DEBUG_PRINT("could not link " << libfile << " into the kernel cache");
+    return false;
+  }
+  if (!insert(key, tempfile, sourcefile)) {
+    unlink(tempfile.c_str());
+    return false;
+  }
+  return true;
+#endif /* _WIN32 */
+}
+
+std::string KernelCache::tuning(const std::string& key)
+{
+  std::string choice;
+#ifndef _WIN32
+  std::string filename = m_dir + "/" + key + TuningExtension;
+  std::ifstream in(filename.c_str());
+  if (!in || !std::getline(in, choice)) return "";
+
+  utime(filename.c_str(), 0);
+  SH_CC_DEBUG_PRINT("recorded tuning for " << key << ": " << choice);
+#endif /* _WIN32 */
+  return choice;
+}
+
+void KernelCache::record_tuning(const std::string& key, const std::string& choice)
+{
+#ifndef _WIN32
+  // written under a temporary name and renamed, like the libraries
+  std::string tempfile = temp_name(key) + TuningExtension;
+  std::ofstream out(tempfile.c_str());
+  out << choice << std::endl;
+  out.close();
+
+  std::string filename = m_dir + "/" + key + TuningExtension;
+  if (!out || rename(tempfile.c_str(), filename.c_str()) != 0) {
+    SH_CC_DEBUG_PRINT("could not record the tuning of " << key);
+    remove(tempfile.c_str());
+  }
+#endif /* _WIN32 */
+}
+
+void KernelCache::evict()
+{
+#ifndef _WIN32
+  DIR* dir = opendir(m_dir.c_str());
+  if (!dir) return;
+
+  std::vector<Entry> entries;
+  unsigned long total = 0;
+  time_t now = time(0);
+  while (struct dirent* ent = readdir(dir)) {
+    std::string name(ent->d_name);
+    bool temp = is_temp(name);
+    if (!temp && !is_entry(name)) continue;
+
+    Entry entry;
+    entry.path = m_dir + "/" + name;
+    struct stat st;
+    if (stat(entry.path.c_str(), &st) != 0) continue; // evicted by someone else
+
+    // Left behind by a compile that failed or was killed.  Younger ones
+    // may still be in use, so they only count towards the cap.
+    if (temp && now - st.st_mtime > TempFileAge) {
+      SH_CC_DEBUG_PRINT("removing stale " << entry.path << " from the kernel cache");
+      unlink(entry.path.c_str());
+      continue;
+    }
+    total += st.st_size;
+    if (temp) continue;
+
+    entry.mtime = st.st_mtime;
+    entry.size = st.st_size;
+    entries.push_back(entry);
+  }
+  closedir(dir);
+
+  if (total <= m_max_size) return;
+
+  // Oldest first.  Unlinking a library that some process has loaded is
+  // harmless, the mapping outlives the directory entry.
+  std::sort(entries.begin(), entries.end());
+  for (std::vector<Entry>::const_iterator I = entries.begin();
+       I != entries.end() && total > m_max_size; ++I) {
+    SH_CC_DEBUG_PRINT("evicting " << I->path << " from the kernel cache");
+    unlink(I->path.c_str());
+    total -= I->size;
+  }
+#endif /* _WIN32 */
+}
+
+}
@@ -0,0 +1,119 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHCCCACHE_HPP
+#define SHCCCACHE_HPP
+
+#include <string>
+#include <vector>
+#include "Threads.hpp"
+
+namespace Cc {
+
+/** On-disk cache of compiled kernels.
+ *
+ * Shared objects are stored under a name derived from a hash of the
+ * generated source, of the compiler command line and of the compiler's
+ * version, so a program that was compiled by an earlier process can be
+ * dlopen'ed right away.  The source is stored next to each library and
+ * compared on lookup, so that a hash collision never loads the wrong
+ * kernel.
+ *
+ * The directory may be shared by several processes.  Entries are
+ * compiled under a private temporary name and then renamed into place,
+ * which is atomic, and eviction only ever unlinks files (a library that
+ * is already mapped stays valid).  Entries are touched on every hit and
+ * the least recently used ones are removed once the directory grows
+ * beyond its size cap.  Temporary files left behind by compiles that
+ * failed or were killed count towards the cap and are removed once
+ * they are an hour old.
+ *
+ * The cache is off unless $SH_CC_CACHE_DIR, read when the backend
+ * loads, names the directory it should live in, for example $HOME/.shcc-cache, which is created if
+ * needed.  The size cap is given in megabytes by $SH_CC_CACHE_SIZE
+ * (default: 64).
+ *
+ * Next to the libraries, the cache keeps small files recording which
+ * compile profile autotuning picked for a kernel, which are evicted
+ * like the libraries.
+ */
+class KernelCache {
+public:
+  /// Returns the process-wide cache, or 0 if caching is disabled
+  static KernelCache* instance();
+
+  /// Returns the key identifying the given source compiled with args
+  static std::string key(const std::string& source,
+                         const std::vector<std::string>& args);
+
+  /// Returns the first line of the "--version" output of the compiler
+  /// args[0], which is part of the key
+  static std::string compiler_version(const std::vector<std::string>& args);
+
+  /// Path of the shared object stored under key
+  std::string path(const std::string& key) const;
+
+  /// Returns a base filename in the cache directory that no other
+  /// process or kernel will use
+  std::string temp_name(const std::string& key);
+
+  /// Returns true if key is in the cache, built from source, and marks
+  /// it as recently used
+  bool lookup(const std::string& key, const std::string& source);
+
+  /// Moves a freshly compiled library and the source file it was built
+  /// from into the cache under key.  Returns false if the files could
+  /// not be moved.
+  bool insert(const std::string& key, const std::string& libfile,
+              const std::string& sourcefile);
+
+  /// Like insert(), but hard links libfile into the cache instead of
+  /// moving it, so that one library holding several kernels can be
+  /// stored under each of their keys
+  bool insert_link(const std::string& key, const std::string& libfile,
+                   const std::string& sourcefile);
+
+  /// Removes least recently used entries until the cache fits in its cap
+  void evict();
+
+  /// Returns the choice autotuning recorded for the kernel stored under
+  /// key, or an empty string if it has not been tuned
+  std::string tuning(const std::string& key);
+
+  /// Records the choice autotuning made for the kernel stored under key
+  void record_tuning(const std::string& key, const std::string& choice);
+
+private:
+  KernelCache(const std::string& dir, unsigned long max_size);
+
+  /// Makes the cache from the environment, or returns 0
+  static KernelCache* create();
+
+  std::string m_dir;
+  unsigned long m_max_size; ///< in bytes
+  volatile int m_counter;
+
+  // NOT IMPLEMENTED
+  KernelCache(const KernelCache& other);
+  KernelCache& operator=(const KernelCache& other);
+};
+
+}
+
+#endif
@@ -17,7 +17,9 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
 // MA  02110-1301, USA
 //////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
 #include <map>
+#include <set>
 #include <vector>
 #include <sstream>
 #include "Cc.hpp" 
@@ -191,6 +193,109 @@ const CcOpCode opCodeTable[] = {
   // @todo LO, HI, SETLO, SETHI
 };
 
+// Same as opCodeTable, for kernels computing SH_CC_LANES elements at
+// once.  Every operand is a lane vector (see CcLanes.hpp), so ops that
+// have no vector operator go through the sh_cc_ helpers, which compute
+// lane by lane what the scalar expression above computes.
+const CcOpCode laneOpCodeTable[] = {
+  {OP_ASN,   "#0" },
+  {OP_NEG,   "-(#0)" },  
+  {OP_ADD,   "$0 + $1"},
+  {OP_MUL,   "$0 * $1"},
+  {OP_DIV,   "$0 / $1"},
+
+  {OP_SLT,   "sh_cc_bool($0 < $1)"},
+  {OP_SLE,   "sh_cc_bool($0 <= $1)"},
+  {OP_SGT,   "sh_cc_bool($0 > $1)"},
+  {OP_SGE,   "sh_cc_bool($0 >= $1)"},
+  {OP_SEQ,   "sh_cc_bool($0 == $1)"},
+  {OP_SNE,   "sh_cc_bool($0 != $1)"},
+
+  {OP_ABS,   "sh_cc_abs(#0)"}, 
+  {OP_ACOS,  "sh_cc_acos(#0)"},
+  {OP_ASIN,  "sh_cc_asin(#0)"},
+  {OP_ATAN,  "sh_cc_atan(#0)"},
+  {OP_ATAN2, "sh_cc_atan2(#0, #1)"},
+  {OP_ACOSH, "sh_cc_acosh(#0)"},
+  {OP_ASINH, "sh_cc_asinh(#0)"},
+  {OP_ATANH, "sh_cc_atanh(#0)"},
+  {OP_CBRT,  "sh_cc_cbrt(#0)"},
+  {OP_CEIL,  "sh_cc_ceil(#0)"},
+  {OP_COS,   "sh_cc_cos(#0)"},
+  {OP_COSH,  "sh_cc_cosh(#0)"},
+  {OP_EXP,   "sh_cc_exp(#0)"},
+  {OP_EXP2,  "sh_cc_exp2(#0)"},
+  {OP_EXP10, "sh_cc_exp10(#0)"},
+  {OP_FLR,   "sh_cc_floor(#0)"},
+  {OP_FRAC,  "sh_cc_frac(#0)"},
+  {OP_LOG,   "sh_cc_log(#0)"},
+  {OP_LOG2,  "sh_cc_log2(#0)"},
+  {OP_LOG10, "sh_cc_log10(#0)"},
+  {OP_LRP,   "$0 * ($1 - $2) + $2"},
+  {OP_MAD,   "$0 * $1 + $2"},
+  {OP_MAX,   "sh_cc_max($0, $1)"},
+  {OP_MIN,   "sh_cc_min($0, $1)"}, 
+  {OP_MOD,   "sh_cc_mod($0, $1)"},
+  {OP_POW,   "sh_cc_pow($0, $1)"},
+  {OP_RCP,   "sh_cc_splat(1.0f) / #0"},
+  {OP_RND,   "sh_cc_rnd(#0)"},
+  {OP_RSQ,   "sh_cc_rsq(#0)"},
+  {OP_SIN,   "sh_cc_sin(#0)"},
+  {OP_SINH,  "sh_cc_sinh(#0)"},
+  {OP_SGN,   "sh_cc_sgn(#0)"},
+  {OP_SQRT,  "sh_cc_sqrt(#0)"},
+  {OP_TAN,   "sh_cc_tan(#0)"},
+  {OP_TANH,  "sh_cc_tanh(#0)"},
+  {OP_COND,  "sh_cc_select(sh_cc_true($0), $1, $2)"},
+  {OP_FETCH, "#0"},
+
+  {OPERATION_END,  0} 
+};
+
+// Same as opCodeTable, for statements whose operands all have the same
+// fraction type.  F stands for its sh_cc_fraction type (see CcTypes.hpp),
+// which saturates the results.  Comparisons work on the fixed-point
+// values directly.
+const CcOpCode fractionOpCodeTable[] = {
+  {OP_ASN,   "#0" },
+  {OP_NEG,   "F::neg(#0)" },  
+  {OP_ADD,   "F::add($0, $1)"},
+  {OP_MUL,   "F::mul($0, $1)"},
+  {OP_DIV,   "F::div($0, $1)"},
+
+  {OP_SLT,   "F::truth($0 < $1)"},
+  {OP_SLE,   "F::truth($0 <= $1)"},
+  {OP_SGT,   "F::truth($0 > $1)"},
+  {OP_SGE,   "F::truth($0 >= $1)"},
+  {OP_SEQ,   "F::truth($0 == $1)"},
+  {OP_SNE,   "F::truth($0 != $1)"},
+
+  {OP_ABS,   "F::abs(#0)"}, 
+  {OP_LRP,   "F::lrp($0, $1, $2)"},
+  {OP_MAD,   "F::add(F::mul($0, $1), $2)"},
+  {OP_MAX,   "($0 > $1 ? $0 : $1)"},
+  {OP_MIN,   "($0 < $1 ? $0 : $1)"}, 
+  {OP_SGN,   "F::sgn(#0)"},
+  {OP_COND,  "($0 > 0 ? $1 : $2)"},
+
+  {OPERATION_END,  0} 
+};
+
+// Parses a table into a map.  Each map is a function-local static
+// initialized with this, so threads emitting code at once never fill
+// it together.
+CcOpCodeMap make_opcode_map(const CcOpCode* table)
+{
+  CcOpCodeMap result;
+  SH_CC_DEBUG_PRINT("Operation -> C++ code mappings");
+  for(int i = 0; table[i].op != OPERATION_END; ++i) {
+    result[table[i].op] = CcOpCodeVecs(table[i]); 
+    SH_CC_DEBUG_PRINT(opInfo[table[i].op].name << " -> " 
+        << result[table[i].op].encode());
+  }
+  return result;
+}
+
 // @todo type these are still implemented in the switch statement below
 // fix them later or maybe just leave them 
 #if 0
@@ -208,44 +313,49 @@ const CcOpCode opCodeTable[] = {
 
 // @todo type implement emit
 void CcBackendCode::emit(const Statement& stmt) {
-  static CcOpCodeMap opcodeMap;
+  static const CcOpCodeMap opcodeMap = make_opcode_map(opCodeTable);
 
-  // @todo type should really move this to the CcBackendCode constructor 
   // @todo type should handle other types properly
-  
-  // fill in opcodeMap from the above table
-  if(opcodeMap.empty()) {
-    SH_CC_DEBUG_PRINT("Operation -> C++ code mappings");
-    for(int i = 0; opCodeTable[i].op != OPERATION_END; ++i) {
-
-      opcodeMap[opCodeTable[i].op] = CcOpCodeVecs(opCodeTable[i]); 
-      SH_CC_DEBUG_PRINT(opInfo[opCodeTable[i].op].name << " -> " 
-          << opcodeMap[opCodeTable[i].op].encode());
-    }
-  }
 
   // output SH intermediate m_code for reference
   m_code << "  // " << stmt << std::endl;
 
+  if (!stmt.dest.null() && stmt.dest.node()->uniform()) {
+    m_writes_uniforms = true;
+  }
+
+  bool fractions = fraction_operands(stmt);
+  if (fractions && emit_fraction(stmt)) return;
+
   // generate C m_code from statement
 
   // @todo get rid of warnings for assignment of different types 
   // (e.g. when float to int cast required)
 
   // handle ops in the table first 
-  if(opcodeMap.find(stmt.op) != opcodeMap.end()) {
-    CcOpCodeVecs codeVecs = opcodeMap[stmt.op]; 
+  CcOpCodeMap::const_iterator found = opcodeMap.find(stmt.op);
+  if(found != opcodeMap.end()) {
+    const CcOpCodeVecs& codeVecs = found->second; 
     for(int i = 0; i < stmt.dest.size(); ++i) {
-      m_code << "  " << resolve(stmt.dest, i) << " = (" 
-        << ctype(stmt.dest.valueType()) << ")(";
+      // fractions are converted to and from their real values
+      ValueType destType = value_type(stmt.dest);
+      m_code << "  " << resolve(stmt.dest, i) << " = ";
+      if (isFraction(destType)) {
+        m_code << fraction_type(destType) << "::make(";
+      } else {
+        m_code << "(" << ctype(destType) << ")(";
+      }
       unsigned int j;
       for(j = 0; j < codeVecs.index.size(); ++j) { 
         const Variable& src = stmt.src[codeVecs.index[j]];
+        int idx = codeVecs.scalar[j] && src.size() == 1 ? 0 : i;
         m_code << codeVecs.frag[j];
-        if(codeVecs.scalar[j]) {
-          m_code << resolve(src, src.size() > 1 ? i : 0); 
+        if (isFraction(value_type(src))) {
+          if (src.neg()) m_code << "-";
+          m_code << fraction_type(value_type(src)) << "::get(" 
+                 << m_varmap[src.node()].m_name << "[" << src.swizzle()[idx] << "])";
         } else {
-          m_code << resolve(src, i); 
+          m_code << resolve(src, idx); 
         }
       }
       m_code << codeVecs.frag[j] << ");" << std::endl;
@@ -253,6 +363,11 @@ void CcBackendCode::emit(const Statement& stmt) {
     return;
   }
 
+  if (fractions) {
+    emit_in_float(stmt);
+    return;
+  }
+
   // handle remaining ops with some custom code
   // @todo improve collecting ops
   switch(stmt.op) {
@@ -314,6 +429,10 @@ void CcBackendCode::emit(const Statement& stmt) {
 
     case OP_LIT:
       {
+        // LIT clamps its source in place
+        if (stmt.src[0].node()->uniform()) {
+          m_writes_uniforms = true;
+        }
         m_code << "  {" << std::endl;
 	
 	// Clamp to zero the first two arguments
@@ -410,8 +529,9 @@ void CcBackendCode::emit(const Statement& stmt) {
          << resolve(stmt.src[0], i) 
          << " > 0)";
       }
-      m_code << ")" << std::endl;
-      m_code << "    return;" << std::endl;
+      m_code << ") {" << std::endl;
+      emit_return("    ");
+      m_code << "  }" << std::endl;
       break;
       }
     case OP_OPTBRA:
@@ -436,6 +556,106 @@ void CcBackendCode::emit(const Statement& stmt) {
   }
 }
 
+bool CcBackendCode::fraction_operands(const Statement& stmt)
+{
+  if (!stmt.dest.null() && isFraction(value_type(stmt.dest))) return true;
+  for (int i = 0; i < opInfo[stmt.op].arity; ++i) {
+    // texture lookups convert texels themselves
+    if (stmt.src[i].node()->kind() == SH_TEXTURE) continue;
+    if (isFraction(value_type(stmt.src[i]))) return true;
+  }
+  return false;
+}
+
+bool CcBackendCode::emit_fraction(const Statement& stmt)
+{
+  static const CcOpCodeMap opcodeMap = make_opcode_map(fractionOpCodeTable);
+
+  CcOpCodeMap::const_iterator found = opcodeMap.find(stmt.op);
+  if (found == opcodeMap.end()) return false;
+  ValueType valueType = value_type(stmt.dest);
+  for (int i = 0; i < opInfo[stmt.op].arity; ++i) {
+    if (value_type(stmt.src[i]) != valueType) return false;
+  }
+
+  std::string type = fraction_type(valueType);
+  const CcOpCodeVecs& codeVecs = found->second; 
+  for(int i = 0; i < stmt.dest.size(); ++i) {
+    std::ostringstream code;
+    unsigned int j;
+    for(j = 0; j < codeVecs.index.size(); ++j) { 
+      const Variable& src = stmt.src[codeVecs.index[j]];
+      code << codeVecs.frag[j];
+
+      // negation saturates as well
+      int idx = codeVecs.scalar[j] && src.size() == 1 ? 0 : i;
+      const CcVariable& var = m_varmap[src.node()];
+      if (src.neg()) code << "F::neg(";
+      code << var.m_name << "[" << src.swizzle()[idx] << "]";
+      if (src.neg()) code << ")";
+    }
+    code << codeVecs.frag[j];
+
+    std::string expr = code.str();
+    std::string::size_type pos;
+    while ((pos = expr.find("F::")) != std::string::npos) {
+      expr.replace(pos, 1, type);
+    }
+    m_code << "  " << resolve(stmt.dest, i) << " = " << expr << ";" << std::endl;
+  }
+  return true;
+}
+
+void CcBackendCode::emit_in_float(const Statement& stmt)
+{
+  // Swap the fraction variables for float copies, emit stmt as usual,
+  // then convert the copy of dest back
+  std::map<VariableNodePtr, CcVariable> saved;
+  m_code << "  {" << std::endl;
+  for (int i = 0; i < opInfo[stmt.op].arity; ++i) {
+    VariableNodePtr node = stmt.src[i].node();
+    if (node->kind() == SH_TEXTURE || saved.count(node)) continue;
+    const CcVariable& var = m_varmap[node];
+    if (!isFraction(var.m_valueType)) continue;
+
+    std::ostringstream name;
+    name << "float_" << saved.size();
+    m_code << "    float " << name.str() << "[" << var.m_size << "];" << std::endl;
+    for (int j = 0; j < var.m_size; ++j) {
+      m_code << "    " << name.str() << "[" << j << "] = " << fraction_type(var.m_valueType) 
+             << "::get(" << var.m_name << "[" << j << "]);" << std::endl;
+    }
+    saved[node] = var;
+    m_varmap[node] = CcVariable(var.m_num, name.str(), var.m_size, SH_FLOAT);
+  }
+
+  VariableNodePtr dest = stmt.dest.null() ? VariableNodePtr(0) : stmt.dest.node();
+  if (dest && isFraction(m_varmap[dest].m_valueType)) {
+    const CcVariable& var = m_varmap[dest];
+    std::ostringstream name;
+    name << "float_" << saved.size();
+    m_code << "    float " << name.str() << "[" << var.m_size << "];" << std::endl;
+    saved[dest] = var;
+    m_varmap[dest] = CcVariable(var.m_num, name.str(), var.m_size, SH_FLOAT);
+  }
+
+  emit(stmt);
+
+  if (dest && saved.count(dest)) {
+    const CcVariable& var = saved[dest];
+    for (int i = 0; i < stmt.dest.size(); ++i) {
+      int j = stmt.dest.swizzle()[i];
+      m_code << "    " << var.m_name << "[" << j << "] = " << fraction_type(var.m_valueType) 
+             << "::make(" << m_varmap[dest].m_name << "[" << j << "]);" << std::endl;
+    }
+  }
+  for (std::map<VariableNodePtr, CcVariable>::iterator I = saved.begin(); 
+       I != saved.end(); ++I) {
+    m_varmap[I->first] = I->second;
+  }
+  m_code << "  }" << std::endl;
+}
+
 void CcBackendCode::emitTexLookup(const Statement& stmt, const char* texfunc) {
   TextureNodePtr node = shref_dynamic_cast<TextureNode>(stmt.src[0].node());
   int dims = 0; 
@@ -483,13 +703,13 @@ void CcBackendCode::emitTexLookup(const Statement& stmt, const char* texfunc) {
   bool tempsrc = (!stmt.src[1].swizzle().identity()) || stmt.src[1].neg();
 
   if(tempdest) {
-    m_code << "    " << ctype(stmt.dest.valueType()) <<  
+    m_code << "    " << ctype(value_type(stmt.dest)) <<  
       " result[" << stmt.dest.size() << "];" << std::endl;
     destvar = "result";
   } else destvar = resolve(stmt.dest);
 
   if(tempsrc) {
-    m_code << "    " << ctype(stmt.src[1].valueType()) 
+    m_code << "    " << ctype(value_type(stmt.src[1])) 
       << " input[" << stmt.src[1].size() << "];" << std::endl;
 
     for(int i = 0; i < stmt.src[1].size(); i++) {
@@ -503,10 +723,7 @@ void CcBackendCode::emitTexLookup(const Statement& stmt, const char* texfunc) {
   m_code << "    " << texfunc << "<"
      << dims << ", "
      << node->size() << ", "
-     << node->width() << ", "
-     << node->height() << ", "
-     << node->depth() <<  ", "
-     << ctype(node->valueType()) << "," 
+     << texel_type(node->valueType()) << "," 
      << srcWrap << ">("
    << resolve(stmt.src[0])
    << ", "
@@ -525,5 +742,329 @@ void CcBackendCode::emitTexLookup(const Statement& stmt, const char* texfunc) {
   m_code << "  }" << std::endl;
 }
 
+namespace {
+
+/// Control graphs with more nodes than this are not if-converted
+const int MaxLaneNodes = 32;
+
+/// Depth-first search that fails on back edges, leaving the nodes in
+/// reverse topological order
+bool topological_order(CtrlGraphNode* node, std::set<CtrlGraphNode*>& visiting,
+                       std::set<CtrlGraphNode*>& done,
+                       std::vector<CtrlGraphNode*>& order)
+{
+  if (done.find(node) != done.end()) return true;
+  if (visiting.find(node) != visiting.end()) return false; // loop
+  visiting.insert(node);
+
+  for (CtrlGraphNode::SuccessorIt I = node->successors_begin();
+       I != node->successors_end(); ++I) {
+    if (!topological_order(I->node, visiting, done, order)) return false;
+  }
+  if (node->follower() && 
+      !topological_order(node->follower(), visiting, done, order)) {
+    return false;
+  }
+
+  visiting.erase(node);
+  done.insert(node);
+  order.push_back(node);
+  return true;
+}
+
+/// Returns true if exit can be reached from node without going through
+/// avoid
+bool reaches_exit(CtrlGraphNode* node, CtrlGraphNode* avoid, 
+                  std::set<CtrlGraphNode*>& seen)
+{
+  if (node == avoid || !seen.insert(node).second) return false;
+  if (node->successors_empty() && !node->follower()) return true;
+
+  for (CtrlGraphNode::SuccessorIt I = node->successors_begin();
+       I != node->successors_end(); ++I) {
+    if (reaches_exit(I->node, avoid, seen)) return true;
+  }
+  return node->follower() && reaches_exit(node->follower(), avoid, seen);
 }
 
+}
+
+bool CcBackendCode::lanes_supported(const Statement& stmt)
+{
+  if (!stmt.dest.null() && stmt.dest.valueType() != SH_FLOAT) return false;
+  for (int i = 0; i < opInfo[stmt.op].arity; ++i) {
+    if (stmt.src[i].valueType() != SH_FLOAT) return false;
+  }
+
+  switch (stmt.op) {
+  case OP_DOT:
+  case OP_CSUM:
+  case OP_CMUL:
+  case OP_NORM:
+  case OP_XPD:
+    return true;
+  default:
+    break;
+  }
+
+  for (int i = 0; laneOpCodeTable[i].op != OPERATION_END; ++i) {
+    if (laneOpCodeTable[i].op == stmt.op) return true;
+  }
+  return false;
+}
+
+void CcBackendCode::emit_lanes(const Statement& stmt, const std::string& mask)
+{
+  static const CcOpCodeMap opcodeMap = make_opcode_map(laneOpCodeTable);
+
+  m_lanes_code << "  // " << stmt << std::endl;
+
+  // All the results are computed before dest is written, since dest
+  // may also be a source
+  std::vector<std::string> values(stmt.dest.size());
+  std::string prelude;
+
+  CcOpCodeMap::const_iterator found = opcodeMap.find(stmt.op);
+  if (found != opcodeMap.end()) {
+    const CcOpCodeVecs& codeVecs = found->second; 
+    for(int i = 0; i < stmt.dest.size(); ++i) {
+      std::ostringstream value;
+      unsigned int j;
+      for(j = 0; j < codeVecs.index.size(); ++j) { 
+        const Variable& src = stmt.src[codeVecs.index[j]];
+        value << codeVecs.frag[j];
+        if(codeVecs.scalar[j]) {
+          value << resolve(src, src.size() > 1 ? i : 0); 
+        } else {
+          value << resolve(src, i); 
+        }
+      }
+      value << codeVecs.frag[j];
+      values[i] = value.str();
+    }
+  } else {
+    switch(stmt.op) {
+    case OP_DOT:
+      {
+        int inc0 = stmt.src[0].size() == 1 ? 0 : 1;
+        int inc1 = stmt.src[1].size() == 1 ? 0 : 1;
+        int size = std::max(stmt.src[0].size(), stmt.src[1].size());
+
+        std::ostringstream value;
+        for(int i = 0, s0 = 0, s1 = 0; i < size; ++i, s0 += inc0, s1 += inc1) {
+          if (i != 0) value << " + ";
+          value << resolve(stmt.src[0], s0) << " * " << resolve(stmt.src[1], s1);
+        }
+        values[0] = value.str();
+        break;
+      }
+    case OP_CSUM:
+    case OP_CMUL:
+      {
+        std::ostringstream value;
+        for(int i = 0; i < stmt.src[0].size(); ++i) {
+          if (i != 0) value << (stmt.op == OP_CSUM ? " + " : " * ");
+          value << resolve(stmt.src[0], i);
+        }
+        values[0] = value.str();
+        break;
+      }
+    case OP_NORM:
+      {
+        std::ostringstream len;
+        len << "    sh_cc_lanef len = sh_cc_rsq(";
+        for(int i = 0; i < stmt.dest.size(); i++) {
+          if (i != 0) len << " + ";
+          len << resolve(stmt.src[0], i) << " * " << resolve(stmt.src[0], i);
+        }
+        len << ");" << std::endl;
+        prelude = len.str();
+        for(int i = 0; i < stmt.dest.size(); i++) {
+          values[i] = "len * " + resolve(stmt.src[0], i);
+        }
+        break;
+      }
+    case OP_XPD:
+      {
+        for(int i = 0; i < stmt.dest.size(); i++) {
+          int i0 = (i+1)%3;
+          int i1 = (i+2)%3;
+          values[i] = resolve(stmt.src[0], i0) + " * " + resolve(stmt.src[1], i1)
+            + " - " + resolve(stmt.src[1], i0) + " * " + resolve(stmt.src[0], i1);
+        }
+        break;
+      }
+    default:
+      SH_DEBUG_ASSERT(false); // rejected by lanes_supported()
+      break;
+    }
+  }
+
+  m_lanes_code << "  {" << std::endl;
+  m_lanes_code << prelude;
+  for(int i = 0; i < stmt.dest.size(); ++i) {
+    m_lanes_code << "    sh_cc_lanef r" << i << " = " << values[i] << ";" << std::endl;
+  }
+  for(int i = 0; i < stmt.dest.size(); ++i) {
+    std::string dest = resolve(stmt.dest, i);
+    if (mask.empty()) {
+      m_lanes_code << "    " << dest << " = r" << i << ";" << std::endl;
+    } else {
+      m_lanes_code << "    " << dest << " = sh_cc_select(" << mask << ", r" << i
+                   << ", " << dest << ");" << std::endl;
+    }
+  }
+  m_lanes_code << "  }" << std::endl;
+}
+
+bool CcBackendCode::emit_lanes()
+{
+  m_lanes_code.str("");
+  if (m_lanes <= 1 || m_writes_uniforms || !m_program->textures.empty()) {
+    return false;
+  }
+
+  // Lane vectors only hold floats
+  const ProgramNode::VarList* lists[] = {
+    &m_program->constants, &m_program->inputs, &m_program->outputs,
+    &m_program->uniforms, &m_program->temps
+  };
+  for (int l = 0; l < 5; ++l) {
+    for (ProgramNode::VarList::const_iterator I = lists[l]->begin(); 
+         I != lists[l]->end(); ++I) {
+      if ((*I)->valueType() != SH_FLOAT) return false;
+    }
+  }
+
+  // Branches are turned into masks, which only works without loops
+  std::set<CtrlGraphNode*> visiting, done;
+  std::vector<CtrlGraphNode*> order;
+  CtrlGraphNode* entry = m_program->ctrlGraph->entry();
+  if (!topological_order(entry, visiting, done, order)) return false;
+  if (order.size() > static_cast<unsigned int>(MaxLaneNodes)) return false;
+  std::reverse(order.begin(), order.end());
+
+  for (std::vector<CtrlGraphNode*>::const_iterator N = order.begin(); 
+       N != order.end(); ++N) {
+    if (!(*N)->block) continue;
+    for (BasicBlock::StmtList::const_iterator I = (*N)->block->begin();
+         I != (*N)->block->end(); ++I) {
+      if (!lanes_supported(*I)) return false;
+    }
+  }
+
+  SH_CC_DEBUG_PRINT("Emitting " << m_lanes << "-lane code...");
+
+  int num = 0;
+  for (ProgramNode::VarList::const_iterator I = m_program->constants.begin();
+       I != m_program->constants.end(); ++I, ++num) {
+    const CcVariable& var = m_varmap[*I];
+    m_lanes_code << "  static const float " << var.m_name << "_data[" << var.m_size << "] = {" 
+                 << (*I)->getVariant()->encodeArray() << "};" << std::endl;
+    m_lanes_code << "  sh_cc_lanef " << var.m_name << "[" << var.m_size << "];" << std::endl;
+    for (int i = 0; i < var.m_size; ++i) {
+      m_lanes_code << "  " << var.m_name << "[" << i << "] = sh_cc_splat(" 
+                   << var.m_name << "_data[" << i << "]);" << std::endl;
+    }
+  }
+
+  num = 0;
+  for (ProgramNode::VarList::const_iterator I = m_program->inputs.begin();
+       I != m_program->inputs.end(); ++I, ++num) {
+    const CcVariable& var = m_varmap[*I];
+    m_lanes_code << "  sh_cc_lanef " << var.m_name << "[" << var.m_size << "];" << std::endl;
+    m_lanes_code << "  sh_cc_load(" << var.m_name << ", " << var.m_size << ", inputs[" << num 
+                 << "], input_strides[" << num << "]);" << std::endl;
+  }
+
+  num = 0;
+  for (ProgramNode::VarList::const_iterator I = m_program->uniforms.begin();
+       I != m_program->uniforms.end(); ++I, ++num) {
+    const CcVariable& var = m_varmap[*I];
+    m_lanes_code << "  sh_cc_lanef " << var.m_name << "[" << var.m_size << "];" << std::endl;
+    m_lanes_code << "  sh_cc_load(" << var.m_name << ", " << var.m_size << ", params[" << num 
+                 << "], 0);" << std::endl;
+  }
+
+  const ProgramNode::VarList* zeroed[] = { &m_program->outputs, &m_program->temps };
+  for (int l = 0; l < 2; ++l) {
+    for (ProgramNode::VarList::const_iterator I = zeroed[l]->begin();
+         I != zeroed[l]->end(); ++I) {
+      const CcVariable& var = m_varmap[*I];
+      m_lanes_code << "  sh_cc_lanef " << var.m_name << "[" << var.m_size << "];" << std::endl;
+      for (int i = 0; i < var.m_size; ++i) {
+        m_lanes_code << "  " << var.m_name << "[" << i << "] = sh_cc_splat(0.0f);" << std::endl;
+      }
+    }
+  }
+
+  // Lanes in which each node runs.  Nodes that every path goes through
+  // run in all of them and need no masking, which is most of the
+  // program when branches are short.
+  std::set<CtrlGraphNode*> full;
+  for (std::vector<CtrlGraphNode*>::const_iterator N = order.begin(); 
+       N != order.end(); ++N) {
+    std::set<CtrlGraphNode*> seen;
+    if (!reaches_exit(entry, *N, seen)) full.insert(*N);
+    m_lanes_code << "  sh_cc_lanei mask_" << m_label_map[*N] << " = sh_cc_mask(" 
+                 << (full.find(*N) != full.end() ? -1 : 0) << ");" << std::endl;
+  }
+  m_lanes_code << std::endl;
+
+  for (std::vector<CtrlGraphNode*>::const_iterator N = order.begin(); 
+       N != order.end(); ++N) {
+    CtrlGraphNode* node = *N;
+    std::ostringstream mask;
+    mask << "mask_" << m_label_map[node];
+
+    if (node->block) {
+      for (BasicBlock::StmtList::const_iterator I = node->block->begin();
+           I != node->block->end(); ++I) {
+        emit_lanes(*I, full.find(node) != full.end() ? "" : mask.str());
+      }
+    }
+
+    if (node->successors_empty() && !node->follower()) continue;
+    if (node->successors_empty() && full.find(node->follower()) != full.end()) {
+      continue;
+    }
+
+    // As in the scalar code, the first successor whose condition holds
+    // wins and the follower gets the lanes no condition held for
+    m_lanes_code << "  {" << std::endl;
+    m_lanes_code << "    sh_cc_lanei taken = sh_cc_mask(0);" << std::endl;
+    for (CtrlGraphNode::SuccessorIt I = node->successors_begin();
+         I != node->successors_end(); ++I) {
+      m_lanes_code << "    {" << std::endl;
+      m_lanes_code << "      sh_cc_lanei cond = ";
+      for (int i = 0; i < I->cond.size(); ++i) {
+        if (i != 0) m_lanes_code << " | ";
+        m_lanes_code << "sh_cc_true(" << resolve(I->cond, i) << ")";
+      }
+      m_lanes_code << ";" << std::endl;
+      m_lanes_code << "      mask_" << m_label_map[I->node] << " = mask_" << m_label_map[I->node]
+                   << " | (" << mask.str() << " & cond & ~taken);" << std::endl;
+      m_lanes_code << "      taken = taken | cond;" << std::endl;
+      m_lanes_code << "    }" << std::endl;
+    }
+    if (node->follower()) {
+      int label = m_label_map[node->follower()];
+      m_lanes_code << "    mask_" << label << " = mask_" << label 
+                   << " | (" << mask.str() << " & ~taken);" << std::endl;
+    }
+    m_lanes_code << "  }" << std::endl;
+  }
+  m_lanes_code << std::endl;
+
+  num = 0;
+  for (ProgramNode::VarList::const_iterator I = m_program->outputs.begin();
+       I != m_program->outputs.end(); ++I, ++num) {
+    const CcVariable& var = m_varmap[*I];
+    m_lanes_code << "  sh_cc_store(outputs[" << num << "], output_strides[" << num << "], " 
+                 << var.m_name << ", " << var.m_size << ");" << std::endl;
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,237 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+
+/** @file CcLanes.hpp
+ *
+ * Lane vectors used by the vectorized kernels of the cc backend.
+ *
+ * A lane vector holds one tuple component of SH_CC_LANES consecutive
+ * stream elements (struct-of-arrays form), so that a single operation
+ * computes that component for all of them.  Masks hold -1 in the lanes
+ * where a condition is true and 0 elsewhere.
+ *
+ * GCC and Clang vector extensions are used when the target has vector
+ * registers of that width.  Otherwise lane vectors are plain arrays with
+ * the same operators, which the compiler is free to vectorize on its own.
+ *
+ * SH_CC_LANES must be defined before this file is included.
+ */
+
+#if defined(__GNUC__) && (SH_CC_LANES == 4 || \
+                          (SH_CC_LANES == 8 && defined(__AVX__)) || \
+                          (SH_CC_LANES == 16 && defined(__AVX512F__)))
+
+typedef float sh_cc_lanef __attribute__((vector_size(SH_CC_LANES * sizeof(float))));
+typedef int sh_cc_lanei __attribute__((vector_size(SH_CC_LANES * sizeof(int))));
+
+inline sh_cc_lanef sh_cc_select(sh_cc_lanei mask, sh_cc_lanef a, sh_cc_lanef b)
+{
+  return (sh_cc_lanef)(((sh_cc_lanei)a & mask) | ((sh_cc_lanei)b & ~mask));
+}
+
+#else
+
+struct sh_cc_lanei {
+  int v[SH_CC_LANES];
+  int& operator[](int l) { return v[l]; }
+  int operator[](int l) const { return v[l]; }
+};
+
+struct sh_cc_lanef {
+  float v[SH_CC_LANES];
+  float& operator[](int l) { return v[l]; }
+  float operator[](int l) const { return v[l]; }
+};
+
+#define SH_CC_LANE_BINARY(R, T, OP) \
+inline R operator OP(const T& a, const T& b) \
+{ \
+  R r; \
+  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = a[l] OP b[l]; \
+  return r; \
+}
+
+SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, +)
+SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, -)
+SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, *)
+SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, /)
+SH_CC_LANE_BINARY(sh_cc_lanei, sh_cc_lanei, &)
+SH_CC_LANE_BINARY(sh_cc_lanei, sh_cc_lanei, |)
+
+#define SH_CC_LANE_COMPARE(OP) \
+inline sh_cc_lanei operator OP(const sh_cc_lanef& a, const sh_cc_lanef& b) \
+{ \
+  sh_cc_lanei r; \
+  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = a[l] OP b[l] ? -1 : 0; \
+  return r; \
+}
+
+SH_CC_LANE_COMPARE(<)
+SH_CC_LANE_COMPARE(<=)
+SH_CC_LANE_COMPARE(>)
+SH_CC_LANE_COMPARE(>=)
+SH_CC_LANE_COMPARE(==)
+SH_CC_LANE_COMPARE(!=)
+
+inline sh_cc_lanef operator-(const sh_cc_lanef& a)
+{
+  sh_cc_lanef r;
+  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = -a[l];
+  return r;
+}
+
+inline sh_cc_lanei operator~(const sh_cc_lanei& a)
+{
+  sh_cc_lanei r;
+  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = ~a[l];
+  return r;
+}
+
+inline sh_cc_lanef sh_cc_select(const sh_cc_lanei& mask, const sh_cc_lanef& a, const sh_cc_lanef& b)
+{
+  sh_cc_lanef r;
+  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = mask[l] ? a[l] : b[l];
+  return r;
+}
+
+#endif
+
+inline sh_cc_lanef sh_cc_splat(float x)
+{
+  sh_cc_lanef r;
+  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = x;
+  return r;
+}
+
+inline sh_cc_lanei sh_cc_mask(int x)
+{
+  sh_cc_lanei r;
+  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = x;
+  return r;
+}
+
+// 1 where the condition holds, 0 elsewhere, like the SLT family of ops
+inline sh_cc_lanef sh_cc_bool(sh_cc_lanei mask)
+{
+  return sh_cc_select(mask, sh_cc_splat(1.0f), sh_cc_splat(0.0f));
+}
+
+// Sh truth values are the positive ones
+inline sh_cc_lanei sh_cc_true(sh_cc_lanef a)
+{
+  return a > sh_cc_splat(0.0f);
+}
+
+inline sh_cc_lanef sh_cc_max(sh_cc_lanef a, sh_cc_lanef b)
+{
+  return sh_cc_select(a > b, a, b);
+}
+
+inline sh_cc_lanef sh_cc_min(sh_cc_lanef a, sh_cc_lanef b)
+{
+  return sh_cc_select(a < b, a, b);
+}
+
+inline sh_cc_lanef sh_cc_sgn(sh_cc_lanef a)
+{
+  sh_cc_lanef zero = sh_cc_splat(0.0f);
+  return sh_cc_select(a < zero, sh_cc_splat(-1.0f),
+                      sh_cc_select(a > zero, sh_cc_splat(1.0f), zero));
+}
+
+// Gathers size components of SH_CC_LANES elements that are stride bytes
+// apart into lane vectors.  A stride of 0 broadcasts a single element.
+inline void sh_cc_load(sh_cc_lanef* dest, int size, const void* src, int stride)
+{
+  for (int l = 0; l < SH_CC_LANES; ++l) {
+    const float* element = (const float*)((const char*)src + l * stride);
+    for (int i = 0; i < size; ++i) dest[i][l] = element[i];
+  }
+}
+
+inline void sh_cc_store(void* dest, int stride, const sh_cc_lanef* src, int size)
+{
+  for (int l = 0; l < SH_CC_LANES; ++l) {
+    float* element = (float*)((char*)dest + l * stride);
+    for (int i = 0; i < size; ++i) element[i] = src[i][l];
+  }
+}
+
+// Library functions have no vector versions, so they are applied lane
+// by lane, computing exactly what the scalar kernel would.
+#define SH_CC_LANE_FUNC1(NAME, EXPR) \
+inline sh_cc_lanef NAME(sh_cc_lanef x) \
+{ \
+  sh_cc_lanef r; \
+  for (int l = 0; l < SH_CC_LANES; ++l) { \
+    float a = x[l]; \
+    r[l] = (float)(EXPR); \
+  } \
+  return r; \
+}
+
+#define SH_CC_LANE_FUNC2(NAME, EXPR) \
+inline sh_cc_lanef NAME(sh_cc_lanef x, sh_cc_lanef y) \
+{ \
+  sh_cc_lanef r; \
+  for (int l = 0; l < SH_CC_LANES; ++l) { \
+    float a = x[l]; \
+    float b = y[l]; \
+    r[l] = (float)(EXPR); \
+  } \
+  return r; \
+}
+
+SH_CC_LANE_FUNC1(sh_cc_abs, fabs(a))
+SH_CC_LANE_FUNC1(sh_cc_acos, acos(a))
+SH_CC_LANE_FUNC1(sh_cc_asin, asin(a))
+SH_CC_LANE_FUNC1(sh_cc_atan, atan(a))
+SH_CC_LANE_FUNC1(sh_cc_cbrt, pow(a, 1 / 3.0))
+SH_CC_LANE_FUNC1(sh_cc_ceil, ceil(a))
+SH_CC_LANE_FUNC1(sh_cc_cos, cos(a))
+SH_CC_LANE_FUNC1(sh_cc_cosh, cosh(a))
+SH_CC_LANE_FUNC1(sh_cc_exp, exp(a))
+SH_CC_LANE_FUNC1(sh_cc_exp2, exp2(a))
+SH_CC_LANE_FUNC1(sh_cc_exp10, exp10(a))
+SH_CC_LANE_FUNC1(sh_cc_floor, floor(a))
+SH_CC_LANE_FUNC1(sh_cc_frac, a - floor(a))
+SH_CC_LANE_FUNC1(sh_cc_log, log(a))
+SH_CC_LANE_FUNC1(sh_cc_log2, log2(a))
+SH_CC_LANE_FUNC1(sh_cc_log10, log10(a))
+SH_CC_LANE_FUNC1(sh_cc_rnd, floor(a + 0.5))
+SH_CC_LANE_FUNC1(sh_cc_rsq, 1 / sqrt(a))
+SH_CC_LANE_FUNC1(sh_cc_sin, sin(a))
+SH_CC_LANE_FUNC1(sh_cc_sinh, sinh(a))
+SH_CC_LANE_FUNC1(sh_cc_sqrt, sqrt(a))
+SH_CC_LANE_FUNC1(sh_cc_tan, tan(a))
+SH_CC_LANE_FUNC1(sh_cc_tanh, tanh(a))
+#ifdef _WIN32
+SH_CC_LANE_FUNC1(sh_cc_acosh, log(a + sqrt(a * a - 1.0)))
+SH_CC_LANE_FUNC1(sh_cc_asinh, log(a + sqrt(a * a + 1.0)))
+SH_CC_LANE_FUNC1(sh_cc_atanh, log((1.0 + a)/(1.0 - a)) / 2.0)
+#else
+SH_CC_LANE_FUNC1(sh_cc_acosh, acosh(a))
+SH_CC_LANE_FUNC1(sh_cc_asinh, asinh(a))
+SH_CC_LANE_FUNC1(sh_cc_atanh, atanh(a))
+#endif
+
+SH_CC_LANE_FUNC2(sh_cc_atan2, atan2(a, b))
+SH_CC_LANE_FUNC2(sh_cc_mod, a - b * floor((double)a / b))
+SH_CC_LANE_FUNC2(sh_cc_pow, pow(a, b))
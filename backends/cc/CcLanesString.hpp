@@ -0,0 +1,239 @@
+const char* cc_lanes_string[] = {
+"// Sh: A GPU metaprogramming language.\n",
+"//\n",
+"// Copyright 2003-2006 Serious Hack Inc.\n",
+"//\n",
+"// This library is free software; you can redistribute it and/or\n",
+"// modify it under the terms of the GNU Lesser General Public\n",
+"// License as published by the Free Software Foundation; either\n",
+"// version 2.1 of the License, or (at your option) any later version.\n",
+"//\n",
+"// This library is distributed in the hope that it will be useful,\n",
+"// but WITHOUT ANY WARRANTY; without even the implied warranty of\n",
+"// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n",
+"// Lesser General Public License for more details.\n",
+"//\n",
+"// You should have received a copy of the GNU Lesser General Public\n",
+"// License along with this library; if not, write to the Free Software\n",
+"// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,\n",
+"// MA  02110-1301, USA\n",
+"//////////////////////////////////////////////////////////////////////////////\n",
+"\n",
+"/** @file CcLanes.hpp\n",
+" *\n",
+" * Lane vectors used by the vectorized kernels of the cc backend.\n",
+" *\n",
+" * A lane vector holds one tuple component of SH_CC_LANES consecutive\n",
+" * stream elements (struct-of-arrays form), so that a single operation\n",
+" * computes that component for all of them.  Masks hold -1 in the lanes\n",
+" * where a condition is true and 0 elsewhere.\n",
+" *\n",
+" * GCC and Clang vector extensions are used when the target has vector\n",
+" * registers of that width.  Otherwise lane vectors are plain arrays with\n",
+" * the same operators, which the compiler is free to vectorize on its own.\n",
+" *\n",
+" * SH_CC_LANES must be defined before this file is included.\n",
+" */\n",
+"\n",
+"#if defined(__GNUC__) && (SH_CC_LANES == 4 || \\\n",
+"                          (SH_CC_LANES == 8 && defined(__AVX__)) || \\\n",
+"                          (SH_CC_LANES == 16 && defined(__AVX512F__)))\n",
+"\n",
+"typedef float sh_cc_lanef __attribute__((vector_size(SH_CC_LANES * sizeof(float))));\n",
+"typedef int sh_cc_lanei __attribute__((vector_size(SH_CC_LANES * sizeof(int))));\n",
+"\n",
+"inline sh_cc_lanef sh_cc_select(sh_cc_lanei mask, sh_cc_lanef a, sh_cc_lanef b)\n",
+"{\n",
+"  return (sh_cc_lanef)(((sh_cc_lanei)a & mask) | ((sh_cc_lanei)b & ~mask));\n",
+"}\n",
+"\n",
+"#else\n",
+"\n",
+"struct sh_cc_lanei {\n",
+"  int v[SH_CC_LANES];\n",
+"  int& operator[](int l) { return v[l]; }\n",
+"  int operator[](int l) const { return v[l]; }\n",
+"};\n",
+"\n",
+"struct sh_cc_lanef {\n",
+"  float v[SH_CC_LANES];\n",
+"  float& operator[](int l) { return v[l]; }\n",
+"  float operator[](int l) const { return v[l]; }\n",
+"};\n",
+"\n",
+"#define SH_CC_LANE_BINARY(R, T, OP) \\\n",
+"inline R operator OP(const T& a, const T& b) \\\n",
+"{ \\\n",
+"  R r; \\\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = a[l] OP b[l]; \\\n",
+"  return r; \\\n",
+"}\n",
+"\n",
+"SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, +)\n",
+"SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, -)\n",
+"SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, *)\n",
+"SH_CC_LANE_BINARY(sh_cc_lanef, sh_cc_lanef, /)\n",
+"SH_CC_LANE_BINARY(sh_cc_lanei, sh_cc_lanei, &)\n",
+"SH_CC_LANE_BINARY(sh_cc_lanei, sh_cc_lanei, |)\n",
+"\n",
+"#define SH_CC_LANE_COMPARE(OP) \\\n",
+"inline sh_cc_lanei operator OP(const sh_cc_lanef& a, const sh_cc_lanef& b) \\\n",
+"{ \\\n",
+"  sh_cc_lanei r; \\\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = a[l] OP b[l] ? -1 : 0; \\\n",
+"  return r; \\\n",
+"}\n",
+"\n",
+"SH_CC_LANE_COMPARE(<)\n",
+"SH_CC_LANE_COMPARE(<=)\n",
+"SH_CC_LANE_COMPARE(>)\n",
+"SH_CC_LANE_COMPARE(>=)\n",
+"SH_CC_LANE_COMPARE(==)\n",
+"SH_CC_LANE_COMPARE(!=)\n",
+"\n",
+"inline sh_cc_lanef operator-(const sh_cc_lanef& a)\n",
+"{\n",
+"  sh_cc_lanef r;\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = -a[l];\n",
+"  return r;\n",
+"}\n",
+"\n",
+"inline sh_cc_lanei operator~(const sh_cc_lanei& a)\n",
+"{\n",
+"  sh_cc_lanei r;\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = ~a[l];\n",
+"  return r;\n",
+"}\n",
+"\n",
+"inline sh_cc_lanef sh_cc_select(const sh_cc_lanei& mask, const sh_cc_lanef& a, const sh_cc_lanef& b)\n",
+"{\n",
+"  sh_cc_lanef r;\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = mask[l] ? a[l] : b[l];\n",
+"  return r;\n",
+"}\n",
+"\n",
+"#endif\n",
+"\n",
+"inline sh_cc_lanef sh_cc_splat(float x)\n",
+"{\n",
+"  sh_cc_lanef r;\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = x;\n",
+"  return r;\n",
+"}\n",
+"\n",
+"inline sh_cc_lanei sh_cc_mask(int x)\n",
+"{\n",
+"  sh_cc_lanei r;\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) r[l] = x;\n",
+"  return r;\n",
+"}\n",
+"\n",
+"// 1 where the condition holds, 0 elsewhere, like the SLT family of ops\n",
+"inline sh_cc_lanef sh_cc_bool(sh_cc_lanei mask)\n",
+"{\n",
+"  return sh_cc_select(mask, sh_cc_splat(1.0f), sh_cc_splat(0.0f));\n",
+"}\n",
+"\n",
+"// Sh truth values are the positive ones\n",
+"inline sh_cc_lanei sh_cc_true(sh_cc_lanef a)\n",
+"{\n",
+"  return a > sh_cc_splat(0.0f);\n",
+"}\n",
+"\n",
+"inline sh_cc_lanef sh_cc_max(sh_cc_lanef a, sh_cc_lanef b)\n",
+"{\n",
+"  return sh_cc_select(a > b, a, b);\n",
+"}\n",
+"\n",
+"inline sh_cc_lanef sh_cc_min(sh_cc_lanef a, sh_cc_lanef b)\n",
+"{\n",
+"  return sh_cc_select(a < b, a, b);\n",
+"}\n",
+"\n",
+"inline sh_cc_lanef sh_cc_sgn(sh_cc_lanef a)\n",
+"{\n",
+"  sh_cc_lanef zero = sh_cc_splat(0.0f);\n",
+"  return sh_cc_select(a < zero, sh_cc_splat(-1.0f),\n",
+"                      sh_cc_select(a > zero, sh_cc_splat(1.0f), zero));\n",
+"}\n",
+"\n",
+"// Gathers size components of SH_CC_LANES elements that are stride bytes\n",
+"// apart into lane vectors.  A stride of 0 broadcasts a single element.\n",
+"inline void sh_cc_load(sh_cc_lanef* dest, int size, const void* src, int stride)\n",
+"{\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) {\n",
+"    const float* element = (const float*)((const char*)src + l * stride);\n",
+"    for (int i = 0; i < size; ++i) dest[i][l] = element[i];\n",
+"  }\n",
+"}\n",
+"\n",
+"inline void sh_cc_store(void* dest, int stride, const sh_cc_lanef* src, int size)\n",
+"{\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) {\n",
+"    float* element = (float*)((char*)dest + l * stride);\n",
+"    for (int i = 0; i < size; ++i) element[i] = src[i][l];\n",
+"  }\n",
+"}\n",
+"\n",
+"// Library functions have no vector versions, so they are applied lane\n",
+"// by lane, computing exactly what the scalar kernel would.\n",
+"#define SH_CC_LANE_FUNC1(NAME, EXPR) \\\n",
+"inline sh_cc_lanef NAME(sh_cc_lanef x) \\\n",
+"{ \\\n",
+"  sh_cc_lanef r; \\\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) { \\\n",
+"    float a = x[l]; \\\n",
+"    r[l] = (float)(EXPR); \\\n",
+"  } \\\n",
+"  return r; \\\n",
+"}\n",
+"\n",
+"#define SH_CC_LANE_FUNC2(NAME, EXPR) \\\n",
+"inline sh_cc_lanef NAME(sh_cc_lanef x, sh_cc_lanef y) \\\n",
+"{ \\\n",
+"  sh_cc_lanef r; \\\n",
+"  for (int l = 0; l < SH_CC_LANES; ++l) { \\\n",
+"    float a = x[l]; \\\n",
+"    float b = y[l]; \\\n",
+"    r[l] = (float)(EXPR); \\\n",
+"  } \\\n",
+"  return r; \\\n",
+"}\n",
+"\n",
+"SH_CC_LANE_FUNC1(sh_cc_abs, fabs(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_acos, acos(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_asin, asin(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_atan, atan(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_cbrt, pow(a, 1 / 3.0))\n",
+"SH_CC_LANE_FUNC1(sh_cc_ceil, ceil(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_cos, cos(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_cosh, cosh(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_exp, exp(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_exp2, exp2(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_exp10, exp10(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_floor, floor(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_frac, a - floor(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_log, log(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_log2, log2(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_log10, log10(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_rnd, floor(a + 0.5))\n",
+"SH_CC_LANE_FUNC1(sh_cc_rsq, 1 / sqrt(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_sin, sin(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_sinh, sinh(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_sqrt, sqrt(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_tan, tan(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_tanh, tanh(a))\n",
+"#ifdef _WIN32\n",
+"SH_CC_LANE_FUNC1(sh_cc_acosh, log(a + sqrt(a * a - 1.0)))\n",
+"SH_CC_LANE_FUNC1(sh_cc_asinh, log(a + sqrt(a * a + 1.0)))\n",
+"SH_CC_LANE_FUNC1(sh_cc_atanh, log((1.0 + a)/(1.0 - a)) / 2.0)\n",
+"#else\n",
+"SH_CC_LANE_FUNC1(sh_cc_acosh, acosh(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_asinh, asinh(a))\n",
+"SH_CC_LANE_FUNC1(sh_cc_atanh, atanh(a))\n",
+"#endif\n",
+"\n",
+"SH_CC_LANE_FUNC2(sh_cc_atan2, atan2(a, b))\n",
+"SH_CC_LANE_FUNC2(sh_cc_mod, a - b * floor((double)a / b))\n",
+"SH_CC_LANE_FUNC2(sh_cc_pow, pow(a, b))\n",
+""};
@@ -28,9 +28,11 @@
  * src indices are assumed to be integers, even if the int 
  * allows floating point values.
  *
- * All of the parameters such as tuple-size, etc.
- * will be known statically at time of code emission, so they
- * are all template parameters.
+ * Parameters such as the tuple-size are known statically at
+ * time of code emission, so they are template parameters.  The
+ * dimensions of a texture are read at run time from the
+ * sh_cc_backend_texture passed in its place, so that a kernel
+ * keeps working when its textures are resized.
  */
 
 // @todo type
@@ -61,17 +63,28 @@ struct sh_gcc_backend_wrap_repeat
   }
 };
 
-template<int TexDims, int TexSize, int TexWidth, int TexHeight, int TexDepth, typename TexType,
+/// What the kernels get for each texture in their textures array.
+/// Must match CcTexture in Cc.hpp.
+struct sh_cc_backend_texture
+{
+  const void* data;
+  int width;
+  int height;
+  int depth;
+};
+
+template<int TexDims, int TexSize, typename TexType,
   typename SrcWrap, typename IndexType, typename MemoryType> 
 void sh_cc_backend_lookupi(const void *texture, IndexType *src, MemoryType *dest)
 {
-  const TexType* data = reinterpret_cast<const TexType*>(texture);
+  const sh_cc_backend_texture* tex = reinterpret_cast<const sh_cc_backend_texture*>(texture);
+  const TexType* data = reinterpret_cast<const TexType*>(tex->data);
   int index = 0;
-  if(TexDims == 3) index = SrcWrap::wrap(sh_cc_backend_nearest(src[2]), TexDepth);
-  if(TexDims >= 2) index = SrcWrap::wrap(sh_cc_backend_nearest(src[1]), TexHeight) 
-      + TexHeight * index;
-  index = SrcWrap::wrap(sh_cc_backend_nearest(src[0]), TexWidth)
-          + TexWidth * index;
+  if(TexDims == 3) index = SrcWrap::wrap(sh_cc_backend_nearest(src[2]), tex->depth);
+  if(TexDims >= 2) index = SrcWrap::wrap(sh_cc_backend_nearest(src[1]), tex->height) 
+      + tex->height * index;
+  index = SrcWrap::wrap(sh_cc_backend_nearest(src[0]), tex->width)
+          + tex->width * index;
 
   int start = index * TexSize; 
   for(int i = 0; i < TexSize; ++i) {
@@ -79,16 +92,15 @@ void sh_cc_backend_lookupi(const void *texture, IndexType *src, MemoryType *dest
   }
 }
 
-template<int TexDims, int TexSize, int TexWidth, int TexHeight, int TexDepth, typename TexType,
+template<int TexDims, int TexSize, typename TexType,
   typename SrcWrap, typename IndexType, typename MemoryType> 
 void sh_cc_backend_lookup(const void *texture, IndexType *src, MemoryType *dest)
 {
+  const sh_cc_backend_texture* tex = reinterpret_cast<const sh_cc_backend_texture*>(texture);
   IndexType scaled_src[TexDims];
-  scaled_src[0] = TexWidth * src[0];
-  if(TexDims > 1) scaled_src[1] = TexHeight * src[1];
-  if(TexDims > 2) scaled_src[2] = TexDepth * src[2];
+  scaled_src[0] = tex->width * src[0];
+  if(TexDims > 1) scaled_src[1] = tex->height * src[1];
+  if(TexDims > 2) scaled_src[2] = tex->depth * src[2];
 
-  sh_cc_backend_lookupi<TexDims, TexSize, TexWidth, TexHeight, TexDepth, TexType, 
-    SrcWrap>(texture, scaled_src, dest);
+  sh_cc_backend_lookupi<TexDims, TexSize, TexType, SrcWrap>(texture, scaled_src, dest);
 }
-
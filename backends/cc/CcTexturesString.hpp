@@ -48,9 +48,11 @@ const char* cc_texture_string[] = {
 " * src indices are assumed to be integers, even if the int \n",
 " * allows floating point values.\n",
 " *\n",
-" * All of the parameters such as tuple-size, etc.\n",
-" * will be known statically at time of code emission, so they\n",
-" * are all template parameters.\n",
+" * Parameters such as the tuple-size are known statically at\n",
+" * time of code emission, so they are template parameters.  The\n",
+" * dimensions of a texture are read at run time from the\n",
+" * sh_cc_backend_texture passed in its place, so that a kernel\n",
+" * keeps working when its textures are resized.\n",
 " */\n",
 "\n",
 "// @todo type\n",
@@ -81,17 +83,28 @@ const char* cc_texture_string[] = {
 "  }\n",
 "};\n",
 "\n",
-"template<int TexDims, int TexSize, int TexWidth, int TexHeight, int TexDepth, typename TexType,\n",
+"/// What the kernels get for each texture in their textures array.\n",
+"/// Must match CcTexture in Cc.hpp.\n",
+"struct sh_cc_backend_texture\n",
+"{\n",
+"  const void* data;\n",
+"  int width;\n",
+"  int height;\n",
+"  int depth;\n",
+"};\n",
+"\n",
+"template<int TexDims, int TexSize, typename TexType,\n",
 "  typename SrcWrap, typename IndexType, typename MemoryType> \n",
 "void sh_cc_backend_lookupi(const void *texture, IndexType *src, MemoryType *dest)\n",
 "{\n",
-"  const TexType* data = reinterpret_cast<const TexType*>(texture);\n",
+"  const sh_cc_backend_texture* tex = reinterpret_cast<const sh_cc_backend_texture*>(texture);\n",
+"  const TexType* data = reinterpret_cast<const TexType*>(tex->data);\n",
 "  int index = 0;\n",
-"  if(TexDims == 3) index = SrcWrap::wrap(sh_cc_backend_nearest(src[2]), TexDepth);\n",
-"  if(TexDims >= 2) index = SrcWrap::wrap(sh_cc_backend_nearest(src[1]), TexHeight) \n",
-"      + TexHeight * index;\n",
-"  index = SrcWrap::wrap(sh_cc_backend_nearest(src[0]), TexWidth)\n",
-"          + TexWidth * index;\n",
+"  if(TexDims == 3) index = SrcWrap::wrap(sh_cc_backend_nearest(src[2]), tex->depth);\n",
+"  if(TexDims >= 2) index = SrcWrap::wrap(sh_cc_backend_nearest(src[1]), tex->height) \n",
+"      + tex->height * index;\n",
+"  index = SrcWrap::wrap(sh_cc_backend_nearest(src[0]), tex->width)\n",
+"          + tex->width * index;\n",
 "\n",
 "  int start = index * TexSize; \n",
 "  for(int i = 0; i < TexSize; ++i) {\n",
@@ -99,17 +112,16 @@ const char* cc_texture_string[] = {
 "  }\n",
 "}\n",
 "\n",
-"template<int TexDims, int TexSize, int TexWidth, int TexHeight, int TexDepth, typename TexType,\n",
+"template<int TexDims, int TexSize, typename TexType,\n",
 "  typename SrcWrap, typename IndexType, typename MemoryType> \n",
 "void sh_cc_backend_lookup(const void *texture, IndexType *src, MemoryType *dest)\n",
 "{\n",
+"  const sh_cc_backend_texture* tex = reinterpret_cast<const sh_cc_backend_texture*>(texture);\n",
 "  IndexType scaled_src[TexDims];\n",
-"  scaled_src[0] = TexWidth * src[0];\n",
-"  if(TexDims > 1) scaled_src[1] = TexHeight * src[1];\n",
-"  if(TexDims > 2) scaled_src[2] = TexDepth * src[2];\n",
+"  scaled_src[0] = tex->width * src[0];\n",
+"  if(TexDims > 1) scaled_src[1] = tex->height * src[1];\n",
+"  if(TexDims > 2) scaled_src[2] = tex->depth * src[2];\n",
 "\n",
-"  sh_cc_backend_lookupi<TexDims, TexSize, TexWidth, TexHeight, TexDepth, TexType, \n",
-"    SrcWrap>(texture, scaled_src, dest);\n",
+"  sh_cc_backend_lookupi<TexDims, TexSize, TexType, SrcWrap>(texture, scaled_src, dest);\n",
 "}\n",
-"\n",
 ""};
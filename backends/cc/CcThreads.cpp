@@ -0,0 +1,230 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#include <exception>
+#include "CcThreads.hpp"
+#include "Debug.hpp"
+#include "Exception.hpp"
+#include "Threads.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+namespace Cc {
+
+namespace {
+// Its threads only start with the first job, so making the pool when
+// the backend loads costs nothing
+WorkerPool* const loaded_pool = WorkerPool::instance();
+}
+
+WorkerPool* WorkerPool::instance()
+{
+  static WorkerPool* pool = new WorkerPool();
+  return pool;
+}
+
+int WorkerPool::processors()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? static_cast<int>(count) : 1;
+#endif /* _WIN32 */
+}
+
+#ifdef _WIN32
+
+WorkerPool::WorkerPool()
+{
+}
+
+void WorkerPool::run(Task task, void* data, int count, int threads)
+{
+  for (int i = 0; i < count; ++i) {
+    task(data, i);
+  }
+}
+
+#else
+
+namespace {
+
+// Whether the current thread is running a task of the pool
+SH_THREAD_LOCAL bool in_task = false;
+
+}
+
+WorkerPool::WorkerPool()
+  : m_task(0),
+    m_data(0),
+    m_count(0),
+    m_next(0),
+    m_remaining(0),
+    m_wanted(0),
+    m_generation(0),
+    m_failed(false)
+{
+  pthread_mutex_init(&m_mutex, 0);
+  pthread_mutex_init(&m_run_mutex, 0);
+  pthread_cond_init(&m_work_cond, 0);
+  pthread_cond_init(&m_done_cond, 0);
+}
+
+void WorkerPool::run(Task task, void* data, int count, int threads)
+{
+  if (threads > count) threads = count;
+  // The pool is busy with the job this task belongs to
+  if (in_task) threads = 1;
+  if (threads <= 1) {
+    for (int i = 0; i < count; ++i) {
+      task(data, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&m_run_mutex);
+
+  // The calling thread does its share of the work too
+  while (static_cast<int>(m_threads.size()) < threads - 1) {
+    pthread_t thread;
+    if (pthread_create(&thread, 0, worker_main, this) != 0) {
+      SH_DEBUG_WARN("Could not start a cc backend worker thread");
+      break;
+    }
+    pthread_detach(thread);
+    m_threads.push_back(thread);
+  }
+
+  pthread_mutex_lock(&m_mutex);
+  m_task = task;
+  m_data = data;
+  m_count = count;
+  m_next = 0;
+  m_remaining = count;
+  m_wanted = threads - 1;
+  m_failed = false;
+  m_error = "";
+  ++m_generation;
+  pthread_cond_broadcast(&m_work_cond);
+  pthread_mutex_unlock(&m_mutex);
+
+  drain();
+
+  pthread_mutex_lock(&m_mutex);
+  while (m_remaining > 0) {
+    pthread_cond_wait(&m_done_cond, &m_mutex);
+  }
+  bool failed = m_failed;
+  std::string message = m_error;
+  pthread_mutex_unlock(&m_mutex);
+
+  pthread_mutex_unlock(&m_run_mutex);
+
+  if (failed) throw SH::Exception(message);
+}
+
+void* WorkerPool::worker_main(void* pool)
+{
+  static_cast<WorkerPool*>(pool)->work();
+  return 0;
+}
+
+void WorkerPool::work()
+{
+  unsigned int seen = 0;
+
+  pthread_mutex_lock(&m_mutex);
+  for (;;) {
+    while (m_generation == seen) {
+      pthread_cond_wait(&m_work_cond, &m_mutex);
+    }
+    seen = m_generation;
+
+    // The job may not want every thread in the pool
+    if (m_wanted == 0) continue;
+    --m_wanted;
+
+    pthread_mutex_unlock(&m_mutex);
+    drain();
+    pthread_mutex_lock(&m_mutex);
+  }
+}
+
+void WorkerPool::drain()
+{
+  for (;;) {
+    pthread_mutex_lock(&m_mutex);
+    if (m_next >= m_count) {
+      pthread_mutex_unlock(&m_mutex);
+      return;
+    }
+    int index = m_next++;
+    Task task = m_task;
+    void* data = m_data;
+    pthread_mutex_unlock(&m_mutex);
+
+    // Exceptions cannot cross threads, so they are caught here and
+    // rethrown by run()
+    bool failed = false;
+    std::string message;
+    bool was_in_task = in_task;
+    in_task = true;
+    try {
+      task(data, index);
+    } catch (const std::exception& e) {
+      failed = true;
+      message = e.what();
+    } catch (...) {
+      failed = true;
+      message = "Unknown exception in a cc backend worker";
+    }
+    in_task = was_in_task;
+
+    pthread_mutex_lock(&m_mutex);
+    if (failed) {
+      if (!m_failed) {
+        m_failed = true;
+        m_error = message;
+      }
+      // Skip the chunks nobody has started
+      m_remaining -= m_count - m_next;
+      m_next = m_count;
+    }
+    if (--m_remaining == 0) {
+      pthread_cond_signal(&m_done_cond);
+    }
+    pthread_mutex_unlock(&m_mutex);
+  }
+}
+
+#endif /* _WIN32 */
+
+}
@@ -0,0 +1,97 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHCCTHREADS_HPP
+#define SHCCTHREADS_HPP
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include <string>
+#include <vector>
+
+namespace Cc {
+
+/** Pool of worker threads used to run stream kernels.
+ *
+ * The threads are started the first time they are needed and then
+ * wait for work, so running a kernel does not pay for thread creation.
+ * On platforms without pthreads all the work is done by the calling
+ * thread.
+ */
+class WorkerPool {
+public:
+  /// A task processes chunk number index of the work described by data
+  typedef void (*Task)(void* data, int index);
+
+  static WorkerPool* instance();
+
+  /// Number of processors available to the process
+  static int processors();
+
+  /// Runs task(data, i) for every i in [0, count) using up to threads
+  /// threads, including the calling one.  Returns once all chunks have
+  /// been processed.
+  ///
+  /// If a task throws, the chunks not started yet are skipped and run()
+  /// throws an SH::Exception with the message of the first exception
+  /// once the others are done.
+  ///
+  /// The pool runs one job at a time, so run() is not re-entrant: when
+  /// called from inside a task, it runs the job on the calling thread
+  /// alone.
+  void run(Task task, void* data, int count, int threads);
+
+private:
+  WorkerPool();
+
+#ifndef _WIN32
+  static void* worker_main(void* pool);
+  void work();
+
+  /// Grabs and runs chunks of the current job until none are left
+  void drain();
+
+  std::vector<pthread_t> m_threads;
+
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_work_cond;  ///< signalled when a new job is posted
+  pthread_cond_t m_done_cond;  ///< signalled when the last chunk finishes
+  pthread_mutex_t m_run_mutex; ///< serializes callers of run()
+
+  Task m_task;
+  void* m_data;
+  int m_count;     ///< number of chunks in the current job
+  int m_next;      ///< next chunk to hand out
+  int m_remaining; ///< chunks not finished yet
+  int m_wanted;    ///< workers that may join the current job
+  unsigned int m_generation;
+  bool m_failed;        ///< whether a task of the current job threw
+  std::string m_error;  ///< message of the first exception thrown
+#endif /* _WIN32 */
+
+  // NOT IMPLEMENTED
+  WorkerPool(const WorkerPool& other);
+  WorkerPool& operator=(const WorkerPool& other);
+};
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+
+/** @file CcTypes.hpp
+ *
+ * Fixed-point fraction and half-float support for the kernels of the
+ * cc backend.
+ *
+ * Fractions are kept in the integer type they are stored in, where One
+ * represents 1.0, and the arithmetic saturates to [Min, One] the way
+ * Fraction<T> does.  Wide must hold the sum of two values, Product the
+ * product of two values and a value times One.
+ *
+ * Halves are computed in float and only converted from and to their 16
+ * bit representation when they are loaded from or stored to memory,
+ * using the same rounding as SH::Half.
+ */
+
+template<typename T, long long One, long long Min, typename Wide, typename Product>
+struct sh_cc_fraction {
+  static inline T clamp(Wide v)
+  {
+    return v < Min ? (T)Min : (v > One ? (T)One : (T)v);
+  }
+
+  static inline T clamp_product(Product v)
+  {
+    return v < (Product)Min ? (T)Min : (v > (Product)One ? (T)One : (T)v);
+  }
+
+  static inline double get(T a)
+  {
+    return (double)a / One;
+  }
+
+  // Truncates like the conversions of Fraction<T>
+  static inline T make(double v)
+  {
+    double t = v * One;
+    return t < Min ? (T)Min : (t > One ? (T)One : (t == t ? (T)t : (T)0));
+  }
+
+  static inline T truth(bool b)
+  {
+    return b ? (T)One : (T)0;
+  }
+
+  static inline T neg(T a) { return clamp(-(Wide)a); }
+  static inline T abs(T a) { return a < 0 ? neg(a) : a; }
+  static inline T sgn(T a) { return a < 0 ? (T)Min : (a > 0 ? (T)One : (T)0); }
+  static inline T add(T a, T b) { return clamp((Wide)a + (Wide)b); }
+  static inline T sub(T a, T b) { return clamp((Wide)a - (Wide)b); }
+  static inline T mul(T a, T b) { return clamp_product((Product)a * (Product)b / One); }
+
+  static inline T div(T a, T b)
+  {
+    if (b == 0) return a < 0 ? (T)Min : (a > 0 ? (T)One : (T)0);
+    return clamp_product((Product)a * One / (Product)b);
+  }
+
+  // b - c can leave the range of T, so this one is computed in double
+  static inline T lrp(T a, T b, T c)
+  {
+    return make(get(a) * (get(b) - get(c)) + get(c));
+  }
+
+  /// Texture element, converted to its value on lookups
+  struct texel {
+    T raw;
+    operator double() const { return get(raw); }
+  };
+};
+
+typedef sh_cc_fraction<signed char, 127LL, -127LL, int, int> sh_cc_fb;
+typedef sh_cc_fraction<short, 32767LL, -32767LL, int, int> sh_cc_fs;
+typedef sh_cc_fraction<int, 2147483647LL, -2147483647LL, long long, long long> sh_cc_fi;
+typedef sh_cc_fraction<unsigned char, 255LL, 0LL, int, int> sh_cc_fub;
+typedef sh_cc_fraction<unsigned short, 65535LL, 0LL, long long, long long> sh_cc_fus;
+typedef sh_cc_fraction<unsigned int, 4294967295LL, 0LL, long long, unsigned long long> sh_cc_fui;
+
+inline float sh_cc_half_get(unsigned short h)
+{
+  int sign = (h >> 15) ? -1 : 1;
+  int exponent = (h >> 10) & 0x1F;
+  int significand = h & 0x3FF;
+  double fraction = sign * ((exponent ? 1 : 0) + significand / (double)(1 << 10));
+  return (float)ldexp(fraction, exponent ? exponent - 15 : -14);
+}
+
+inline unsigned short sh_cc_half_make(double value)
+{
+  int exponent;
+  double fraction = frexp(value, &exponent);
+  int sign = fraction < 0;
+  fraction = sign ? -fraction : fraction;
+
+  unsigned short result = (unsigned short)(sign << 15);
+  if (fraction == 0) { // zero
+  } else if (fabs(value) > 65504) { // infinity
+    result |= 31 << 10;
+  } else if (exponent < -13) { // denormalized
+    result |= (int)(fraction * (1LL << (exponent + 24)));
+  } else { // normalized
+    result |= ((exponent + 14) << 10) | (int)((fraction - 0.5) * (1 << 11));
+  }
+  return result;
+}
+
+/// Texture element of a half texture
+struct sh_cc_half {
+  unsigned short raw;
+  operator double() const { return sh_cc_half_get(raw); }
+};
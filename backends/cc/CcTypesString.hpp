@@ -0,0 +1,132 @@
+const char* cc_types_string[] = {
+"// Sh: A GPU metaprogramming language.\n",
+"//\n",
+"// Copyright 2003-2006 Serious Hack Inc.\n",
+"//\n",
+"// This library is free software; you can redistribute it and/or\n",
+"// modify it under the terms of the GNU Lesser General Public\n",
+"// License as published by the Free Software Foundation; either\n",
+"// version 2.1 of the License, or (at your option) any later version.\n",
+"//\n",
+"// This library is distributed in the hope that it will be useful,\n",
+"// but WITHOUT ANY WARRANTY; without even the implied warranty of\n",
+"// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n",
+"// Lesser General Public License for more details.\n",
+"//\n",
+"// You should have received a copy of the GNU Lesser General Public\n",
+"// License along with this library; if not, write to the Free Software\n",
+"// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,\n",
+"// MA  02110-1301, USA\n",
+"//////////////////////////////////////////////////////////////////////////////\n",
+"\n",
+"/** @file CcTypes.hpp\n",
+" *\n",
+" * Fixed-point fraction and half-float support for the kernels of the\n",
+" * cc backend.\n",
+" *\n",
+" * Fractions are kept in the integer type they are stored in, where One\n",
+" * represents 1.0, and the arithmetic saturates to [Min, One] the way\n",
+" * Fraction<T> does.  Wide must hold the sum of two values, Product the\n",
+" * product of two values and a value times One.\n",
+" *\n",
+" * Halves are computed in float and only converted from and to their 16\n",
+" * bit representation when they are loaded from or stored to memory,\n",
+" * using the same rounding as SH::Half.\n",
+" */\n",
+"\n",
+"template<typename T, long long One, long long Min, typename Wide, typename Product>\n",
+"struct sh_cc_fraction {\n",
+"  static inline T clamp(Wide v)\n",
+"  {\n",
+"    return v < Min ? (T)Min : (v > One ? (T)One : (T)v);\n",
+"  }\n",
+"\n",
+"  static inline T clamp_product(Product v)\n",
+"  {\n",
+"    return v < (Product)Min ? (T)Min : (v > (Product)One ? (T)One : (T)v);\n",
+"  }\n",
+"\n",
+"  static inline double get(T a)\n",
+"  {\n",
+"    return (double)a / One;\n",
+"  }\n",
+"\n",
+"  // Truncates like the conversions of Fraction<T>\n",
+"  static inline T make(double v)\n",
+"  {\n",
+"    double t = v * One;\n",
+"    return t < Min ? (T)Min : (t > One ? (T)One : (t == t ? (T)t : (T)0));\n",
+"  }\n",
+"\n",
+"  static inline T truth(bool b)\n",
+"  {\n",
+"    return b ? (T)One : (T)0;\n",
+"  }\n",
+"\n",
+"  static inline T neg(T a) { return clamp(-(Wide)a); }\n",
+"  static inline T abs(T a) { return a < 0 ? neg(a) : a; }\n",
+"  static inline T sgn(T a) { return a < 0 ? (T)Min : (a > 0 ? (T)One : (T)0); }\n",
+"  static inline T add(T a, T b) { return clamp((Wide)a + (Wide)b); }\n",
+"  static inline T sub(T a, T b) { return clamp((Wide)a - (Wide)b); }\n",
+"  static inline T mul(T a, T b) { return clamp_product((Product)a * (Product)b / One); }\n",
+"\n",
+"  static inline T div(T a, T b)\n",
+"  {\n",
+"    if (b == 0) return a < 0 ? (T)Min : (a > 0 ? (T)One : (T)0);\n",
+"    return clamp_product((Product)a * One / (Product)b);\n",
+"  }\n",
+"\n",
+"  // b - c can leave the range of T, so this one is computed in double\n",
+"  static inline T lrp(T a, T b, T c)\n",
+"  {\n",
+"    return make(get(a) * (get(b) - get(c)) + get(c));\n",
+"  }\n",
+"\n",
+"  /// Texture element, converted to its value on lookups\n",
+"  struct texel {\n",
+"    T raw;\n",
+"    operator double() const { return get(raw); }\n",
+"  };\n",
+"};\n",
+"\n",
+"typedef sh_cc_fraction<signed char, 127LL, -127LL, int, int> sh_cc_fb;\n",
+"typedef sh_cc_fraction<short, 32767LL, -32767LL, int, int> sh_cc_fs;\n",
+"typedef sh_cc_fraction<int, 2147483647LL, -2147483647LL, long long, long long> sh_cc_fi;\n",
+"typedef sh_cc_fraction<unsigned char, 255LL, 0LL, int, int> sh_cc_fub;\n",
+"typedef sh_cc_fraction<unsigned short, 65535LL, 0LL, long long, long long> sh_cc_fus;\n",
+"typedef sh_cc_fraction<unsigned int, 4294967295LL, 0LL, long long, unsigned long long> sh_cc_fui;\n",
+"\n",
+"inline float sh_cc_half_get(unsigned short h)\n",
+"{\n",
+"  int sign = (h >> 15) ? -1 : 1;\n",
+"  int exponent = (h >> 10) & 0x1F;\n",
+"  int significand = h & 0x3FF;\n",
+"  double fraction = sign * ((exponent ? 1 : 0) + significand / (double)(1 << 10));\n",
+"  return (float)ldexp(fraction, exponent ? exponent - 15 : -14);\n",
+"}\n",
+"\n",
+"inline unsigned short sh_cc_half_make(double value)\n",
+"{\n",
+"  int exponent;\n",
+"  double fraction = frexp(value, &exponent);\n",
+"  int sign = fraction < 0;\n",
+"  fraction = sign ? -fraction : fraction;\n",
+"\n",
+"  unsigned short result = (unsigned short)(sign << 15);\n",
+"  if (fraction == 0) { // zero\n",
+"  } else if (fabs(value) > 65504) { // infinity\n",
+"    result |= 31 << 10;\n",
+"  } else if (exponent < -13) { // denormalized\n",
+"    result |= (int)(fraction * (1LL << (exponent + 24)));\n",
+"  } else { // normalized\n",
+"    result |= ((exponent + 14) << 10) | (int)((fraction - 0.5) * (1 << 11));\n",
+"  }\n",
+"  return result;\n",
+"}\n",
+"\n",
+"/// Texture element of a half texture\n",
+"struct sh_cc_half {\n",
+"  unsigned short raw;\n",
+"  operator double() const { return sh_cc_half_get(raw); }\n",
+"};\n",
+""};
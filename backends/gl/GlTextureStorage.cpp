@@ -225,6 +225,11 @@ int HostGlTextureTransfer::cost(const Storage* from, const Storage* to)
   return 100;
 }
 
+int HostGlTextureTransfer::path_cost() const
+{
+  return 100;
+}
+
 GlTextureHostTransfer::GlTextureHostTransfer()
   : Transfer("opengl:texture", "host")
 {
@@ -320,6 +325,11 @@ int GlTextureHostTransfer::cost(const Storage* from, const Storage* to)
   return 1000;
 }
 
+int GlTextureHostTransfer::path_cost() const
+{
+  return 1000;
+}
+
 GlTextureGlTextureTransfer::GlTextureGlTextureTransfer(const std::string& target)
   : Transfer("opengl:texture", "opengl:texture"), m_target(target)
 {
@@ -415,6 +425,12 @@ int GlTextureGlTextureTransfer::cost(const Storage* from, const Storage* to)
     return 2000;
 }
 
+int GlTextureGlTextureTransfer::path_cost() const
+{
+  // Assume the cheap case, as for RGB textures
+  return 20;
+}
+
 HostGlTextureTransfer* HostGlTextureTransfer::instance;
 GlTextureHostTransfer* GlTextureHostTransfer::instance;
 GlTextureGlTextureTransfer* GlTextureGlTextureTransfer::instance;
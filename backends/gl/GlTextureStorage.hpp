@@ -91,6 +91,7 @@ public:
   HostGlTextureTransfer();
   bool transfer(const SH::Storage* from, SH::Storage* to);
   int cost(const SH::Storage* from, const SH::Storage* to);
+  int path_cost() const;
   static HostGlTextureTransfer* instance;
 };
 
@@ -99,6 +100,7 @@ public:
   GlTextureHostTransfer();
   bool transfer(const SH::Storage* from, SH::Storage* to);
   int cost(const SH::Storage* from, const SH::Storage* to);
+  int path_cost() const;
   static GlTextureHostTransfer* instance;
 };
 
@@ -107,6 +109,7 @@ public:
   GlTextureGlTextureTransfer(const std::string& target);
   bool transfer(const SH::Storage* from, SH::Storage* to);
   int cost(const SH::Storage* from, const SH::Storage* to);
+  int path_cost() const;
   static GlTextureGlTextureTransfer* instance;
 
 private:
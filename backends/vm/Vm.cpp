@@ -0,0 +1,1064 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "Vm.hpp"
+#include "Debug.hpp"
+#include "Error.hpp"
+#include "FileMemory.hpp"
+#include "Exception.hpp"
+#include "Stream.hpp"
+#include "Variant.hpp"
+#include "VariantFactory.hpp"
+#include "TypeInfo.hpp"
+#include "Optimizations.hpp"
+#include "Context.hpp"
+#include "Operation.hpp"
+#include "Transformer.hpp"
+#include "TextureNode.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef SH_VM_DEBUG
+#  define SH_VM_DEBUG_PRINT(x) SH_DEBUG_PRINT(x)
+#else
+#  define SH_VM_DEBUG_PRINT(x) do { } while(0)
+#endif
+
+namespace Vm {
+
+using namespace SH;
+
+namespace {
+
+/// Scratch registers are numbered from here until the program is lowered
+const int ScratchBase = 1 << 20;
+
+/// Interned id of host storages, for cheap lookups
+const int HostStorageId = SH::Storage::intern("host");
+
+/// The ops that compute each component of the destination from the same
+/// component of the sources (or their only component)
+struct VmOpMapping {
+  Operation op;
+  VmOpcode opcode;
+};
+
+const VmOpMapping opMappings[] = {
+  {OP_ASN,   VM_MOV},
+  {OP_FETCH, VM_MOV},
+  {OP_NEG,   VM_NEG},
+  {OP_ADD,   VM_ADD},
+  {OP_MUL,   VM_MUL},
+  {OP_DIV,   VM_DIV},
+  {OP_MAD,   VM_MAD},
+  {OP_SLT,   VM_SLT},
+  {OP_SLE,   VM_SLE},
+  {OP_SGT,   VM_SGT},
+  {OP_SGE,   VM_SGE},
+  {OP_SEQ,   VM_SEQ},
+  {OP_SNE,   VM_SNE},
+  {OP_ABS,   VM_ABS},
+  {OP_ACOS,  VM_ACOS},
+  {OP_ACOSH, VM_ACOSH},
+  {OP_ASIN,  VM_ASIN},
+  {OP_ASINH, VM_ASINH},
+  {OP_ATAN,  VM_ATAN},
+  {OP_ATAN2, VM_ATAN2},
+  {OP_ATANH, VM_ATANH},
+  {OP_CBRT,  VM_CBRT},
+  {OP_CEIL,  VM_CEIL},
+  {OP_COS,   VM_COS},
+  {OP_COSH,  VM_COSH},
+  {OP_EXP,   VM_EXP},
+  {OP_EXP2,  VM_EXP2},
+  {OP_EXP10, VM_EXP10},
+  {OP_FLR,   VM_FLR},
+  {OP_FRAC,  VM_FRAC},
+  {OP_LOG,   VM_LOG},
+  {OP_LOG2,  VM_LOG2},
+  {OP_LOG10, VM_LOG10},
+  {OP_LRP,   VM_LRP},
+  {OP_MAX,   VM_MAX},
+  {OP_MIN,   VM_MIN},
+  {OP_MOD,   VM_MOD},
+  {OP_POW,   VM_POW},
+  {OP_RCP,   VM_RCP},
+  {OP_RND,   VM_RND},
+  {OP_RSQ,   VM_RSQ},
+  {OP_SIN,   VM_SIN},
+  {OP_SINH,  VM_SINH},
+  {OP_SGN,   VM_SGN},
+  {OP_SQRT,  VM_SQRT},
+  {OP_TAN,   VM_TAN},
+  {OP_TANH,  VM_TANH},
+  {OP_COND,  VM_COND},
+
+  {OPERATION_END, VM_OPCODE_END}
+};
+
+typedef std::map<Operation, VmOpcode> OpcodeMap;
+
+/// Parses opMappings.  Used to initialize a function-local static, so
+/// that threads lowering programs at once never fill it together.
+OpcodeMap make_opcode_map()
+{
+  OpcodeMap result;
+  for (int i = 0; opMappings[i].op != OPERATION_END; ++i) {
+    result[opMappings[i].op] = opMappings[i].opcode;
+  }
+  return result;
+}
+
+struct StorageUpToDate : std::binary_function<StoragePtr, MemoryPtr, bool> {
+  bool operator()(const StoragePtr& storage, const MemoryPtr& memory) const {
+    return (storage->timestamp() == memory->timestamp());
+  }
+};
+struct SecondUpToDateStorage : std::binary_function<StoragePtr, MemoryPtr, bool> {
+  SecondUpToDateStorage() : m_second(false) { }
+  bool operator()(const StoragePtr& storage, const MemoryPtr& memory) const {
+    bool result = (m_second && storage->timestamp() == memory->timestamp());
+    m_second = storage->timestamp() == memory->timestamp() ? true : m_second;
+    return result;
+  }
+  mutable bool m_second;
+};
+
+/// The values of a variable, converted to double
+std::vector<double> values(const VariableNodePtr& node)
+{
+  VariantPtr variant = variantFactory(SH_DOUBLE, HOST)->generate(node->size());
+  variant->set(node->getVariant());
+  const double* data = static_cast<const double*>(variant->array());
+  return std::vector<double>(data, data + node->size());
+}
+
+/// Where a stream input or output is in memory
+struct StreamBinding {
+  char* data;    ///< element 0
+  int stride[3]; ///< in bytes, between elements along each dimension
+  bool linear;   ///< one dimensional
+  VmLoad load;
+  VmStore store;
+  std::vector<void*> regs; ///< first register of each component in the batch
+};
+
+/// Points binding at the first element of stream in storage
+void locate(StreamBinding& binding, const BaseTexture& stream, const HostStoragePtr& storage)
+{
+  const TextureNodePtr& node = stream.node();
+  int datasize = typeInfo(node->valueType(), MEM)->datasize() * node->size();
+  int pitch[3] = {datasize, datasize * node->width(), datasize * node->width() * node->height()};
+  int stride[3], offset[3];
+  stream.get_stride(stride, 3);
+  stream.get_offset(offset, 3);
+
+  binding.data = reinterpret_cast<char*>(storage->data());
+  for (int i = 0; i < 3; ++i) {
+    binding.data += offset[i] * pitch[i];
+    binding.stride[i] = stride[i] * pitch[i];
+  }
+  binding.linear = node->height() == 1 && node->depth() == 1;
+}
+
+/// Returns the address of element (x, y, z) of binding
+char* element(const StreamBinding& binding, int x, int y, int z)
+{
+  return binding.data + static_cast<long long>(x) * binding.stride[0]
+    + static_cast<long long>(y) * binding.stride[1]
+    + static_cast<long long>(z) * binding.stride[2];
+}
+
+/// Returns the host storage a FileMemory maps its file to, so that
+/// outputs go straight into the file, or 0 if mem is not a FileMemory
+/// or program reads it too
+HostStoragePtr mapped_storage(const MemoryPtr& mem, const Program& prg,
+                              const ProgramNodePtr& program)
+{
+  FileMemoryPtr file = shref_dynamic_cast<FileMemory>(mem);
+  if (!file) return 0;
+  for (Stream::const_iterator I = prg.stream_inputs.begin(); I != prg.stream_inputs.end(); ++I) {
+    if (I->node()->memory(0) == mem) return 0;
+  }
+  for (ProgramNode::TexList::const_iterator I = program->begin_textures();
+       I != program->end_textures(); ++I) {
+    if ((*I)->memory(0) == mem) return 0;
+  }
+  return file->hostStorage();
+}
+
+/// Allocates host storage for a stream that has none
+HostStoragePtr allocate(const BaseTexture& stream)
+{
+  const TextureNodePtr& node = stream.node();
+  int datasize = typeInfo(node->valueType(), MEM)->datasize();
+  return new HostStorage(node->memory(0).object(),
+                         datasize * node->size() * node->width() * node->height() * node->depth(),
+                         node->valueType());
+}
+
+}
+
+VmBackendCode::VmBackendCode(const ProgramNodeCPtr& program)
+  : m_original_program(program),
+    m_program(0),
+    m_entry(0),
+    m_variable_registers(0),
+    m_scratch_used(0),
+    m_scratch_registers(0),
+    m_writes_uniforms(false),
+    m_generated(false)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+VmBackendCode::~VmBackendCode(void)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+bool VmBackendCode::allocateRegister(const VariableNodePtr& var)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+  return false;
+}
+
+void VmBackendCode::freeRegister(const VariableNodePtr& var)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+void VmBackendCode::upload(void)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+void VmBackendCode::bind(void)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+void VmBackendCode::unbind(void)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+void VmBackendCode::update(void)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+void VmBackendCode::updateUniform(const VariableNodePtr& uniform)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+std::ostream& VmBackendCode::print(std::ostream& out)
+{
+  out << m_instructions.size() << " instructions in " << m_blocks.size()
+      << " blocks, " << m_variable_registers + m_scratch_registers
+      << " registers" << std::endl;
+  return out;
+}
+
+std::ostream& VmBackendCode::describe_interface(std::ostream& out)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+  return out;
+}
+
+std::ostream& VmBackendCode::describe_bindings(std::ostream& out)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+  return out;
+}
+
+VmBackendCode::Registers VmBackendCode::registers(const VariableNodePtr& node)
+{
+  std::map<VariableNodePtr, Registers>::const_iterator I = m_registers.find(node);
+  if (I != m_registers.end()) return I->second;
+
+  if (!isRegularValueType(node->valueType())) {
+    error(BackendException("vm backend does not support "
+                           + std::string(valueTypeName(node->valueType())) + " variables"));
+  }
+
+  Registers regs;
+  regs.doubles = node->valueType() == SH_DOUBLE;
+  regs.base = m_variable_registers;
+  regs.size = node->size();
+  m_variable_registers += node->size();
+  m_registers[node] = regs;
+
+  if (node->uniform()) {
+    Binding binding;
+    binding.node = node;
+    binding.regs = regs;
+    m_uniforms.push_back(binding);
+  } else if (node->hasValues()) {
+    std::vector<double> data = values(node);
+    for (int i = 0; i < node->size(); ++i) {
+      Fill fill;
+      fill.doubles = regs.doubles;
+      fill.reg = regs.base + i;
+      fill.value = data[i];
+      m_fills.push_back(fill);
+    }
+  }
+  return regs;
+}
+
+int VmBackendCode::scratch(bool doubles)
+{
+  int reg = ScratchBase + m_scratch_used++;
+  m_scratch_registers = std::max(m_scratch_registers, m_scratch_used);
+  return reg;
+}
+
+int VmBackendCode::constant(double value, bool doubles)
+{
+  Fill fill;
+  fill.doubles = doubles;
+  fill.reg = m_variable_registers++;
+  fill.value = value;
+  m_fills.push_back(fill);
+  return fill.reg;
+}
+
+int VmBackendCode::operand(const Variable& v, int i, bool doubles)
+{
+  Registers regs = registers(v.node());
+  int reg = regs.base + v.swizzle()[i];
+  if (regs.doubles != doubles) {
+    int converted = scratch(doubles);
+    emit(VM_CVT, doubles, converted, reg);
+    reg = converted;
+  }
+  if (v.neg()) {
+    int negated = scratch(doubles);
+    emit(VM_NEG, doubles, negated, reg);
+    reg = negated;
+  }
+  return reg;
+}
+
+void VmBackendCode::emit(VmOpcode op, bool doubles, int dest, int a, int b, int c)
+{
+  VmInstruction inst;
+  inst.handler = vm_handler(op, doubles);
+  inst.dest = dest;
+  inst.src[0] = a;
+  inst.src[1] = b;
+  inst.src[2] = c;
+  m_instructions.push_back(inst);
+}
+
+void VmBackendCode::lower(const Statement& stmt)
+{
+  static const OpcodeMap opcodes = make_opcode_map();
+
+  m_scratch_used = 0;
+  if (stmt.dest.null()) return;
+  if (stmt.dest.node()->uniform()) m_writes_uniforms = true;
+
+  Registers dest = registers(stmt.dest.node());
+  bool doubles = dest.doubles;
+  int size = stmt.dest.size();
+
+  // When the destination is also a source, the results are only moved
+  // to it once every source component has been read
+  bool aliased = false;
+  for (int i = 0; i < opInfo[stmt.op].arity; ++i) {
+    if (stmt.src[i].node() == stmt.dest.node()) aliased = true;
+  }
+  std::vector<int> results(size);
+  for (int i = 0; i < size; ++i) {
+    results[i] = aliased ? scratch(doubles) : dest.base + stmt.dest.swizzle()[i];
+  }
+
+  OpcodeMap::const_iterator I = opcodes.find(stmt.op);
+  if (I != opcodes.end()) {
+    int arity = opInfo[stmt.op].arity;
+    for (int i = 0; i < size; ++i) {
+      int src[3] = {0, 0, 0};
+      for (int j = 0; j < arity; ++j) {
+        const Variable& v = stmt.src[j];
+        src[j] = operand(v, v.size() == 1 ? 0 : i, doubles);
+      }
+      emit(I->second, doubles, results[i], src[0], src[1], src[2]);
+    }
+  } else {
+    switch (stmt.op) {
+    case OP_DOT:
+      {
+        int n = std::max(stmt.src[0].size(), stmt.src[1].size());
+        for (int k = 0; k < n; ++k) {
+          int a = operand(stmt.src[0], stmt.src[0].size() == 1 ? 0 : k, doubles);
+          int b = operand(stmt.src[1], stmt.src[1].size() == 1 ? 0 : k, doubles);
+          if (k == 0) {
+            emit(VM_MUL, doubles, results[0], a, b);
+          } else {
+            emit(VM_MAD, doubles, results[0], a, b, results[0]);
+          }
+        }
+        break;
+      }
+
+    case OP_CSUM:
+    case OP_CMUL:
+      {
+        VmOpcode op = stmt.op == OP_CSUM ? VM_ADD : VM_MUL;
+        emit(VM_MOV, doubles, results[0], operand(stmt.src[0], 0, doubles));
+        for (int k = 1; k < stmt.src[0].size(); ++k) {
+          emit(op, doubles, results[0], results[0], operand(stmt.src[0], k, doubles));
+        }
+        break;
+      }
+
+    case OP_NORM:
+      {
+        std::vector<int> src(size);
+        int scale = scratch(doubles);
+        for (int k = 0; k < size; ++k) {
+          src[k] = operand(stmt.src[0], k, doubles);
+          if (k == 0) {
+            emit(VM_MUL, doubles, scale, src[k], src[k]);
+          } else {
+            emit(VM_MAD, doubles, scale, src[k], src[k], scale);
+          }
+        }
+        emit(VM_RSQ, doubles, scale, scale);
+        for (int k = 0; k < size; ++k) {
+          emit(VM_MUL, doubles, results[k], src[k], scale);
+        }
+        break;
+      }
+
+    case OP_XPD:
+      {
+        int product = scratch(doubles);
+        for (int i = 0; i < size; ++i) {
+          int i0 = (i + 1) % 3;
+          int i1 = (i + 2) % 3;
+          emit(VM_MUL, doubles, product, operand(stmt.src[1], i0, doubles),
+               operand(stmt.src[0], i1, doubles));
+          emit(VM_MUL, doubles, results[i], operand(stmt.src[0], i0, doubles),
+               operand(stmt.src[1], i1, doubles));
+          emit(VM_SUB, doubles, results[i], results[i], product);
+        }
+        break;
+      }
+
+    case OP_LIT:
+      {
+        // Clamps like the cc backend, then follows the OpenGL spec.  The
+        // power is selected rather than multiplied since it may overflow.
+        int zero = constant(0, doubles);
+        int one = constant(1, doubles);
+        int x = scratch(doubles);
+        int y = scratch(doubles);
+        int e = scratch(doubles);
+        emit(VM_MAX, doubles, x, operand(stmt.src[0], 0, doubles), zero);
+        emit(VM_MAX, doubles, y, operand(stmt.src[0], 1, doubles), zero);
+        emit(VM_MAX, doubles, e, operand(stmt.src[0], 2, doubles), constant(-128, doubles));
+        emit(VM_MIN, doubles, e, e, constant(128, doubles));
+        for (int i = 0; i < size; ++i) {
+          switch (i) {
+          case 1:
+            emit(VM_MOV, doubles, results[i], x);
+            break;
+          case 2:
+            emit(VM_POW, doubles, y, y, e);
+            emit(VM_COND, doubles, results[i], x, y, zero);
+            break;
+          default:
+            emit(VM_MOV, doubles, results[i], one);
+            break;
+          }
+        }
+        break;
+      }
+
+    case OP_TEX:
+    case OP_TEXI:
+      {
+        lower_texture(stmt, results, doubles);
+        break;
+      }
+
+    default:
+      error(BackendException("vm backend does not support "
+                             + std::string(opInfo[stmt.op].name) + " statements"));
+      return;
+    }
+  }
+
+  if (aliased) {
+    for (int i = 0; i < size; ++i) {
+      emit(VM_MOV, doubles, dest.base + stmt.dest.swizzle()[i], results[i]);
+    }
+  }
+}
+
+void VmBackendCode::lower_texture(const Statement& stmt, const std::vector<int>& results,
+                                  bool doubles)
+{
+  TextureNodePtr node = shref_dynamic_cast<TextureNode>(stmt.src[0].node());
+
+  VmLookup lookup;
+  lookup.texture = std::distance(m_program->begin_textures(),
+                                 std::find(m_program->begin_textures(),
+                                           m_program->end_textures(), node));
+  lookup.size = node->size();
+  lookup.indexed = stmt.op == OP_TEXI;
+  lookup.fetch = vm_fetch(node->valueType());
+
+  switch (node->dims()) {
+  case SH_TEXTURE_1D:   lookup.dims = 1; break;
+  case SH_TEXTURE_2D:
+  case SH_TEXTURE_RECT: lookup.dims = 2; break;
+  case SH_TEXTURE_3D:   lookup.dims = 3; break;
+  default:
+    error(BackendException("vm backend does not support cube maps"));
+    return;
+  }
+
+  switch (node->traits().wrapping()) {
+  case TextureTraits::WRAP_CLAMP:
+  case TextureTraits::WRAP_CLAMP_TO_EDGE:
+    lookup.repeat = false;
+    break;
+  case TextureTraits::WRAP_REPEAT:
+    lookup.repeat = true;
+    break;
+  default:
+    error(BackendException("vm backend does not support requested texture wrapping mode."));
+    return;
+  }
+
+  if (!lookup.fetch) {
+    error(BackendException("vm backend does not support "
+                           + std::string(valueTypeName(node->valueType())) + " textures"));
+  }
+
+  for (int j = 0; j < lookup.dims; ++j) {
+    lookup.src[j] = operand(stmt.src[1], j, doubles);
+  }
+  for (int j = 0; j < lookup.size; ++j) {
+    lookup.dest[j] = scratch(doubles);
+  }
+
+  emit(VM_TEX, doubles, m_lookups.size());
+  m_lookups.push_back(lookup);
+
+  for (int i = 0; i < stmt.dest.size() && i < lookup.size; ++i) {
+    emit(VM_MOV, doubles, results[i], lookup.dest[i]);
+  }
+}
+
+void VmBackendCode::lower(CtrlGraphNode* node)
+{
+  m_block_numbers[node] = m_blocks.size();
+
+  Block block;
+  block.begin = m_instructions.size();
+  block.follower = -1;
+  block.follower_node = 0;
+
+  if (node->block) {
+    for (BasicBlock::StmtList::const_iterator I = node->block->begin();
+         I != node->block->end(); ++I) {
+      if (I->op != OP_KIL) {
+        lower(*I);
+        continue;
+      }
+
+      // Elements that are killed stop here, the others go on in a block
+      // of their own
+      m_scratch_used = 0;
+      Branch kill;
+      kill.target = -1;
+      kill.node = 0;
+      kill.doubles = registers(I->src[0].node()).doubles;
+      for (int i = 0; i < I->src[0].size(); ++i) {
+        kill.conds.push_back(operand(I->src[0], i, kill.doubles));
+      }
+      block.end = m_instructions.size();
+      block.branches.push_back(kill);
+      block.follower = m_blocks.size() + 1;
+      m_blocks.push_back(block);
+
+      block = Block();
+      block.begin = m_instructions.size();
+      block.follower = -1;
+      block.follower_node = 0;
+    }
+  }
+
+  m_scratch_used = 0;
+  for (CtrlGraphNode::SuccessorIt I = node->successors_begin();
+       I != node->successors_end(); ++I) {
+    Branch branch;
+    branch.target = -1;
+    branch.node = I->node;
+    branch.doubles = registers(I->cond.node()).doubles;
+    for (int i = 0; i < I->cond.size(); ++i) {
+      branch.conds.push_back(operand(I->cond, i, branch.doubles));
+    }
+    block.branches.push_back(branch);
+  }
+  block.follower_node = node->follower();
+  block.end = m_instructions.size();
+  m_blocks.push_back(block);
+}
+
+namespace {
+
+struct LowerFunctor {
+  LowerFunctor(std::vector<CtrlGraphNode*>& nodes) : nodes(nodes) { }
+
+  void operator()(CtrlGraphNode* node)
+  {
+    nodes.push_back(node);
+  }
+
+  std::vector<CtrlGraphNode*>& nodes;
+};
+
+}
+
+bool VmBackendCode::generate(void)
+{
+  // Transform the code to remove types this backend cannot handle
+  m_program = m_original_program->clone();
+  Context::current()->enter(m_program);
+  Transformer transform(m_program);
+
+  transform.convertInputOutput();
+  transform.stripDummyOps();
+  if(transform.changed()) {
+    optimize(m_program);
+  } else {
+    m_program = shref_const_cast<ProgramNode>(m_original_program);
+  }
+  Context::current()->exit();
+
+  // Inputs and outputs first, so that their bindings follow the order
+  // of the program's lists
+  for (ProgramNode::VarList::const_iterator I = m_program->begin_inputs();
+       I != m_program->end_inputs(); ++I) {
+    Binding binding;
+    binding.node = *I;
+    binding.regs = registers(*I);
+    m_inputs.push_back(binding);
+  }
+  for (ProgramNode::VarList::const_iterator I = m_program->begin_outputs();
+       I != m_program->end_outputs(); ++I) {
+    Binding binding;
+    binding.node = *I;
+    binding.regs = registers(*I);
+    m_outputs.push_back(binding);
+  }
+
+  std::vector<CtrlGraphNode*> nodes;
+  LowerFunctor f(nodes);
+  m_program->ctrlGraph->dfs(f);
+  for (std::vector<CtrlGraphNode*>::const_iterator I = nodes.begin(); I != nodes.end(); ++I) {
+    lower(*I);
+  }
+  m_entry = m_block_numbers[m_program->ctrlGraph->entry()];
+
+  // Resolve the branches, and move the scratch registers down to right
+  // after the others
+  for (std::vector<Block>::iterator I = m_blocks.begin(); I != m_blocks.end(); ++I) {
+    if (I->follower_node) I->follower = m_block_numbers[I->follower_node];
+    for (std::vector<Branch>::iterator J = I->branches.begin(); J != I->branches.end(); ++J) {
+      if (J->node) J->target = m_block_numbers[J->node];
+      for (std::vector<int>::iterator K = J->conds.begin(); K != J->conds.end(); ++K) {
+        if (*K >= ScratchBase) *K += m_variable_registers - ScratchBase;
+      }
+    }
+  }
+  VmHandler float_lookup = vm_handler(VM_TEX, false);
+  VmHandler double_lookup = vm_handler(VM_TEX, true);
+  for (std::vector<VmInstruction>::iterator I = m_instructions.begin();
+       I != m_instructions.end(); ++I) {
+    bool lookup = I->handler == float_lookup || I->handler == double_lookup;
+    if (!lookup && I->dest >= ScratchBase) I->dest += m_variable_registers - ScratchBase;
+    for (int j = 0; j < 3; ++j) {
+      if (I->src[j] >= ScratchBase) I->src[j] += m_variable_registers - ScratchBase;
+    }
+  }
+  for (std::vector<VmLookup>::iterator I = m_lookups.begin(); I != m_lookups.end(); ++I) {
+    for (int j = 0; j < 3; ++j) {
+      if (I->src[j] >= ScratchBase) I->src[j] += m_variable_registers - ScratchBase;
+    }
+    for (int j = 0; j < 4; ++j) {
+      if (I->dest[j] >= ScratchBase) I->dest[j] += m_variable_registers - ScratchBase;
+    }
+  }
+
+  int total = m_variable_registers + m_scratch_registers;
+  m_floats.assign(total * VmBatchSize, 0.0f);
+  bool doubles = false;
+  for (std::map<VariableNodePtr, Registers>::const_iterator I = m_registers.begin();
+       I != m_registers.end(); ++I) {
+    if (I->second.doubles) doubles = true;
+  }
+  if (doubles) m_doubles.assign(total * VmBatchSize, 0.0);
+
+  VmFrame constants;
+  constants.floats = m_floats.empty() ? 0 : &m_floats[0];
+  constants.doubles = m_doubles.empty() ? 0 : &m_doubles[0];
+  for (std::vector<Fill>::const_iterator I = m_fills.begin(); I != m_fills.end(); ++I) {
+    fill(constants, *I);
+  }
+
+  SH_VM_DEBUG_PRINT("Lowered " << m_program->name() << " to " << m_instructions.size()
+                    << " instructions using " << total << " registers");
+  m_generated = true;
+  return true;
+}
+
+void VmBackendCode::fill(const VmFrame& frame, const Fill& fill)
+{
+  if (fill.doubles) {
+    std::fill(frame.doubles + fill.reg * VmBatchSize,
+              frame.doubles + (fill.reg + 1) * VmBatchSize, fill.value);
+  } else {
+    std::fill(frame.floats + fill.reg * VmBatchSize,
+              frame.floats + (fill.reg + 1) * VmBatchSize, static_cast<float>(fill.value));
+  }
+}
+
+void VmBackendCode::fill(const VmFrame& frame, const Binding& binding, const VariableNodePtr& node)
+{
+  std::vector<double> data = values(node);
+  for (int i = 0; i < binding.regs.size; ++i) {
+    Fill value;
+    value.doubles = binding.regs.doubles;
+    value.reg = binding.regs.base + i;
+    value.value = data[i];
+    fill(frame, value);
+  }
+}
+
+bool VmBackendCode::taken(const Branch& branch, const VmFrame& frame, int lane) const
+{
+  for (std::vector<int>::const_iterator I = branch.conds.begin(); I != branch.conds.end(); ++I) {
+    if (branch.doubles) {
+      if (frame.doubles[*I * VmBatchSize + lane] > 0) return true;
+    } else {
+      if (frame.floats[*I * VmBatchSize + lane] > 0) return true;
+    }
+  }
+  return false;
+}
+
+void VmBackendCode::run(const VmFrame& frame, int count,
+                        std::vector<std::vector<int> >& waiting)
+{
+  // Every element waits at the block it runs next.  The lowest numbered
+  // block with waiting elements runs first, so that elements which went
+  // separate ways are gathered again where the branches join.
+  std::vector<int> lanes;
+  for (int i = 0; i < count; ++i) lanes.push_back(i);
+  waiting[m_entry].swap(lanes);
+  int next = m_entry;
+
+  while (next < static_cast<int>(m_blocks.size())) {
+    const Block& block = m_blocks[next];
+    lanes.clear();
+    lanes.swap(waiting[next]);
+
+    // All the elements are here, the handlers can run on the whole batch
+    const int* active = static_cast<int>(lanes.size()) == count ? 0 : &lanes[0];
+    int active_count = lanes.size();
+    for (int i = block.begin; i < block.end; ++i) {
+      const VmInstruction& inst = m_instructions[i];
+      inst.handler(inst, frame, active, active_count);
+    }
+
+    if (block.branches.empty()) {
+      if (block.follower >= 0) {
+        std::vector<int>& follower = waiting[block.follower];
+        follower.insert(follower.end(), lanes.begin(), lanes.end());
+      }
+    } else {
+      for (std::vector<int>::const_iterator I = lanes.begin(); I != lanes.end(); ++I) {
+        int target = block.follower;
+        for (std::vector<Branch>::const_iterator J = block.branches.begin();
+             J != block.branches.end(); ++J) {
+          if (taken(*J, frame, *I)) {
+            target = J->target;
+            break;
+          }
+        }
+        if (target >= 0) waiting[target].push_back(*I);
+      }
+    }
+
+    next = 0;
+    while (next < static_cast<int>(m_blocks.size()) && waiting[next].empty()) ++next;
+  }
+}
+
+bool VmBackendCode::execute(const Program& prg, Stream& dest)
+{
+  if (!m_generated && !generate()) {
+    SH_VM_DEBUG_PRINT("failed to generate program...");
+    return false;
+  }
+
+  std::vector<float> floats(m_floats);
+  std::vector<double> doubles(m_doubles);
+  std::vector<std::vector<int> > waiting(m_blocks.size());
+  VmFrame frame;
+  frame.floats = floats.empty() ? 0 : &floats[0];
+  frame.doubles = doubles.empty() ? 0 : &doubles[0];
+
+  // Uniform inputs are the same for every element, so their registers
+  // are filled once like the uniforms
+  std::vector<StreamBinding> inputs;
+  Program::BindingSpec::const_iterator I = prg.binding_spec.begin();
+  Stream::const_iterator stream = prg.stream_inputs.begin();
+  Record::const_iterator uniform = prg.uniform_inputs.begin();
+  for (int iidx = 0; I != prg.binding_spec.end(); ++I, ++iidx) {
+    const Binding& binding = m_inputs[iidx];
+    if (*I != Program::STREAM) {
+      fill(frame, binding, uniform->node());
+      ++uniform;
+      continue;
+    }
+
+    MemoryPtr mem = stream->node()->memory(0);
+    StoragePtr s = mem->findStorage(HostStorageId, std::bind2nd(StorageUpToDate(), mem));
+    HostStoragePtr storage = shref_dynamic_cast<HostStorage>(s);
+
+    if (!storage) {
+      // We should probably complain here
+      storage = allocate(*stream);
+    }
+
+    StreamBinding input;
+    locate(input, *stream, storage);
+    input.load = vm_load(stream->node()->valueType(), binding.regs.doubles);
+    input.store = 0;
+    for (int i = 0; i < binding.regs.size; ++i) {
+      int reg = (binding.regs.base + i) * VmBatchSize;
+      input.regs.push_back(binding.regs.doubles ? (void*)(frame.doubles + reg) : (void*)(frame.floats + reg));
+    }
+    if (!input.load) {
+      SH_DEBUG_WARN("vm backend cannot read " << valueTypeName(stream->node()->valueType()) << " streams");
+      return false;
+    }
+    inputs.push_back(input);
+    ++stream;
+  }
+
+  for (std::vector<Binding>::const_iterator J = m_uniforms.begin(); J != m_uniforms.end(); ++J) {
+    fill(frame, *J, J->node);
+  }
+
+  std::vector<VmTexture> textures;
+  for (ProgramNode::TexList::const_iterator J = m_program->begin_textures();
+       J != m_program->end_textures(); ++J) {
+    TextureNodePtr texture = *J;
+    HostStoragePtr storage = shref_dynamic_cast<HostStorage>(texture->memory(0)->findStorage(HostStorageId));
+
+    VmTexture descriptor;
+    descriptor.data = storage->data();
+    descriptor.width = texture->width();
+    descriptor.height = texture->height();
+    descriptor.depth = texture->depth();
+    textures.push_back(descriptor);
+  }
+  frame.textures = textures.empty() ? 0 : &textures[0];
+  frame.lookups = m_lookups.empty() ? 0 : &m_lookups[0];
+
+  std::vector<StreamBinding> outputs;
+  int dest_count[3] = {0, 0, 0};
+  int oidx = 0;
+  for (Stream::NodeList::iterator J = dest.begin(); J != dest.end(); ++J, ++oidx) {
+    MemoryPtr mem = J->node()->memory(0);
+    StoragePtr s = mem->findStorage(HostStorageId, std::not1(std::bind2nd(StorageUpToDate(), mem)));
+    if (!s) {
+      s = mem->findStorage(HostStorageId, std::bind2nd(SecondUpToDateStorage(), mem));
+    }
+    if (!s) s = mapped_storage(mem, prg, m_program);
+    HostStoragePtr storage = shref_dynamic_cast<HostStorage>(s);
+
+    if (!storage) {
+      SH_VM_DEBUG_PRINT("  Allocating new storage");
+      storage = allocate(*J);
+    }
+    // Only the elements of the stream are written
+    std::size_t written_offset, written_length;
+    J->get_byte_range(written_offset, written_length);
+    storage->dirty(written_offset, written_length);
+
+    const Binding& binding = m_outputs[oidx];
+    StreamBinding output;
+    locate(output, *J, storage);
+    output.load = 0;
+    output.store = vm_store(J->node()->valueType(), binding.regs.doubles);
+    for (int i = 0; i < binding.regs.size; ++i) {
+      int reg = (binding.regs.base + i) * VmBatchSize;
+      output.regs.push_back(binding.regs.doubles ? (void*)(frame.doubles + reg) : (void*)(frame.floats + reg));
+    }
+    if (!output.store) {
+      SH_DEBUG_WARN("vm backend cannot write " << valueTypeName(J->node()->valueType()) << " streams");
+      return false;
+    }
+    outputs.push_back(output);
+
+    int count[3];
+    J->get_count(count, 3);
+    if (dest_count[0] == 0) {
+      std::copy(count, count + 3, dest_count);
+    } else if (!std::equal(count, count + 3, dest_count)) {
+      SH_VM_DEBUG_PRINT("channel count discrepancy...");
+      return false;
+    }
+  }
+
+  // One dimensional inputs are read in order when the outputs have more
+  // dimensions
+  for (std::vector<StreamBinding>::iterator J = inputs.begin(); J != inputs.end(); ++J) {
+    if (!J->linear) continue;
+    J->stride[1] = J->stride[0] * dest_count[0];
+    J->stride[2] = J->stride[1] * dest_count[1];
+  }
+
+  // Elements are run a row at a time.  Uniforms written by one element
+  // are read by the next.
+  int batch_size = m_writes_uniforms ? 1 : VmBatchSize;
+  for (int z = 0; z < dest_count[2]; ++z) {
+    for (int y = 0; y < dest_count[1]; ++y) {
+      for (int begin = 0; begin < dest_count[0]; begin += batch_size) {
+        int count = std::min(batch_size, dest_count[0] - begin);
+
+        for (std::vector<StreamBinding>::const_iterator J = inputs.begin(); J != inputs.end(); ++J) {
+          J->load(element(*J, begin, y, z), J->stride[0],
+                  J->regs.size(), const_cast<void**>(&J->regs[0]), count);
+        }
+        // Outputs start out as zero, like in the cc backend
+        for (std::vector<Binding>::const_iterator J = m_outputs.begin(); J != m_outputs.end(); ++J) {
+          for (int i = 0; i < J->regs.size; ++i) {
+            int reg = (J->regs.base + i) * VmBatchSize;
+            if (J->regs.doubles) {
+              std::fill(frame.doubles + reg, frame.doubles + reg + count, 0.0);
+            } else {
+              std::fill(frame.floats + reg, frame.floats + reg + count, 0.0f);
+            }
+          }
+        }
+
+        run(frame, count, waiting);
+
+        for (std::vector<StreamBinding>::const_iterator J = outputs.begin(); J != outputs.end(); ++J) {
+          J->store(element(*J, begin, y, z), J->stride[0], J->regs.size(), &J->regs[0], count);
+        }
+      }
+    }
+  }
+
+  if (m_writes_uniforms) {
+    for (std::vector<Binding>::const_iterator J = m_uniforms.begin(); J != m_uniforms.end(); ++J) {
+      VariantPtr variant = variantFactory(SH_DOUBLE, HOST)->generate(J->regs.size);
+      double* data = static_cast<double*>(variant->array());
+      for (int i = 0; i < J->regs.size; ++i) {
+        int reg = (J->regs.base + i) * VmBatchSize;
+        data[i] = J->regs.doubles ? frame.doubles[reg] : frame.floats[reg];
+      }
+      J->node->getVariant()->set(variant);
+    }
+  }
+
+  return true;
+}
+
+
+VmBackend::VmBackend(void)
+  : Backend("vm", "1.0")
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+VmBackend::~VmBackend(void)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+}
+
+BackendCodePtr VmBackend::generate_code(const std::string& target,
+                                        const ProgramNodeCPtr& program)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+  VmBackendCodePtr backendcode = new VmBackendCode(program);
+  backendcode->generate();
+  return backendcode;
+}
+
+void VmBackend::execute(const Program& program, Stream& dest)
+{
+  SH_VM_DEBUG_PRINT(__FUNCTION__);
+
+  ProgramNodePtr prg = shref_const_cast<ProgramNode>(program.node());
+  Pointer<Backend> b(this);
+
+  VmBackendCodePtr backendcode = shref_dynamic_cast<VmBackendCode>(prg->code(b));
+  backendcode->execute(program, dest);
+}
+
+}
+
+
+extern "C" {
+  using namespace Vm;
+
+#ifdef _WIN32
+  __declspec(dllexport)
+#endif
+  VmBackend* backend_libshvm_instantiate()
+  {
+    return new VmBackend();
+  }
+
+  // Behind the cc backend, which generates faster code when there is a
+  // compiler to build it
+#ifdef _WIN32
+  __declspec(dllexport)
+#endif
+  int backend_libshvm_target_cost(const std::string& target)
+  {
+    if ("vm:stream" == target)  return 1;
+    if ("cpu:stream" == target) return 6;
+    if ("*:stream" == target)   return 11;
+    if ("stream" == target)     return 11;
+    return 0;
+  }
+}
@@ -0,0 +1,190 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHVM_HPP
+#define SHVM_HPP
+
+#include <map>
+#include <vector>
+
+#include "Backend.hpp"
+#include "VmOps.hpp"
+
+// #define SH_VM_DEBUG 1
+
+namespace Vm {
+
+/** Stream program lowered to the bytecode of VmOps.hpp.
+ *
+ * Lowering is a single pass over the optimized control graph, so
+ * programs run right away without waiting for a compiler.  The stream
+ * is then run through the bytecode VmBatchSize elements at a time.
+ */
+class VmBackendCode: public SH::BackendCode
+{
+public:
+  VmBackendCode(const SH::ProgramNodeCPtr& program);
+  ~VmBackendCode(void);
+
+  bool allocateRegister(const SH::VariableNodePtr& var);
+  void freeRegister(const SH::VariableNodePtr& var);
+
+  void upload(void);
+  void bind(void);
+  void unbind(void);
+  void update(void);
+
+  void updateUniform(const SH::VariableNodePtr& uniform);
+
+  std::ostream& print(std::ostream& out);
+  std::ostream& describe_interface(std::ostream& out);
+  std::ostream& describe_bindings(std::ostream& out);
+
+protected:
+  friend class VmBackend;
+  bool generate(void);
+  bool execute(const SH::Program& prg, SH::Stream& dest);
+
+private:
+  /// The registers holding the components of a variable
+  struct Registers {
+    bool doubles; ///< in the double register file rather than the float one
+    int base;     ///< component i is in register base + i
+    int size;
+  };
+
+  /// A successor of a block, taken by the elements for which any of the
+  /// components of the condition is positive
+  struct Branch {
+    int target; ///< block number, or -1 to stop
+    SH::CtrlGraphNode* node; ///< target until the blocks are all numbered
+    bool doubles;
+    std::vector<int> conds;
+  };
+
+  /// A run of instructions ending in branches.  Blocks are numbered in
+  /// the depth first order of the control graph, and KIL statements
+  /// split the block they are in.
+  struct Block {
+    int begin, end; ///< range of m_instructions
+    std::vector<Branch> branches;
+    int follower;   ///< block number, or -1 to stop
+    SH::CtrlGraphNode* follower_node;
+  };
+
+  /// A register filled with the same value for every element, for
+  /// constants and uniforms
+  struct Fill {
+    bool doubles;
+    int reg;
+    double value;
+  };
+
+  /// Where a program input or output comes from or goes to
+  struct Binding {
+    SH::VariableNodePtr node;
+    Registers regs;
+  };
+
+  void lower(SH::CtrlGraphNode* node);
+  void lower(const SH::Statement& stmt);
+  void lower_texture(const SH::Statement& stmt, const std::vector<int>& results,
+                     bool doubles);
+
+  /// Returns the registers of a variable, allocating them on first use
+  Registers registers(const SH::VariableNodePtr& node);
+  /// Returns a new register that is only used within one statement
+  int scratch(bool doubles);
+  /// Returns a register holding value
+  int constant(double value, bool doubles);
+  /// Returns the register holding component i of v in the given
+  /// register file, converting and negating it into a scratch register
+  /// if needed
+  int operand(const SH::Variable& v, int i, bool doubles);
+
+  void emit(VmOpcode op, bool doubles, int dest, int a = 0, int b = 0, int c = 0);
+
+  /// Fills registers of frame with the same value for every element
+  /// @{
+  void fill(const VmFrame& frame, const Fill& fill);
+  void fill(const VmFrame& frame, const Binding& binding, const SH::VariableNodePtr& node);
+  // @}
+
+  /// Runs count elements of the current batch from the entry block.
+  /// waiting holds the elements waiting to run each block.
+  void run(const VmFrame& frame, int count, std::vector<std::vector<int> >& waiting);
+  /// Whether any condition register of branch is positive in lane
+  bool taken(const Branch& branch, const VmFrame& frame, int lane) const;
+
+  SH::ProgramNodeCPtr m_original_program;
+  SH::ProgramNodePtr m_program;
+
+  std::map<SH::VariableNodePtr, Registers> m_registers;
+  std::map<SH::CtrlGraphNode*, int> m_block_numbers;
+
+  std::vector<VmInstruction> m_instructions;
+  std::vector<Block> m_blocks;
+  std::vector<VmLookup> m_lookups;
+  std::vector<Fill> m_fills;
+  std::vector<Binding> m_inputs;
+  std::vector<Binding> m_outputs;
+  std::vector<Binding> m_uniforms;
+  int m_entry; ///< block number of the control graph's entry
+
+  /// Register files of a batch with the constants filled in.  Each
+  /// execution runs on its own copy, so that several threads can run
+  /// the same code.
+  /// @{
+  std::vector<float> m_floats;
+  std::vector<double> m_doubles;
+  // @}
+
+  /// Float and double registers are numbered together, so the register
+  /// files have as many registers each.  Variables and constants come
+  /// first, followed by the scratch registers, which are numbered from
+  /// ScratchBase while the program is lowered and moved down once the
+  /// other registers are all known.
+  int m_variable_registers;
+  int m_scratch_used;      ///< by the statement being lowered
+  int m_scratch_registers; ///< largest m_scratch_used
+
+  /// Whether the program assigns to a uniform, in which case the
+  /// elements are run one at a time
+  bool m_writes_uniforms;
+  bool m_generated;
+};
+
+class VmBackend: public SH::Backend
+{
+public:
+  VmBackend(void);
+  ~VmBackend(void);
+
+  SH::BackendCodePtr generate_code(const std::string& target,
+				     const SH::ProgramNodeCPtr& program);
+
+  void execute(const SH::Program& program, SH::Stream& dest);
+};
+
+typedef SH::Pointer<VmBackendCode> VmBackendCodePtr;
+typedef SH::Pointer<VmBackend> VmBackendPtr;
+
+}
+
+#endif
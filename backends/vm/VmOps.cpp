@@ -0,0 +1,387 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <math.h>
+#include "VmOps.hpp"
+#include "Half.hpp"
+#include "Fraction.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+namespace {
+
+using namespace Vm;
+
+template<typename T> T* registers(const VmFrame& frame, int reg);
+
+template<> inline float* registers<float>(const VmFrame& frame, int reg)
+{
+  return frame.floats + reg * VmBatchSize;
+}
+
+template<> inline double* registers<double>(const VmFrame& frame, int reg)
+{
+  return frame.doubles + reg * VmBatchSize;
+}
+
+// The ops, computing a single value of type T.  Functions without a
+// float version in C++98 are computed in double.
+#define VM_UNARY_OP(name, expr) \
+  struct name { template<typename T> static inline T apply(T a) { return (T)(expr); } };
+#define VM_BINARY_OP(name, expr) \
+  struct name { template<typename T> static inline T apply(T a, T b) { return (T)(expr); } };
+#define VM_TERNARY_OP(name, expr) \
+  struct name { template<typename T> static inline T apply(T a, T b, T c) { return (T)(expr); } };
+
+VM_UNARY_OP(Mov, a)
+VM_UNARY_OP(Neg, -a)
+VM_BINARY_OP(Add, a + b)
+VM_BINARY_OP(Sub, a - b)
+VM_BINARY_OP(Mul, a * b)
+VM_BINARY_OP(Div, a / b)
+VM_TERNARY_OP(Mad, a * b + c)
+VM_BINARY_OP(Slt, a < b ? 1 : 0)
+VM_BINARY_OP(Sle, a <= b ? 1 : 0)
+VM_BINARY_OP(Sgt, a > b ? 1 : 0)
+VM_BINARY_OP(Sge, a >= b ? 1 : 0)
+VM_BINARY_OP(Seq, a == b ? 1 : 0)
+VM_BINARY_OP(Sne, a != b ? 1 : 0)
+VM_UNARY_OP(Abs, a < 0 ? -a : a)
+VM_UNARY_OP(Acos, acos((double)a))
+VM_UNARY_OP(Acosh, log(a + sqrt((double)a * a - 1.0)))
+VM_UNARY_OP(Asin, asin((double)a))
+VM_UNARY_OP(Asinh, log(a + sqrt((double)a * a + 1.0)))
+VM_UNARY_OP(Atan, atan((double)a))
+VM_BINARY_OP(Atan2, atan2((double)a, (double)b))
+VM_UNARY_OP(Atanh, log((1.0 + a) / (1.0 - a)) / 2.0)
+VM_UNARY_OP(Cbrt, pow((double)a, 1 / 3.0))
+VM_UNARY_OP(Ceil, ceil((double)a))
+VM_UNARY_OP(Cos, cos((double)a))
+VM_UNARY_OP(Cosh, cosh((double)a))
+VM_UNARY_OP(Exp, exp((double)a))
+VM_UNARY_OP(Exp2, pow(2.0, (double)a))
+VM_UNARY_OP(Exp10, pow(10.0, (double)a))
+VM_UNARY_OP(Flr, floor((double)a))
+VM_UNARY_OP(Frac, a - floor((double)a))
+VM_UNARY_OP(Log, log((double)a))
+VM_UNARY_OP(Log2, log((double)a) / log(2.0))
+VM_UNARY_OP(Log10, log10((double)a))
+VM_TERNARY_OP(Lrp, a * (b - c) + c)
+VM_BINARY_OP(Max, a > b ? a : b)
+VM_BINARY_OP(Min, a < b ? a : b)
+VM_BINARY_OP(Mod, a - b * floor((double)a / b))
+VM_BINARY_OP(Pow, pow((double)a, (double)b))
+VM_UNARY_OP(Rcp, 1 / a)
+VM_UNARY_OP(Rnd, floor(a + 0.5))
+VM_UNARY_OP(Rsq, 1 / sqrt((double)a))
+VM_UNARY_OP(Sin, sin((double)a))
+VM_UNARY_OP(Sinh, sinh((double)a))
+VM_UNARY_OP(Sgn, a < 0 ? -1 : (a > 0 ? 1 : 0))
+VM_UNARY_OP(Sqrt, sqrt((double)a))
+VM_UNARY_OP(Tan, tan((double)a))
+VM_UNARY_OP(Tanh, tanh((double)a))
+VM_TERNARY_OP(Cond, a > 0 ? b : c)
+
+#undef VM_UNARY_OP
+#undef VM_BINARY_OP
+#undef VM_TERNARY_OP
+
+// The loops over the elements are written out once for every op and
+// type, so that the compiler can inline the op and vectorize the dense
+// case.
+
+template<typename T, typename Op>
+void unary(const VmInstruction& inst, const VmFrame& frame, const int* lanes, int count)
+{
+  T* dest = registers<T>(frame, inst.dest);
+  const T* a = registers<T>(frame, inst.src[0]);
+  if (lanes) {
+    for (int i = 0; i < count; ++i) dest[lanes[i]] = Op::apply(a[lanes[i]]);
+  } else {
+    for (int i = 0; i < count; ++i) dest[i] = Op::apply(a[i]);
+  }
+}
+
+template<typename T, typename Op>
+void binary(const VmInstruction& inst, const VmFrame& frame, const int* lanes, int count)
+{
+  T* dest = registers<T>(frame, inst.dest);
+  const T* a = registers<T>(frame, inst.src[0]);
+  const T* b = registers<T>(frame, inst.src[1]);
+  if (lanes) {
+    for (int i = 0; i < count; ++i) {
+      int l = lanes[i];
+      dest[l] = Op::apply(a[l], b[l]);
+    }
+  } else {
+    for (int i = 0; i < count; ++i) dest[i] = Op::apply(a[i], b[i]);
+  }
+}
+
+template<typename T, typename Op>
+void ternary(const VmInstruction& inst, const VmFrame& frame, const int* lanes, int count)
+{
+  T* dest = registers<T>(frame, inst.dest);
+  const T* a = registers<T>(frame, inst.src[0]);
+  const T* b = registers<T>(frame, inst.src[1]);
+  const T* c = registers<T>(frame, inst.src[2]);
+  if (lanes) {
+    for (int i = 0; i < count; ++i) {
+      int l = lanes[i];
+      dest[l] = Op::apply(a[l], b[l], c[l]);
+    }
+  } else {
+    for (int i = 0; i < count; ++i) dest[i] = Op::apply(a[i], b[i], c[i]);
+  }
+}
+
+// Reads a register of the other file
+template<typename T, typename S>
+void convert(const VmInstruction& inst, const VmFrame& frame, const int* lanes, int count)
+{
+  T* dest = registers<T>(frame, inst.dest);
+  const S* a = registers<S>(frame, inst.src[0]);
+  if (lanes) {
+    for (int i = 0; i < count; ++i) dest[lanes[i]] = static_cast<T>(a[lanes[i]]);
+  } else {
+    for (int i = 0; i < count; ++i) dest[i] = static_cast<T>(a[i]);
+  }
+}
+
+inline int wrap(int index, int size, bool repeat)
+{
+  if (repeat) {
+    index %= size;
+    return index < 0 ? index + size : index;
+  }
+  return index >= size ? size - 1 : (index < 0 ? 0 : index);
+}
+
+// Nearest neighbour lookups, like the ones of the cc backend
+template<typename T>
+void lookup(const VmInstruction& inst, const VmFrame& frame, const int* lanes, int count)
+{
+  const VmLookup& lookup = frame.lookups[inst.dest];
+  const VmTexture& tex = frame.textures[lookup.texture];
+  int sizes[3] = {tex.width, tex.height, tex.depth};
+  const T* src[3];
+  T* dest[4];
+  for (int j = 0; j < lookup.dims; ++j) src[j] = registers<T>(frame, lookup.src[j]);
+  for (int j = 0; j < lookup.size; ++j) dest[j] = registers<T>(frame, lookup.dest[j]);
+
+  for (int i = 0; i < count; ++i) {
+    int l = lanes ? lanes[i] : i;
+    int index = 0;
+    for (int j = lookup.dims - 1; j >= 0; --j) {
+      double coord = lookup.indexed ? src[j][l] : src[j][l] * sizes[j];
+      index = index * sizes[j] + wrap(static_cast<int>(floor(coord)), sizes[j], lookup.repeat);
+    }
+    for (int j = 0; j < lookup.size; ++j) {
+      dest[j][l] = static_cast<T>(lookup.fetch(tex.data, index * lookup.size + j));
+    }
+  }
+}
+
+template<typename T>
+struct Handlers {
+  VmHandler table[VM_OPCODE_END];
+
+  Handlers()
+  {
+    table[VM_MOV] = unary<T, Mov>;
+    table[VM_NEG] = unary<T, Neg>;
+    table[VM_CVT] = 0; // see vm_handler()
+    table[VM_ADD] = binary<T, Add>;
+    table[VM_SUB] = binary<T, Sub>;
+    table[VM_MUL] = binary<T, Mul>;
+    table[VM_DIV] = binary<T, Div>;
+    table[VM_MAD] = ternary<T, Mad>;
+    table[VM_SLT] = binary<T, Slt>;
+    table[VM_SLE] = binary<T, Sle>;
+    table[VM_SGT] = binary<T, Sgt>;
+    table[VM_SGE] = binary<T, Sge>;
+    table[VM_SEQ] = binary<T, Seq>;
+    table[VM_SNE] = binary<T, Sne>;
+    table[VM_ABS] = unary<T, Abs>;
+    table[VM_ACOS] = unary<T, Acos>;
+    table[VM_ACOSH] = unary<T, Acosh>;
+    table[VM_ASIN] = unary<T, Asin>;
+    table[VM_ASINH] = unary<T, Asinh>;
+    table[VM_ATAN] = unary<T, Atan>;
+    table[VM_ATAN2] = binary<T, Atan2>;
+    table[VM_ATANH] = unary<T, Atanh>;
+    table[VM_CBRT] = unary<T, Cbrt>;
+    table[VM_CEIL] = unary<T, Ceil>;
+    table[VM_COS] = unary<T, Cos>;
+    table[VM_COSH] = unary<T, Cosh>;
+    table[VM_EXP] = unary<T, Exp>;
+    table[VM_EXP2] = unary<T, Exp2>;
+    table[VM_EXP10] = unary<T, Exp10>;
+    table[VM_FLR] = unary<T, Flr>;
+    table[VM_FRAC] = unary<T, Frac>;
+    table[VM_LOG] = unary<T, Log>;
+    table[VM_LOG2] = unary<T, Log2>;
+    table[VM_LOG10] = unary<T, Log10>;
+    table[VM_LRP] = ternary<T, Lrp>;
+    table[VM_MAX] = binary<T, Max>;
+    table[VM_MIN] = binary<T, Min>;
+    table[VM_MOD] = binary<T, Mod>;
+    table[VM_POW] = binary<T, Pow>;
+    table[VM_RCP] = unary<T, Rcp>;
+    table[VM_RND] = unary<T, Rnd>;
+    table[VM_RSQ] = unary<T, Rsq>;
+    table[VM_SIN] = unary<T, Sin>;
+    table[VM_SINH] = unary<T, Sinh>;
+    table[VM_SGN] = unary<T, Sgn>;
+    table[VM_SQRT] = unary<T, Sqrt>;
+    table[VM_TAN] = unary<T, Tan>;
+    table[VM_TANH] = unary<T, Tanh>;
+    table[VM_COND] = ternary<T, Cond>;
+    table[VM_TEX] = lookup<T>;
+  }
+};
+
+// Memory types convert from and to double, integers go through long
+// long so that they wrap around like the cc backend's
+template<typename M>
+struct MemoryValue {
+  static inline M make(double value) { return M(value); }
+};
+
+#define VM_INTEGER_MEMORY(M) \
+  template<> struct MemoryValue<M> { \
+    static inline M make(double value) { return (M)(long long)value; } \
+  };
+
+VM_INTEGER_MEMORY(char)
+VM_INTEGER_MEMORY(short)
+VM_INTEGER_MEMORY(int)
+VM_INTEGER_MEMORY(unsigned char)
+VM_INTEGER_MEMORY(unsigned short)
+VM_INTEGER_MEMORY(unsigned int)
+
+#undef VM_INTEGER_MEMORY
+
+template<typename M, typename T>
+void load(const char* src, int stride, int size, void** dest, int count)
+{
+  for (int j = 0; j < size; ++j) {
+    T* reg = static_cast<T*>(dest[j]);
+    const char* element = src + j * sizeof(M);
+    for (int i = 0; i < count; ++i, element += stride) {
+      reg[i] = static_cast<T>(static_cast<double>(*reinterpret_cast<const M*>(element)));
+    }
+  }
+}
+
+template<typename M, typename T>
+void store(char* dest, int stride, int size, void* const* src, int count)
+{
+  for (int j = 0; j < size; ++j) {
+    const T* reg = static_cast<const T*>(src[j]);
+    char* element = dest + j * sizeof(M);
+    for (int i = 0; i < count; ++i, element += stride) {
+      *reinterpret_cast<M*>(element) = MemoryValue<M>::make(reg[i]);
+    }
+  }
+}
+
+template<typename M>
+double fetch(const void* data, int index)
+{
+  return static_cast<double>(static_cast<const M*>(data)[index]);
+}
+
+struct Converters {
+  VmLoad load;
+  VmStore store;
+  VmFetch fetch;
+
+  Converters()
+    : load(0), store(0), fetch(0)
+  {
+  }
+
+  template<typename M, typename T>
+  static Converters make()
+  {
+    Converters result;
+    result.load = ::load<M, T>;
+    result.store = ::store<M, T>;
+    result.fetch = ::fetch<M>;
+    return result;
+  }
+};
+
+template<typename T>
+Converters converters(SH::ValueType memType)
+{
+  using namespace SH;
+  switch (memType) {
+  case SH_HALF:    return Converters::make<Half, T>();
+  case SH_FLOAT:   return Converters::make<float, T>();
+  case SH_DOUBLE:  return Converters::make<double, T>();
+  case SH_BYTE:    return Converters::make<char, T>();
+  case SH_SHORT:   return Converters::make<short, T>();
+  case SH_INT:     return Converters::make<int, T>();
+  case SH_UBYTE:   return Converters::make<unsigned char, T>();
+  case SH_USHORT:  return Converters::make<unsigned short, T>();
+  case SH_UINT:    return Converters::make<unsigned int, T>();
+  case SH_FBYTE:   return Converters::make<FracByte, T>();
+  case SH_FSHORT:  return Converters::make<FracShort, T>();
+  case SH_FINT:    return Converters::make<FracInt, T>();
+  case SH_FUBYTE:  return Converters::make<FracUByte, T>();
+  case SH_FUSHORT: return Converters::make<FracUShort, T>();
+  case SH_FUINT:   return Converters::make<FracUInt, T>();
+  default:         return Converters();
+  }
+}
+
+}
+
+namespace Vm {
+
+VmHandler vm_handler(VmOpcode op, bool doubles)
+{
+  static Handlers<float> float_handlers;
+  static Handlers<double> double_handlers;
+
+  if (op == VM_CVT) return doubles ? convert<double, float> : convert<float, double>;
+  if (op < 0 || op >= VM_OPCODE_END) return 0;
+  return doubles ? double_handlers.table[op] : float_handlers.table[op];
+}
+
+VmLoad vm_load(SH::ValueType memType, bool doubles)
+{
+  return doubles ? converters<double>(memType).load : converters<float>(memType).load;
+}
+
+VmStore vm_store(SH::ValueType memType, bool doubles)
+{
+  return doubles ? converters<double>(memType).store : converters<float>(memType).store;
+}
+
+VmFetch vm_fetch(SH::ValueType memType)
+{
+  return converters<double>(memType).fetch;
+}
+
+}
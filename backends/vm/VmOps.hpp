@@ -0,0 +1,125 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHVMOPS_HPP
+#define SHVMOPS_HPP
+
+#include "StorageType.hpp"
+
+/** @file VmOps.hpp
+ *
+ * The bytecode of the vm backend.
+ *
+ * Registers hold one scalar for each of the VmBatchSize stream elements
+ * computed at once, and come in a float and a double register file.
+ * Every instruction computes one scalar component, so tuple ops are
+ * lowered to one instruction per component and swizzles are resolved
+ * to register numbers.  The handler of an instruction is picked once,
+ * when the program is lowered, among handlers specialized for the op
+ * and the register type.
+ *
+ * Handlers either run on the first count elements of the batch, or on
+ * the count elements listed in lanes when the elements of a batch took
+ * different branches.
+ */
+
+namespace Vm {
+
+/// Number of stream elements run through the bytecode at once
+const int VmBatchSize = 128;
+
+enum VmOpcode {
+  VM_MOV, VM_NEG, VM_CVT,
+  VM_ADD, VM_SUB, VM_MUL, VM_DIV, VM_MAD,
+  VM_SLT, VM_SLE, VM_SGT, VM_SGE, VM_SEQ, VM_SNE,
+  VM_ABS, VM_ACOS, VM_ACOSH, VM_ASIN, VM_ASINH, VM_ATAN, VM_ATAN2, VM_ATANH,
+  VM_CBRT, VM_CEIL, VM_COS, VM_COSH, VM_EXP, VM_EXP2, VM_EXP10, VM_FLR,
+  VM_FRAC, VM_LOG, VM_LOG2, VM_LOG10, VM_LRP, VM_MAX, VM_MIN, VM_MOD,
+  VM_POW, VM_RCP, VM_RND, VM_RSQ, VM_SIN, VM_SINH, VM_SGN, VM_SQRT,
+  VM_TAN, VM_TANH, VM_COND,
+  VM_TEX, ///< see VmLookup
+  VM_OPCODE_END
+};
+
+/// Converts a texel of a texture's memory type to a double
+typedef double (*VmFetch)(const void* data, int index);
+
+/// A texture lookup, which an instruction refers to by number since it
+/// has more operands than fit in a VmInstruction
+struct VmLookup {
+  int texture;   ///< index in VmFrame::textures
+  int dims;      ///< 1, 2 or 3
+  int size;      ///< number of components of a texel
+  bool indexed;  ///< coordinates are texel indices rather than in [0, 1]
+  bool repeat;   ///< wrap coordinates around instead of clamping them
+  VmFetch fetch;
+  int src[3];    ///< coordinate registers
+  int dest[4];   ///< result registers
+};
+
+/// Where a program's textures are in memory while it runs
+struct VmTexture {
+  const void* data;
+  int width;
+  int height;
+  int depth;
+};
+
+/// What the handlers run on
+struct VmFrame {
+  float* floats;   ///< VmBatchSize floats for each float register
+  double* doubles; ///< VmBatchSize doubles for each double register
+  const VmTexture* textures;
+  const VmLookup* lookups;
+};
+
+struct VmInstruction;
+
+typedef void (*VmHandler)(const VmInstruction& inst, const VmFrame& frame,
+                          const int* lanes, int count);
+
+struct VmInstruction {
+  VmHandler handler;
+  int dest;   ///< register, or VmLookup number for VM_TEX
+  int src[3]; ///< registers, VM_CVT reads the other register file
+};
+
+/// Returns the handler computing op in float or double registers, or 0
+/// if there is none
+VmHandler vm_handler(VmOpcode op, bool doubles);
+
+/// Copy count elements of a stream, each size components of its memory
+/// type starting stride bytes apart, to or from registers (one per
+/// component).
+/// @{
+typedef void (*VmLoad)(const char* src, int stride, int size, void** dest, int count);
+typedef void (*VmStore)(char* dest, int stride, int size, void* const* src, int count);
+// @}
+
+/// Returns the functions converting memory of the given value type from
+/// and to float or double registers, or 0 for unsupported types
+/// @{
+VmLoad vm_load(SH::ValueType memType, bool doubles);
+VmStore vm_store(SH::ValueType memType, bool doubles);
+VmFetch vm_fetch(SH::ValueType memType);
+// @}
+
+}
+
+#endif
@@ -14,6 +14,8 @@ my @SRC_DIRS = ('backends', 'src', 'test', 'examples');
 #    - COPYING
 #    - src/sh/scripts/common.py
 #    - backend/cc/CcTexturesString.hpp
+#    - backend/cc/CcLanesString.hpp
+#    - backend/cc/CcTypesString.hpp
 my $copyright_text = <<END_OF_COPYRIGHT_TEXT;
 // Sh: A GPU metaprogramming language.
 //
@@ -35,16 +35,36 @@
 #include "Backend.hpp"
 #include "Program.hpp"
 #include "Debug.hpp"
+#include "FileMemory.hpp"
 #include "Internals.hpp"
 #include "Transformer.hpp"
 #include "Syntax.hpp"
+#include "Threads.hpp"
+
+#ifndef _WIN32
+# include <pthread.h>
+# include <unistd.h>
+#endif
 
 #include <algorithm>
 #include <cctype>
+#include <functional>
+#include <vector>
 #include "binreloc.h"
 
 namespace {
 
+/// Interned id of host storages, for cheap lookups
+const int HostStorageId = SH::Storage::intern("host");
+
+/// Guards the loaded, selected and instantiated backends.  Backends
+/// register during static initialization.
+SH::Mutex& backend_mutex()
+{
+  static SH::Mutex mutex;
+  return mutex;
+}
+
 template<typename EntryPoint>
 EntryPoint* load_function(SH::Backend::LibraryHandle module, const char* name)
 {
@@ -60,92 +80,410 @@ EntryPoint* load_function(SH::Backend::LibraryHandle module, const char* name)
 #endif
 }
 
-void get_params(const SH::BaseTexture& stream,
-                int& offset, int& stride, int& repeat, int& count)
+/// Gather and scatter loops are only split across threads when every
+/// thread gets at least this many elements
+const int MinElementsPerThread = 4096;
+
+int processors()
 {
-  stream.get_offset(&offset, 1);
-  stream.get_stride(&stride, 1);
-  stream.get_repeat(&repeat, 1);
-  stream.get_count(&count, 1);
-}                
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? static_cast<int>(count) : 1;
+#endif
+}
 
-class Gather {
-public:
-  Gather(const SH::BaseTexture& source)
+typedef void (*RangeTask)(void* data, int begin, int end);
+
+struct TaskRange {
+  RangeTask task;
+  void* data;
+  int begin, end;
+};
+
+void* task_range_main(void* range)
+{
+  TaskRange* r = reinterpret_cast<TaskRange*>(range);
+  r->task(r->data, r->begin, r->end);
+  return 0;
+}
+
+/// Runs task on count elements split in ranges, one per thread
+void run_split(RangeTask task, void* data, int count)
+{
+  int threads = SH::Context::current()->threads();
+  if (threads <= 0) threads = processors();
+  threads = std::min(threads, count / MinElementsPerThread);
+#if defined(_WIN32)
+  threads = 1;
+#endif
+  if (threads <= 1) {
+    task(data, 0, count);
+    return;
+  }
+
+#if !defined(_WIN32)
+  std::vector<TaskRange> ranges(threads);
+  std::vector<pthread_t> ids(threads);
+  std::vector<bool> started(threads, false);
+  for (int t = 0; t < threads; ++t) {
+    ranges[t].task = task;
+    ranges[t].data = data;
+    ranges[t].begin = static_cast<int>(static_cast<long long>(count) * t / threads);
+    ranges[t].end = static_cast<int>(static_cast<long long>(count) * (t + 1) / threads);
+  }
+  // The calling thread takes the first range, and any a thread could
+  // not be started for
+  for (int t = 1; t < threads; ++t) {
+    started[t] = pthread_create(&ids[t], 0, task_range_main, &ranges[t]) == 0;
+  }
+  task_range_main(&ranges[0]);
+  for (int t = 1; t < threads; ++t) {
+    if (started[t]) {
+      pthread_join(ids[t], 0);
+    } else {
+      task_range_main(&ranges[t]);
+    }
+  }
+#endif
+}
+
+/// Where the elements of a stream are in its host storage
+struct StreamLayout {
+  char* data;
+  int size;        ///< bytes per element
+  int dims;        ///< 1, 2 or 3
+  int width, height;
+  int offset[3], stride[3], repeat[3], count[3];
+  bool unit[3];    ///< stride and repeat of 1 in the dimension
+  int total;       ///< number of elements in the stream
+  /// Whether element i of the stream is base + i, as it is for whole
+  /// textures and for 1D streams with unit stride
+  bool contiguous;
+  int base;
+
+  StreamLayout(const SH::BaseTexture& stream, char* data)
+    : data(data)
   {
-    m_size = source.node()->size() * 
-             SH::typeInfo(source.node()->valueType(), SH::MEM)->datasize();
+    SH::TextureNodePtr node = stream.node();
+    size = node->size() * SH::typeInfo(node->valueType(), SH::MEM)->datasize();
+    dims = node->dims() == SH::SH_TEXTURE_1D ? 1 : node->dims() == SH::SH_TEXTURE_3D ? 3 : 2;
+    width = node->width();
+    height = node->height();
+    stream.get_offset(offset, 3);
+    stream.get_stride(stride, 3);
+    stream.get_repeat(repeat, 3);
+    stream.get_count(count, 3);
+    total = 1;
+    contiguous = true;
+    for (int d = 0; d < 3; ++d) {
+      if (d >= dims) {
+        offset[d] = 0;
+        stride[d] = repeat[d] = count[d] = 1;
+      }
+      unit[d] = stride[d] == 1 && repeat[d] == 1;
+      total *= count[d];
+      contiguous = contiguous && unit[d];
+    }
+    if (dims > 1) contiguous = contiguous && offset[0] == 0 && count[0] == width;
+    if (dims > 2) contiguous = contiguous && offset[1] == 0 && count[1] == height;
+    base = (offset[2] * height + offset[1]) * width + offset[0];
   }
-  void operator()(char *src, int src_elt, char *dest, int dest_elt) const
+
+  /// Coordinate of the c'th element along dimension d
+  int coordinate(int d, int c) const
   {
-    memcpy(dest + dest_elt*m_size, src + src_elt*m_size, m_size);
+    if (unit[d]) {
+      if (c >= count[d]) c %= count[d];
+      return c + offset[d];
+    }
+    return ((c * stride[d] / repeat[d]) % count[d]) + offset[d];
   }
-private:
-  int m_size;
-};
 
-class Scatter {
-public:
-  Scatter(const SH::BaseTexture& source)
+  int element(int x, int y, int z) const
   {
-    m_size = source.node()->size() * 
-             SH::typeInfo(source.node()->valueType(), SH::MEM)->datasize();
+    return (coordinate(2, z) * height + coordinate(1, y)) * width + coordinate(0, x);
   }
-  void operator()(char *dest, int dest_elt, char *src, int src_elt) const
+
+  /// Element i of the stream, walking it x first
+  int element(int i) const
   {
-    memcpy(dest + dest_elt*m_size, src + src_elt*m_size, m_size);
+    if (contiguous && i < total) return base + i;
+    if (dims == 1) return coordinate(0, i);
+    return element(i % count[0], (i / count[0]) % count[1], i / (count[0] * count[1]));
   }
-private:
-  int m_size;
 };
 
-template <typename Functor>
-void do_gather_scatter_1d(const SH::BaseTexture& stream1,
-                          const SH::BaseTexture& stream2,
-                          const SH::BaseTexture& index,
-                          const Functor& functor)
+inline void copy_element(char* dest, const char* src, int size)
+{
+  // Let the compiler inline the common sizes
+  switch (size) {
+  case 4: memcpy(dest, src, 4); break;
+  case 8: memcpy(dest, src, 8); break;
+  case 12: memcpy(dest, src, 12); break;
+  case 16: memcpy(dest, src, 16); break;
+  default: memcpy(dest, src, size); break;
+  }
+}
+
+/// A gather or scatter between the indexed stream and the other
+/// stream, which is walked in step with the index
+struct IndexedCopy {
+  const StreamLayout* indexed;
+  const StreamLayout* other;
+  const StreamLayout* index;
+  int index_value_size;
+  bool scatter;
+  /// Elements of the indexed stream each thread of a scatter writes,
+  /// so that repeated indices are written in order
+  int element_count;
+};
+
+/// Element of the indexed stream pointed to by element i of the index
+template <typename T>
+inline int indexed_element(const IndexedCopy& copy, int i)
 {
-  SH::HostStoragePtr stream1_storage = 
-    SH::shref_dynamic_cast<SH::HostStorage>(stream1.node()->memory(0)->findStorage("host"));
-  SH::HostStoragePtr stream2_storage = 
-    SH::shref_dynamic_cast<SH::HostStorage>(stream2.node()->memory(0)->findStorage("host"));
+  const char* value = copy.index->data + copy.index->element(i) * copy.index->size;
+  const StreamLayout& indexed = *copy.indexed;
+  int x = static_cast<int>(*reinterpret_cast<const T*>(value));
+  if (indexed.dims == 1) return indexed.coordinate(0, x);
+  if (copy.index->size == copy.index_value_size) return indexed.element(x);
+
+  int y = static_cast<int>(*reinterpret_cast<const T*>(value + copy.index_value_size));
+  int z = 0;
+  if (indexed.dims == 3) {
+    z = static_cast<int>(*reinterpret_cast<const T*>(value + 2 * copy.index_value_size));
+  }
+  return indexed.element(x, y, z);
+}
+
+template <typename T>
+void indexed_copy(void* data, int begin, int end)
+{
+  const IndexedCopy& copy = *reinterpret_cast<const IndexedCopy*>(data);
+  const StreamLayout& indexed = *copy.indexed;
+  const StreamLayout& other = *copy.other;
+  const int size = indexed.size;
+
+  if (!copy.scatter) {
+    for (int i = begin; i < end; ++i) {
+      copy_element(other.data + other.element(i) * size,
+                   indexed.data + indexed_element<T>(copy, i) * size, size);
+    }
+    return;
+  }
+
+  // Threads of a scatter each own a range of the destination
+  int first = static_cast<int>(static_cast<long long>(copy.element_count) * begin
+                               / copy.index->total);
+  int last = static_cast<int>(static_cast<long long>(copy.element_count) * end
+                              / copy.index->total);
+  bool whole = begin == 0 && end == copy.index->total;
+  for (int i = 0; i < copy.index->total; ++i) {
+    int elt = indexed_element<T>(copy, i);
+    if (whole || (elt >= first && elt < last)) {
+      copy_element(indexed.data + elt * size, other.data + other.element(i) * size, size);
+    }
+  }
+}
+
+/// Copies between indexed[index] and other, reading the index in
+/// place when its type allows it
+void do_gather_scatter(const SH::BaseTexture& indexed_stream,
+                       const SH::BaseTexture& other_stream,
+                       const SH::BaseTexture& index_stream,
+                       bool scatter)
+{
+  SH::HostStoragePtr indexed_storage = 
+    SH::shref_dynamic_cast<SH::HostStorage>(indexed_stream.node()->memory(0)->findStorage(HostStorageId));
+  SH::HostStoragePtr other_storage = 
+    SH::shref_dynamic_cast<SH::HostStorage>(other_stream.node()->memory(0)->findStorage(HostStorageId));
   SH::HostStoragePtr index_storage = 
-    SH::shref_dynamic_cast<SH::HostStorage>(index.node()->memory(0)->findStorage("host"));
-  if (!stream1_storage || !stream2_storage || !index_storage) {
+    SH::shref_dynamic_cast<SH::HostStorage>(index_stream.node()->memory(0)->findStorage(HostStorageId));
+  if (!indexed_storage || !other_storage || !index_storage) {
     SH::error(SH::Exception("No storage assocated with stream"));
+    return;
   }
-  
-  int index_offset, index_stride, index_repeat, index_count;
-  get_params(index, index_offset, index_stride, index_repeat, index_count);
-  int s1_offset, s1_stride, s1_repeat, s1_count;
-  get_params(stream1, s1_offset, s1_stride, s1_repeat, s1_count);
-  int s2_offset, s2_stride, s2_repeat, s2_count;
-  get_params(stream2, s2_offset, s2_stride, s2_repeat, s2_count);
-
-  SH::VariantPtr index_variant = SH::variantFactory(index_storage->value_type(), SH::MEM)->
-    generate(index_storage->length() / index_storage->value_size(),
-             const_cast<void*>(index_storage->data()), false);
-  if (index_storage->value_type() != SH::SH_INT &&
-      index_storage->value_type() != SH::SH_UINT) {
-    // TODO: we shouldn't convert [u]{s,b}
-    SH::VariantPtr converted_variant = SH::variantFactory(SH::SH_INT, SH::MEM)->
+
+  int dims = indexed_stream.node()->dims() == SH::SH_TEXTURE_1D ? 1 :
+             indexed_stream.node()->dims() == SH::SH_TEXTURE_3D ? 3 : 2;
+  int index_size = index_stream.node()->size();
+  if (index_size != 1 && index_size != dims) {
+    SH::error(SH::Exception("Indices must be positions or have a coordinate per dimension"));
+    return;
+  }
+
+  index_storage->sync();
+  SH::ValueType index_type = index_storage->value_type();
+  SH::VariantPtr converted;
+  char* index_data = reinterpret_cast<char*>(index_storage->data());
+  switch (index_type) {
+  case SH::SH_INT: case SH::SH_UINT: case SH::SH_SHORT: case SH::SH_USHORT:
+  case SH::SH_BYTE: case SH::SH_UBYTE: case SH::SH_FLOAT: case SH::SH_DOUBLE:
+    break;
+  default: {
+    // TODO: we shouldn't convert fractional types
+    SH::VariantPtr index_variant = SH::variantFactory(index_type, SH::MEM)->
+      generate(index_storage->length() / index_storage->value_size(), index_data, false);
+    converted = SH::variantFactory(SH::SH_INT, SH::MEM)->
       generate(index_storage->length() / index_storage->value_size());
-    converted_variant->set(index_variant);
-    index_variant = converted_variant;
+    converted->set(index_variant);
+    index_data = reinterpret_cast<char*>(converted->array());
+    index_type = SH::SH_INT;
+    break;
+  }
   }
-  
-  int* index_ptr = reinterpret_cast<int*>(index_variant->array());
-  char* stream1_ptr = reinterpret_cast<char*>(stream1_storage->data());
-  char* stream2_ptr = reinterpret_cast<char*>(stream2_storage->data());
 
-  for (int i = 0; i < index_count; ++i) {
-    int index_elt = ((i * index_stride / index_repeat) % index_count) + index_offset;
-    int stream1_elt = (index_ptr[index_elt] * s1_stride / s1_repeat) % s1_count + s1_offset;
-    int stream2_elt = ((i * s2_stride / s2_repeat) % s2_count) + s2_offset;
-    functor(stream1_ptr, stream1_elt, stream2_ptr, stream2_elt);
+  if (scatter) {
+    other_storage->sync();
+    indexed_storage->dirty();
+  } else {
+    indexed_storage->sync();
+    other_storage->dirty();
+  }
+  StreamLayout indexed(indexed_stream, reinterpret_cast<char*>(indexed_storage->data()));
+  StreamLayout other(other_stream, reinterpret_cast<char*>(other_storage->data()));
+  StreamLayout index(index_stream, index_data);
+  int index_value_size = SH::typeInfo(index_type, SH::MEM)->datasize();
+  index.size = index_size * index_value_size;
+
+  IndexedCopy copy;
+  copy.indexed = &indexed;
+  copy.other = &other;
+  copy.index = &index;
+  copy.index_value_size = index_value_size;
+  copy.scatter = scatter;
+  copy.element_count = indexed_storage->length() / indexed.size;
+
+  RangeTask task = 0;
+  switch (index_type) {
+  case SH::SH_INT:    task = indexed_copy<int>; break;
+  case SH::SH_UINT:   task = indexed_copy<unsigned int>; break;
+  case SH::SH_SHORT:  task = indexed_copy<short>; break;
+  case SH::SH_USHORT: task = indexed_copy<unsigned short>; break;
+  case SH::SH_BYTE:   task = indexed_copy<char>; break;
+  case SH::SH_UBYTE:  task = indexed_copy<unsigned char>; break;
+  case SH::SH_FLOAT:  task = indexed_copy<float>; break;
+  case SH::SH_DOUBLE: task = indexed_copy<double>; break;
+  default: SH_DEBUG_ASSERT(false); return;
   }
+  run_split(task, &copy, index.total);
 }
 
+struct StorageUpToDate : std::binary_function<SH::StoragePtr, SH::MemoryPtr, bool> {
+  bool operator()(const SH::StoragePtr& storage, const SH::MemoryPtr& memory) const {
+    return (storage->timestamp() == memory->timestamp());
+  }
+};
+
+/// A 1D stream in a FileMemory run through two staging windows
+struct WindowedStream {
+  SH::BaseTexture stream;
+  SH::HostStoragePtr storage; ///< the mapping, or 0 if not in a FileMemory
+  char* data;         ///< contents of storage
+  int size;           ///< bytes per element
+  int offset, stride, count;
+  SH::HostMemoryPtr staging[2];
+  char* buffer[2];    ///< contents of the staging memories' host storages
+
+  WindowedStream(const SH::BaseTexture& stream)
+    : stream(stream), data(0)
+  {
+    size = stream.node()->size() *
+           SH::typeInfo(stream.node()->valueType(), SH::MEM)->datasize();
+    stream.get_offset(&offset, 1);
+    stream.get_stride(&stride, 1);
+    stream.get_count(&count, 1);
+    SH::FileMemoryPtr file = SH::shref_dynamic_cast<SH::FileMemory>(stream.node()->memory(0));
+    if (file && stream.node()->dims() == SH::SH_TEXTURE_1D) {
+      storage = file->hostStorage();
+    }
+  }
+
+  /// Returns a stream of window elements like this one, staged in the
+  /// given staging memory
+  SH::BaseTexture stage(int set, int window)
+  {
+    SH::TextureNodePtr node = stream.node();
+    SH::TextureNodePtr staged = new SH::TextureNode(SH::SH_TEXTURE_1D, node->size(),
+                                                    node->valueType(), node->traits(),
+                                                    window);
+    staging[set] = new SH::HostMemory(window * size, node->valueType());
+    buffer[set] = reinterpret_cast<char*>(staging[set]->hostStorage()->data());
+    staged->memory(staging[set], 0);
+    return SH::BaseTexture(staged);
+  }
+
+  /// Copies elements first to first + n - 1 into a staging buffer,
+  /// addressed the way backends address stream elements
+  void copy_in(int set, int first, int n) const
+  {
+    if (stride == 1) {
+      memcpy(buffer[set], data + (offset + first)*size, n*size);
+      return;
+    }
+    for (int i = 0; i < n; ++i) {
+      memcpy(buffer[set] + i*size, data + (offset + (first + i)*stride)*size, size);
+    }
+  }
+
+  /// Copies the n results of a window to elements first to first + n - 1
+  void copy_out(const char* results, int first, int n) const
+  {
+    if (stride == 1) {
+      memcpy(data + (offset + first)*size, results, n*size);
+      return;
+    }
+    for (int i = 0; i < n; ++i) {
+      memcpy(data + (offset + (first + i)*stride)*size, results + i*size, size);
+    }
+  }
+
+  /// Returns the results left in a staging memory by the backend
+  const char* results(int set) const
+  {
+    SH::MemoryPtr memory = staging[set];
+    SH::HostStoragePtr host = SH::shref_dynamic_cast<SH::HostStorage>(
+      memory->findStorage(HostStorageId, std::bind2nd(StorageUpToDate(), memory)));
+    if (!host) {
+      host = staging[set]->hostStorage();
+      host->sync();
+    }
+    return reinterpret_cast<const char*>(host->data());
+  }
+};
+
+/// The copies made while a window runs.  Only raw buffers are touched,
+/// so that no reference counts change behind the running window's back.
+struct WindowCopy {
+  const std::vector<WindowedStream>* inputs;
+  const std::vector<WindowedStream>* outputs;
+  int in_set, in_first, in_count;   ///< window to stage, if in_count > 0
+  std::vector<const char*> results; ///< of the window to store
+  int out_first, out_count;         ///< window to store, if out_count > 0
+};
+
+void copy_window(const WindowCopy& copy)
+{
+  for (int i = 0; copy.out_count > 0 && i < (int)copy.outputs->size(); ++i) {
+    (*copy.outputs)[i].copy_out(copy.results[i], copy.out_first, copy.out_count);
+  }
+  for (int i = 0; copy.in_count > 0 && i < (int)copy.inputs->size(); ++i) {
+    (*copy.inputs)[i].copy_in(copy.in_set, copy.in_first, copy.in_count);
+  }
+}
+
+#ifndef _WIN32
+void* copy_window_main(void* copy)
+{
+  copy_window(*reinterpret_cast<WindowCopy*>(copy));
+  return 0;
+}
+#endif
+
 }
 
 namespace SH {
@@ -254,6 +592,13 @@ BackendSetPtr Backend::generate_set(const ProgramSet& s)
   return new TrivialBackendSet(s, this);
 }
 
+void Backend::compile_set(const std::string& target, const ProgramSet& s)
+{
+  for (ProgramSet::const_iterator I = s.begin(); I != s.end(); ++I) {
+    (*I)->compile(target, this);
+  }
+}
+
 string Backend::lookup_filename(const string& backend_name)
 {
   init();
@@ -295,6 +640,7 @@ bool Backend::is_valid_name(const string& backend_name)
 
 void Backend::register_backend(const std::string& backend_name, InstantiateEntryPoint *instantiate, TargetCostEntryPoint *target_cost)
 {
+  Lock lock(backend_mutex());
   init();
   
   if (m_loaded_libraries->find(backend_name) != m_loaded_libraries->end()) {
@@ -449,6 +795,7 @@ BackendPtr Backend::instantiate_backend(const string& backend_name)
 
 bool Backend::use_backend(const string& backend_name)
 {
+  Lock lock(backend_mutex());
   init();
   m_selected_backends->insert(backend_name);
   return load_library(lookup_filename(backend_name));
@@ -456,12 +803,14 @@ bool Backend::use_backend(const string& backend_name)
 
 bool Backend::have_backend(const string& backend_name)
 {
+  Lock lock(backend_mutex());
   init();
   return load_library(lookup_filename(backend_name));
 }
 
 void Backend::clear_backends()
 {
+  Lock lock(backend_mutex());
   init();
   m_selected_backends->clear();
 }
@@ -537,6 +886,7 @@ void Backend::load_all_backends()
 
 string Backend::target_handler(const string& target, bool restrict_to_selected)
 {
+  Lock lock(backend_mutex());
   init();
 
   bool selected_only = (m_selected_backends->size() > 0) && restrict_to_selected;
@@ -569,6 +919,7 @@ string Backend::target_handler(const string& target, bool restrict_to_selected)
 
 Pointer<Backend> Backend::get_backend(const string& target)
 {
+  Lock lock(backend_mutex());
   init();
 
   string best_backend = target_handler(target, true);
@@ -625,6 +976,7 @@ void Backend::unbind_all_programs()
 
 void Backend::unbind_all_backends()
 {
+  Lock lock(backend_mutex());
   init();
   for (BackendMap::iterator i = m_instantiated_backends->begin();
        i != m_instantiated_backends->end(); i++) {
@@ -648,6 +1000,7 @@ void Backend::check_target(const string& target, const string& generic_target,
 
 list<string> Backend::derived_targets(const string& target)
 {
+  Lock lock(backend_mutex());
   list<string> ret;
 
   // Vertex shaders
@@ -682,20 +1035,138 @@ void Backend::gather(const SH::BaseTexture& dest,
                      const SH::BaseTexture& src,
                      const SH::BaseTexture& index)
 {
-  if (src.node()->dims() != SH::SH_TEXTURE_1D) {
-    SH::error(SH::Exception("Only 1D gather is currently supported"));
+  if (src.node()->dims() == SH::SH_TEXTURE_CUBE) {
+    SH::error(SH::Exception("Cannot gather from cube maps"));
   }
-  do_gather_scatter_1d(src, dest, index, Gather(src));
+  do_gather_scatter(src, dest, index, false);
 }
 
 void Backend::scatter(const SH::BaseTexture& dest,
                       const SH::BaseTexture& index,
                       const SH::BaseTexture& src)
 {
-  if (src.node()->dims() != SH::SH_TEXTURE_1D) {
-    SH::error(SH::Exception("Only 1D scatter is currently supported"));
+  if (dest.node()->dims() == SH::SH_TEXTURE_CUBE) {
+    SH::error(SH::Exception("Cannot scatter to cube maps"));
+  }
+  do_gather_scatter(dest, src, index, true);
+}
+
+void Backend::execute_windows(const Program& program, Stream& dest, int window)
+{
+  std::vector<WindowedStream> inputs, outputs;
+  for (Stream::const_iterator I = program.stream_inputs.begin();
+       I != program.stream_inputs.end(); ++I) {
+    inputs.push_back(WindowedStream(*I));
+  }
+  for (Stream::iterator I = dest.begin(); I != dest.end(); ++I) {
+    outputs.push_back(WindowedStream(*I));
+  }
+
+  // Anything but 1D streams in files, with inputs at least as long as
+  // the outputs and written somewhere else than they are read from,
+  // runs in one go.  Streams in other memories are resident anyway, so
+  // staging them would only add copies.
+  int total = outputs.empty() ? 0 : outputs.front().count;
+  bool windowed = total > window;
+  for (std::size_t i = 0; windowed && i < outputs.size(); ++i) {
+    windowed = outputs[i].storage && outputs[i].count == total;
+    for (std::size_t j = 0; windowed && j < inputs.size(); ++j) {
+      windowed = inputs[j].storage && inputs[j].count >= total &&
+        inputs[j].stream.node()->memory(0) != outputs[i].stream.node()->memory(0);
+    }
   }
-  do_gather_scatter_1d(dest, src, index, Scatter(src));
+  if (!windowed) {
+    execute(program, dest);
+    return;
+  }
+
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    inputs[i].storage->sync();
+    inputs[i].data = reinterpret_cast<char*>(inputs[i].storage->data());
+  }
+  for (std::size_t i = 0; i < outputs.size(); ++i) {
+    std::size_t written_offset, written_length;
+    outputs[i].stream.get_byte_range(written_offset, written_length);
+    outputs[i].storage->dirty(written_offset, written_length);
+    outputs[i].data = reinterpret_cast<char*>(outputs[i].storage->data());
+  }
+
+  // Each window is run by a copy of the program reading from staging
+  // streams rather than from the whole input streams
+  Program staged_programs[2] = {program, program};
+  Stream staged_dest[2];
+  for (int set = 0; set < 2; ++set) {
+    staged_programs[set].stream_inputs = Stream();
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+      staged_programs[set].stream_inputs.append(inputs[i].stage(set, window));
+    }
+    for (std::size_t i = 0; i < outputs.size(); ++i) {
+      staged_dest[set].append(outputs[i].stage(set, window));
+    }
+  }
+
+  WindowCopy copy;
+  copy.inputs = &inputs;
+  copy.outputs = &outputs;
+  copy.in_set = 0;
+  copy.in_first = 0;
+  copy.in_count = window;
+  copy.out_count = 0;
+  copy_window(copy);
+
+  int windows = (total + window - 1) / window;
+  for (int w = 0; w < windows; ++w) {
+    int set = w % 2;
+    int first = w * window;
+    int count = std::min(window, total - first);
+
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+      inputs[i].staging[set]->hostStorage()->dirtyall();
+    }
+    if (count < window) {
+      for (Stream::iterator I = staged_programs[set].stream_inputs.begin();
+           I != staged_programs[set].stream_inputs.end(); ++I) {
+        I->set_count(&count, 1);
+      }
+      for (Stream::iterator I = staged_dest[set].begin(); I != staged_dest[set].end(); ++I) {
+        I->set_count(&count, 1);
+      }
+    }
+
+    // Stage the next window and store the previous one while this one runs
+    copy.in_set = 1 - set;
+    copy.in_first = first + window;
+    copy.in_count = std::min(window, total - copy.in_first);
+#ifdef _WIN32
+    copy_window(copy);
+#else
+    pthread_t thread;
+    bool threaded = pthread_create(&thread, 0, copy_window_main, &copy) == 0;
+    if (!threaded) copy_window(copy);
+#endif
+
+    try {
+      execute(staged_programs[set], staged_dest[set]);
+    } catch (...) {
+#ifndef _WIN32
+      if (threaded) pthread_join(thread, 0);
+#endif
+      throw;
+    }
+#ifndef _WIN32
+    if (threaded) pthread_join(thread, 0);
+#endif
+
+    copy.results.clear();
+    for (std::size_t i = 0; i < outputs.size(); ++i) {
+      copy.results.push_back(outputs[i].results(set));
+    }
+    copy.out_first = first;
+    copy.out_count = count;
+  }
+
+  copy.in_count = 0;
+  copy_window(copy);
 }
 
 }
@@ -116,9 +116,23 @@ public:
                                          const ProgramNodeCPtr& shader) = 0;
 
   virtual BackendSetPtr generate_set(const ProgramSet& s);
+
+  /** Compile every program of a set for a particular target, as if
+   * compile() was called on each of them.  Backends whose compiles
+   * take long can override this to overlap them. */
+  virtual void compile_set(const std::string& target, const ProgramSet& s);
   
   /** Execute a stream program, if supported */
   virtual void execute(const Program& program, Stream& dest) = 0;
+
+  /** Execute a stream program window elements at a time, for 1D
+   * streams in FileMemory.  Only two windows of each stream are
+   * staged in host memory, and the files are read and written
+   * through their mappings, so no buffer as large as a stream is
+   * allocated.  The next window is copied in and the previous one
+   * copied out while one runs.  Programs on any other streams are
+   * executed in one go. */
+  virtual void execute_windows(const Program& program, Stream& dest, int window);
   
   /** Gather data from src at points specified by index */
   virtual void gather(const BaseTexture& dest,
@@ -21,6 +21,9 @@
 
 namespace {
 
+/// Interned id of host storages, for cheap lookups
+const int HostStorageId = SH::Storage::intern("host");
+
 struct StorageUpToDate : std::binary_function<SH::StoragePtr, SH::MemoryPtr, bool> {
   bool operator()(const SH::StoragePtr& storage, const SH::MemoryPtr& memory) const {
     return (storage->timestamp() == memory->timestamp());
@@ -29,9 +32,9 @@ struct StorageUpToDate : std::binary_function<SH::StoragePtr, SH::MemoryPtr, boo
 
 SH::HostStoragePtr find_storage(const SH::MemoryPtr& mem)
 {
-  SH::StoragePtr storage = mem->findStorage("host", std::bind2nd(StorageUpToDate(), mem));
+  SH::StoragePtr storage = mem->findStorage(HostStorageId, std::bind2nd(StorageUpToDate(), mem));
   if (!storage) {
-    storage = mem->findStorage("host");
+    storage = mem->findStorage(HostStorageId);
   }
   if (!storage) {
     SH::error(SH::Exception("No host storage found"));
@@ -113,6 +116,23 @@ void BaseTexture::set_repeat(const int* repeat, int n)
     m_repeat[i] = repeat[i];
 }
 
+void BaseTexture::get_byte_range(std::size_t& offset, std::size_t& length) const
+{
+  std::size_t element = m_node->size() * typeInfo(m_node->valueType(), MEM)->datasize();
+  std::size_t pitch[3] = {element, element * m_node->width(),
+                          element * m_node->width() * m_node->height()};
+  offset = 0;
+  length = element;
+  for (int i = 0; i < 3; ++i) {
+    if (m_count[i] <= 0) {
+      length = 0;
+      return;
+    }
+    offset += m_offset[i] * pitch[i];
+    length += (m_count[i] - 1) * m_stride[i] * pitch[i];
+  }
+}
+
 void* BaseTexture::read_data(int n) const
 {
   HostStoragePtr host_storage = find_storage(m_node->memory(n));
@@ -54,6 +54,10 @@ public:
   void set_offset(const int* offset, int n);
   /// Set the repeat for n dimensions
   void set_repeat(const int* repeat, int n);
+
+  /// Get the bytes of memory 0 spanned by the elements, from the first
+  /// element to the end of the last one
+  void get_byte_range(std::size_t& offset, std::size_t& length) const;
   
   /// Sync and return a pointer to memory \a n
   void* read_data(int n) const;
@@ -0,0 +1,187 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include "BufferPool.hpp"
+
+#if defined(_WIN32)
+# include <malloc.h>
+#else
+# include <stdlib.h>
+# include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <new>
+
+namespace SH {
+
+namespace {
+// Storage can be allocated during static initialization, so the pool
+// is made on first use.  Asking for it here as well makes sure that
+// first use happens while the library loads, on one thread, since
+// MSVC 7 and 8 do not guard the creation of function-local statics.
+BufferPool* const loaded_pool = BufferPool::instance();
+}
+
+BufferPool* BufferPool::instance()
+{
+  static BufferPool* pool = new BufferPool();
+  return pool;
+}
+
+BufferPool::BufferPool()
+  : m_max_cached(256 * 1024 * 1024)
+{
+  m_stats.allocations = 0;
+  m_stats.reuses = 0;
+  m_stats.releases = 0;
+  m_stats.frees = 0;
+  m_stats.bytes_in_use = 0;
+  m_stats.bytes_cached = 0;
+  m_stats.peak_bytes = 0;
+}
+
+BufferPool::Class BufferPool::size_class(std::size_t length, std::size_t align)
+{
+  std::size_t size;
+  if (length >= HugePage) {
+    size = (length + HugePage - 1) / HugePage * HugePage;
+    align = std::max(align, HugePage);
+  } else {
+    for (size = CacheLine; size < length; size *= 2) ;
+  }
+  return Class(size, std::max(align, CacheLine));
+}
+
+void* BufferPool::allocate(std::size_t length, std::size_t align)
+{
+  Class c = size_class(length, align);
+
+  {
+    Lock lock(m_mutex);
+    m_stats.bytes_in_use += c.first;
+    FreeLists::iterator I = m_free.find(c);
+    if (I != m_free.end() && !I->second.empty()) {
+      void* data = I->second.back();
+      I->second.pop_back();
+      m_stats.bytes_cached -= c.first;
+      ++m_stats.reuses;
+      return data;
+    }
+    ++m_stats.allocations;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes,
+                                  m_stats.bytes_in_use + m_stats.bytes_cached);
+  }
+
+  void* data = system_allocate(c);
+  if (!data) {
+    Lock lock(m_mutex);
+    m_stats.bytes_in_use -= c.first;
+    --m_stats.allocations;
+    throw std::bad_alloc();
+  }
+  return data;
+}
+
+void BufferPool::release(void* data, std::size_t length, std::size_t align)
+{
+  if (!data) return;
+  Class c = size_class(length, align);
+
+  {
+    Lock lock(m_mutex);
+    ++m_stats.releases;
+    m_stats.bytes_in_use -= c.first;
+    if (m_stats.bytes_cached + c.first <= m_max_cached) {
+      m_free[c].push_back(data);
+      m_stats.bytes_cached += c.first;
+      return;
+    }
+    ++m_stats.frees;
+  }
+  system_free(data);
+}
+
+void BufferPool::trim()
+{
+  FreeLists released;
+  {
+    Lock lock(m_mutex);
+    released.swap(m_free);
+    m_stats.bytes_cached = 0;
+    for (FreeLists::const_iterator I = released.begin(); I != released.end(); ++I) {
+      m_stats.frees += I->second.size();
+    }
+  }
+
+  for (FreeLists::const_iterator I = released.begin(); I != released.end(); ++I) {
+    std::for_each(I->second.begin(), I->second.end(), system_free);
+  }
+}
+
+std::size_t BufferPool::max_cached() const
+{
+  Lock lock(m_mutex);
+  return m_max_cached;
+}
+
+void BufferPool::max_cached(std::size_t bytes)
+{
+  bool over;
+  {
+    Lock lock(m_mutex);
+    m_max_cached = bytes;
+    over = m_stats.bytes_cached > bytes;
+  }
+  if (over) trim();
+}
+
+BufferPool::Stats BufferPool::stats() const
+{
+  Lock lock(m_mutex);
+  return m_stats;
+}
+
+void* BufferPool::system_allocate(const Class& c)
+{
+#if defined(_WIN32)
+  return _aligned_malloc(c.first, c.second);
+#else
+  void* data = 0;
+  if (posix_memalign(&data, c.second, c.first) != 0) return 0;
+# ifdef MADV_HUGEPAGE
+  if (c.second >= HugePage) madvise(data, c.first, MADV_HUGEPAGE);
+# endif
+  return data;
+#endif
+}
+
+void BufferPool::system_free(void* data)
+{
+#if defined(_WIN32)
+  _aligned_free(data);
+#else
+  free(data);
+#endif
+}
+
+const std::size_t BufferPool::CacheLine;
+const std::size_t BufferPool::HugePage;
+
+}
@@ -0,0 +1,107 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHBUFFERPOOL_HPP
+#define SHBUFFERPOOL_HPP
+
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+#include "DllExport.hpp"
+#include "Threads.hpp"
+
+namespace SH {
+
+/** @addtogroup memory
+ * @{
+ */
+
+/** Recycles the buffers behind HostStorage.
+ *
+ * Buffers are rounded up to a size class and aligned to at least a
+ * cache line.  Buffers of a huge page or more are aligned to huge
+ * pages.  Released buffers wait in the pool for the next buffer of
+ * their class, so running the same streams frame after frame stops
+ * allocating once the first frame is done.
+ */
+class
+SH_DLLEXPORT BufferPool {
+public:
+  static BufferPool* instance();
+
+  /// Alignment of every buffer
+  static const std::size_t CacheLine = 64;
+  /// Alignment of buffers of at least this size
+  static const std::size_t HugePage = 2 * 1024 * 1024;
+
+  /// Returns a buffer of at least length bytes aligned to align, which
+  /// must be a power of two
+  void* allocate(std::size_t length, std::size_t align = CacheLine);
+
+  /// Gives back a buffer from allocate() called with the same length
+  /// and align
+  void release(void* data, std::size_t length, std::size_t align = CacheLine);
+
+  /// Frees the released buffers
+  void trim();
+
+  /// Most bytes of released buffers kept for reuse, 256MB by default.
+  /// Buffers released past that are freed.
+  std::size_t max_cached() const;
+  void max_cached(std::size_t bytes);
+
+  struct Stats {
+    std::size_t allocations; ///< buffers obtained from the system
+    std::size_t reuses;      ///< allocate() calls served by a released buffer
+    std::size_t releases;    ///< release() calls
+    std::size_t frees;       ///< buffers given back to the system
+    std::size_t bytes_in_use; ///< bytes of buffers allocated and not released
+    std::size_t bytes_cached; ///< bytes of released buffers kept for reuse
+    std::size_t peak_bytes;   ///< most bytes in use and cached at once
+  };
+  Stats stats() const;
+
+private:
+  BufferPool();
+
+  /// Size class and alignment of a buffer
+  typedef std::pair<std::size_t, std::size_t> Class;
+  static Class size_class(std::size_t length, std::size_t align);
+
+  static void* system_allocate(const Class& c);
+  static void system_free(void* data);
+
+  typedef std::map<Class, std::vector<void*> > FreeLists;
+  FreeLists m_free;
+  std::size_t m_max_cached;
+  Stats m_stats;
+
+  mutable Mutex m_mutex;
+
+  // NOT IMPLEMENTED
+  BufferPool(const BufferPool& other);
+  BufferPool& operator=(const BufferPool& other);
+};
+
+/*@}*/
+
+}
+
+#endif
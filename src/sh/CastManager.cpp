@@ -48,8 +48,6 @@ struct CastMgrEdgeWeigher
 
 namespace SH {
 
-CastManager* CastManager::m_instance = 0;
-
 CastMgrEdge::CastMgrEdge(const VariantCast* caster, bool automatic)
   : m_caster(caster), m_auto(automatic)
 {
@@ -160,7 +158,11 @@ void CastManager::doCast(Variant* dest, const Variant* src)
   SH_DEBUG_ASSERT(!(destVt == srcVt && srcDt == destDt));
 
   for(bool first = true;;first = false) {
-    const VariantCast* caster = m_castStep(destVt, destDt, srcVt, srcDt);
+    const VariantCast* caster;
+    {
+      ScopedLock<SpinLock> lock(m_lookupLock);
+      caster = m_castStep(destVt, destDt, srcVt, srcDt);
+    }
     if(!caster) {
       SH_DEBUG_ERROR("Unable to cast to " << valueTypeName(destVt) << " from " << valueTypeName(srcVt));
     }
@@ -204,13 +206,20 @@ bool CastManager::doAllocCast(const Variant*& dest, const Variant* src,
 
 int CastManager::castDist(ValueType destValueType, ValueType srcValueType)
 {
+  ScopedLock<SpinLock> lock(m_lookupLock);
   return m_autoDist(destValueType, srcValueType);
 }
 
+namespace {
+// Made while the library loads, so that the first Context registers
+// its casts with a manager no other thread is still creating
+CastManager* const loaded_manager = CastManager::instance();
+}
+
 CastManager* CastManager::instance() 
 {
-  if(!m_instance) m_instance = new CastManager();
-  return m_instance;
+  static CastManager* manager = new CastManager();
+  return manager;
 }
 
 std::ostream& CastManager::graphviz_dump(std::ostream& out) const
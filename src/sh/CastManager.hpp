@@ -23,6 +23,7 @@
 #include <map>
 #include "HashMap.hpp"
 #include "RefCount.hpp"
+#include "Threads.hpp"
 #include "Graph.hpp"
 #include "TypeInfo.hpp"
 
@@ -173,7 +174,8 @@ CastManager {
     // shortest distance only in precedence DAG 
     CastDistMap m_autoDist;
 
-    static CastManager* m_instance;
+    // Looking up either map inserts into it
+    SpinLock m_lookupLock;
 };
 
 }
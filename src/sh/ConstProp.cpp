@@ -30,6 +30,7 @@
 #include "Context.hpp"
 #include "Syntax.hpp"
 #include "Info.hpp"
+#include "Threads.hpp"
 #include <sstream>
 #include <fstream>
 
@@ -305,16 +306,17 @@ struct ConstProp : public Info {
 
     static void clear()
     {
-      m_values.clear();
+      values().clear();
     }
     
     static ValueNum lookup(const VariableNodePtr& node)
     {
-      for (std::size_t i = 0; i < m_values.size(); i++) {
-        if (m_values[i]->type == NODE && m_values[i]->node == node) return i;
+      std::vector<Value*>& all = values();
+      for (std::size_t i = 0; i < all.size(); i++) {
+        if (all[i]->type == NODE && all[i]->node == node) return i;
       }
-      m_values.push_back(new Value(node)); // FIXME: Never gets deleted
-      return m_values.size() - 1;
+      all.push_back(new Value(node)); // FIXME: Never gets deleted
+      return all.size() - 1;
     }
 
     bool operator==(const Value& other) const
@@ -342,19 +344,20 @@ struct ConstProp : public Info {
 
     static ValueNum lookup(ConstProp* cp)
     {
+      std::vector<Value*>& all = values();
       Value* val = new Value(cp); // FIXME: Never gets deleted
       
-      for (std::size_t i = 0; i < m_values.size(); i++) {
-        if (m_values[i]->type != STMT) continue;
-        if (m_values[i]->op != cp->stmt->op) continue;
+      for (std::size_t i = 0; i < all.size(); i++) {
+        if (all[i]->type != STMT) continue;
+        if (all[i]->op != cp->stmt->op) continue;
 
-        if (*val == *m_values[i]) {
+        if (*val == *all[i]) {
           delete val;
           return i;
         }
       }
-      m_values.push_back(val);
-      return m_values.size() - 1;
+      all.push_back(val);
+      return all.size() - 1;
     }
 
     ValueType valueType() {
@@ -366,7 +369,7 @@ struct ConstProp : public Info {
 
     static Value* get(ValueNum n)
     {
-      return m_values[n];
+      return values()[n];
     }
 
     static void dump(std::ostream& out);
@@ -398,7 +401,8 @@ struct ConstProp : public Info {
       }
     }
     
-    static std::vector<Value*> m_values;
+    /// Each thread optimizing programs has its own values
+    static std::vector<Value*>& values();
   };
   
   struct Cell {
@@ -506,7 +510,12 @@ ConstProp::Cell meet(const ConstProp::Cell& a, const ConstProp::Cell& b)
   return ConstProp::Cell(ConstProp::Cell::TOP);
 }
 
-std::vector<ConstProp::Value*> ConstProp::Value::m_values = std::vector<ConstProp::Value*>();
+std::vector<ConstProp::Value*>& ConstProp::Value::values()
+{
+  static SH_THREAD_LOCAL std::vector<Value*>* values = 0;
+  if (!values) values = new std::vector<Value*>(); // FIXME: Never gets deleted
+  return *values;
+}
 
 std::ostream& operator<<(std::ostream& out, const ConstProp::Uniform& uniform)
 {
@@ -522,17 +531,18 @@ std::ostream& operator<<(std::ostream& out, const ConstProp::Uniform& uniform)
 
 void ConstProp::Value::dump(std::ostream& out)
 {
+  std::vector<Value*>& all = values();
   out << "--- uniform values ---" << std::endl;
-  for (std::size_t i = 0; i < m_values.size(); i++) {
+  for (std::size_t i = 0; i < all.size(); i++) {
     out << i << ": ";
-    if (m_values[i]->type == NODE) {
-      out << "node " << m_values[i]->node->name() << std::endl;
-    } else if (m_values[i]->type == STMT) {
-      out << "stmt [" << m_values[i]->destsize << "] " << opInfo[m_values[i]->op].name << " ";
-      for (int j = 0; j < opInfo[m_values[i]->op].arity; j++) {
+    if (all[i]->type == NODE) {
+      out << "node " << all[i]->node->name() << std::endl;
+    } else if (all[i]->type == STMT) {
+      out << "stmt [" << all[i]->destsize << "] " << opInfo[all[i]->op].name << " ";
+      for (int j = 0; j < opInfo[all[i]->op].arity; j++) {
         if (j) out << ", ";
-        for (std::vector<Uniform>::iterator U = m_values[i]->src[j].begin();
-             U != m_values[i]->src[j].end(); ++U) {
+        for (std::vector<Uniform>::iterator U = all[i]->src[j].begin();
+             U != all[i]->src[j].end(); ++U) {
           out << *U;
         }
       }
@@ -621,8 +631,8 @@ struct DumpConstProp {
 
 struct FinishConstProp
 {
-  FinishConstProp(bool lift_uniforms)
-    : lift_uniforms(lift_uniforms)
+  FinishConstProp(bool lift_uniforms, bool& changed)
+    : lift_uniforms(lift_uniforms), changed(changed)
   {
   }
   
@@ -658,6 +668,7 @@ struct FinishConstProp
             SH_DEBUG_PRINT("Replaced {" << *I << "} with " << newconst);
 #endif
             *I = Statement(I->dest, OP_ASN, newconst);
+            changed = true;
           } else {
             // otherwise, do the same for each source field.
             for (int s = 0; s < opInfo[I->op].arity; s++) {
@@ -678,6 +689,7 @@ struct FinishConstProp
                 SH_DEBUG_PRINT("Replaced {" << *I << "}.src[" << s << "] with " << newconst);
 #endif
                 I->src[s] = newconst;
+                changed = true;
               }
             }
           }
@@ -765,6 +777,7 @@ struct FinishConstProp
               VariableNodePtr node = build_uniform(value, uniform);
               if (node) {
                 I->src[s] = Variable(node, swizzle, neg);
+                changed = true;
               } else {
 #ifdef SH_DEBUG_CONSTPROP
                 SH_DEBUG_PRINT("Could not lift " << *I << ".src[" << s << "] for some reason");
@@ -916,6 +929,7 @@ struct FinishConstProp
   }
 
   bool lift_uniforms;
+  bool& changed;
 };
 
 }
@@ -924,6 +938,12 @@ namespace SH {
 
 
 void propagate_constants(Program& p)
+{
+  bool changed;
+  propagate_constants(p, changed);
+}
+
+void propagate_constants(Program& p, bool& changed)
 {
   CtrlGraphPtr graph = p.node()->ctrlGraph;
 
@@ -1034,7 +1054,8 @@ void propagate_constants(Program& p)
 #endif
   
   FinishConstProp finish(p.node()->target().find("gpu:") == 0
-                         && !Context::current()->optimization_disabled("uniform lifting"));
+                         && !Context::current()->optimization_disabled("uniform lifting"),
+                         changed);
   graph->dfs(finish);
   
 }
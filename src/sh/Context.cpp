@@ -21,37 +21,116 @@
 #include "Debug.hpp"
 #include "TypeInfo.hpp"
 #include "BaseTexture.hpp"
+#include "StreamGraph.hpp"
+#include "DependentGraph.hpp"
+#include "Threads.hpp"
 #include "binreloc.h"
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 namespace SH {
 
 Context* Context::m_instance = 0;
 
+namespace {
+
+/// Contexts can be needed during static initialization, before a
+/// global mutex would be constructed.  The setters hold it too, since
+/// create() copies the first thread's settings while that thread may
+/// be changing them.
+Mutex& context_mutex()
+{
+  static Mutex mutex;
+  return mutex;
+}
+
+// Made at load time, since its first use could otherwise be several
+// threads creating their contexts at once
+Mutex& loaded_mutex = context_mutex();
+
+#ifndef _WIN32
+pthread_key_t context_key;
+
+void delete_context(void* context)
+{
+  delete reinterpret_cast<Context*>(context);
+}
+#endif
+
+}
+
 Context* Context::current()
 {
-  if (!m_instance) {
-    m_instance = new Context();
+  static SH_THREAD_LOCAL Context* context = 0;
+  if (!context) context = create();
+  return context;
+}
 
-    // must be done this way since
-    // init_types requires a Context object, 
-    TypeInfo::init();
+Context* Context::create()
+{
+  Lock lock(context_mutex());
+  if (m_instance) {
+    Context* context = new Context(m_instance);
+#ifndef _WIN32
+    // Threads other than the first delete their context on exit
+    pthread_setspecific(context_key, context);
+#endif
+    return context;
+  }
 
-#ifndef __APPLE__
-    // Enable binary relocation (from autopackage)
-    BrInitError error;
-    int init_passed = br_init_lib(&error);
-    if (!init_passed && error != BR_INIT_ERROR_DISABLED) {
-      SH_DEBUG_WARN("BinReloc failed to initialize (error code " 
-        << error << "). Will fallback to hardcoded default paths.");
-    }
+  m_instance = new Context();
+#ifndef _WIN32
+  pthread_key_create(&context_key, delete_context);
 #endif
+
+  // must be done this way since
+  // init_types requires a Context object, 
+  TypeInfo::init();
+
+#ifndef __APPLE__
+  // Enable binary relocation (from autopackage)
+  BrInitError error;
+  int init_passed = br_init_lib(&error);
+  if (!init_passed && error != BR_INIT_ERROR_DISABLED) {
+    SH_DEBUG_WARN("BinReloc failed to initialize (error code " 
+      << error << "). Will fallback to hardcoded default paths.");
   }
+#endif
   return m_instance;
 }
 
 Context::Context()
   : m_optimization(2),
-    m_throw_errors(true)
+    m_throw_errors(true),
+    m_threads(0),
+    m_async_compile(false),
+    m_compile_profile("default"),
+    m_autotune(false),
+    m_stream_window(0),
+    m_lazy_streams(false),
+    m_lazy_dependents(false)
+{
+  m_compile_profiles["default"] = "-O2";
+  m_compile_profiles["O3"] = "-O3";
+  m_compile_profiles["native"] = "-O3 -march=native";
+  m_compile_profiles["fast"] = "-Ofast";
+  m_compile_profiles["unroll"] = "-O3 -funroll-loops";
+}
+
+Context::Context(const Context* other)
+  : m_optimization(other->m_optimization),
+    m_throw_errors(other->m_throw_errors),
+    m_threads(other->m_threads),
+    m_async_compile(other->m_async_compile),
+    m_compile_profiles(other->m_compile_profiles),
+    m_compile_profile(other->m_compile_profile),
+    m_autotune(other->m_autotune),
+    m_stream_window(other->m_stream_window),
+    m_lazy_streams(other->m_lazy_streams),
+    m_lazy_dependents(other->m_lazy_dependents),
+    m_disabled_optimizations(other->m_disabled_optimizations)
 {
 }
 
@@ -63,6 +142,7 @@ int Context::optimization() const
 
 void Context::optimization(int level)
 {
+  Lock lock(context_mutex());
   m_optimization = level;
 }
 
@@ -73,16 +153,19 @@ bool Context::throw_errors() const
 
 void Context::throw_errors(bool on)
 {
+  Lock lock(context_mutex());
   m_throw_errors = on;
 }
 
 void Context::disable_optimization(const std::string& name)
 {
+  Lock lock(context_mutex());
   m_disabled_optimizations.insert(name);
 }
 
 void Context::enable_optimization(const std::string& name)
 {
+  Lock lock(context_mutex());
   m_disabled_optimizations.erase(name);
 }
 
@@ -91,6 +174,127 @@ bool Context::optimization_disabled(const std::string& name) const
   return m_disabled_optimizations.find(name) != m_disabled_optimizations.end();
 }
 
+const OptimizerStats& Context::optimizer_stats() const
+{
+  return m_optimizer_stats;
+}
+
+OptimizerStats& Context::optimizer_stats()
+{
+  return m_optimizer_stats;
+}
+
+void Context::reset_optimizer_stats()
+{
+  m_optimizer_stats = OptimizerStats();
+}
+
+int Context::threads() const
+{
+  return m_threads;
+}
+
+void Context::threads(int count)
+{
+  Lock lock(context_mutex());
+  m_threads = count;
+}
+
+bool Context::async_compile() const
+{
+  return m_async_compile;
+}
+
+void Context::async_compile(bool on)
+{
+  Lock lock(context_mutex());
+  m_async_compile = on;
+}
+
+void Context::add_compile_profile(const std::string& name, const std::string& flags)
+{
+  Lock lock(context_mutex());
+  m_compile_profiles[name] = flags;
+}
+
+Context::CompileProfileMap::const_iterator Context::begin_compile_profiles() const
+{
+  return m_compile_profiles.begin();
+}
+
+Context::CompileProfileMap::const_iterator Context::end_compile_profiles() const
+{
+  return m_compile_profiles.end();
+}
+
+std::string Context::compile_flags(const std::string& name) const
+{
+  CompileProfileMap::const_iterator I = m_compile_profiles.find(name);
+  if (I == m_compile_profiles.end()) return "";
+  return I->second;
+}
+
+const std::string& Context::compile_profile() const
+{
+  return m_compile_profile;
+}
+
+void Context::compile_profile(const std::string& name)
+{
+  Lock lock(context_mutex());
+  m_compile_profile = name;
+}
+
+bool Context::autotune() const
+{
+  return m_autotune;
+}
+
+void Context::autotune(bool on)
+{
+  Lock lock(context_mutex());
+  m_autotune = on;
+}
+
+int Context::stream_window() const
+{
+  return m_stream_window;
+}
+
+void Context::stream_window(int elements)
+{
+  Lock lock(context_mutex());
+  m_stream_window = elements;
+}
+
+bool Context::lazy_streams() const
+{
+  return m_lazy_streams;
+}
+
+void Context::lazy_streams(bool on)
+{
+  {
+    Lock lock(context_mutex());
+    m_lazy_streams = on;
+  }
+  if (!on) StreamGraph::instance()->flush();
+}
+
+bool Context::lazy_dependents() const
+{
+  return m_lazy_dependents;
+}
+
+void Context::lazy_dependents(bool on)
+{
+  {
+    Lock lock(context_mutex());
+    m_lazy_dependents = on;
+  }
+  if (!on) DependentGraph::instance()->flush();
+}
+
 bool Context::is_bound(const std::string& target)
 {
   return bound_program(target);
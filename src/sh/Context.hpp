@@ -24,12 +24,23 @@
 #include <map>
 #include "DllExport.hpp"
 #include "Program.hpp"
+#include "PassManager.hpp"
 
 namespace SH {
 
+/** Settings and construction state of Sh.
+ *
+ * Each thread has its own context, so that threads can construct and
+ * bind programs independently.  A thread's context starts with the
+ * settings the first thread's context had when the thread first called
+ * current().  Changing a setting of the first thread's context is safe
+ * while other threads start, but does not reach threads that already
+ * have their context.
+ */
 class
 SH_DLLEXPORT Context {
 public:
+  /// The context of the calling thread
   static Context* current();
 
   /// 0 means no optimizations. The default level is 2.
@@ -50,6 +61,65 @@ public:
   /// Check whether an optimization is disabled
   bool optimization_disabled(const std::string& name) const;
 
+  /// What the optimizer passes did to the programs optimized in this
+  /// context since the stats were last reset
+  const OptimizerStats& optimizer_stats() const;
+  void reset_optimizer_stats();
+  /// \internal
+  OptimizerStats& optimizer_stats();
+
+  /// Number of threads host backends may use to execute a stream.
+  /// 0 means one per available processor, which is the default.
+  int threads() const;
+  void threads(int count);
+
+  /// Whether host backends may compile programs in the background,
+  /// interpreting them until the compiled code is ready.  Off by default.
+  bool async_compile() const;
+  void async_compile(bool on);
+
+  /// Named sets of flags host backends pass to their compiler, such as
+  /// "-O3 -march=native".  Adding a profile that exists replaces its
+  /// flags.  The profiles "default", "O3", "native", "fast" and
+  /// "unroll" are predefined.
+  typedef std::map<std::string, std::string> CompileProfileMap;
+  void add_compile_profile(const std::string& name, const std::string& flags);
+  CompileProfileMap::const_iterator begin_compile_profiles() const;
+  CompileProfileMap::const_iterator end_compile_profiles() const;
+  /// Flags of the given profile, or an empty string if there is none
+  std::string compile_flags(const std::string& name) const;
+
+  /// The profile programs are compiled with, "default" by default
+  const std::string& compile_profile() const;
+  void compile_profile(const std::string& name);
+
+  /// Whether host backends try every compile profile on a sample of the
+  /// first stream a program runs on and keep the fastest.  Off by default.
+  bool autotune() const;
+  void autotune(bool on);
+
+  /// Number of elements 1D streams in FileMemory are run through at a
+  /// time, copying the next window in and the last one out while one
+  /// runs.  Streams in other memories, streams this long or shorter,
+  /// and all streams when 0 (the default), are run in one go.
+  int stream_window() const;
+  void stream_window(int elements);
+
+  /// Whether stream assignments are only recorded, to be run (and
+  /// fused where possible) once their results are needed.  Off by
+  /// default.  Turning it off runs the recorded assignments.
+  /// @see StreamGraph
+  bool lazy_streams() const;
+  void lazy_streams(bool on);
+
+  /// Whether changing a uniform only marks the uniforms depending on
+  /// it as stale, to be reevaluated together before the next bind,
+  /// stream program run or look at their values.  Off by default.
+  /// Turning it off reevaluates the stale ones.
+  /// @see DependentGraph
+  bool lazy_dependents() const;
+  void lazy_dependents(bool on);
+
   bool is_bound(const std::string& target);
   ProgramNodePtr bound_program(const std::string& target);
 
@@ -74,6 +144,10 @@ public:
   /// The program currently being constructed. May be null.
   ProgramNodePtr parsing();
 
+  /// Whether no program is being constructed (parsing() is null), so
+  /// that operations on variables are computed right away
+  bool immediate() const { return m_parsing.empty() || !m_parsing.top(); }
+
   /// Start constructing the given program
   void enter(const ProgramNodePtr& program);
 
@@ -82,15 +156,30 @@ public:
   
 private:
   Context();
+  /// A context with the settings of other but nothing bound or parsing
+  explicit Context(const Context* other);
+
+  /// Makes the context of a thread which has none
+  static Context* create();
 
   int m_optimization;
   bool m_throw_errors;
+  int m_threads;
+  bool m_async_compile;
+  CompileProfileMap m_compile_profiles;
+  std::string m_compile_profile;
+  bool m_autotune;
+  int m_stream_window;
+  bool m_lazy_streams;
+  bool m_lazy_dependents;
   
   BoundProgramMap m_bound;
   std::stack<ProgramNodePtr> m_parsing;
 
   std::set<std::string> m_disabled_optimizations;
+  OptimizerStats m_optimizer_stats;
   
+  /// The context of the first thread
   static Context* m_instance;
 
   // NOT IMPLEMENTED
@@ -0,0 +1,112 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include "DependentGraph.hpp"
+#include "Threads.hpp"
+
+namespace SH {
+
+DependentGraph* DependentGraph::instance()
+{
+  static SH_THREAD_LOCAL DependentGraph* graph = 0;
+  if (!graph) graph = new DependentGraph();
+  return graph;
+}
+
+DependentGraph::DependentGraph()
+  : m_flushing(false)
+{
+  m_stats.marks = 0;
+  m_stats.updates = 0;
+  m_stats.avoided = 0;
+}
+
+void DependentGraph::mark(VariableNode* node)
+{
+  for (std::list<VariableNode*>::const_iterator I = node->m_dependents.begin();
+       I != node->m_dependents.end(); ++I) {
+    VariableNode* dependent = *I;
+    if (dependent->m_stale) {
+      // While flushing, the dependents of what is being reevaluated are
+      // stale because they are still to come
+      if (!m_flushing) ++m_stats.avoided;
+      continue;
+    }
+    dependent->m_stale = true;
+    m_stale.push_back(dependent);
+    ++m_stats.marks;
+    mark(dependent);
+  }
+}
+
+void DependentGraph::flush()
+{
+  if (m_flushing) return;
+
+  m_flushing = true;
+  // Reevaluating may mark more, so go until nothing is left
+  while (!m_stale.empty()) {
+    NodeList stale;
+    stale.swap(m_stale);
+
+    NodeList order;
+    std::set<VariableNode*> visited;
+    for (NodeList::const_iterator I = stale.begin(); I != stale.end(); ++I) {
+      visit(I->object(), visited, order);
+    }
+
+    NodeList::reverse_iterator I = order.rbegin();
+    try {
+      for (; I != order.rend(); ++I) {
+        (*I)->m_stale = false;
+        (*I)->update();
+        ++m_stats.updates;
+      }
+    } catch (...) {
+      // The ones not reached yet wait for the next flush
+      m_stale.insert(m_stale.end(), ++I, order.rend());
+      m_flushing = false;
+      throw;
+    }
+  }
+  m_flushing = false;
+}
+
+bool DependentGraph::empty() const
+{
+  return m_stale.empty();
+}
+
+DependentGraph::Stats DependentGraph::stats() const
+{
+  return m_stats;
+}
+
+void DependentGraph::visit(VariableNode* node, std::set<VariableNode*>& visited,
+                           NodeList& order) const
+{
+  if (!node->m_stale || !visited.insert(node).second) return;
+  for (std::list<VariableNode*>::const_iterator I = node->m_dependents.begin();
+       I != node->m_dependents.end(); ++I) {
+    visit(*I, visited, order);
+  }
+  order.push_back(node);
+}
+
+}
@@ -0,0 +1,84 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHDEPENDENTGRAPH_HPP
+#define SHDEPENDENTGRAPH_HPP
+
+#include <cstddef>
+#include <set>
+#include <vector>
+#include "DllExport.hpp"
+#include "VariableNode.hpp"
+
+namespace SH {
+
+/** Dependent uniforms waiting to be reevaluated.
+ *
+ * While Context::lazy_dependents() is on, changing a uniform only marks
+ * the uniforms attached to programs using it, and theirs in turn, as
+ * stale.  flush() then reevaluates each stale uniform once, after the
+ * ones it depends on, however many of the uniforms it uses changed.
+ *
+ * The graph is flushed before a program is bound or a stream program
+ * is run, and whenever the values of a stale uniform are looked at.
+ *
+ * Each thread marks and flushes its own dependents.
+ */
+class
+SH_DLLEXPORT DependentGraph {
+public:
+  /// The graph of the calling thread
+  static DependentGraph* instance();
+
+  /// Mark the dependents of node, and all that depend on them, as stale
+  void mark(VariableNode* node);
+
+  /// Reevaluate all the stale dependents
+  void flush();
+
+  /// Whether there are stale dependents
+  bool empty() const;
+
+  struct Stats {
+    std::size_t marks;   ///< dependents marked stale
+    std::size_t updates; ///< dependents reevaluated by flush()
+    /// Marks of dependents that were already stale, each of which would
+    /// have been a reevaluation without lazy_dependents()
+    std::size_t avoided;
+  };
+  Stats stats() const;
+
+private:
+  DependentGraph();
+
+  typedef std::vector<VariableNodePtr> NodeList;
+
+  /// Adds node and the stale nodes depending on it to order, each
+  /// after all the stale nodes depending on it
+  void visit(VariableNode* node, std::set<VariableNode*>& visited,
+             NodeList& order) const;
+
+  NodeList m_stale;
+  bool m_flushing;
+  Stats m_stats;
+};
+
+}
+
+#endif
@@ -36,13 +36,13 @@ namespace SH {
     
     // Steps 2 and 3
     for (int i = m_n; i >= 2; i--) {
-      CtrlGraphNodePtr w = m_vertex[i];
+      CtrlGraphNode* w = m_vertex[i];
       // Step 2
       PredSet& pred = m_pred[w];
       for (PredSet::iterator I = pred.begin(); I != pred.end(); ++I) {
-	CtrlGraphNodePtr v = *I;
-	CtrlGraphNodePtr u = eval(v);
-	if (m_semi[u] < m_semi[v]) m_semi[w] = m_semi[u];
+	CtrlGraphNode* v = *I;
+	CtrlGraphNode* u = eval(v);
+	if (m_semi[u] < m_semi[w]) m_semi[w] = m_semi[u];
       }
       m_bucket[m_vertex[m_semi[w]]].insert(w);
       link(m_parent[w], w);
@@ -51,19 +51,53 @@ namespace SH {
       BucketSet& bucket = m_bucket[m_parent[w]];
       while (!bucket.empty()) {
 	BucketSet::iterator I = bucket.begin();
-	CtrlGraphNodePtr v = *I;
+	CtrlGraphNode* v = *I;
 	bucket.erase(I);
-	CtrlGraphNodePtr u = eval(v);
+	CtrlGraphNode* u = eval(v);
 	m_dom[v] = (m_semi[u] < m_semi[v] ? u : m_parent[w]);
       }
     }
     
     // Step 4
     for (int i = 2; i <= m_n; i++) {
-      CtrlGraphNodePtr w = m_vertex[i];
+      CtrlGraphNode* w = m_vertex[i];
       if (m_dom[w] != m_vertex[m_semi[w]]) m_dom[w] = m_dom[m_dom[w]];
     }
     m_dom[m_graph->entry()] = 0;
+
+    // The tree itself (link() only builds the dfs spanning forest)
+    m_children.clear();
+    for (int i = 2; i <= m_n; i++) {
+      m_children[m_dom[m_vertex[i]]].insert(m_vertex[i]);
+    }
+
+    // Dominance frontiers, walking up from the predecessors of each
+    // join until reaching its immediate dominator [Cooper, Harvey &
+    // Kennedy, "A Simple, Fast Dominance Algorithm"]
+    for (int i = 1; i <= m_n; i++) {
+      CtrlGraphNode* w = m_vertex[i];
+      PredSet& pred = m_pred[w];
+      if (pred.size() < 2) continue;
+      for (PredSet::iterator I = pred.begin(); I != pred.end(); ++I) {
+        for (CtrlGraphNode* runner = *I; runner && runner != m_dom[w];
+             runner = m_dom[runner]) {
+          m_frontier[runner].insert(w);
+        }
+      }
+    }
+  }
+
+  CtrlGraphNode* DomTree::idom(CtrlGraphNode* node) const
+  {
+    DomMap::const_iterator I = m_dom.find(node);
+    return I == m_dom.end() ? 0 : I->second;
+  }
+
+  const DomTree::FrontierSet& DomTree::frontier(CtrlGraphNode* node) const
+  {
+    static const FrontierSet empty;
+    FrontierMap::const_iterator I = m_frontier.find(node);
+    return I == m_frontier.end() ? empty : I->second;
   }
   
   struct DebugDumper {
@@ -71,7 +105,7 @@ namespace SH {
       : tree(tree)
     {
     }
-    void operator()(CtrlGraphNodePtr node, int level) {
+    void operator()(CtrlGraphNode* node, int level) {
       //    node->print(std::cerr, 0);
       printIndent(std::cerr, level);
       SH_DEBUG_PRINT("Node with numbering " << tree.numbering(node));
@@ -89,7 +123,7 @@ namespace SH {
 #endif
   }
 
-  void DomTree::dfs(CtrlGraphNodePtr v)
+  void DomTree::dfs(CtrlGraphNode* v)
   {
     if (!v) return;
     m_n++;
@@ -98,16 +132,16 @@ namespace SH {
     m_ancestor[v] = 0;
     m_label[v] = v;
   
-    for (std::vector<CtrlGraphBranch>::const_iterator I = v->successors.begin();
-	 I != v->successors.end(); ++I) {
-      CtrlGraphNodePtr w = I->node;
+    for (CtrlGraphNode::SuccessorIt I = v->successors_begin();
+	 I != v->successors_end(); ++I) {
+      CtrlGraphNode* w = I->node;
       if (m_semi[w] == 0) {
 	m_parent[w] = v;
 	dfs(w);
       }
       m_pred[w].insert(v);
     }
-    CtrlGraphNodePtr w = v->follower;
+    CtrlGraphNode* w = v->follower();
     if (w) {
       if (m_semi[w] == 0) {
 	m_parent[w] = v;
@@ -117,7 +151,7 @@ namespace SH {
     }
   }
 
-  CtrlGraphNodePtr DomTree::eval(CtrlGraphNodePtr v)
+  CtrlGraphNode* DomTree::eval(CtrlGraphNode* v)
   {
     if (!m_ancestor[v]) {
       return v;
@@ -127,7 +161,7 @@ namespace SH {
     }
   }
 
-  void DomTree::compress(CtrlGraphNodePtr v)
+  void DomTree::compress(CtrlGraphNode* v)
   {
     // This procedure assumes ancestor[v] != 0
     if (m_ancestor[m_ancestor[v]]) {
@@ -139,7 +173,7 @@ namespace SH {
     }
   }
 
-  void DomTree::link(CtrlGraphNodePtr v, CtrlGraphNodePtr w)
+  void DomTree::link(CtrlGraphNode* v, CtrlGraphNode* w)
   {
     m_ancestor[w] = v;
     m_children[v].insert(w);
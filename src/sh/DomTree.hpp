@@ -46,47 +46,61 @@ namespace SH {
   
     void debugDump();
 
-    int numbering(CtrlGraphNodePtr node) const {
+    int numbering(CtrlGraphNode* node) const {
       return (int)(std::find( m_vertex.begin(), m_vertex.end(), node) - m_vertex.begin());
     }
+
+    /// The immediate dominator of node, or 0 for the entry and for
+    /// nodes that cannot be reached from it.
+    CtrlGraphNode* idom(CtrlGraphNode* node) const;
+
+    typedef std::set<CtrlGraphNode*> FrontierSet;
+
+    /// The dominance frontier of node: the nodes where node's dominance
+    /// ends, i.e. the joins that a definition in node can reach along
+    /// with other definitions.
+    const FrontierSet& frontier(CtrlGraphNode* node) const;
   
   private:
-    void dfs(CtrlGraphNodePtr v);
-    CtrlGraphNodePtr eval(CtrlGraphNodePtr v);
-    void compress(CtrlGraphNodePtr v);
-    void link(CtrlGraphNodePtr v, CtrlGraphNodePtr w);
+    void dfs(CtrlGraphNode* v);
+    CtrlGraphNode* eval(CtrlGraphNode* v);
+    void compress(CtrlGraphNode* v);
+    void link(CtrlGraphNode* v, CtrlGraphNode* w);
   
     CtrlGraphPtr m_graph;
 
     // See [TODO Ref Langauer & Tarjan pg 127] for more information on these
 
-    typedef std::map<CtrlGraphNodePtr, CtrlGraphNodePtr> ParentMap;
+    typedef std::map<CtrlGraphNode*, CtrlGraphNode*> ParentMap;
     ParentMap m_parent;
-    typedef std::set<CtrlGraphNodePtr> PredSet;
-    typedef std::map<CtrlGraphNodePtr, PredSet> PredMap;
+    typedef std::set<CtrlGraphNode*> PredSet;
+    typedef std::map<CtrlGraphNode*, PredSet> PredMap;
     PredMap m_pred;
-    typedef std::map<CtrlGraphNodePtr, int> SemiMap;
+    typedef std::map<CtrlGraphNode*, int> SemiMap;
     SemiMap m_semi;
-    std::vector<CtrlGraphNodePtr> m_vertex;
-    typedef std::set<CtrlGraphNodePtr> BucketSet;
-    typedef std::map<CtrlGraphNodePtr, BucketSet> BucketMap;
+    std::vector<CtrlGraphNode*> m_vertex;
+    typedef std::set<CtrlGraphNode*> BucketSet;
+    typedef std::map<CtrlGraphNode*, BucketSet> BucketMap;
     BucketMap m_bucket;
-    typedef std::map<CtrlGraphNodePtr, CtrlGraphNodePtr> DomMap;
+    typedef std::map<CtrlGraphNode*, CtrlGraphNode*> DomMap;
     DomMap m_dom;
 
-    typedef std::map<CtrlGraphNodePtr, CtrlGraphNodePtr> AncestorMap;
+    typedef std::map<CtrlGraphNode*, CtrlGraphNode*> AncestorMap;
     AncestorMap m_ancestor;
-    typedef std::map<CtrlGraphNodePtr, CtrlGraphNodePtr> LabelMap;
+    typedef std::map<CtrlGraphNode*, CtrlGraphNode*> LabelMap;
     LabelMap m_label;
 
-    typedef std::set<CtrlGraphNodePtr> ChildrenSet;
-    typedef std::map<CtrlGraphNodePtr, ChildrenSet> ChildrenMap;
+    typedef std::set<CtrlGraphNode*> ChildrenSet;
+    typedef std::map<CtrlGraphNode*, ChildrenSet> ChildrenMap;
     ChildrenMap m_children;
+
+    typedef std::map<CtrlGraphNode*, FrontierSet> FrontierMap;
+    FrontierMap m_frontier;
   
     int m_n;
 
-    template<typename T> void postorderNode(T& f, CtrlGraphNodePtr root, int level = 0);
-    template<typename T> void preorderNode(T& f, CtrlGraphNodePtr root, int level = 0);
+    template<typename T> void postorderNode(T& f, CtrlGraphNode* root, int level = 0);
+    template<typename T> void preorderNode(T& f, CtrlGraphNode* root, int level = 0);
   };
 
   template<typename T>
@@ -96,7 +110,7 @@ namespace SH {
   }
 
   template<typename T>
-  void DomTree::postorderNode(T& f, CtrlGraphNodePtr root, int level)
+  void DomTree::postorderNode(T& f, CtrlGraphNode* root, int level)
   {
     ChildrenSet& children = m_children[root];
     for (ChildrenSet::iterator I = children.begin(); I != children.end(); ++I) {
@@ -112,7 +126,7 @@ namespace SH {
   }
 
   template<typename T>
-  void DomTree::preorderNode(T& f, CtrlGraphNodePtr root, int level)
+  void DomTree::preorderNode(T& f, CtrlGraphNode* root, int level)
   {
     f(root, level);
     ChildrenSet& children = m_children[root];
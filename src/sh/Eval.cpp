@@ -17,6 +17,7 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
 // MA  02110-1301, USA
 //////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
 #include <sstream>
 #include "Eval.hpp"
 #include "Variant.hpp"
@@ -24,10 +25,7 @@
 
 namespace SH {
 
-Eval* Eval::m_instance = 0;
-
 //#define SH_DEBUG_EVAL 
-#define SH_EVALOP_CACHE
 
 void Eval::operator()(Operation op, Variant* dest, 
     const Variant* a, const Variant* b, const Variant* c) const
@@ -40,11 +38,16 @@ void Eval::operator()(Operation op, Variant* dest,
       << (c ? c->encodeArray() : "NULL")); 
 #endif
 
-  const EvalOpInfo *evalOpInfo = 
-    getEvalOpInfo(op, dest ? dest->valueType() : VALUETYPE_END, 
-                      a ? a->valueType() : VALUETYPE_END, 
-                      b ? b->valueType() : VALUETYPE_END, 
-                      c ? c->valueType() : VALUETYPE_END);
+  ValueType src0 = a ? a->valueType() : VALUETYPE_END;
+  ValueType src1 = b ? b->valueType() : VALUETYPE_END;
+  ValueType src2 = c ? c->valueType() : VALUETYPE_END;
+
+  // Without an entry in the table, every source is checked for casts
+  static const bool check_all[3] = {true, true, true};
+  const Dispatch* entry = dispatch(op, src0, src1, src2);
+  const EvalOpInfo *evalOpInfo = entry ? entry->info : search(op, src0, src1, src2);
+  const bool* cast = entry ? entry->cast : check_all;
+
   if(!evalOpInfo) {
     // @todo range proper error message
     SH_DEBUG_ERROR("Unable to find eval op for " << opInfo[op].name << 
@@ -57,31 +60,26 @@ void Eval::operator()(Operation op, Variant* dest,
 
   const EvalOp* evalOp = evalOpInfo->m_evalOp; 
  
-  // cast arguments to required types, and set up a destination
-  // of the required type
-  CastManager *castmgr = CastManager::instance();
-
   // cast versions of variables
-  Variant *cdest; 
-  const Variant *ca, *cb, *cc;
-  bool newd, newa, newb, newc; //< indicate whether castmgr allocated new Variants
-  if(dest->typeMatches(evalOpInfo->m_dest, HOST)) {
-    newd = false; 
-    cdest = dest;
-  } else {
+  Variant *cdest = dest; 
+  const Variant *ca = a, *cb = b, *cc = c;
+  bool newd = false, newa = false, newb = false, newc = false; //< indicate whether castmgr allocated new Variants
+  if(!dest->typeMatches(evalOpInfo->m_dest, HOST)) {
     newd = true;
     cdest = variantFactory(evalOpInfo->m_dest)->generate(dest->size());  
   }
-  newa = castmgr->doAllocCast(ca, a, evalOpInfo->m_src[0], HOST);
-  newb = castmgr->doAllocCast(cb, b, evalOpInfo->m_src[1], HOST);
-  newc = castmgr->doAllocCast(cc, c, evalOpInfo->m_src[2], HOST);
+  if(cast[0] || cast[1] || cast[2]) {
+    CastManager *castmgr = CastManager::instance();
+    if(cast[0]) newa = castmgr->doAllocCast(ca, a, evalOpInfo->m_src[0], HOST);
+    if(cast[1]) newb = castmgr->doAllocCast(cb, b, evalOpInfo->m_src[1], HOST);
+    if(cast[2]) newc = castmgr->doAllocCast(cc, c, evalOpInfo->m_src[2], HOST);
+  }
 
   (*evalOp)(cdest, ca, cb, cc);
 
   // cast destination back and assign 
-  // @todo remove the casting cruft if type indicies are the same
   if(newd) {
-    castmgr->doCast(dest, cdest);
+    CastManager::instance()->doCast(dest, cdest);
     delete cdest; 
   }
   if(newa) delete const_cast<Variant*>(ca);
@@ -107,7 +105,66 @@ void Eval::addOp(Operation op, const EvalOp* evalOp, ValueType dest,
     ValueType src0, ValueType src1, ValueType src2)
 {
   m_evalOpMap[op].push_back(EvalOpInfo(op, evalOp, dest, src0, src1, src2));
-  m_evalOpCache(op, src0, src1, src2) = &(m_evalOpMap[op].back()); // @todo type no refcount inc is okay since above inc'ed 
+
+  // ops added after init() have to go in the table too
+  if(!m_dispatch.empty()) build();
+}
+
+void Eval::init(const std::vector<ValueType>& valueTypes)
+{
+  m_valueTypes = valueTypes;
+  build();
+}
+
+void Eval::build()
+{
+  std::fill(m_slot, m_slot + SLOT_RANGE, -1);
+  std::vector<ValueType> slotTypes;
+  for(std::vector<ValueType>::const_iterator I = m_valueTypes.begin();
+      I != m_valueTypes.end(); ++I) {
+    if(*I >= SLOT_RANGE || m_slot[*I] >= 0) continue;
+    m_slot[*I] = slotTypes.size();
+    slotTypes.push_back(*I);
+  }
+  m_slots = slotTypes.size();
+  int slots = m_slots;
+
+  m_dispatch.clear();
+  for(int op = 0; op < (int)OPERATION_END; ++op) {
+    int arity = opInfo[op].arity;
+    int entries = 1;
+    for(int i = 0; i < arity; ++i) entries *= slots;
+    m_offset[op] = m_dispatch.size();
+
+    for(int index = 0; index < entries; ++index) {
+      ValueType src[3] = {VALUETYPE_END, VALUETYPE_END, VALUETYPE_END};
+      for(int i = 0, rest = index; i < arity; ++i, rest /= slots) {
+        src[i] = slotTypes[rest % slots];
+      }
+
+      Dispatch entry;
+      entry.info = search(Operation(op), src[0], src[1], src[2]);
+      for(int i = 0; i < 3; ++i) {
+        entry.cast[i] = entry.info && i < arity && entry.info->m_src[i] != src[i];
+      }
+      m_dispatch.push_back(entry);
+    }
+  }
+}
+
+const Eval::Dispatch* Eval::dispatch(Operation op, ValueType src0,
+    ValueType src1, ValueType src2) const
+{
+  if(m_dispatch.empty()) return 0;
+
+  const ValueType src[3] = {src0, src1, src2};
+  int arity = opInfo[op].arity;
+  int index = 0;
+  for(int i = arity - 1; i >= 0; --i) {
+    if(src[i] >= SLOT_RANGE || m_slot[src[i]] < 0) return 0;
+    index = index * m_slots + m_slot[src[i]];
+  }
+  return &m_dispatch[m_offset[op] + index];
 }
 
 const EvalOpInfo* Eval::getEvalOpInfo(Operation op, ValueType dest,
@@ -121,22 +178,15 @@ const EvalOpInfo* Eval::getEvalOpInfo(Operation op, ValueType dest,
       << ", " << valueTypeName(src2)); 
 #endif
 
-#ifdef SH_EVALOP_CACHE
-  const EvalOpInfo*& result = m_evalOpCache(op, src0, src1, src2);
-  if(result) {
-#ifdef SH_DEBUG_EVAL
-      SH_DEBUG_PRINT("    cached result=" << result->encode()); 
-#endif
-    return result;
-  }
-#else
-  const EvalOpinfo* result = 0;
-#endif
+  const Dispatch* entry = dispatch(op, src0, src1, src2);
+  if(entry) return entry->info;
+  return search(op, src0, src1, src2);
+}
 
-  // @todo this really needs to be improved...
-  // linear search through a table with hundreds of entries is stupid
-  // (for *each* operation ever performed)
-  
+const EvalOpInfo* Eval::search(Operation op, ValueType src0,
+    ValueType src1, ValueType src2) const
+{
+  const EvalOpInfo* result = 0;
   const OpInfoList &oiList = m_evalOpMap[op];
   OpInfoList::const_iterator I;
   int mindist = 2000000001; 
@@ -209,15 +259,23 @@ std::string Eval::availableOps() const
   return out.str();
 }
 
+namespace {
+// Constant folding may run on any thread, so the evaluator is made
+// while the library loads instead
+Eval* const loaded_eval = Eval::instance();
+}
+
 Eval* Eval::instance() 
 {
-  if(!m_instance) m_instance = new Eval();
-  return m_instance;
-  
+  static Eval* eval = new Eval();
+  return eval;
 }
 
 Eval::Eval()
 {
+  std::fill(m_slot, m_slot + SLOT_RANGE, -1);
+  std::fill(m_offset, m_offset + OPERATION_END, 0);
+  m_slots = 0;
 }
 
 EvalOpInfo::EvalOpInfo(Operation op, const EvalOp* evalOp, 
@@ -22,7 +22,6 @@
 
 #include <vector>
 #include <map>
-#include "HashMap.hpp"
 #include "Info.hpp"
 #include "Statement.hpp"
 #include "Variant.hpp"
@@ -106,9 +105,14 @@ Eval {
         ValueType src0, ValueType src1 = VALUETYPE_END, 
         ValueType src2 = VALUETYPE_END); 
 
+    /** Builds the dispatch table for the given host value types.
+     * Called by TypeInfo::init() once all the ops and casts are registered.
+     */
+    void init(const std::vector<ValueType>& valueTypes);
+
     /** Returns a new op info representing the types that arguments
      * should be cast into for an operation.
-     * Caches the result.
+     * Comes from the dispatch table when every source type has a slot in it.
      *
      * @{
      */
@@ -131,10 +135,38 @@ Eval {
     typedef OpInfoList OpInfoMap[OPERATION_END];
     OpInfoMap m_evalOpMap; 
 
-    typedef PairPairHashMap<Operation, ValueType, ValueType, ValueType, const EvalOpInfo*> EvalOpCache;
-    mutable EvalOpCache  m_evalOpCache;
-
-    static Eval* m_instance;
+    /** The op info for an op and its source types, and which of the
+     * sources have to be cast to the types of the op info first.
+     */
+    struct Dispatch {
+      const EvalOpInfo* info;
+      bool cast[3];
+    };
+
+    /// Fills m_dispatch from m_evalOpMap
+    void build();
+
+    /// The table entry for op and the given source types, or 0 if one of
+    /// the types op uses has no slot
+    const Dispatch* dispatch(Operation op, ValueType src0,
+        ValueType src1, ValueType src2) const;
+
+    /// Finds the op info whose sources are the fewest automatic promotions
+    /// away from the given types, or 0 if none is close enough
+    const EvalOpInfo* search(Operation op, ValueType src0,
+        ValueType src1, ValueType src2) const;
+
+    /// Value types below this may have a slot in the dispatch table
+    enum { SLOT_RANGE = 0x40 };
+
+    std::vector<ValueType> m_valueTypes;
+    signed char m_slot[SLOT_RANGE]; ///< slot of each value type, or -1
+    int m_slots;
+
+    /// The entries of op start at m_offset[op], one for each combination
+    /// of slots of the sources op uses, with src0 varying fastest
+    int m_offset[OPERATION_END];
+    std::vector<Dispatch> m_dispatch;
 };
 
 class 
@@ -17,6 +17,8 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
 // MA  02110-1301, USA
 //////////////////////////////////////////////////////////////////////////////
+#include <map>
+#include <utility>
 #include "Evaluate.hpp"
 #include "Eval.hpp"
 #include "Debug.hpp"
@@ -92,5 +94,146 @@ void evaluate(const ProgramNodeCPtr& p)
   }
 }
 
+Evaluator::Evaluator(const ProgramNodeCPtr& program)
+  : m_program(program)
+{
+  // Lay out each control graph node the first time it is reached,
+  // then point the jumps at where their nodes ended up
+  typedef std::map<CtrlGraphNode*, std::size_t> StartMap;
+  StartMap start;
+  std::vector<std::pair<std::size_t, CtrlGraphNode*> > jumps;
+  std::vector<CtrlGraphNode*> pending(1, program->ctrlGraph->entry());
+  CtrlGraphNode* exit = program->ctrlGraph->exit();
+
+  while (!pending.empty()) {
+    CtrlGraphNode* node = pending.back();
+    pending.pop_back();
+    if (!node || node == exit || start.find(node) != start.end()) continue;
+    start[node] = m_instructions.size();
+
+    BasicBlockPtr block = node->block;
+    if (block) {
+      for (BasicBlock::StmtList::iterator I = block->begin(); I != block->end(); ++I) {
+        add(*I);
+      }
+    }
+
+    for (CtrlGraphNode::SuccessorIt I = node->successors_begin(); I != node->successors_end(); ++I) {
+      Instruction branch;
+      branch.kind = Instruction::BRANCH;
+      prepare(branch.src[0], I->cond, VALUETYPE_END);
+      jumps.push_back(std::make_pair(m_instructions.size(), I->node));
+      m_instructions.push_back(branch);
+      pending.push_back(I->node);
+    }
+
+    Instruction jump;
+    jump.kind = Instruction::JUMP;
+    jumps.push_back(std::make_pair(m_instructions.size(), node->follower()));
+    m_instructions.push_back(jump);
+    pending.push_back(node->follower());
+  }
+
+  for (std::size_t i = 0; i < jumps.size(); ++i) {
+    StartMap::const_iterator S = start.find(jumps[i].second);
+    m_instructions[jumps[i].first].target = 
+      S == start.end() ? m_instructions.size() : S->second;
+  }
+}
+
+void Evaluator::run()
+{
+  std::size_t next = 0;
+  while (next < m_instructions.size()) {
+    const Instruction& instruction = m_instructions[next++];
+    switch (instruction.kind) {
+    case Instruction::EVAL:
+      (*instruction.op)(target(instruction.dest), load(instruction.src[0]),
+                        load(instruction.src[1]), load(instruction.src[2]));
+      store(instruction.dest);
+      break;
+    case Instruction::BRANCH:
+      if (load(instruction.src[0])->isTrue()) next = instruction.target;
+      break;
+    case Instruction::JUMP:
+      next = instruction.target;
+      break;
+    case Instruction::STATEMENT:
+      evaluate(*instruction.stmt);
+      break;
+    }
+  }
+}
+
+void Evaluator::add(Statement& stmt)
+{
+  if (stmt.dest.null()) return;
+
+  Instruction instruction;
+  instruction.stmt = &stmt;
+  const EvalOpInfo* info = Eval::instance()->getEvalOpInfo(stmt);
+  if (!info || stmt.op == OP_KIL) {
+    instruction.kind = Instruction::STATEMENT;
+    m_instructions.push_back(instruction);
+    return;
+  }
+
+  instruction.kind = Instruction::EVAL;
+  instruction.op = info->m_evalOp;
+  prepare(instruction.dest, stmt.dest, info->m_dest);
+  for (int i = 0; i < opInfo[stmt.op].arity; ++i) {
+    prepare(instruction.src[i], stmt.src[i], info->m_src[i]);
+  }
+  m_instructions.push_back(instruction);
+}
+
+void Evaluator::prepare(Operand& operand, const Variable& var, ValueType opType)
+{
+  var.node()->addVariant();
+  operand.node = var.node();
+  operand.values = operand.node->getVariant();
+  operand.neg = var.neg();
+  operand.swizzle = var.swizzle();
+  if (operand.neg || !operand.swizzle.identity()) {
+    operand.swizzled = variantFactory(operand.node->valueType())->generate(var.size());
+  }
+  if (opType != VALUETYPE_END && opType != operand.node->valueType()) {
+    operand.cast = variantFactory(opType)->generate(var.size());
+  }
+}
+
+const Variant* Evaluator::load(const Operand& src) const
+{
+  if (!src.node) return 0;
+
+  const Variant* result = src.values;
+  if (src.swizzled) {
+    src.values->get(src.swizzled.object(), src.neg, src.swizzle);
+    result = src.swizzled.object();
+  }
+  if (src.cast) {
+    src.cast->set(result);
+    result = src.cast.object();
+  }
+  return result;
+}
+
+Variant* Evaluator::target(const Operand& dest) const
+{
+  if (dest.cast) return dest.cast.object();
+  if (dest.swizzled) return dest.swizzled.object();
+  return dest.values;
+}
+
+void Evaluator::store(const Operand& dest) const
+{
+  if (dest.cast) {
+    if (dest.swizzled) dest.swizzled->set(dest.cast.object());
+    else dest.values->set(dest.cast.object());
+  }
+  if (dest.swizzled) dest.values->set(dest.swizzled.object(), dest.neg, dest.swizzle);
+  dest.node->update_all();
+}
+
 }
 
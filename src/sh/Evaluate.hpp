@@ -20,8 +20,11 @@
 #ifndef SHEVALUATE_HPP
 #define SHEVALUATE_HPP
 
+#include <cstddef>
+#include <vector>
 #include "Statement.hpp"
 #include "ProgramNode.hpp"
+#include "Variant.hpp"
 
 // @todo merge this with Eval.hpp, Eval.cpp
 namespace SH {
@@ -32,6 +35,76 @@ void evaluate(Statement& stmt);
 SH_DLLEXPORT
 void evaluate(const ProgramNodeCPtr& p);
 
+class EvalOp;
+
+/** A program prepared once for evaluating on the host many times.
+ *
+ * The control graph is flattened into a list of instructions.  Each one
+ * holds the EvalOp for its operand types, the variants it reads and
+ * writes, and scratch variants for operands that are swizzled, negated
+ * or of a different type than the op takes.  Running it does no op
+ * lookups, allocations or Context changes, unlike
+ * evaluate(const ProgramNodeCPtr&).
+ *
+ * The program must not be changed while an Evaluator for it exists.
+ */
+class
+SH_DLLEXPORT Evaluator: public RefCountable {
+public:
+  Evaluator(const ProgramNodeCPtr& program);
+
+  /// Evaluates the program, leaving the results in the variants of its
+  /// outputs
+  void run();
+
+private:
+  /// An operand of an instruction
+  struct Operand {
+    VariableNodePtr node; ///< null for an unused source
+    Variant* values; ///< node's variant
+    bool neg;
+    Swizzle swizzle;
+    VariantPtr swizzled; ///< values after swizzle and neg, if they change them
+    VariantPtr cast; ///< values in the type the op takes, if different
+  };
+
+  struct Instruction {
+    enum Kind {
+      EVAL,   ///< dest = op(src...)
+      BRANCH, ///< go to target if src[0] is true
+      JUMP,   ///< go to target
+      STATEMENT ///< no EvalOp fits, so evaluate(*stmt)
+    };
+    Kind kind;
+    const EvalOp* op;
+    Statement* stmt;
+    Operand dest;
+    Operand src[3];
+    std::size_t target;
+  };
+
+  void add(Statement& stmt);
+  void prepare(Operand& operand, const Variable& var, ValueType opType);
+
+  /// Returns the values an instruction reads from src
+  const Variant* load(const Operand& src) const;
+
+  /// Returns where an instruction writes dest's values
+  Variant* target(const Operand& dest) const;
+
+  /// Writes the values from target(dest) into dest's node
+  void store(const Operand& dest) const;
+
+  ProgramNodeCPtr m_program;
+  std::vector<Instruction> m_instructions;
+
+  // NOT IMPLEMENTED
+  Evaluator(const Evaluator& other);
+  Evaluator& operator=(const Evaluator& other);
+};
+
+typedef Pointer<Evaluator> EvaluatorPtr;
+
 }
 
 #endif
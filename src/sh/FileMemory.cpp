@@ -0,0 +1,452 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <sys/types.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <cerrno>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include "FileMemory.hpp"
+#include "Debug.hpp"
+#include "Error.hpp"
+#include "Exception.hpp"
+#include "Variant.hpp"
+
+namespace {
+
+using namespace SH;
+
+/// Copies the values of one storage to another, converting them if
+/// the value types differ
+bool copy_values(const void* from, ValueType from_type, std::size_t from_length,
+                 void* to, ValueType to_type, std::size_t to_length)
+{
+  if (from_type == to_type) {
+    if (from_length != to_length) {
+      SH_DEBUG_WARN("From length = " << from_length << ", To length = " << to_length);
+      return false;
+    }
+    // The host storage of a FileMemory is the mapping itself
+    if (from != to) std::memcpy(to, from, to_length);
+  } else {
+    const std::size_t nb_values = from_length / typeInfo(from_type, MEM)->datasize();
+    VariantPtr from_variant = variantFactory(from_type, MEM)->
+      generate(nb_values, const_cast<void*>(from), false);
+    VariantPtr to_variant = variantFactory(to_type, MEM)->
+      generate(nb_values, to, false);
+    to_variant->set(from_variant);
+  }
+  return true;
+}
+
+/// Copies only the values in ranges
+bool copy_ranges(const void* from, ValueType from_type, std::size_t from_length,
+                 void* to, ValueType to_type, std::size_t to_length,
+                 const ValueRanges& ranges)
+{
+  const std::size_t from_size = typeInfo(from_type, MEM)->datasize();
+  const std::size_t to_size = typeInfo(to_type, MEM)->datasize();
+  const std::size_t nb_values = from_length / from_size;
+  if (nb_values != to_length / to_size) {
+    SH_DEBUG_WARN("From length = " << from_length << ", To length = " << to_length);
+    return false;
+  }
+  for (ValueRanges::const_iterator I = ranges.begin(); I != ranges.end(); ++I) {
+    std::size_t begin = I->first;
+    std::size_t end = std::min(I->second, nb_values);
+    if (begin >= end) continue;
+    if (!copy_values(reinterpret_cast<const char*>(from) + begin * from_size, from_type,
+                     (end - begin) * from_size,
+                     reinterpret_cast<char*>(to) + begin * to_size, to_type,
+                     (end - begin) * to_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+namespace SH {
+
+///////////////////////////
+// --- MmapStorage --- //
+///////////////////////////
+
+MmapStorage::MmapStorage(Memory* memory, const std::string& filename, ValueType value_type,
+                         bool writable)
+  : Storage(memory, value_type),
+    m_filename(filename),
+    m_writable(writable),
+    m_length(0),
+    m_data(0)
+{
+  init(0, false);
+}
+
+MmapStorage::MmapStorage(Memory* memory, const std::string& filename, std::size_t length,
+                         ValueType value_type)
+  : Storage(memory, value_type),
+    m_filename(filename),
+    m_writable(true),
+    m_length(0),
+    m_data(0)
+{
+  init(length, true);
+}
+
+void MmapStorage::init(std::size_t length, bool create)
+{
+  try {
+    map(length, create);
+  } catch (...) {
+    // Leave the memory before this storage is destroyed by the
+    // exception.  The extra reference keeps removeStorage from
+    // deleting it on the way.
+    acquireRef();
+    memory()->removeStorage(this);
+    releaseRef();
+    throw;
+  }
+}
+
+#if defined(_WIN32)
+
+void MmapStorage::map(std::size_t length, bool create)
+{
+  m_mapping = 0;
+  m_file = CreateFileA(m_filename.c_str(), GENERIC_READ | (m_writable ? GENERIC_WRITE : 0),
+                       FILE_SHARE_READ, 0, create ? CREATE_ALWAYS : OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, 0);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    m_file = 0;
+    error(Exception("Could not open " + m_filename));
+    return;
+  }
+
+  std::string failure;
+  LARGE_INTEGER size;
+  if (create) {
+    size.QuadPart = length;
+    if (!SetFilePointerEx(m_file, size, 0, FILE_BEGIN) || !SetEndOfFile(m_file)) {
+      failure = "resize";
+    }
+  } else {
+    if (GetFileSizeEx(m_file, &size)) {
+      length = static_cast<std::size_t>(size.QuadPart);
+    } else {
+      failure = "read the size of";
+    }
+  }
+
+  // Empty files cannot be mapped.  Read-only files are mapped copy on
+  // write, so that writing to the data does not fault but never
+  // reaches the file either.
+  if (failure.empty() && length) {
+    m_mapping = CreateFileMappingA(m_file, 0, m_writable ? PAGE_READWRITE : PAGE_WRITECOPY,
+                                   0, 0, 0);
+    if (m_mapping) {
+      m_data = MapViewOfFile(m_mapping, m_writable ? FILE_MAP_WRITE : FILE_MAP_COPY,
+                             0, 0, length);
+    }
+    if (m_data) {
+      m_length = length;
+    } else {
+      failure = "map";
+    }
+  }
+
+  if (!failure.empty()) {
+    if (m_mapping) CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_mapping = 0;
+    m_file = 0;
+    error(Exception("Could not " + failure + " " + m_filename));
+  }
+}
+
+MmapStorage::~MmapStorage()
+{
+  flush();
+  if (m_data) UnmapViewOfFile(m_data);
+  if (m_mapping) CloseHandle(m_mapping);
+  if (m_file) CloseHandle(m_file);
+}
+
+void MmapStorage::flush()
+{
+  if (m_writable && m_data) FlushViewOfFile(m_data, 0);
+}
+
+#else
+
+void MmapStorage::map(std::size_t length, bool create)
+{
+  int flags = m_writable ? O_RDWR : O_RDONLY;
+  if (create) flags |= O_CREAT | O_TRUNC;
+
+  m_file = open(m_filename.c_str(), flags, 0666);
+  if (m_file < 0) {
+    error(Exception("Could not open " + m_filename + ": " + std::strerror(errno)));
+    return;
+  }
+
+  std::string failure;
+  if (create) {
+    if (ftruncate(m_file, length) != 0) failure = "resize";
+  } else {
+    struct stat st;
+    if (fstat(m_file, &st) == 0) {
+      length = st.st_size;
+    } else {
+      failure = "read the size of";
+    }
+  }
+
+  // Empty files cannot be mapped.  Read-only files are mapped
+  // privately, so that writing to the data does not fault but never
+  // reaches the file either.
+  if (failure.empty() && length) {
+    void* data = mmap(0, length, PROT_READ | PROT_WRITE,
+                      m_writable ? MAP_SHARED : MAP_PRIVATE, m_file, 0);
+    if (data == MAP_FAILED) {
+      failure = "map";
+    } else {
+      m_data = data;
+      m_length = length;
+    }
+  }
+
+  if (!failure.empty()) {
+    std::string reason = std::strerror(errno);
+    close(m_file);
+    m_file = -1;
+    error(Exception("Could not " + failure + " " + m_filename + ": " + reason));
+  }
+}
+
+MmapStorage::~MmapStorage()
+{
+  flush();
+  if (m_data) munmap(m_data, m_length);
+  if (m_file >= 0) close(m_file);
+}
+
+void MmapStorage::flush()
+{
+  if (m_writable && m_data) msync(m_data, m_length, MS_SYNC);
+}
+
+#endif
+
+std::string MmapStorage::id() const
+{
+  return "file";
+}
+
+const std::string& MmapStorage::filename() const
+{
+  return m_filename;
+}
+
+bool MmapStorage::writable() const
+{
+  return m_writable;
+}
+
+std::size_t MmapStorage::length() const
+{
+  return m_length;
+}
+
+const void* MmapStorage::data() const
+{
+  return m_data;
+}
+
+void* MmapStorage::data()
+{
+  return m_data;
+}
+
+//////////////////////////
+// --- FileMemory --- //
+//////////////////////////
+
+FileMemory::FileMemory(const std::string& filename, ValueType value_type, bool writable)
+  : m_fileStorage(0), m_hostStorage(0)
+{
+  // avoids base-from-member initialization problem
+  m_fileStorage = new MmapStorage(this, filename, value_type, writable);
+  init();
+}
+
+FileMemory::FileMemory(const std::string& filename, std::size_t length, ValueType value_type)
+  : m_fileStorage(0), m_hostStorage(0)
+{
+  // avoids base-from-member initialization problem
+  m_fileStorage = new MmapStorage(this, filename, length, value_type);
+  init();
+}
+
+void FileMemory::init()
+{
+  // Make the file storage represent the newest version of the memory
+  m_fileStorage->dirtyall();
+
+  // The host storage shares the mapping, so syncing it copies nothing
+  m_hostStorage = new HostStorage(this, m_fileStorage->length(), m_fileStorage->data(),
+                                  m_fileStorage->value_type());
+  m_hostStorage->sync();
+}
+
+FileMemory::~FileMemory()
+{
+  if (m_fileStorage->writable()) flush();
+}
+
+MmapStoragePtr FileMemory::fileStorage()
+{
+  return m_fileStorage;
+}
+
+Pointer<const MmapStorage> FileMemory::fileStorage() const
+{
+  return m_fileStorage;
+}
+
+HostStoragePtr FileMemory::hostStorage()
+{
+  return m_hostStorage;
+}
+
+Pointer<const HostStorage> FileMemory::hostStorage() const
+{
+  return m_hostStorage;
+}
+
+void FileMemory::flush()
+{
+  m_fileStorage->sync();
+  m_fileStorage->flush();
+}
+
+class HostFileTransfer : public Transfer {
+public:
+  bool transfer(const Storage* from, Storage* to)
+  {
+    const HostStorage* host_from = dynamic_cast<const HostStorage*>(from);
+    MmapStorage* file_to = dynamic_cast<MmapStorage*>(to);
+
+    // Check that casts succeeded
+    if (!host_from) return false;
+    if (!file_to) return false;
+
+    return copy_values(host_from->data(), host_from->value_type(), host_from->length(),
+                       file_to->data(), file_to->value_type(), file_to->length());
+  }
+
+  bool transfer_ranges(const Storage* from, Storage* to, const ValueRanges& ranges)
+  {
+    const HostStorage* host_from = dynamic_cast<const HostStorage*>(from);
+    MmapStorage* file_to = dynamic_cast<MmapStorage*>(to);
+
+    // Check that casts succeeded
+    if (!host_from) return false;
+    if (!file_to) return false;
+
+    return copy_ranges(host_from->data(), host_from->value_type(), host_from->length(),
+                       file_to->data(), file_to->value_type(), file_to->length(), ranges);
+  }
+
+  int cost(const Storage* from, const Storage* to)
+  {
+    const HostStorage* host_from = dynamic_cast<const HostStorage*>(from);
+    const MmapStorage* file_to = dynamic_cast<const MmapStorage*>(to);
+    if (host_from && file_to && host_from->data() == file_to->data()) return 0;
+    return 10;
+  }
+
+private:
+  HostFileTransfer()
+    : Transfer("host", "file")
+  {
+  }
+
+  static HostFileTransfer* instance;
+};
+
+HostFileTransfer* HostFileTransfer::instance = new HostFileTransfer();
+
+class FileHostTransfer : public Transfer {
+public:
+  bool transfer(const Storage* from, Storage* to)
+  {
+    const MmapStorage* file_from = dynamic_cast<const MmapStorage*>(from);
+    HostStorage* host_to = dynamic_cast<HostStorage*>(to);
+
+    // Check that casts succeeded
+    if (!file_from) return false;
+    if (!host_to) return false;
+
+    return copy_values(file_from->data(), file_from->value_type(), file_from->length(),
+                       host_to->data(), host_to->value_type(), host_to->length());
+  }
+
+  bool transfer_ranges(const Storage* from, Storage* to, const ValueRanges& ranges)
+  {
+    const MmapStorage* file_from = dynamic_cast<const MmapStorage*>(from);
+    HostStorage* host_to = dynamic_cast<HostStorage*>(to);
+
+    // Check that casts succeeded
+    if (!file_from) return false;
+    if (!host_to) return false;
+
+    return copy_ranges(file_from->data(), file_from->value_type(), file_from->length(),
+                       host_to->data(), host_to->value_type(), host_to->length(), ranges);
+  }
+
+  int cost(const Storage* from, const Storage* to)
+  {
+    const MmapStorage* file_from = dynamic_cast<const MmapStorage*>(from);
+    const HostStorage* host_to = dynamic_cast<const HostStorage*>(to);
+    if (file_from && host_to && file_from->data() == host_to->data()) return 0;
+    return 10;
+  }
+
+private:
+  FileHostTransfer()
+    : Transfer("file", "host")
+  {
+  }
+
+  static FileHostTransfer* instance;
+};
+
+FileHostTransfer* FileHostTransfer::instance = new FileHostTransfer();
+
+}
@@ -0,0 +1,149 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHFILEMEMORY_HPP
+#define SHFILEMEMORY_HPP
+
+#include <string>
+#include "DllExport.hpp"
+#include "Memory.hpp"
+
+namespace SH {
+
+/** @addtogroup memory
+ * @{
+ */
+
+/** A Storage representing the contents of a file mapped into memory.
+ * You probably want to use FileMemory to construct this.
+ *
+ * Read-only mappings are private: the data can still be written to,
+ * but changes never reach the file.
+ * @see Memory
+ * @see Storage
+ * @see FileMemory
+ */
+class
+SH_DLLEXPORT MmapStorage : public Storage {
+public:
+  /// Maps all of an existing file
+  MmapStorage(Memory* memory, const std::string& filename, ValueType value_type,
+              bool writable);
+  /// Creates (or truncates) a file of length bytes and maps it read-write
+  MmapStorage(Memory* memory, const std::string& filename, std::size_t length,
+              ValueType value_type);
+
+  /// Unmap the file. Changes to writable mappings are written back.
+  ~MmapStorage();
+
+  std::string id() const;
+
+  /// Return the name of the mapped file
+  const std::string& filename() const;
+
+  /// Return whether changes to the data are written to the file
+  bool writable() const;
+
+  /// Return the length (in bytes) of the mapped file
+  std::size_t length() const;
+
+  /// Return the location of the mapped file
+  const void* data() const;
+  /// Return the location of the mapped file
+  void* data();
+
+  /// Write the changes made so far back to the file, if writable
+  void flush();
+
+private:
+  void init(std::size_t length, bool create);
+  /// Opens and maps the file, creating it with the given length or
+  /// finding its length
+  void map(std::size_t length, bool create);
+
+  std::string m_filename;
+  bool m_writable;
+  std::size_t m_length; ///< number of bytes mapped
+  void* m_data;         ///< the mapped file, or 0 if it is empty
+
+#ifdef _WIN32
+  void* m_file;         ///< HANDLE of the file
+  void* m_mapping;      ///< HANDLE of the file mapping object
+#else
+  int m_file;           ///< file descriptor
+#endif
+
+  // NOT IMPLEMENTED
+  MmapStorage& operator=(const MmapStorage& other);
+  MmapStorage(const MmapStorage& other);
+};
+
+typedef Pointer<MmapStorage> MmapStoragePtr;
+typedef Pointer<const MmapStorage> MmapStorageCPtr;
+
+/** A Memory backed by a file.
+ *
+ * The file is mapped into memory, and its host storage refers to the
+ * mapping, so that stream programs read the file without copying it.
+ * The host backends write stream outputs straight into the mapping as
+ * well, except for programs that also read the memory, which write to
+ * a new host storage.  Results in other storages are copied back to
+ * the file when it is flushed or when the memory is destroyed.
+ * @see Memory
+ * @see MmapStorage
+ */
+class
+SH_DLLEXPORT FileMemory : public Memory {
+public:
+  /// Maps all of an existing file, for reading only unless writable
+  FileMemory(const std::string& filename, ValueType value_type, bool writable = false);
+  /// Creates (or truncates) a file of length bytes to read and write
+  FileMemory(const std::string& filename, std::size_t length, ValueType value_type);
+
+  /// Flushes the memory before unmapping the file
+  ~FileMemory();
+
+  MmapStoragePtr fileStorage();
+  Pointer<const MmapStorage> fileStorage() const;
+
+  HostStoragePtr hostStorage();
+  Pointer<const HostStorage> hostStorage() const;
+
+  /// Bring the file up to date with the newest version of the memory
+  void flush();
+
+private:
+  void init();
+
+  MmapStoragePtr m_fileStorage;
+  HostStoragePtr m_hostStorage;
+
+  // NOT IMPLEMENTED
+  FileMemory& operator=(const FileMemory& other);
+  FileMemory(const FileMemory& other);
+};
+
+typedef Pointer<FileMemory> FileMemoryPtr;
+typedef Pointer<const FileMemory> FileMemoryCPtr;
+
+/*@}*/
+
+}
+
+#endif
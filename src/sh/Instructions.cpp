@@ -30,11 +30,6 @@ namespace {
 
 using namespace SH;
 
-inline bool immediate()
-{
-  return !Context::current()->parsing();
-}
-
 inline void sizes_match(const Variable& a, const Variable& b)
 {
   SH_DEBUG_ASSERT(a.size() == b.size());
@@ -82,6 +77,12 @@ inline void addStatement(const Statement& stmt)
 }
 
 namespace SH {
+
+bool immediate()
+{
+  return Context::current()->immediate();
+}
+
 #define INST_UNARY_OP_CORE(op)\
   if(immediate()) {\
     has_values(dest, src);\
@@ -32,6 +32,11 @@ namespace SH {
  * @{
  */
 
+/// Whether instructions are computed right away rather than added to
+/// the program being constructed
+SH_DLLEXPORT
+bool immediate();
+
 SH_DLLEXPORT
 void shASN(Variable& dest, const Variable& src);
 //void shNEG(Variable& dest, const Variable& src);
@@ -157,8 +162,32 @@ void shKIL(const Variable& cond);
 SH_DLLEXPORT
 void shRET(const Variable& cond);
 
+template<int N, typename T> class Generic;
+
+/** Versions of the most common instructions for operands of the same
+ * type.  In immediate mode they compute straight on the values of
+ * float, double and int operands, without the casts, temporary
+ * variants and Eval lookups of the versions above, which they fall
+ * back on otherwise.  Scalar operands are used for every element.
+ * @{
+ */
+template<int N, int M, typename T>
+void shASN(Generic<N, T>& dest, const Generic<M, T>& src);
+template<int N, int M1, int M2, typename T>
+void shADD(Generic<N, T>& dest, const Generic<M1, T>& a, const Generic<M2, T>& b);
+template<int N, int M1, int M2, typename T>
+void shMUL(Generic<N, T>& dest, const Generic<M1, T>& a, const Generic<M2, T>& b);
+template<int N, int M1, int M2, typename T>
+void shDIV(Generic<N, T>& dest, const Generic<M1, T>& a, const Generic<M2, T>& b);
+template<int N, int M1, int M2, int M3, typename T>
+void shMAD(Generic<N, T>& dest, const Generic<M1, T>& a,
+           const Generic<M2, T>& b, const Generic<M3, T>& c);
+/*@}*/
+
 /*@}*/
 
 }
 
+#include "InstructionsImpl.hpp"
+
 #endif
@@ -0,0 +1,228 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHINSTRUCTIONSIMPL_HPP
+#define SHINSTRUCTIONSIMPL_HPP
+
+#include "Instructions.hpp"
+#include "Variant.hpp"
+
+namespace SH {
+
+/** Value types Eval computes on without casting the operands.  The
+ * others are cast to one of these first, which only the general
+ * instructions do.
+ */
+template<typename T> struct ImmediateType { static const bool value = false; };
+template<> struct ImmediateType<float> { static const bool value = true; };
+template<> struct ImmediateType<double> { static const bool value = true; };
+template<> struct ImmediateType<int> { static const bool value = true; };
+
+/// The host values of var's node, or 0 if it has none
+template<int N, typename T>
+typename HostType<T>::type* immediate_values(const Generic<N, T>& var)
+{
+  Variant* variant = var.node()->getVariant();
+  if (!variant) return 0;
+  return static_cast<DataVariant<T, HOST>*>(variant)->begin();
+}
+
+/// Reads the elements of an operand through its swizzle and negation
+template<int M, typename T>
+struct ImmediateSource {
+  typedef typename HostType<T>::type host_type;
+
+  ImmediateSource(const Generic<M, T>& var, const host_type* values)
+    : m_values(values), m_swizzle(var.swizzle()), m_neg(var.neg())
+  {
+  }
+
+  /// Element i, or the only element of a scalar
+  host_type operator[](int i) const
+  {
+    host_type value = m_values[m_swizzle[M == 1 ? 0 : i]];
+    return m_neg ? -value : value;
+  }
+
+  const host_type* m_values;
+  const Swizzle& m_swizzle;
+  bool m_neg;
+};
+
+/// Writes result through the writemask and negation of dest, like
+/// Variable::setVariant()
+template<int N, typename T>
+void immediate_write(Generic<N, T>& dest, typename HostType<T>::type* values,
+                     const typename HostType<T>::type result[N])
+{
+  const Swizzle& swizzle = dest.swizzle();
+  bool neg = dest.neg();
+  for (int i = 0; i < N; ++i) {
+    values[swizzle[i]] = neg ? -result[i] : result[i];
+  }
+  dest.updateVariant();
+}
+
+struct ImmediateAsn {
+  template<typename H> static H apply(H a) { return a; }
+};
+struct ImmediateAdd {
+  template<typename H> static H apply(H a, H b) { return a + b; }
+};
+struct ImmediateMul {
+  template<typename H> static H apply(H a, H b) { return a * b; }
+};
+struct ImmediateDiv {
+  template<typename H> static H apply(H a, H b) { return a / b; }
+};
+struct ImmediateMad {
+  template<typename H> static H apply(H a, H b, H c) { return a * b + c; }
+};
+
+/** Runs Op on the host values of the operands.  Each function returns
+ * false, having done nothing, if the instruction has to take the
+ * general path: outside of immediate mode, for types Eval would cast,
+ * or when an operand has no values.
+ *
+ * The results are computed before dest is written, since it may share
+ * its node with an operand.
+ */
+template<typename T, bool Immediate = ImmediateType<T>::value>
+struct ImmediateInstruction {
+  template<typename Op, int N, int M>
+  static bool unary(Generic<N, T>&, const Generic<M, T>&)
+  {
+    return false;
+  }
+
+  template<typename Op, int N, int M1, int M2>
+  static bool binary(Generic<N, T>&, const Generic<M1, T>&, const Generic<M2, T>&)
+  {
+    return false;
+  }
+
+  template<typename Op, int N, int M1, int M2, int M3>
+  static bool ternary(Generic<N, T>&, const Generic<M1, T>&,
+                      const Generic<M2, T>&, const Generic<M3, T>&)
+  {
+    return false;
+  }
+};
+
+template<typename T>
+struct ImmediateInstruction<T, true> {
+  typedef typename HostType<T>::type host_type;
+
+  template<typename Op, int N, int M>
+  static bool unary(Generic<N, T>& dest, const Generic<M, T>& a)
+  {
+    if (!immediate()) return false;
+    host_type* values = immediate_values(dest);
+    const host_type* a_values = immediate_values(a);
+    if (!values || !a_values) return false;
+
+    ImmediateSource<M, T> A(a, a_values);
+    host_type result[N];
+    for (int i = 0; i < N; ++i) result[i] = Op::apply(A[i]);
+    immediate_write(dest, values, result);
+    return true;
+  }
+
+  template<typename Op, int N, int M1, int M2>
+  static bool binary(Generic<N, T>& dest, const Generic<M1, T>& a,
+                     const Generic<M2, T>& b)
+  {
+    if (!immediate()) return false;
+    host_type* values = immediate_values(dest);
+    const host_type* a_values = immediate_values(a);
+    const host_type* b_values = immediate_values(b);
+    if (!values || !a_values || !b_values) return false;
+
+    ImmediateSource<M1, T> A(a, a_values);
+    ImmediateSource<M2, T> B(b, b_values);
+    host_type result[N];
+    for (int i = 0; i < N; ++i) result[i] = Op::apply(A[i], B[i]);
+    immediate_write(dest, values, result);
+    return true;
+  }
+
+  template<typename Op, int N, int M1, int M2, int M3>
+  static bool ternary(Generic<N, T>& dest, const Generic<M1, T>& a,
+                      const Generic<M2, T>& b, const Generic<M3, T>& c)
+  {
+    if (!immediate()) return false;
+    host_type* values = immediate_values(dest);
+    const host_type* a_values = immediate_values(a);
+    const host_type* b_values = immediate_values(b);
+    const host_type* c_values = immediate_values(c);
+    if (!values || !a_values || !b_values || !c_values) return false;
+
+    ImmediateSource<M1, T> A(a, a_values);
+    ImmediateSource<M2, T> B(b, b_values);
+    ImmediateSource<M3, T> C(c, c_values);
+    host_type result[N];
+    for (int i = 0; i < N; ++i) result[i] = Op::apply(A[i], B[i], C[i]);
+    immediate_write(dest, values, result);
+    return true;
+  }
+};
+
+template<int N, int M, typename T>
+void shASN(Generic<N, T>& dest, const Generic<M, T>& src)
+{
+  if (ImmediateInstruction<T>::template unary<ImmediateAsn>(dest, src)) return;
+  shASN(static_cast<Variable&>(dest), static_cast<const Variable&>(src));
+}
+
+template<int N, int M1, int M2, typename T>
+void shADD(Generic<N, T>& dest, const Generic<M1, T>& a, const Generic<M2, T>& b)
+{
+  if (ImmediateInstruction<T>::template binary<ImmediateAdd>(dest, a, b)) return;
+  shADD(static_cast<Variable&>(dest), static_cast<const Variable&>(a),
+        static_cast<const Variable&>(b));
+}
+
+template<int N, int M1, int M2, typename T>
+void shMUL(Generic<N, T>& dest, const Generic<M1, T>& a, const Generic<M2, T>& b)
+{
+  if (ImmediateInstruction<T>::template binary<ImmediateMul>(dest, a, b)) return;
+  shMUL(static_cast<Variable&>(dest), static_cast<const Variable&>(a),
+        static_cast<const Variable&>(b));
+}
+
+template<int N, int M1, int M2, typename T>
+void shDIV(Generic<N, T>& dest, const Generic<M1, T>& a, const Generic<M2, T>& b)
+{
+  if (ImmediateInstruction<T>::template binary<ImmediateDiv>(dest, a, b)) return;
+  shDIV(static_cast<Variable&>(dest), static_cast<const Variable&>(a),
+        static_cast<const Variable&>(b));
+}
+
+template<int N, int M1, int M2, int M3, typename T>
+void shMAD(Generic<N, T>& dest, const Generic<M1, T>& a,
+           const Generic<M2, T>& b, const Generic<M3, T>& c)
+{
+  if (ImmediateInstruction<T>::template ternary<ImmediateMad>(dest, a, b, c)) return;
+  shMAD(static_cast<Variable&>(dest), static_cast<const Variable&>(a),
+        static_cast<const Variable&>(b), static_cast<const Variable&>(c));
+}
+
+}
+
+#endif
@@ -92,6 +92,29 @@ void scatter(const Array1D<T1>& dest,
              const Array1D<T2>& index,
              const Array1D<T1>& src);
 
+/// 2D and 3D indices are either positions in the source (or
+/// destination) stream, counted x first, or have one coordinate per
+/// dimension.
+template <typename T1, typename T2>
+void gather(const Array2D<T1>& dest,
+            const Array2D<T1>& src, 
+            const Array2D<T2>& index);
+
+template <typename T1, typename T2>
+void gather(const Array3D<T1>& dest,
+            const Array3D<T1>& src, 
+            const Array3D<T2>& index);
+
+template <typename T1, typename T2>
+void scatter(const Array2D<T1>& dest,
+             const Array2D<T2>& index,
+             const Array2D<T1>& src);
+
+template <typename T1, typename T2>
+void scatter(const Array3D<T1>& dest,
+             const Array3D<T2>& index,
+             const Array3D<T1>& src);
+
 }
 
 #include "LibStreamImpl.hpp"
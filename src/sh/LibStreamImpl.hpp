@@ -251,6 +251,55 @@ void scatter(const Array1D<T1>& dest, const Array1D<T2>& index, const Array1D<T1
   backend->scatter(dest, index, src);
 }
 
+
+template <typename T1, typename T2>
+void gather(const Array2D<T1>& dest, const Array2D<T1>& src, const Array2D<T2>& index)
+{
+  if (T2::typesize != 1 && T2::typesize != 2) {
+    error(Exception("2D gather index must be a 1 or 2 tuple"));
+    return;
+  }
+  BackendPtr backend = Backend::get_backend("stream");
+  SH_DEBUG_ASSERT(backend);
+  backend->gather(dest, src, index);
+}
+
+template <typename T1, typename T2>
+void gather(const Array3D<T1>& dest, const Array3D<T1>& src, const Array3D<T2>& index)
+{
+  if (T2::typesize != 1 && T2::typesize != 3) {
+    error(Exception("3D gather index must be a 1 or 3 tuple"));
+    return;
+  }
+  BackendPtr backend = Backend::get_backend("stream");
+  SH_DEBUG_ASSERT(backend);
+  backend->gather(dest, src, index);
+}
+
+template <typename T1, typename T2>
+void scatter(const Array2D<T1>& dest, const Array2D<T2>& index, const Array2D<T1>& src)
+{
+  if (T2::typesize != 1 && T2::typesize != 2) {
+    error(Exception("2D scatter index must be a 1 or 2 tuple"));
+    return;
+  }
+  BackendPtr backend = Backend::get_backend("stream");
+  SH_DEBUG_ASSERT(backend);
+  backend->scatter(dest, index, src);
+}
+
+template <typename T1, typename T2>
+void scatter(const Array3D<T1>& dest, const Array3D<T2>& index, const Array3D<T1>& src)
+{
+  if (T2::typesize != 1 && T2::typesize != 3) {
+    error(Exception("3D scatter index must be a 1 or 3 tuple"));
+    return;
+  }
+  BackendPtr backend = Backend::get_backend("stream");
+  SH_DEBUG_ASSERT(backend);
+  backend->scatter(dest, index, src);
+}
+
 }
 
 #endif
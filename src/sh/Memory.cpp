@@ -20,8 +20,29 @@
 #include "Memory.hpp"
 #include "Debug.hpp"
 #include "Variant.hpp"
+#include "StreamGraph.hpp"
+#include "BufferPool.hpp"
+#include "Threads.hpp"
 #include <cstring>
 #include <algorithm>
+#include <climits>
+
+namespace {
+
+/// Partial writes kept by each memory.  Storages further behind than
+/// that are synced whole.
+const std::size_t MaxChanges = 64;
+
+/// Guards the storage ids, transfers and paths.  Transfers register
+/// during static initialization, before a global mutex would be
+/// constructed.
+SH::Mutex& transfer_mutex()
+{
+  static SH::Mutex mutex;
+  return mutex;
+}
+
+}
 
 namespace SH {
 
@@ -47,26 +68,44 @@ int Memory::timestamp() const
 
 Pointer<Storage> Memory::findStorage(const std::string& id)
 {
-  for (StorageList::iterator I = m_storages.begin(); I != m_storages.end(); ++I) {
-    if ((*I)->id() == id) {
-      return *I;
-    }
-  }
-  return 0;
+  return findStorage(Storage::intern(id));
 }
 
 Pointer<const Storage> Memory::findStorage(const std::string& id) const
 {
-  for (StorageList::const_iterator I = m_storages.begin(); I != m_storages.end(); ++I) {
-    if ((*I)->id() == id) {
-      return *I;
-    }
+  return findStorage(Storage::intern(id));
+}
+
+Pointer<Storage> Memory::findStorage(int id)
+{
+  const std::vector<Storage*>& list = storages(id);
+  if (list.empty()) return 0;
+  return list.front();
+}
+
+Pointer<const Storage> Memory::findStorage(int id) const
+{
+  const std::vector<Storage*>& list = storages(id);
+  if (list.empty()) return 0;
+  return list.front();
+}
+
+const std::vector<Storage*>& Memory::storages(int id) const
+{
+  for (std::vector<Storage*>::const_iterator I = m_unindexed.begin(); I != m_unindexed.end(); ++I) {
+    int storage_id = (*I)->interned_id();
+    if (storage_id >= static_cast<int>(m_table.size())) m_table.resize(storage_id + 1);
+    m_table[storage_id].push_back(*I);
   }
-  return 0;
+  m_unindexed.clear();
+
+  if (id >= static_cast<int>(m_table.size())) m_table.resize(id + 1);
+  return m_table[id];
 }
 
 Memory::Memory()
-  : m_timestamp(0), m_frozen(false), m_frozenTimestamp(0)
+  : m_timestamp(0), m_frozen(false), m_frozenTimestamp(0), m_pending(false),
+    m_changes_start(0)
 {
 }
 
@@ -75,9 +114,55 @@ int Memory::increment_timestamp()
   return ++m_timestamp;
 }
 
+void Memory::record_change(int timestamp, std::size_t begin, std::size_t end)
+{
+  if (!end) {
+    m_changes.clear();
+    m_changes_start = timestamp;
+    return;
+  }
+
+  Change change;
+  change.timestamp = timestamp;
+  change.begin = begin;
+  change.end = end;
+  m_changes.push_back(change);
+  if (m_changes.size() > MaxChanges) {
+    m_changes_start = m_changes.front().timestamp;
+    m_changes.pop_front();
+  }
+}
+
+bool Memory::changes(int since, int until, ValueRanges& ranges) const
+{
+  if (since < m_changes_start) return false;
+
+  ranges.clear();
+  for (std::deque<Change>::const_iterator I = m_changes.begin(); I != m_changes.end(); ++I) {
+    if (I->timestamp > since && I->timestamp <= until) {
+      ranges.push_back(std::make_pair(I->begin, I->end));
+    }
+  }
+  if (ranges.empty()) return true;
+
+  // Merge overlapping and adjacent ranges
+  std::sort(ranges.begin(), ranges.end());
+  ValueRanges::iterator last = ranges.begin();
+  for (ValueRanges::iterator I = ranges.begin() + 1; I != ranges.end(); ++I) {
+    if (I->first <= last->second) {
+      last->second = std::max(last->second, I->second);
+    } else {
+      *++last = *I;
+    }
+  }
+  ranges.erase(last + 1, ranges.end());
+  return true;
+}
+
 void Memory::addStorage(const Pointer<Storage>& storage)
 {
   m_storages.push_back(storage);
+  m_unindexed.push_back(storage.object());
 }
 
 void Memory::removeStorage(const Pointer<Storage>& storage)
@@ -87,6 +172,11 @@ void Memory::removeStorage(const Pointer<Storage>& storage)
     return;
   }
   (*I)->orphan();
+  m_unindexed.erase(std::remove(m_unindexed.begin(), m_unindexed.end(), storage.object()),
+                    m_unindexed.end());
+  for (StorageTable::iterator J = m_table.begin(); J != m_table.end(); ++J) {
+    J->erase(std::remove(J->begin(), J->end(), storage.object()), J->end());
+  }
   m_storages.erase(I);
 
   // TODO: fix this, refcount lossage.
@@ -115,16 +205,22 @@ void Memory::freeze(bool state)
 // --- Transfer --- //
 ////////////////////////
 Transfer::Transfer(const std::string& from, const std::string& to)
+  : m_from(Storage::intern(from)), m_to(Storage::intern(to))
 {
   Storage::addTransfer(from, to, this);
 }
 
+Transfer::~Transfer()
+{
+  Storage::removeTransfer(this);
+}
+
 
 ///////////////////////
 // --- Storage --- //
 ///////////////////////
 Storage::Storage()
-  : m_timestamp(-1)
+  : m_timestamp(-1), m_interned_id(-1)
 {
 }
 
@@ -165,28 +261,50 @@ void Storage::sync() const
 {
   SH_DEBUG_ASSERT(m_memory);
   
+  if (m_memory->pending()) StreamGraph::instance()->flush();
+
   if (m_memory->timestamp() == timestamp()) return; // We are already in sync
 
-  // Out of sync. Find the cheapest other storage to sync from
+  // Out of sync. Find the cheapest other storage to sync from, possibly
+  // going through other storages of the memory
   const Storage* source = 0;
+  const std::vector<int>* source_path = 0;
   int transfer_cost = -1;
   Memory::StorageList::const_iterator I;
   for (I = m_memory->m_storages.begin(); I != m_memory->m_storages.end(); ++I) {
     const Storage* other = I->object();
     if (other == this) continue;
     if (other->timestamp() < m_memory->timestamp()) continue;
+    const std::vector<int>* other_path = 0;
     int local_cost = cost(other, this);
+    if (local_cost < 0) {
+      other_path = &path(other->interned_id(), interned_id());
+      local_cost = path_cost(*other_path);
+    }
     if (local_cost < 0) continue; // Can't transfer from that storage.
     if (!source || local_cost < transfer_cost) {
       source = other;
+      source_path = other_path;
       transfer_cost = local_cost;
     }
   }
   
-  // For now:
-  SH_DEBUG_ASSERT(source);
-  // TODO: In the future, traverse the graph of transfers to find a
-  // cheap, working one.
+  if (!source) {
+    SH_DEBUG_WARN("No transfer can bring " << this << " up to date!");
+    return;
+  }
+
+  // Bring the intermediate storages along the path up to date first
+  if (source_path) {
+    for (std::size_t i = 1; i + 1 < source_path->size(); ++i) {
+      Storage* next = m_memory->storages((*source_path)[i]).front();
+      if (!transfer(source, next)) {
+        SH_DEBUG_WARN("Transfer from " << source << " to " << next << " failed!");
+        return;
+      }
+      source = next;
+    }
+  }
 
   // Do the actual transfer
   // Need to cast away the constness since we actually want to write TO this,
@@ -206,34 +324,85 @@ void Storage::dirty()
 
 void Storage::dirtyall()
 {
+  if (m_memory->pending()) StreamGraph::instance()->flush();
+
   m_timestamp = m_memory->increment_timestamp();
+  m_memory->record_change(m_timestamp, 0, 0);
+}
+
+void Storage::dirty(std::size_t offset, std::size_t length)
+{
+  sync();
+
+  m_timestamp = m_memory->increment_timestamp();
+  std::size_t end = (offset + length + m_value_size - 1) / m_value_size;
+  if (end > 0) {
+    m_memory->record_change(m_timestamp, offset / m_value_size, end);
+  }
+}
+
+int Storage::interned_id() const
+{
+  if (m_interned_id < 0) m_interned_id = intern(id());
+  return m_interned_id;
+}
+
+int Storage::intern(const std::string& id)
+{
+  // Transfers intern their ids during static initialization, so this
+  // cannot be a static member
+  static std::map<std::string, int>* ids = new std::map<std::string, int>();
+  Lock lock(transfer_mutex());
+  std::map<std::string, int>::const_iterator I = ids->find(id);
+  if (I != ids->end()) return I->second;
+  int result = static_cast<int>(ids->size());
+  (*ids)[id] = result;
+  return result;
+}
+
+Transfer* Storage::find_transfer(int from, int to)
+{
+  if (!m_transfers) return 0;
+  if (from >= static_cast<int>(m_transfers->size())) return 0;
+  const std::vector<Transfer*>& transfers = (*m_transfers)[from];
+  if (to >= static_cast<int>(transfers.size())) return 0;
+  return transfers[to];
 }
 
 int Storage::cost(const Storage* from, const Storage* to)
 {
   if (!from) return -1;
   if (!to) return -1;
-  if (!m_transfers) return false;
-  
-  TransferMap::const_iterator I = m_transfers->find(std::make_pair(from->id(), to->id()));
-  if (I == m_transfers->end()) return -1;
 
-  return I->second->cost(from, to);
+  Transfer* transfer = find_transfer(from->interned_id(), to->interned_id());
+  if (!transfer) return -1;
+
+  return transfer->cost(from, to);
 }
 
 bool Storage::transfer(const Storage* from, Storage* to)
 {
   if (!from) return false;
   if (!to) return false;
-  if (!m_transfers) return false;
 
-  TransferMap::const_iterator I = m_transfers->find(std::make_pair(from->id(), to->id()));
-  if (I == m_transfers->end()) return false; // No transfer function?
+  Transfer* transfer = find_transfer(from->interned_id(), to->interned_id());
+  if (!transfer) return false; // No transfer function?
+
+  // Storages that were up to date before only need the values written
+  // since
+  ValueRanges ranges;
+  bool done;
+  if (to->timestamp() >= 0 && from->memory() && from->memory() == to->memory()
+      && from->memory()->changes(to->timestamp(), from->timestamp(), ranges)) {
+    done = transfer->transfer_ranges(from, to, ranges);
+  } else {
+    done = transfer->transfer(from, to);
+  }
 
   // TODO: Should we only allow transfers between storages
   // corresponding to the same memory?
   // Probably.
-  if (I->second->transfer(from, to)) {
+  if (done) {
     to->setTimestamp(from->timestamp());
     return true;
   } else {
@@ -241,18 +410,90 @@ bool Storage::transfer(const Storage* from, Storage* to)
   }
 }
 
+const std::vector<int>& Storage::path(int from, int to)
+{
+  Lock lock(transfer_mutex());
+  if (!m_paths) m_paths = new PathMap();
+  std::pair<PathMap::iterator, bool> inserted =
+    m_paths->insert(std::make_pair(std::make_pair(from, to), std::vector<int>()));
+  std::vector<int>& result = inserted.first->second;
+  if (!inserted.second || !m_transfers) return result;
+
+  // Dijkstra's algorithm over the ids, there are only a handful of them
+  int ids = static_cast<int>(m_transfers->size());
+  if (from >= ids || to >= ids) return result;
+  std::vector<int> distance(ids, INT_MAX);
+  std::vector<int> previous(ids, -1);
+  std::vector<bool> done(ids, false);
+  distance[from] = 0;
+  for (;;) {
+    int current = -1;
+    for (int i = 0; i < ids; ++i) {
+      if (!done[i] && distance[i] != INT_MAX
+          && (current < 0 || distance[i] < distance[current])) current = i;
+    }
+    if (current < 0 || current == to) break;
+    done[current] = true;
+
+    const std::vector<Transfer*>& transfers = (*m_transfers)[current];
+    for (int next = 0; next < static_cast<int>(transfers.size()); ++next) {
+      if (!transfers[next] || next == current) continue;
+      int next_distance = distance[current] + transfers[next]->path_cost();
+      if (next_distance < distance[next]) {
+        distance[next] = next_distance;
+        previous[next] = current;
+      }
+    }
+  }
+  if (distance[to] == INT_MAX || from == to) return result;
+
+  for (int id = to; id >= 0; id = previous[id]) result.push_back(id);
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
+int Storage::path_cost(const std::vector<int>& ids) const
+{
+  if (ids.size() < 3) return -1;
+
+  // Every storage in between has to exist for the data to go through it
+  int result = 0;
+  for (std::size_t i = 0; i + 1 < ids.size(); ++i) {
+    if (i > 0 && m_memory->storages(ids[i]).empty()) return -1;
+    result += find_transfer(ids[i], ids[i + 1])->path_cost();
+  }
+  return result;
+}
+
 void Storage::addTransfer(const std::string& from,
                             const std::string& to,
                             Transfer* transfer)
 {
-  if (!m_transfers) m_transfers = new TransferMap();
-  (*m_transfers)[std::make_pair(from, to)] = transfer;
+  Lock lock(transfer_mutex());
+  if (!m_transfers) m_transfers = new TransferTable();
+  int from_id = intern(from);
+  int to_id = intern(to);
+  int ids = std::max(from_id, to_id) + 1;
+  if (ids > static_cast<int>(m_transfers->size())) m_transfers->resize(ids);
+  for (TransferTable::iterator I = m_transfers->begin(); I != m_transfers->end(); ++I) {
+    if (ids > static_cast<int>(I->size())) I->resize(ids, 0);
+  }
+  (*m_transfers)[from_id][to_id] = transfer;
+  if (m_paths) m_paths->clear();
+}
+
+void Storage::removeTransfer(Transfer* transfer)
+{
+  Lock lock(transfer_mutex());
+  if (find_transfer(transfer->m_from, transfer->m_to) != transfer) return;
+  (*m_transfers)[transfer->m_from][transfer->m_to] = 0;
+  if (m_paths) m_paths->clear();
 }
 
 Storage::Storage(Memory* memory, ValueType value_type)
   : m_value_type(value_type), 
     m_value_size(typeInfo(value_type, MEM)->datasize()),
-    m_memory(memory), m_timestamp(-1)
+    m_memory(memory), m_timestamp(-1), m_interned_id(-1)
 {
   m_memory->addStorage(this);
 }
@@ -263,7 +504,8 @@ void Storage::value_type(ValueType value_type)
   m_value_size = typeInfo(value_type, MEM)->datasize();
 }
 
-Storage::TransferMap* Storage::m_transfers = 0;
+Storage::TransferTable* Storage::m_transfers = 0;
+Storage::PathMap* Storage::m_paths = 0;
 
 ///////////////////////////
 // --- HostStorage --- //
@@ -272,18 +514,17 @@ Storage::TransferMap* Storage::m_transfers = 0;
 HostStorage::HostStorage(Memory* memory, std::size_t length, ValueType value_type, std::size_t align)
   : Storage(memory, value_type),
     m_length(length),
-    m_data_unaligned(new char[length + align - 1]),
+    m_align(align),
+    m_data(0),
     m_managed(true)
 {
-  // Assumes align is a power of two
-  m_data = reinterpret_cast<void *>((reinterpret_cast<ptrdiff_t>(m_data_unaligned) + align - 1) & ~(align - 1));
 }
 
 HostStorage::HostStorage(Memory* memory, std::size_t length, void* data, ValueType value_type)
   : Storage(memory, value_type),
     m_length(length),
+    m_align(1),
     m_data(data),
-    m_data_unaligned(data),
     m_managed(false)
 {
 }
@@ -291,7 +532,7 @@ HostStorage::HostStorage(Memory* memory, std::size_t length, void* data, ValueTy
 HostStorage::~HostStorage()
 {
   if (m_managed) {
-    delete [] reinterpret_cast<char*>(m_data_unaligned);
+    BufferPool::instance()->release(m_data, m_length, m_align);
   }
 }
 
@@ -308,14 +549,24 @@ std::size_t HostStorage::length() const
 
 const void* HostStorage::data() const
 {
-  return m_data;
+  return const_cast<HostStorage*>(this)->data();
 }
 
 void* HostStorage::data()
 {
+  // Looking at the data of a memory waiting for stream results means
+  // the results are needed now
+  if (memory() && memory()->pending()) StreamGraph::instance()->flush();
+
+  if (m_managed && !m_data) allocate();
   return m_data;
 }
 
+void HostStorage::allocate()
+{
+  m_data = BufferPool::instance()->allocate(m_length, m_align);
+}
+
 //////////////////////////
 // --- HostMemory --- //
 //////////////////////////
@@ -385,6 +636,42 @@ public:
     return true;
   }
 
+  bool transfer_ranges(const Storage* from, Storage* to, const ValueRanges& ranges)
+  {
+    const HostStorage* host_from = dynamic_cast<const HostStorage*>(from);
+    HostStorage* host_to = dynamic_cast<HostStorage*>(to);
+
+    // Check that casts succeeded
+    if (!host_from) return false;
+    if (!host_to) return false;
+
+    const std::size_t nb_values = host_from->length() / host_from->value_size();
+    if (nb_values != host_to->length() / host_to->value_size()) {
+      std::cerr << "From length = " << host_from->length() << ", To length = " << host_to->length() << std::endl;
+      return false;
+    }
+
+    const char* from_data = reinterpret_cast<const char*>(host_from->data());
+    char* to_data = reinterpret_cast<char*>(host_to->data());
+    for (ValueRanges::const_iterator I = ranges.begin(); I != ranges.end(); ++I) {
+      std::size_t begin = I->first;
+      std::size_t end = std::min(I->second, nb_values);
+      if (begin >= end) continue;
+      if (host_from->value_type() == host_to->value_type()) {
+        std::memcpy(to_data + begin * host_to->value_size(),
+                    from_data + begin * host_from->value_size(),
+                    (end - begin) * host_to->value_size());
+      } else {
+        VariantPtr from_variant = variantFactory(host_from->value_type(), MEM)->
+          generate(end - begin, const_cast<char*>(from_data) + begin * host_from->value_size(), false);
+        VariantPtr to_variant = variantFactory(host_to->value_type(), MEM)->
+          generate(end - begin, to_data + begin * host_to->value_size(), false);
+        to_variant->set(from_variant);
+      }
+    }
+    return true;
+  }
+
   int cost(const Storage* from, const Storage* to)
   {
     return 10; // Maybe this should be 0, but you never know...
@@ -20,10 +20,12 @@
 #ifndef SHMEMORY_HPP
 #define SHMEMORY_HPP
 
+#include <deque>
 #include <list>
 #include <map>
 #include <utility>
 #include <string>
+#include <vector>
 #include "DllExport.hpp"
 #include "RefCount.hpp"
 #include "MemoryDep.hpp"
@@ -37,6 +39,11 @@ namespace SH {
 
 class Storage;
 
+/// Ranges of values of a memory, as [begin, end) pairs of value
+/// indices, sorted and not overlapping.  Values rather than bytes, so
+/// that ranges mean the same in storages of different value types.
+typedef std::vector< std::pair<std::size_t, std::size_t> > ValueRanges;
+
 /** A memory object.
  * A memory object represents a chunk of data.   Note, however, that
  * copies of this data may be stored in more than one place, i.e. on
@@ -58,12 +65,22 @@ public:
 
   Pointer<const Storage> findStorage(const std::string& id) const;
 
+  /// Find a storage of a given interned id.
+  /// @see Storage::intern
+  Pointer<Storage> findStorage(int id);
+
+  Pointer<const Storage> findStorage(int id) const;
+
   /// Find a storage of a given id selected by an external functor.
   /// @arg functor A functor of StoragePtr -> bool.
   template<typename Functor>
   Pointer<Storage> findStorage(const std::string& id, const Functor& f);
   template<typename Functor>
   Pointer<Storage> findStorage(const std::string& id, Functor& f);
+  template<typename Functor>
+  Pointer<Storage> findStorage(int id, const Functor& f);
+  template<typename Functor>
+  Pointer<Storage> findStorage(int id, Functor& f);
 
   /// Discard this storage from this memory
   void removeStorage(const Pointer<Storage>& storage);
@@ -77,16 +94,41 @@ public:
   /// (un)freeze the current timestamp
   void freeze(bool state);
 
+  /// Find the values written after version since of the memory, up to
+  /// version until, merged into ranges.  Returns false if they are not
+  /// all known, e.g. because the whole memory was written.
+  bool changes(int since, int until, ValueRanges& ranges) const;
+
+  /// Whether stream assignments waiting in the StreamGraph read or
+  /// write this memory
+  bool pending() const { return m_pending; }
+  /// \internal
+  void pending(bool state) { m_pending = state; }
+
 protected:
   Memory();
 
 private:
   int increment_timestamp();
 
+  /// Record that values [begin, end) were written at version timestamp,
+  /// or the whole memory when end is 0
+  void record_change(int timestamp, std::size_t begin, std::size_t end);
+
   void addStorage(const Pointer<Storage>& storage);
 
   typedef std::list< Pointer<Storage> > StorageList;
   StorageList m_storages;
+
+  /// The storages by interned id, in the order they were added.
+  /// Storages cannot tell their id while they are being constructed,
+  /// so they wait in m_unindexed until the next lookup.
+  typedef std::vector< std::vector<Storage*> > StorageTable;
+  mutable StorageTable m_table;
+  mutable std::vector<Storage*> m_unindexed;
+
+  /// Return the storages of an interned id
+  const std::vector<Storage*>& storages(int id) const;
   int m_timestamp;
 
   /// frozen memory's timestamp is updated only once it is thawed
@@ -94,6 +136,17 @@ private:
   /// timestamp at the point when the memory was frozen
   int m_frozenTimestamp;
 
+  bool m_pending;
+
+  struct Change {
+    int timestamp;
+    std::size_t begin, end;
+  };
+  /// The latest partial writes, oldest first
+  std::deque<Change> m_changes;
+  /// Writes after this version are all in m_changes
+  int m_changes_start;
+
   /// the list of all dependencies, for update calls
   std::list<MemoryDep*> dependencies;
 
@@ -122,21 +175,37 @@ typedef Pointer<const Memory> MemoryCPtr;
 class
 SH_DLLEXPORT Transfer {
 public:
-  virtual ~Transfer() {}
+  virtual ~Transfer();
 
   /// Returns true if the transfer succeeded.
   virtual bool transfer(const Storage* from, Storage* to) = 0;
 
+  /// Transfers only the values in ranges, the other values of to being
+  /// up to date already.  Returns true if the transfer succeeded.
+  /// Transfers everything unless overridden.
+  virtual bool transfer_ranges(const Storage* from, Storage* to, const ValueRanges& ranges)
+  {
+    return transfer(from, to);
+  }
+
   /// Returns -1 if transfer impossible, otherwise the cost of
   /// transfer.
   /// @todo Perhaps this needs more information, e.g. size of the storages.
   virtual int cost(const Storage* from, const Storage* to) = 0;
 
+  /// Returns the cost used to plan transfers going through other
+  /// storages, before the storages involved are known.  10 unless
+  /// overridden.
+  virtual int path_cost() const { return 10; }
+
 protected:
   Transfer(const std::string& from, const std::string& to);
 
 private:
-  
+  int m_from, m_to; ///< interned ids
+
+  friend class Storage;
+
   /// NOT IMPLEMENTED
   Transfer(const Transfer& other);
   /// NOT IMPLEMENTED
@@ -176,11 +245,24 @@ public:
   /// Mark an upcoming write to this storage.
   /// Don't call sync, all storages are replaced.
   void dirtyall();
+
+  /// Mark an upcoming write to length bytes of this storage starting at
+  /// offset.  This will sync, if necessary.  Only the values written
+  /// are copied when other storages sync after this.
+  void dirty(std::size_t offset, std::size_t length);
   
   /// Return an id uniquely identifying the _type_ of this storage
   /// This is used for looking up transfer functions.
   /// e.g.: host, opengl:texture, sm:texture
   virtual std::string id() const = 0;
+
+  /// Return the interned id() of this storage
+  int interned_id() const;
+
+  /// Return a small integer standing for a storage id, the same every
+  /// time it is asked for the same id.  Lookups by interned id are
+  /// cheaper than by name.
+  static int intern(const std::string& id);
   
   /// Return the cost of transferring from one storage to another.
   /// Returns -1 if there is no possible transfer.
@@ -190,6 +272,12 @@ public:
   /// Returns true if the transfer succeeded.
   static bool transfer(const Storage* from, Storage* to);
 
+  /// Return the cheapest chain of interned ids, from and to included,
+  /// along which registered transfers can take data from one id to
+  /// another, or an empty chain if there is none.
+  /// Chains are planned once and cached until transfers change.
+  static const std::vector<int>& path(int from, int to);
+
   /// Use this to register new transfer functions when they are instantiated.
   static void addTransfer(const std::string& from,
                           const std::string& to,
@@ -216,12 +304,26 @@ protected:
 private:
   Memory* m_memory;
   int m_timestamp;
+  mutable int m_interned_id; ///< -1 until asked for
 
   /// Force-set the version of the data currently stored by this storage
   void setTimestamp(int timestamp);
   
-  typedef std::map<std::pair<std::string, std::string>, Transfer*> TransferMap;
-  static TransferMap* m_transfers;
+  /// Registered transfers, by interned from and to ids
+  typedef std::vector< std::vector<Transfer*> > TransferTable;
+  static TransferTable* m_transfers;
+  static Transfer* find_transfer(int from, int to);
+
+  typedef std::map<std::pair<int, int>, std::vector<int> > PathMap;
+  static PathMap* m_paths;
+
+  static void removeTransfer(Transfer* transfer);
+
+  /// Return the cost of bringing this storage up to date along a path,
+  /// or -1 if this storage's memory lacks a storage along the way
+  int path_cost(const std::vector<int>& ids) const;
+
+  friend class Transfer;
 
   /// NOT IMPLEMENTED
   Storage(const Storage& other);
@@ -253,15 +355,19 @@ public:
   /// Return the length (in bytes) of data represented by this storage.
   std::size_t length() const;
 
-  /// Return the location of the storage's data on the host
+  /// Return the location of the storage's data on the host.
+  /// Internally managed data is only allocated once asked for, from
+  /// the BufferPool.
   const void* data() const;
   /// Return the location of the storage's data on the host
   void* data();
   
 private:
+  void allocate();
+
   std::size_t m_length; ///< number of bytes stored
+  std::size_t m_align;  ///< alignment of internally managed data
   void* m_data;         ///< the actual data, stored on the host, aligned
-  void* m_data_unaligned; ///< the actual data, stored on the host
 
   bool m_managed; ///< Did we create the data? If so, this is true
 
@@ -299,23 +405,39 @@ typedef Pointer<HostMemory> HostMemoryPtr;
 typedef Pointer<const HostMemory> HostMemoryCPtr;
 
 template<typename Functor>
-Pointer<Storage> Memory::findStorage(const std::string& id, Functor& f)
+Pointer<Storage> Memory::findStorage(int id, Functor& f)
 {
-  for (StorageList::iterator I = m_storages.begin(); I != m_storages.end(); ++I) {
-    if ((*I)->id() == id && f(*I)) return *I;
+  const std::vector<Storage*>& list = storages(id);
+  for (std::vector<Storage*>::const_iterator I = list.begin(); I != list.end(); ++I) {
+    Pointer<Storage> storage(*I);
+    if (f(storage)) return storage;
   }
   return 0;
 }
 
 template<typename Functor>
-Pointer<Storage> Memory::findStorage(const std::string& id, const Functor& f)
+Pointer<Storage> Memory::findStorage(int id, const Functor& f)
 {
-  for (StorageList::iterator I = m_storages.begin(); I != m_storages.end(); ++I) {
-    if ((*I)->id() == id && f(*I)) return *I;
+  const std::vector<Storage*>& list = storages(id);
+  for (std::vector<Storage*>::const_iterator I = list.begin(); I != list.end(); ++I) {
+    Pointer<Storage> storage(*I);
+    if (f(storage)) return storage;
   }
   return 0;
 }
 
+template<typename Functor>
+Pointer<Storage> Memory::findStorage(const std::string& id, Functor& f)
+{
+  return findStorage(Storage::intern(id), f);
+}
+
+template<typename Functor>
+Pointer<Storage> Memory::findStorage(const std::string& id, const Functor& f)
+{
+  return findStorage(Storage::intern(id), f);
+}
+
 /*@}*/
 
 }
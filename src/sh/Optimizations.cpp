@@ -27,6 +27,7 @@
 #include "Evaluate.hpp"
 #include "Context.hpp"
 #include "Syntax.hpp"
+#include "PassManager.hpp"
 #include <sstream>
 #include <fstream>
 
@@ -39,6 +40,11 @@ using namespace SH;
 // Branch instruction insertion/removal
 
 struct BraInstInserter {
+  BraInstInserter(bool& changed)
+    : changed(changed)
+  {
+  }
+
   void operator()(CtrlGraphNode* node)
   {
     if (!node) return;
@@ -47,11 +53,19 @@ struct BraInstInserter {
          I != node->successors_end(); ++I) {
       if (!node->block) node->block = new BasicBlock();
       node->block->addStatement(Statement(I->cond, OP_OPTBRA, I->cond));
+      changed = true;
     }
   }
+
+  bool& changed;
 };
 
 struct BraInstRemover {
+  BraInstRemover(bool& changed)
+    : changed(changed)
+  {
+  }
+
   void operator()(CtrlGraphNode* node)
   {
     if (!node) return;
@@ -61,11 +75,14 @@ struct BraInstRemover {
     for (BasicBlock::StmtList::iterator I = block->begin(); I != block->end();) {
       if (I->op == OP_OPTBRA) {
         I = block->erase(I);
+        changed = true;
         continue;
       }
       ++I;
     }
   }
+
+  bool& changed;
 };
 
 // Straightening
@@ -185,6 +202,7 @@ struct RedundantEdgeRemover {
          i != node->successors_end();) {
       if (i->node == node->follower()) {
         i = node->successors_erase(i);
+        changed = true;
       } else {
         ++i;
       }
@@ -407,6 +425,10 @@ struct ForwardSubst {
 };
 
 struct ForwardPlacement {
+  ForwardPlacement(bool& changed)
+    : changed(changed)
+  {
+  }
   
   void operator()(CtrlGraphNode* node) {
     if (!node) return;
@@ -421,8 +443,13 @@ struct ForwardPlacement {
         if ((*J)->dest.node() == I->dest.node() ||
             inRHS((*J)->dest.node(), *I) || 
             inRHS(I->dest.node(), **J)) {
-          block->m_statements.insert(I, **J);
-          block->m_statements.erase(*J);
+          // Splice rather than copy, so that statements keep their
+          // identity (and any info pointing at them) when they move
+          BasicBlock::StmtList::iterator next = *J;
+          if (++next != I) {
+            block->m_statements.splice(I, block->m_statements, *J);
+            changed = true;
+          }
           J = m_movable.erase(J);
         }
         else
@@ -435,6 +462,7 @@ struct ForwardPlacement {
   
   typedef std::list<BasicBlock::StmtList::iterator> MovableList;
   MovableList m_movable;
+  bool& changed;
 };
 
 }
@@ -443,13 +471,25 @@ namespace SH {
 
 void insert_branch_instructions(Program& p)
 {
-  BraInstInserter r;
+  bool changed;
+  insert_branch_instructions(p, changed);
+}
+
+void insert_branch_instructions(Program& p, bool& changed)
+{
+  BraInstInserter r(changed);
   p.node()->ctrlGraph->dfs(r);
 }
 
 void remove_branch_instructions(Program& p)
 {
-  BraInstRemover r;
+  bool changed;
+  remove_branch_instructions(p, changed);
+}
+
+void remove_branch_instructions(Program& p, bool& changed)
+{
+  BraInstRemover r(changed);
   p.node()->ctrlGraph->dfs(r);
 }
 
@@ -516,9 +556,9 @@ void forward_substitute(Program& p, bool& changed)
   p.node()->ctrlGraph->dfs(f);
 }
 
-void forward_placement(Program& p)
+void forward_placement(Program& p, bool& changed)
 {
-  ForwardPlacement r;
+  ForwardPlacement r(changed);
   p.node()->ctrlGraph->dfs(r);
 }
 
@@ -532,71 +572,7 @@ void optimize(Program& p, int level)
   SH_DEBUG_PRINT(p.node()->describe_decls());
 #endif
 
-#ifdef SH_DEBUG_OPTIMIZER
-  int pass = 0;
-  SH_DEBUG_PRINT("Begin optimization for program with target " << p.node()->target());
-#endif
-  
-  bool changed;
-  do {
-
-#ifdef SH_DEBUG_OPTIMIZER
-    SH_DEBUG_PRINT("---Optimizer pass " << pass << " BEGIN---");
-    std::ostringstream s;
-    s << "opt_" << pass;
-    std::string filename = s.str() + ".dot";
-    std::ofstream out(filename.c_str());
-    p.node()->ctrlGraph->graphviz_dump(out);
-    out.close();
-    std::string cmdline = std::string("dot -Tps -o ") + s.str() + ".ps " + s.str() + ".dot";
-    system(cmdline.c_str());
-#endif
-
-    changed = false;
-
-    if (!Context::current()->optimization_disabled("copy propagation")) {
-      copy_propagate(p, changed);
-    }
-    if (!Context::current()->optimization_disabled("forward substitution")) {
-      forward_substitute(p, changed);
-    }
-
-    if (!Context::current()->optimization_disabled("remove_empty_blocks")) {
-      remove_empty_blocks(p, changed);
-    }
-
-    if (!Context::current()->optimization_disabled("straightening")) {
-      straighten(p, changed);
-    }
-
-    if (!Context::current()->optimization_disabled("remove_redundant_edges")) {
-      remove_redundant_edges(p, changed);
-    }
-
-    insert_branch_instructions(p);
-
-    if (level >= 2 &&
-        !Context::current()->optimization_disabled("propagation")) {
-      add_value_tracking(p);
-      propagate_constants(p);
-    }
-
-    if (!Context::current()->optimization_disabled("deadcode")) {
-      add_value_tracking(p); // TODO: Really necessary?
-      remove_dead_code(p, changed);
-    }
-
-    remove_branch_instructions(p);
-
-    if (!Context::current()->optimization_disabled("forward placement")) {
-      forward_placement(p);
-    }
-
-#ifdef SH_DEBUG_OPTIMIZER
-    SH_DEBUG_PRINT("---Optimizer pass " << pass << " END---");
-    pass++;
-#endif
-  } while (changed);
+  PassManager::instance()->run(p, level, Context::current()->optimizer_stats());
   p.node()->collectVariables();
 }
 
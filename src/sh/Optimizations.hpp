@@ -59,15 +59,35 @@ void add_value_tracking(Program& prg);
 /// Insert instructions representing each conditional branch
 SH_DLLEXPORT
 void insert_branch_instructions(Program& prg);
+SH_DLLEXPORT
+void insert_branch_instructions(Program& prg, bool& changed);
 
 /// Remove instructions representing conditional branches
 SH_DLLEXPORT
 void remove_branch_instructions(Program& prg);
+SH_DLLEXPORT
+void remove_branch_instructions(Program& prg, bool& changed);
+
+/// Replace uses of copies with what was copied
+SH_DLLEXPORT
+void copy_propagate(Program& p, bool& changed);
+
+/// Substitute single assignments into the statements using them
+SH_DLLEXPORT
+void forward_substitute(Program& p, bool& changed);
+
+/// Remove blocks with no statements
+SH_DLLEXPORT
+void remove_empty_blocks(Program& p, bool& changed);
 
 /// Merge blocks with redundant edges
 SH_DLLEXPORT
 void straighten(Program& p, bool& changed);
 
+/// Remove conditional edges going to the same place as the follower
+SH_DLLEXPORT
+void remove_redundant_edges(Program& p, bool& changed);
+
 /// Remove code that serves no purpose in the given program
 SH_DLLEXPORT
 void remove_dead_code(Program& p, bool& changed);
@@ -75,6 +95,12 @@ void remove_dead_code(Program& p, bool& changed);
 /// Propagate constants and lift uniform computations
 SH_DLLEXPORT
 void propagate_constants(Program& p);
+SH_DLLEXPORT
+void propagate_constants(Program& p, bool& changed);
+
+/// Move statements down to just before their results are first needed
+SH_DLLEXPORT
+void forward_placement(Program& p, bool& changed);
 
 /* per statement uddu chains */
 struct 
@@ -0,0 +1,288 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include "PassManager.hpp"
+
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <sys/time.h>
+#endif
+
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <fstream>
+#include "Context.hpp"
+#include "CtrlGraph.hpp"
+#include "Debug.hpp"
+#include "Optimizations.hpp"
+#include "Program.hpp"
+
+namespace {
+
+using namespace SH;
+
+/// Wall clock time in seconds
+double now()
+{
+#if defined(_WIN32)
+  LARGE_INTEGER count, frequency;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&frequency);
+  return static_cast<double>(count.QuadPart) / frequency.QuadPart;
+#else
+  timeval time;
+  gettimeofday(&time, 0);
+  return time.tv_sec + time.tv_usec * 1e-6;
+#endif
+}
+
+struct SizeCounter {
+  SizeCounter()
+    : statements(0), blocks(0)
+  {
+  }
+
+  void operator()(CtrlGraphNode* node)
+  {
+    if (!node) return;
+    ++blocks;
+    if (node->block) statements += node->block->m_statements.size();
+  }
+
+  int statements;
+  int blocks;
+};
+
+/// Times a run and adds it to stats, along with the size of the
+/// program after it
+class PassRun {
+public:
+  PassRun(Program& p, PassStats& stats, int statements)
+    : m_program(p), m_stats(stats), m_statements(statements), m_start(now())
+  {
+  }
+
+  /// Returns the number of statements after the run
+  int finish(bool changed)
+  {
+    m_stats.seconds += now() - m_start;
+    ++m_stats.runs;
+    if (changed) ++m_stats.changes;
+
+    SizeCounter size;
+    m_program.node()->ctrlGraph->dfs(size);
+    if (size.statements < m_statements) {
+      m_stats.statements_removed += m_statements - size.statements;
+    } else {
+      m_stats.statements_added += size.statements - m_statements;
+    }
+    m_stats.statements = size.statements;
+    m_stats.blocks = size.blocks;
+    return size.statements;
+  }
+
+private:
+  Program& m_program;
+  PassStats& m_stats;
+  int m_statements;
+  double m_start;
+};
+
+}
+
+namespace SH {
+
+PassStats::PassStats(const std::string& name)
+  : name(name), runs(0), changes(0), seconds(0.0),
+    statements_removed(0), statements_added(0),
+    statements(0), blocks(0)
+{
+}
+
+OptimizerStats::OptimizerStats()
+  : programs(0), iterations(0), seconds(0.0), analyses_reused(0)
+{
+}
+
+const PassStats* OptimizerStats::pass(const std::string& name) const
+{
+  for (PassList::const_iterator I = passes.begin(); I != passes.end(); ++I) {
+    if (I->name == name) return &*I;
+  }
+  return 0;
+}
+
+PassStats& OptimizerStats::add_pass(const std::string& name)
+{
+  for (PassList::iterator I = passes.begin(); I != passes.end(); ++I) {
+    if (I->name == name) return *I;
+  }
+  passes.push_back(PassStats(name));
+  return passes.back();
+}
+
+std::ostream& operator<<(std::ostream& out, const OptimizerStats& stats)
+{
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(4);
+
+  out << stats.programs << " programs, " << stats.iterations << " iterations, "
+      << stats.seconds << "s, value tracking reused " 
+      << stats.analyses_reused << " times" << std::endl;
+  out << std::left << std::setw(28) << "pass" << std::right
+      << std::setw(7) << "runs" << std::setw(9) << "changes"
+      << std::setw(10) << "seconds" << std::setw(9) << "removed"
+      << std::setw(9) << "added" << std::setw(8) << "stmts"
+      << std::setw(8) << "blocks" << std::endl;
+  for (OptimizerStats::PassList::const_iterator I = stats.passes.begin();
+       I != stats.passes.end(); ++I) {
+    out << std::left << std::setw(28) << I->name << std::right
+        << std::setw(7) << I->runs << std::setw(9) << I->changes
+        << std::setw(10) << I->seconds << std::setw(9) << I->statements_removed
+        << std::setw(9) << I->statements_added << std::setw(8) << I->statements
+        << std::setw(8) << I->blocks << std::endl;
+  }
+
+  out.flags(flags);
+  out.precision(precision);
+  return out;
+}
+
+namespace {
+// Made at load time rather than by whichever threads optimize their
+// first programs at once
+PassManager* const loaded_manager = PassManager::instance();
+}
+
+PassManager* PassManager::instance()
+{
+  static PassManager* manager = new PassManager();
+  return manager;
+}
+
+PassManager::PassManager()
+{
+  add("copy propagation", copy_propagate, 1, REPEAT);
+  add("forward substitution", forward_substitute, 1, REPEAT);
+  add("remove_empty_blocks", remove_empty_blocks, 1, REPEAT);
+  add("straightening", straighten, 1, REPEAT);
+  add("remove_redundant_edges", remove_redundant_edges, 1, REPEAT);
+  add("insert branch instructions", insert_branch_instructions, 1, REQUIRED);
+  add("propagation", propagate_constants, 2, NEEDS_VALUE_TRACKING);
+  add("deadcode", remove_dead_code, 1, NEEDS_VALUE_TRACKING | REPEAT);
+  add("remove branch instructions", remove_branch_instructions, 1, REQUIRED);
+  add("forward placement", forward_placement, 1, 0);
+}
+
+void PassManager::add(const std::string& name, Pass pass, int level, int flags)
+{
+  Entry entry;
+  entry.name = name;
+  entry.pass = pass;
+  entry.level = level;
+  entry.flags = flags;
+  m_passes.push_back(entry);
+}
+
+void PassManager::run(Program& p, int level, OptimizerStats& stats) const
+{
+  double start = now();
+
+  // The passes to run and where their stats go
+  std::vector<const Entry*> passes;
+  std::vector<PassStats*> pass_stats;
+  for (PassList::const_iterator I = m_passes.begin(); I != m_passes.end(); ++I) {
+    if (I->level > level) continue;
+    if (!(I->flags & REQUIRED) &&
+        Context::current()->optimization_disabled(I->name)) continue;
+    passes.push_back(&*I);
+  }
+  // Add them all before holding on to any, since adding can move them
+  stats.add_pass("value tracking");
+  for (std::size_t i = 0; i < passes.size(); ++i) stats.add_pass(passes[i]->name);
+  PassStats* tracking_stats = &stats.add_pass("value tracking");
+  for (std::size_t i = 0; i < passes.size(); ++i) {
+    pass_stats.push_back(&stats.add_pass(passes[i]->name));
+  }
+
+  SizeCounter size;
+  p.node()->ctrlGraph->dfs(size);
+  int statements = size.statements;
+
+  bool tracked = false; // whether value tracking is up to date
+#ifdef SH_DEBUG_OPTIMIZER
+  int iteration = 0;
+  SH_DEBUG_PRINT("Begin optimization for program with target " << p.node()->target());
+#endif
+
+  bool repeat;
+  do {
+#ifdef SH_DEBUG_OPTIMIZER
+    SH_DEBUG_PRINT("---Optimizer pass " << iteration << " BEGIN---");
+    std::ostringstream s;
+    s << "opt_" << iteration;
+    std::string filename = s.str() + ".dot";
+    std::ofstream out(filename.c_str());
+    p.node()->ctrlGraph->graphviz_dump(out);
+    out.close();
+    std::string cmdline = std::string("dot -Tps -o ") + s.str() + ".ps " + s.str() + ".dot";
+    system(cmdline.c_str());
+#endif
+
+    ++stats.iterations;
+    repeat = false;
+    for (std::size_t i = 0; i < passes.size(); ++i) {
+      const Entry& entry = *passes[i];
+
+      if (entry.flags & NEEDS_VALUE_TRACKING) {
+        if (tracked) {
+          ++stats.analyses_reused;
+        } else {
+          PassRun run(p, *tracking_stats, statements);
+          add_value_tracking(p);
+          statements = run.finish(false);
+          tracked = true;
+        }
+      }
+
+      bool changed = false;
+      PassRun run(p, *pass_stats[i], statements);
+      entry.pass(p, changed);
+      statements = run.finish(changed);
+
+      if (changed) {
+        tracked = false;
+        if (entry.flags & REPEAT) repeat = true;
+      }
+    }
+
+#ifdef SH_DEBUG_OPTIMIZER
+    SH_DEBUG_PRINT("---Optimizer pass " << iteration << " END---");
+    ++iteration;
+#endif
+  } while (repeat);
+
+  ++stats.programs;
+  stats.seconds += now() - start;
+}
+
+}
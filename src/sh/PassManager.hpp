@@ -0,0 +1,130 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHPASSMANAGER_HPP
+#define SHPASSMANAGER_HPP
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "DllExport.hpp"
+
+namespace SH {
+
+class Program;
+
+/** What one optimizer pass (or analysis) did, summed over the programs
+ * optimized.
+ */
+struct
+SH_DLLEXPORT PassStats {
+  PassStats(const std::string& name);
+
+  std::string name;
+  int runs;        ///< times it ran
+  int changes;     ///< runs that changed the program
+  double seconds;  ///< wall time spent in it
+  long statements_removed; ///< statements fewer after its runs than before
+  long statements_added;   ///< statements more after its runs than before
+  int statements;  ///< statements in the program after its last run
+  int blocks;      ///< control graph nodes after its last run
+};
+
+/** What the optimizer did.
+ * @see Context::optimizer_stats()
+ */
+struct
+SH_DLLEXPORT OptimizerStats {
+  OptimizerStats();
+
+  int programs;   ///< programs optimized
+  int iterations; ///< times through the passes, over all programs
+  double seconds; ///< wall time spent optimizing
+
+  /// Times a pass needing value tracking found it still up to date, so
+  /// that it was not rebuilt
+  int analyses_reused;
+
+  /// The "value tracking" analysis, then the passes in the order they
+  /// run
+  typedef std::vector<PassStats> PassList;
+  PassList passes;
+
+  /// The stats of the named pass, or 0 if it has not run
+  const PassStats* pass(const std::string& name) const;
+  PassStats& add_pass(const std::string& name);
+};
+
+/// Prints the stats as a table, one pass to a line
+SH_DLLEXPORT
+std::ostream& operator<<(std::ostream& out, const OptimizerStats& stats);
+
+/** Runs the optimizer passes over a program, over and over until none
+ * of them changes it.
+ *
+ * Each pass says whether it changed the program.  Value tracking is
+ * built for the passes needing it, and only rebuilt when a pass has
+ * changed the program since it was last built.
+ *
+ * Each pass can be turned off with Context::disable_optimization(),
+ * by its name, unless it is REQUIRED.
+ */
+class
+SH_DLLEXPORT PassManager {
+public:
+  /// The passes optimize() runs
+  static PassManager* instance();
+
+  typedef void (*Pass)(Program& p, bool& changed);
+
+  enum Flags {
+    NEEDS_VALUE_TRACKING = 1, ///< needs up to date value tracking
+    REPEAT = 2,   ///< if it changes the program, run all the passes again
+    REQUIRED = 4  ///< cannot be disabled
+  };
+
+  /// Adds a pass run at optimization levels of at least level, after
+  /// the passes already added.  Add passes before optimizing programs
+  /// on several threads.
+  void add(const std::string& name, Pass pass, int level, int flags);
+
+  /// Runs the passes for the given level over p, adding what they did
+  /// to stats
+  void run(Program& p, int level, OptimizerStats& stats) const;
+
+private:
+  PassManager();
+
+  struct Entry {
+    std::string name;
+    Pass pass;
+    int level;
+    int flags;
+  };
+  typedef std::vector<Entry> PassList;
+  PassList m_passes;
+
+  // NOT IMPLEMENTED
+  PassManager(const PassManager& other);
+  PassManager& operator=(const PassManager& other);
+};
+
+}
+
+#endif
@@ -34,6 +34,7 @@ Pool::Pool(std::size_t element_size, std::size_t block_size)
 
 void* Pool::alloc()
 {
+  ScopedLock<SpinLock> lock(m_lock);
   if (!m_next) {
     //SH_DEBUG_PRINT("new pool");
     char* block = new char[m_block_size * m_element_size];
@@ -52,10 +53,22 @@ void* Pool::alloc()
 
 void Pool::free(void* ptr)
 {
+  ScopedLock<SpinLock> lock(m_lock);
   *((void**)ptr) = m_next;
   m_next = ptr;
 }
 
+Pool* Pool::get(Pool*& pool, std::size_t element_size, std::size_t block_size)
+{
+  if (!pool) {
+    Pool* created = new Pool(element_size, block_size);
+    if (!atomic_set_if_null(reinterpret_cast<void* volatile&>(pool), created)) {
+      delete created;
+    }
+  }
+  return pool;
+}
+
 }
 
 #endif // USE_MEMORY_POOL
@@ -26,6 +26,7 @@
 
 #include <cstddef>
 #include "DllExport.hpp"
+#include "Threads.hpp"
 
 namespace SH {
 
@@ -38,11 +39,16 @@ public:
   void* alloc();
   void free(void*);
 
+  /// Returns pool, creating it first if it is null.  Threads racing
+  /// to create the same pool all get the same one.
+  static Pool* get(Pool*& pool, std::size_t element_size, std::size_t block_size);
+
 private:
   std::size_t m_element_size;
   std::size_t m_block_size;
 
   void* m_next;
+  SpinLock m_lock; ///< guards m_next
 };
 
 }
@@ -37,6 +37,13 @@ ProgramSet::ProgramSet(const Program& a, const Program& b)
   m_nodes.push_back(shref_const_cast<ProgramNode>(b.node()));
 }
 
+ProgramSet::ProgramSet(const std::list<Program>& programs)
+{
+  for (std::list<Program>::const_iterator I = programs.begin(); I != programs.end(); ++I) {
+    m_nodes.push_back(shref_const_cast<ProgramNode>(I->node()));
+  }
+}
+
 Pointer<BackendSet> ProgramSet::backend_set(const Pointer<Backend>& backend) const
 {
   if (!backend) return 0;
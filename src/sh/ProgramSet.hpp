@@ -36,6 +36,7 @@ public:
   ProgramSet(); // empty set
   explicit ProgramSet(const Program& a);
   ProgramSet(const Program& a, const Program& b);
+  explicit ProgramSet(const std::list<Program>& programs);
 
   typedef std::list<ProgramNodePtr> NodeList;
   typedef NodeList::iterator iterator;
@@ -22,6 +22,7 @@
 
 #include <utility>
 #include "DllExport.hpp"
+#include "Threads.hpp"
 
 // #define REFCOUNT_DEBUGGING
 
@@ -80,7 +81,7 @@ public:
               << ": " << m_refCount << "->" << (m_refCount + 1) << std::endl;
     RCDEBUG_NORMAL;
 #endif
-    return ++m_refCount;
+    return atomic_increment(m_refCount);
   }
   
   int releaseRef() const
@@ -91,7 +92,7 @@ public:
               << ": " << m_refCount << "->" << (m_refCount - 1) << std::endl;
     RCDEBUG_NORMAL;
 #endif
-    return --m_refCount;
+    return atomic_decrement(m_refCount);
   }
 
   int refCount() const
@@ -100,7 +101,8 @@ public:
   }
 
 private:
-  mutable int m_refCount;
+  /// Changed atomically, so that objects can be shared between threads
+  mutable volatile int m_refCount;
 };
 
 /** A reference-counting smart pointer. 
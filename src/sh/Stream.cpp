@@ -23,6 +23,7 @@
 #include "Algebra.hpp"
 #include "Context.hpp"
 #include "BaseTexture.hpp"
+#include "StreamGraph.hpp"
 
 namespace SH {
 
@@ -156,9 +157,11 @@ Program operator<<(const Program& program,
 Stream& Stream::operator=(const Program& program)
 {
   SH_DEBUG_ASSERT(program.node());
-  BackendPtr backend = Backend::get_backend(program.target());
-  SH_DEBUG_ASSERT(backend);
-  backend->execute(program, *this);
+  if (Context::current()->lazy_streams()) {
+    StreamGraph::instance()->record(program, *this);
+  } else {
+    StreamGraph::execute(program, *this);
+  }
   return *this;
 }
 
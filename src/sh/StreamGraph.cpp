@@ -0,0 +1,415 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <iterator>
+#include "StreamGraph.hpp"
+#include "Algebra.hpp"
+#include "Backend.hpp"
+#include "Context.hpp"
+#include "Debug.hpp"
+#include "DependentGraph.hpp"
+#include "Internals.hpp"
+#include "ProgramNode.hpp"
+#include "Record.hpp"
+#include "Threads.hpp"
+
+namespace {
+
+using namespace SH;
+
+const Memory* memory_of(const BaseTexture& stream)
+{
+  return stream.node()->memory(0).object();
+}
+
+/// Whether two streams are the same elements of the same texture
+bool same_elements(const BaseTexture& a, const BaseTexture& b)
+{
+  if (a.node() != b.node()) return false;
+
+  int a_params[3], b_params[3];
+  a.get_offset(a_params, 3);
+  b.get_offset(b_params, 3);
+  if (!std::equal(a_params, a_params + 3, b_params)) return false;
+  a.get_stride(a_params, 3);
+  b.get_stride(b_params, 3);
+  if (!std::equal(a_params, a_params + 3, b_params)) return false;
+  a.get_count(a_params, 3);
+  b.get_count(b_params, 3);
+  return std::equal(a_params, a_params + 3, b_params);
+}
+
+bool writes(const Stream& dest, const Memory* memory)
+{
+  for (Stream::const_iterator I = dest.begin(); I != dest.end(); ++I) {
+    if (memory_of(*I) == memory) return true;
+  }
+  return false;
+}
+
+/// Memories read by a program, from its streams and its textures
+std::vector<const Memory*> reads(const Program& program)
+{
+  std::vector<const Memory*> result;
+  for (Stream::const_iterator I = program.stream_inputs.begin();
+       I != program.stream_inputs.end(); ++I) {
+    result.push_back(memory_of(*I));
+  }
+  for (ProgramNode::TexList::const_iterator I = program.node()->begin_textures();
+       I != program.node()->end_textures(); ++I) {
+    if ((*I)->memory(0)) result.push_back((*I)->memory(0).object());
+  }
+  return result;
+}
+
+/// Returns a copy of a program with inputs and outputs of its own, so
+/// that it can be connected to a program sharing them (itself, say)
+ProgramNodePtr copy_program(const ProgramNodeCPtr& program)
+{
+  ProgramNodePtr result = program->clone();
+  ProgramNode::VarList inputs = result->inputs;
+  ProgramNode::VarList outputs = result->outputs;
+
+  VarMap varMap;
+  Context::current()->enter(result);
+  for (ProgramNode::VarList::const_iterator I = inputs.begin(); I != inputs.end(); ++I) {
+    varMap[*I] = (*I)->clone();
+  }
+  for (ProgramNode::VarList::const_iterator I = outputs.begin(); I != outputs.end(); ++I) {
+    if (varMap.find(*I) == varMap.end()) varMap[*I] = (*I)->clone();
+  }
+  Context::current()->exit();
+
+  VariableReplacer replacer(varMap);
+  replacer(inputs);
+  replacer(outputs);
+  result->inputs = inputs;
+  result->outputs = outputs;
+  result->ctrlGraph->dfs(replacer);
+  result->collectVariables();
+  return result;
+}
+
+void add_uniform(std::vector<std::pair<VariableNodePtr, VariantPtr> >& values,
+                 const VariableNodePtr& node)
+{
+  if (node->getVariant()) {
+    values.push_back(std::make_pair(node, node->getVariant()->get()));
+  }
+}
+
+}
+
+namespace SH {
+
+StreamGraph* StreamGraph::instance()
+{
+  static SH_THREAD_LOCAL StreamGraph* graph = 0;
+  if (!graph) graph = new StreamGraph();
+  return graph;
+}
+
+StreamGraph::StreamGraph()
+  : m_flushing(false)
+{
+}
+
+bool StreamGraph::empty() const
+{
+  return m_work.empty();
+}
+
+std::size_t StreamGraph::fused_programs() const
+{
+  return m_fused.size();
+}
+
+void StreamGraph::execute(const Program& program, Stream& dest)
+{
+  DependentGraph::instance()->flush();
+  BackendPtr backend = Backend::get_backend(program.target());
+  SH_DEBUG_ASSERT(backend);
+  int window = Context::current()->stream_window();
+  if (window > 0) {
+    backend->execute_windows(program, dest, window);
+  } else {
+    backend->execute(program, dest);
+  }
+}
+
+void StreamGraph::record(const Program& program, const Stream& dest)
+{
+  // Textures are read straight from their storages, without syncing
+  // them first, so the work writing to them has to be done now
+  for (ProgramNode::TexList::const_iterator I = program.node()->begin_textures();
+       I != program.node()->end_textures(); ++I) {
+    if ((*I)->memory(0) && (*I)->memory(0)->pending()) {
+      flush();
+      break;
+    }
+  }
+
+  Assignment assignment;
+  assignment.program = program;
+  assignment.dest = dest;
+  for (ProgramNode::VarList::const_iterator I = program.node()->begin_parameters();
+       I != program.node()->end_parameters(); ++I) {
+    add_uniform(assignment.uniforms, *I);
+  }
+  for (Record::const_iterator I = program.uniform_inputs.begin();
+       I != program.uniform_inputs.end(); ++I) {
+    add_uniform(assignment.uniforms, I->node());
+  }
+  m_work.push_back(assignment);
+
+  std::vector<const Memory*> memories = reads(program);
+  for (Stream::const_iterator I = dest.begin(); I != dest.end(); ++I) {
+    memories.push_back(memory_of(*I));
+  }
+  for (std::size_t i = 0; i < memories.size(); ++i) {
+    const_cast<Memory*>(memories[i])->pending(true);
+  }
+}
+
+void StreamGraph::flush()
+{
+  if (m_flushing || m_work.empty()) return;
+
+  AssignmentList work;
+  work.swap(m_work);
+  for (AssignmentList::iterator I = work.begin(); I != work.end(); ++I) {
+    std::vector<const Memory*> memories = reads(I->program);
+    for (Stream::const_iterator J = I->dest.begin(); J != I->dest.end(); ++J) {
+      memories.push_back(memory_of(*J));
+    }
+    for (std::size_t i = 0; i < memories.size(); ++i) {
+      const_cast<Memory*>(memories[i])->pending(false);
+    }
+  }
+
+  m_flushing = true;
+  try {
+    fuse(work);
+
+    for (AssignmentList::iterator I = work.begin(); I != work.end(); ++I) {
+      if (!I->program.node()) continue;
+
+      // Run with the uniform values of the time of the assignment
+      UniformValues current;
+      for (UniformValues::const_iterator J = I->uniforms.begin(); J != I->uniforms.end(); ++J) {
+        if (!J->first->getVariant()->equals(J->second)) {
+          current.push_back(std::make_pair(J->first, J->first->getVariant()->get()));
+          J->first->setVariant(J->second);
+        }
+      }
+      try {
+        execute(I->program, I->dest);
+      } catch (...) {
+        for (UniformValues::const_iterator J = current.begin(); J != current.end(); ++J) {
+          J->first->setVariant(J->second);
+        }
+        throw;
+      }
+      for (UniformValues::const_iterator J = current.begin(); J != current.end(); ++J) {
+        J->first->setVariant(J->second);
+      }
+    }
+  } catch (...) {
+    m_flushing = false;
+    throw;
+  }
+  m_flushing = false;
+  evict();
+}
+
+void StreamGraph::evict()
+{
+  // A program whose every reference is held by the map is gone
+  std::map<const ProgramNode*, int> held;
+  for (FusedMap::const_iterator I = m_fused.begin(); I != m_fused.end(); ++I) {
+    ++held[I->second.producer.object()];
+    ++held[I->second.consumer.object()];
+  }
+  for (FusedMap::iterator I = m_fused.begin(); I != m_fused.end(); ) {
+    const ProgramNode* producer = I->second.producer.object();
+    const ProgramNode* consumer = I->second.consumer.object();
+    if (producer->refCount() == held[producer] || consumer->refCount() == held[consumer]) {
+      m_fused.erase(I++);
+    } else {
+      ++I;
+    }
+  }
+}
+
+void StreamGraph::fuse(AssignmentList& work)
+{
+  for (int c = 0; c < (int)work.size(); ++c) {
+    bool fused = true;
+    while (fused) {
+      fused = false;
+      int input = 0;
+      for (Stream::const_iterator I = work[c].program.stream_inputs.begin();
+           I != work[c].program.stream_inputs.end(); ++I, ++input) {
+        // Only the last assignment to the stream before this one matters
+        int p;
+        for (p = c - 1; p >= 0; --p) {
+          if (work[p].program.node() && writes(work[p].dest, memory_of(*I))) break;
+        }
+        if (p < 0 || !fusable(work, p, c, *I)) continue;
+
+        work[c] = fuse(work[p], work[c], input);
+        work[p] = Assignment();
+        fused = true;
+        break;
+      }
+    }
+  }
+}
+
+bool StreamGraph::fusable(const AssignmentList& work, int producer, int consumer,
+                          const BaseTexture& stream) const
+{
+  const Assignment& p = work[producer];
+  const Assignment& c = work[consumer];
+  if (p.dest.size() != 1 || p.program.node()->outputs.size() != 1) return false;
+  if (!same_elements(*p.dest.begin(), stream)) return false;
+  if (p.program.target() != c.program.target()) return false;
+
+  // Nothing but the two assignments may know about the stream
+  const Memory* memory = memory_of(stream);
+  int uses = 0;
+  for (AssignmentList::const_iterator I = work.begin(); I != work.end(); ++I) {
+    if (!I->program.node()) continue;
+    std::vector<const Memory*> memories = reads(I->program);
+    uses += std::count(memories.begin(), memories.end(), memory);
+    for (Stream::const_iterator J = I->dest.begin(); J != I->dest.end(); ++J) {
+      if (memory_of(*J) == memory) ++uses;
+    }
+  }
+  if (uses != 2 || !unobserved(work, stream)) return false;
+
+  // The producer now runs with the consumer, so its inputs must not be
+  // written in between, or by the consumer itself
+  std::vector<const Memory*> inputs = reads(p.program);
+  for (int q = producer + 1; q <= consumer; ++q) {
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+      if (writes(work[q].dest, inputs[i])) return false;
+    }
+  }
+
+  // Both programs have to run with the same values of shared uniforms
+  for (UniformValues::const_iterator I = p.uniforms.begin(); I != p.uniforms.end(); ++I) {
+    for (UniformValues::const_iterator J = c.uniforms.begin(); J != c.uniforms.end(); ++J) {
+      if (I->first == J->first && !I->second->equals(J->second)) return false;
+    }
+  }
+  return true;
+}
+
+bool StreamGraph::unobserved(const AssignmentList& work, const BaseTexture& stream) const
+{
+  // Every reference to the texture has to come from the recorded
+  // assignments.  Any other one (an array the user kept, say) could
+  // read the stream once the work has run.
+  const TextureNode* node = stream.node().object();
+  int references = 0;
+  for (AssignmentList::const_iterator I = work.begin(); I != work.end(); ++I) {
+    if (!I->program.node()) continue;
+    for (Stream::const_iterator J = I->program.stream_inputs.begin();
+         J != I->program.stream_inputs.end(); ++J) {
+      if (J->node().object() == node) ++references;
+    }
+    for (Stream::const_iterator J = I->dest.begin(); J != I->dest.end(); ++J) {
+      if (J->node().object() == node) ++references;
+    }
+    for (ProgramNode::TexList::const_iterator J = I->program.node()->begin_textures();
+         J != I->program.node()->end_textures(); ++J) {
+      if (J->object() == node) ++references;
+    }
+  }
+  if (node->refCount() != references) return false;
+
+  // The texture holds its memory as its base level, and nothing else
+  // may hold it
+  return memory_of(stream)->refCount() == 1;
+}
+
+StreamGraph::Assignment StreamGraph::fuse(const Assignment& producer,
+                                          const Assignment& consumer, int input)
+{
+  // Unbind the input, which connect then feeds from the producer's output
+  Program::BindingSpec binding_spec = consumer.program.binding_spec;
+  Program::BindingSpec::iterator binding = binding_spec.begin();
+  int position = 0;
+  for (int streams = 0; ; ++binding, ++position) {
+    if (*binding == Program::STREAM && streams++ == input) break;
+  }
+  binding_spec.erase(binding);
+
+  Stream stream_inputs;
+  int i = 0;
+  for (Stream::const_iterator I = consumer.program.stream_inputs.begin();
+       I != consumer.program.stream_inputs.end(); ++I, ++i) {
+    if (i != input) stream_inputs.append(*I);
+  }
+
+  std::pair<std::pair<const ProgramNode*, const ProgramNode*>, int>
+    key(std::make_pair(producer.program.node().object(), consumer.program.node().object()),
+        position);
+  FusedMap::iterator F = m_fused.find(key);
+  if (F == m_fused.end()) {
+    ProgramNodePtr node = copy_program(consumer.program.node());
+    ProgramNode::VarList::iterator I = node->inputs.begin();
+    std::advance(I, position);
+    VariableNodePtr unbound = *I;
+    node->inputs.erase(I);
+    I = node->inputs.begin();
+    std::advance(I, binding_spec.size());
+    node->inputs.insert(I, unbound);
+
+    Program unbound_consumer(node);
+    unbound_consumer.binding_spec = binding_spec;
+
+    Program unbound_producer(shref_const_cast<ProgramNode>(producer.program.node()));
+    unbound_producer.binding_spec = producer.program.binding_spec;
+
+    Fused fused;
+    fused.producer = producer.program.node();
+    fused.consumer = consumer.program.node();
+    fused.program = connect(unbound_producer, unbound_consumer).node();
+    F = m_fused.insert(std::make_pair(key, fused)).first;
+  }
+
+  Assignment result;
+  result.program = Program(F->second.program);
+  result.program.binding_spec = producer.program.binding_spec;
+  std::copy(binding_spec.begin(), binding_spec.end(),
+            std::back_inserter(result.program.binding_spec));
+  result.program.stream_inputs = producer.program.stream_inputs & stream_inputs;
+  result.program.uniform_inputs.append(producer.program.uniform_inputs);
+  result.program.uniform_inputs.append(consumer.program.uniform_inputs);
+  result.dest = consumer.dest;
+  result.uniforms = producer.uniforms;
+  result.uniforms.insert(result.uniforms.end(), consumer.uniforms.begin(),
+                         consumer.uniforms.end());
+  return result;
+}
+
+}
@@ -0,0 +1,113 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHSTREAMGRAPH_HPP
+#define SHSTREAMGRAPH_HPP
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "DllExport.hpp"
+#include "Program.hpp"
+#include "Stream.hpp"
+#include "Variant.hpp"
+
+namespace SH {
+
+/** Stream assignments waiting to be run.
+ *
+ * While Context::lazy_streams() is on, assigning a stream program to
+ * a stream only records the assignment here.  The recorded work is run
+ * in order as soon as a memory it reads or writes is synced, dirtied
+ * or has its host data looked at.
+ *
+ * When one assignment writes a stream that a later one reads, and
+ * nothing else can see that stream (no one else holds it), the two
+ * programs are connected into one and the intermediate stream is never
+ * written.
+ *
+ * Each thread records its own assignments.
+ */
+class
+SH_DLLEXPORT StreamGraph {
+public:
+  /// The graph of the calling thread
+  static StreamGraph* instance();
+
+  /// Record the assignment of the results of program to dest
+  void record(const Program& program, const Stream& dest);
+
+  /// Run all the recorded assignments
+  void flush();
+
+  /// Whether there are recorded assignments
+  bool empty() const;
+
+  /// Number of connected programs kept for reuse
+  std::size_t fused_programs() const;
+
+  /// Run a stream program right away
+  static void execute(const Program& program, Stream& dest);
+
+private:
+  StreamGraph();
+
+  typedef std::vector<std::pair<VariableNodePtr, VariantPtr> > UniformValues;
+
+  struct Assignment {
+    Program program;
+    Stream dest;
+    /// Values of the program's uniforms when it was assigned, which
+    /// are put back while it runs
+    UniformValues uniforms;
+  };
+  typedef std::vector<Assignment> AssignmentList;
+
+  /// Connects assignments to the ones reading their results
+  void fuse(AssignmentList& work);
+  bool fusable(const AssignmentList& work, int producer, int consumer,
+               const BaseTexture& stream) const;
+  /// Whether nothing but the recorded work can see stream
+  bool unobserved(const AssignmentList& work, const BaseTexture& stream) const;
+  /// Returns the assignment of consumer with its input'th stream input
+  /// read from the results of producer
+  Assignment fuse(const Assignment& producer, const Assignment& consumer, int input);
+
+  AssignmentList m_work;
+  bool m_flushing;
+
+  /// Connected programs, by the programs connected and the position of
+  /// the consumer's input, so that a pipeline run over and over is
+  /// compiled once.  Entries are dropped by evict() once no one but
+  /// this map holds their producer or consumer.
+  struct Fused {
+    ProgramNodeCPtr producer, consumer; ///< keep the keys' programs alive
+    ProgramNodePtr program;
+  };
+  typedef std::map<std::pair<std::pair<const ProgramNode*, const ProgramNode*>, int>,
+                   Fused> FusedMap;
+  FusedMap m_fused;
+
+  /// Drops the connected programs of programs that are gone
+  void evict();
+};
+
+}
+
+#endif
@@ -28,6 +28,7 @@
 #include "Statement.hpp"
 #include "Program.hpp"
 #include "Backend.hpp"
+#include "DependentGraph.hpp"
 #include "Transformer.hpp"
 #include "Optimizations.hpp"
 #include "BaseTexture.hpp"
@@ -69,6 +70,19 @@ void compile(Program& prg, const std::string& target)
   prg.compile(target, backend);
 }
 
+void compile(const ProgramSet& s)
+{
+  if (s.begin() == s.end()) return;
+  compile(s, (*s.begin())->target());
+}
+
+void compile(const ProgramSet& s, const std::string& target)
+{
+  BackendPtr backend = Backend::get_backend(target);
+  if (!backend) return;
+  backend->compile_set(target, s);
+}
+
 void compileShader(Program& prg)
 {
   compile(prg);
@@ -81,6 +95,7 @@ void compileShader(const std::string& target, Program& prg)
 
 void bind(Program& prg)
 {
+  DependentGraph::instance()->flush();
   BackendPtr backend = Backend::get_backend(prg.target());
   if (!backend) return;
   prg.code(backend)->bind();
@@ -88,6 +103,7 @@ void bind(Program& prg)
 
 void bind(const ProgramSet& s)
 {
+  DependentGraph::instance()->flush();
   BackendPtr backend = Backend::get_backend((*(s.begin()))->target());
   if (!backend) return;
   s.backend_set(backend)->bind();
@@ -95,6 +111,7 @@ void bind(const ProgramSet& s)
 
 void bind(const std::string& target, Program& prg)
 {
+  DependentGraph::instance()->flush();
   BackendPtr backend = Backend::get_backend(target);
   if (!backend) return;
   prg.code(target, backend)->bind();
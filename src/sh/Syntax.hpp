@@ -282,6 +282,14 @@ void compile(Program& prg);
 /// Force (re)compilation of a program for a given target.
 SH_DLLEXPORT
 void compile(Program& prg, const std::string& target);
+/// Force (re)compilation of all the programs of a set under the
+/// default target of the first one.  Backends may compile them
+/// concurrently.
+SH_DLLEXPORT
+void compile(const ProgramSet& s);
+/// Force (re)compilation of all the programs of a set for a given target.
+SH_DLLEXPORT
+void compile(const ProgramSet& s, const std::string& target);
 
 /// \deprecated Use compile() instead
 SH_DLLEXPORT
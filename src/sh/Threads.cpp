@@ -0,0 +1,88 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include "Threads.hpp"
+
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+namespace SH {
+
+#if defined(_WIN32)
+
+Mutex::Mutex()
+{
+  CRITICAL_SECTION* section = new CRITICAL_SECTION;
+  InitializeCriticalSection(section);
+  m_mutex = section;
+}
+
+Mutex::~Mutex()
+{
+  CRITICAL_SECTION* section = reinterpret_cast<CRITICAL_SECTION*>(m_mutex);
+  DeleteCriticalSection(section);
+  delete section;
+}
+
+void Mutex::lock()
+{
+  EnterCriticalSection(reinterpret_cast<CRITICAL_SECTION*>(m_mutex));
+}
+
+void Mutex::unlock()
+{
+  LeaveCriticalSection(reinterpret_cast<CRITICAL_SECTION*>(m_mutex));
+}
+
+#else
+
+Mutex::Mutex()
+{
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_t* mutex = new pthread_mutex_t;
+  pthread_mutex_init(mutex, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+  m_mutex = mutex;
+}
+
+Mutex::~Mutex()
+{
+  pthread_mutex_t* mutex = reinterpret_cast<pthread_mutex_t*>(m_mutex);
+  pthread_mutex_destroy(mutex);
+  delete mutex;
+}
+
+void Mutex::lock()
+{
+  pthread_mutex_lock(reinterpret_cast<pthread_mutex_t*>(m_mutex));
+}
+
+void Mutex::unlock()
+{
+  pthread_mutex_unlock(reinterpret_cast<pthread_mutex_t*>(m_mutex));
+}
+
+#endif
+
+}
@@ -0,0 +1,167 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SHTHREADS_HPP
+#define SHTHREADS_HPP
+
+#include "DllExport.hpp"
+
+#if defined(_MSC_VER)
+# include <intrin.h>
+# pragma intrinsic(_InterlockedIncrement, _InterlockedDecrement)
+# pragma intrinsic(_InterlockedExchange, _InterlockedCompareExchange)
+#endif
+
+/// Declares a variable with one instance per thread.  Only for plain
+/// old data, since the instances are never constructed or destroyed.
+#if defined(_MSC_VER)
+# define SH_THREAD_LOCAL __declspec(thread)
+#else
+# define SH_THREAD_LOCAL __thread
+#endif
+
+namespace SH {
+
+/** @defgroup threads Threads
+ * The building blocks that let several threads use Sh at once, as long
+ * as they work on different objects.
+ * @{
+ */
+
+/// Adds 1 to value as one indivisible step and returns the result
+inline int atomic_increment(volatile int& value)
+{
+#if defined(_MSC_VER)
+  return _InterlockedIncrement(reinterpret_cast<volatile long*>(&value));
+#else
+  return __sync_add_and_fetch(&value, 1);
+#endif
+}
+
+/// Subtracts 1 from value as one indivisible step and returns the result
+inline int atomic_decrement(volatile int& value)
+{
+#if defined(_MSC_VER)
+  return _InterlockedDecrement(reinterpret_cast<volatile long*>(&value));
+#else
+  return __sync_sub_and_fetch(&value, 1);
+#endif
+}
+
+/// Sets pointer to value if it is still null, as one indivisible step.
+/// Returns whether it was null.
+inline bool atomic_set_if_null(void* volatile& pointer, void* value)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+  return _InterlockedCompareExchangePointer(&pointer, value, 0) == 0;
+#elif defined(_MSC_VER)
+  return _InterlockedCompareExchange(reinterpret_cast<volatile long*>(&pointer),
+                                     reinterpret_cast<long>(value), 0) == 0;
+#else
+  return __sync_bool_compare_and_swap(&pointer, static_cast<void*>(0), value);
+#endif
+}
+
+/** A lock held for very short stretches, such as pushing to a free
+ * list.  Waiting threads spin rather than sleep.
+ */
+class SpinLock {
+public:
+  SpinLock() : m_locked(0) {}
+
+  void lock()
+  {
+#if defined(_MSC_VER)
+    while (_InterlockedExchange(reinterpret_cast<volatile long*>(&m_locked), 1)) {
+      while (m_locked) ;
+    }
+#else
+    while (__sync_lock_test_and_set(&m_locked, 1)) {
+      while (m_locked) ;
+    }
+#endif
+  }
+
+  void unlock()
+  {
+#if defined(_MSC_VER)
+    _InterlockedExchange(reinterpret_cast<volatile long*>(&m_locked), 0);
+#else
+    __sync_lock_release(&m_locked);
+#endif
+  }
+
+private:
+  volatile int m_locked;
+
+  // NOT IMPLEMENTED
+  SpinLock(const SpinLock& other);
+  SpinLock& operator=(const SpinLock& other);
+};
+
+/** A recursive mutex, which the thread holding it may lock again.
+ */
+class
+SH_DLLEXPORT Mutex {
+public:
+  Mutex();
+  ~Mutex();
+
+  void lock();
+  void unlock();
+
+private:
+  void* m_mutex; ///< pthread_mutex_t or CRITICAL_SECTION
+
+  // NOT IMPLEMENTED
+  Mutex(const Mutex& other);
+  Mutex& operator=(const Mutex& other);
+};
+
+/** Holds a Mutex (or SpinLock) locked while in scope.
+ */
+template<typename M>
+class ScopedLock {
+public:
+  explicit ScopedLock(M& mutex)
+    : m_mutex(mutex)
+  {
+    m_mutex.lock();
+  }
+
+  ~ScopedLock()
+  {
+    m_mutex.unlock();
+  }
+
+private:
+  M& m_mutex;
+
+  // NOT IMPLEMENTED
+  ScopedLock(const ScopedLock& other);
+  ScopedLock& operator=(const ScopedLock& other);
+};
+
+typedef ScopedLock<Mutex> Lock;
+
+/*@}*/
+
+}
+
+#endif
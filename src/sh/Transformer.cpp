@@ -29,6 +29,7 @@
 #include "Internals.hpp"
 #include "Transformer.hpp"
 #include "TextureNode.hpp"
+#include "Threads.hpp"
 
 // #define DBG_TRANSFORMER
 
@@ -392,13 +393,13 @@ void Transformer::splitTuples(int maxTuple, Transformer::VarSplitMap &splits) {
 #endif
 }
 
-static int id = 0;
+static volatile int id = 0;
 
 // Output Convertion to temporaries 
 struct InputOutputConvertor {
   InputOutputConvertor(const ProgramNodePtr& program,
                        VarMap &varMap, bool& changed)
-    : m_program(program), m_varMap( varMap ), m_changed(changed), m_id(++id)
+    : m_program(program), m_varMap( varMap ), m_changed(changed), m_id(atomic_increment(id))
   {}
 
   // assignment operator could not be generated: declaration only
@@ -68,14 +68,28 @@ void TypeInfo::init()
   /* DEBUG */ //SH_DEBUG_PRINT("Eval ops: \n" << Eval::instance()->availableOps());
 
   addCasts();
+
+  // Every op and cast is in place, so Eval can work out ahead of time
+  // which op to use for each combination of host types
+  std::vector<ValueType> hostTypes;
+  for(TypeInfoMap::const_iterator I = m_valueTypes->begin();
+      I != m_valueTypes->end(); ++I) {
+    if(I->first.second == HOST) hostTypes.push_back(I->first.first);
+  }
+  Eval::instance()->init(hostTypes);
 }
 
 const TypeInfo* TypeInfo::get(ValueType valueType, DataType dataType)
 {
   init();
-  const TypeInfo* result = (*m_valueTypes)(valueType, dataType);
-  if(!result) SH_DEBUG_PRINT("Null TypeInfo");
-  return result;
+  // find() rather than operator(), which would insert and race with
+  // other threads
+  TypeInfoMap::const_iterator I = m_valueTypes->find(std::make_pair(valueType, dataType));
+  if(I == m_valueTypes->end() || !I->second) {
+    SH_DEBUG_PRINT("Null TypeInfo");
+    return 0;
+  }
+  return I->second;
 }
 
 const TypeInfo* typeInfo(ValueType valueType, DataType dataType)
@@ -19,13 +19,16 @@
 //////////////////////////////////////////////////////////////////////////////
 #include <map>
 #include <set>
+#include <deque>
+#include <vector>
+#include <algorithm>
 #include <utility>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include "Optimizations.hpp"
-#include "BitSet.hpp"
 #include "CtrlGraph.hpp"
+#include "DomTree.hpp"
 #include "Debug.hpp"
 #include "Evaluate.hpp"
 #include "Context.hpp"
@@ -44,426 +47,412 @@ namespace {
 using namespace SH;
 
 
-// Data related to doing reaching definitions
-struct ReachingDefs {
-  ReachingDefs()
-    : defsize(0)
+// Value tracking is built from the program's static single assignment
+// form, taking each tuple element of each variable as a separate
+// variable.  Phis are placed at the iterated dominance frontiers of the
+// blocks assigning an element that is live across blocks, and the
+// definitions are renamed walking the dominator tree [Cytron et al.,
+// "Efficiently Computing Static Single Assignment Form and the Control
+// Dependence Graph"].  A use's ud chain is then the set of definitions
+// its value stands for, looking through the phis.
+//
+// The work done is proportional to the number of definitions, uses and
+// phis, rather than to the number of blocks times the number of
+// definitions in the whole program as with reaching definitions.
+
+// A definition, or a phi merging the values that reach a join
+struct SsaValue {
+  SsaValue(const ValueTracking::Def& def)
+    : def(def), phi(false), element(-1),
+      order(-1), low(-1), on_stack(false), set(-1)
   {
   }
-  
-  struct Definition {
-    Definition(Statement* stmt,
-               CtrlGraphNode* node,
-               int offset,
-               BitSet disable_mask)
-      : varnode(stmt->dest.node()), stmt(stmt), node(node), offset(offset),
-        disable_mask(disable_mask)
-    {}
-
-    Definition(const VariableNodePtr& varnode,
-               CtrlGraphNode* node,
-               int offset,
-               BitSet disable_mask)
-      : varnode(varnode), stmt(0), node(node), offset(offset), 
-        disable_mask(disable_mask)
-    {}
-
-    bool isInput() const
-    { 
-      return !stmt; 
-    }
 
-    int size() const
-    {
-      if(isInput()) return varnode->size();
-      else return stmt->dest.size();
-    }
-    
-    /* returns whether the i'th element is disabled */
-    int isDisabled(int i) const
-    {
-      return disable_mask[index(i)];
-    }
-    
-    /* returns the offset of the i'th tuple element */
-    int off(int i) const
-    {
-      return offset + i;
-    }
+  SsaValue(int element)
+    : def(static_cast<Statement*>(0), 0), phi(true), element(element),
+      order(-1), low(-1), on_stack(false), set(-1)
+  {
+  }
 
-    /* returns unswizzled index for i'th tuple element */
-    int index(int i) const
-    {
-      if(isInput()) return i;
-      return stmt->dest.swizzle()[i];
-    }
+  ValueTracking::Def def; ///< the definition, unless this is a phi
+  bool phi;
+  int element; ///< the tuple element merged, if this is a phi
+  std::vector<int> args; ///< the value from each predecessor (-1 for none)
 
-    /* returns Def for i'th tuple element */
-    ValueTracking::Def toDef(int i) const
-    {
-      if(isInput()) return ValueTracking::Def(varnode, i); 
-      return ValueTracking::Def(stmt, i);
-    }
+  // Used while resolving phis into definitions
+  int order, low;
+  bool on_stack;
+  int set; ///< index of the definitions this phi stands for
+};
 
-    friend std::ostream& operator<<(std::ostream& out, const Definition& def)
-    {
-      out << "{";
-      out << " off " << def.offset;
-      out << ", node " << def.node;
-      out << ", dsbl " << def.disable_mask << ", ";
-      if(def.isInput()) out << "input " << def.varnode->name();
-      else out << "stmt " << *def.stmt;
-      out << "}";
-      return out;
-    }
-    
-    VariableNodePtr varnode;
-    Statement* stmt;
-    CtrlGraphNode* node;
-    int offset;
-    
-    // Sometimes we want to ignore some of the elements, when
-    // constructing gen, because they are overwritten by later
-    // statements. In that case we mark the ignored components here.
-    // unswizzled disable mask
-    BitSet disable_mask;
-  };
-
-  void addDefinition(const Definition& d)
+// A use, waiting for the phis to be resolved
+struct PendingUse {
+  PendingUse(int value, const ValueTracking::Use& use,
+             ValueTracking::UseDefChain& chain)
+    : value(value), use(use), chain(&chain)
   {
-    // Otherwise, add this definition
-    defs.push_back(d);
-    defsize += d.size(); 
   }
 
-  typedef std::map<CtrlGraphNode*, int> SizeMap;
-  typedef std::map<CtrlGraphNode*, BitSet> ReachingMap;
-  
-  std::vector<Definition> defs;
-  int defsize; ///< current defsize, offset for next added Definition
-
-  ReachingMap gen, prsv;
-  ReachingMap rchin;
+  int value;
+  ValueTracking::Use use;
+  ValueTracking::UseDefChain* chain; ///< where the use's definitions go
 };
 
-struct DefFinder {
-  DefFinder(ReachingDefs& r, CtrlGraphNode* entry, const ProgramNode::VarList& inputs)
-    : entry(entry), inputs(inputs), r(r), offset(0)
+struct Ssa {
+  Ssa(const ProgramNodePtr& p)
+    : p(p), entry(p->ctrlGraph->entry()), exit(p->ctrlGraph->exit()),
+      dom(p->ctrlGraph),
+      intrack(new InputValueTracking()),
+      outtrack(new OutputValueTracking()),
+      order(0)
   {
+    p->destroy_info<InputValueTracking>();
+    p->destroy_info<OutputValueTracking>();
+    p->add_info(intrack);
+    p->add_info(outtrack);
   }
 
-  // assignment operator could not be generated: declaration only
-  DefFinder& operator=(DefFinder const&);
+  /// Number of the index'th element of node, numbering node's elements
+  /// the first time it is seen
+  int element(const VariableNodePtr& node, int index)
+  {
+    std::map<VariableNode*, int>::iterator I = base.find(node.object());
+    if (I == base.end()) {
+      I = base.insert(std::make_pair(node.object(), (int)global.size())).first;
+      std::size_t size = global.size() + node->size();
+      global.resize(size, false);
+      def_blocks.resize(size);
+      last_def.resize(size, 0);
+      current.resize(size, -1);
+    }
+    return I->second + index;
+  }
 
-  void operator()(CtrlGraphNode* node)
+  int add_value(const SsaValue& value)
   {
-    if (!node) return;
-    BasicBlockPtr block = node->block;
+    values.push_back(value);
+    return (int)values.size() - 1;
+  }
 
-    // Use this data structure to mark assignments to node elements,
-    // so that we can ignore earlier assignments to them in this block.
-    std::map<VariableNodePtr, BitSet> disable_map;
-
-    if(block) {
-      // Iterate backwards over the list of statements...
-      BasicBlock::StmtList::iterator I = block->end();
-      while (1) {
-        if (I == block->begin()) break;
-        --I;
-        if (!I->dest.null() && I->op != OP_KIL && I->op != OP_OPTBRA /*&& I->dest.node()->kind() == SH_TEMP*/) {
-          // Construct a disable map if this node has not yet been
-          // assigned to in a later statement in this block.
-          if (disable_map.find(I->dest.node()) == disable_map.end()) {
-            disable_map[I->dest.node()] = BitSet(I->dest.node()->size());
+  /// Places the phis for each element live across blocks, at the
+  /// iterated dominance frontier of the blocks assigning it
+  void place_phis()
+  {
+    // Element last given a phi at/queued for each node, plus one
+    std::map<CtrlGraphNode*, int> has_phi, queued;
+    std::vector<CtrlGraphNode*> worklist;
+    for (int e = 0; e < (int)global.size(); ++e) {
+      if (!global[e]) continue;
+      worklist = def_blocks[e];
+      for (std::size_t i = 0; i < worklist.size(); ++i) queued[worklist[i]] = e + 1;
+      while (!worklist.empty()) {
+        CtrlGraphNode* node = worklist.back();
+        worklist.pop_back();
+        const DomTree::FrontierSet& frontier = dom.frontier(node);
+        for (DomTree::FrontierSet::const_iterator F = frontier.begin();
+             F != frontier.end(); ++F) {
+          if (has_phi[*F] == e + 1) continue;
+          has_phi[*F] = e + 1;
+          phis[*F].push_back(add_value(SsaValue(e)));
+          if (queued[*F] != e + 1) {
+            queued[*F] = e + 1;
+            worklist.push_back(*F);
           }
-
-          // Construct a bitset containing all elements which this
-          // definition affects.
-          BitSet defn_map(I->dest.node()->size());
-          for (int i = 0; i < I->dest.size(); i++) defn_map[I->dest.swizzle()[i]] = true;
-
-          // Skip this definition if all its components have already
-          // been defined in a later statement.
-          if ((defn_map & disable_map[I->dest.node()]) == defn_map) continue;
-
-          // Otherwise, add this definition
-          r.addDefinition(ReachingDefs::Definition(&(*I), node, r.defsize,
-                                                    disable_map[I->dest.node()]));
-
-          // And update the disable map for the destination node.
-          disable_map[I->dest.node()] |= defn_map;
         }
       }
     }
+  }
 
-    // Add in defs for the inputs
-    if(node != entry) return; 
-    for(ProgramNode::VarList::const_iterator I = inputs.begin(); 
-        I != inputs.end(); ++I) {
-      if(disable_map.find(*I) == disable_map.end()) {
-        disable_map[*I] = BitSet((*I)->size());
+  /// Finds the definitions phi v stands for, one strongly connected
+  /// component of phis at a time [Tarjan] so that each is merged once.
+  void resolve(int v)
+  {
+    values[v].order = values[v].low = order++;
+    values[v].on_stack = true;
+    stack.push_back(v);
+
+    for (std::size_t i = 0; i < values[v].args.size(); ++i) {
+      int a = values[v].args[i];
+      if (a < 0 || !values[a].phi) continue;
+      if (values[a].order < 0) {
+        resolve(a);
+        values[v].low = std::min(values[v].low, values[a].low);
+      } else if (values[a].on_stack) {
+        values[v].low = std::min(values[v].low, values[a].order);
       }
+    }
+    if (values[v].low != values[v].order) return;
+
+    // v is the root of a component, which is on the stack above it
+    int set = (int)sets.size();
+    sets.push_back(ValueTracking::UseDefChain());
+    ValueTracking::UseDefChain& defs = sets.back();
+    std::size_t root = stack.size();
+    while (stack[--root] != v) {}
+    for (std::size_t i = root; i < stack.size(); ++i) {
+      values[stack[i]].set = set;
+      values[stack[i]].on_stack = false;
+    }
+    for (std::size_t i = root; i < stack.size(); ++i) {
+      const std::vector<int>& args = values[stack[i]].args;
+      for (std::size_t j = 0; j < args.size(); ++j) {
+        if (args[j] < 0) continue;
+        const SsaValue& arg = values[args[j]];
+        if (!arg.phi) {
+          defs.insert(arg.def);
+        } else if (arg.set != set) {
+          defs.insert(sets[arg.set].begin(), sets[arg.set].end());
+        }
+      }
+    }
+    stack.resize(root);
+  }
 
-      // check whether input does not reach end of block
-      if(disable_map[*I].full()) continue;
+  /// Adds def to the chains of use
+  void add(const PendingUse& u, const ValueTracking::Def& def)
+  {
+    u.chain->insert(def);
+    switch (def.kind) {
+    case ValueTracking::Def::SH_INPUT:
+      // @todo range - inputs passed straight through to outputs are
+      // not recorded
+      if (u.use.kind == ValueTracking::Use::STMT) {
+        ValueTracking::TupleDefUseChain& inputDu = intrack->inputUses[def.node];
+        if (inputDu.empty()) {
+          inputDu.resize(def.node->size());
+        }
+        inputDu[def.index].insert(u.use);
+      }
+      break;
+    case ValueTracking::Def::STMT:
+      {
+        ValueTracking* vt = def.stmt->get_info<ValueTracking>();
+        if (!vt) {
+          vt = new ValueTracking(def.stmt);
+          def.stmt->add_info(vt);
+        }
+        vt->uses[def.index].insert(u.use);
+        break;
+      }
+    }
+  }
 
-      r.addDefinition(ReachingDefs::Definition(*I, node, r.defsize,
-            disable_map[*I]));
+  /// Fills in the ud chains of all uses and the du chains of their
+  /// definitions
+  void build_chains()
+  {
+    for (std::vector<PendingUse>::const_iterator U = uses.begin();
+         U != uses.end(); ++U) {
+      if (!values[U->value].phi) {
+        add(*U, values[U->value].def);
+        continue;
+      }
+      if (values[U->value].order < 0) resolve(U->value);
+      const ValueTracking::UseDefChain& defs = sets[values[U->value].set];
+      for (ValueTracking::UseDefChain::const_iterator D = defs.begin();
+           D != defs.end(); ++D) {
+        add(*U, *D);
+      }
     }
   }
 
-  CtrlGraphNode* entry; // @todo range - this is a touch clumsy
-  const ProgramNode::VarList& inputs;
-  ReachingDefs& r;
-  int offset;
+  ProgramNodePtr p;
+  CtrlGraphNode* entry;
+  CtrlGraphNode* exit;
+  DomTree dom;
+  InputValueTracking* intrack;
+  OutputValueTracking* outtrack;
+
+  // Per element
+  std::map<VariableNode*, int> base; ///< number of each node's first element
+  std::vector<bool> global; ///< whether it is used in a block before being assigned there
+  std::vector< std::vector<CtrlGraphNode*> > def_blocks; ///< blocks assigning it
+  std::vector<CtrlGraphNode*> last_def; ///< last block found assigning it
+  std::vector<int> current; ///< its value at the current point of renaming
+
+  std::vector<SsaValue> values;
+  typedef std::map<CtrlGraphNode*, std::vector<int> > PhiMap;
+  PhiMap phis;
+  std::vector<PendingUse> uses;
+
+  // Resolved phis
+  std::deque<ValueTracking::UseDefChain> sets;
+  std::vector<int> stack;
+  int order;
 };
 
-struct InitRch {
-  InitRch(ReachingDefs& r)
-    : r(r)
+// Finds the blocks assigning each element, and the elements live
+// across blocks
+struct DefBlockFinder {
+  DefBlockFinder(Ssa& ssa)
+    : ssa(ssa)
   {
   }
 
   // assignment operator could not be generated: declaration only
-  InitRch& operator=(InitRch const&);
+  DefBlockFinder& operator=(DefBlockFinder const&);
 
   void operator()(CtrlGraphNode* node)
   {
     if (!node) return;
 
-    r.rchin[node] = BitSet(r.defsize);
-    r.gen[node] = BitSet(r.defsize);
-    r.prsv[node] = ~BitSet(r.defsize);
-      
-    BasicBlockPtr block = node->block;
-
-    // Initialize gen
-    for (unsigned int i = 0; i < r.defs.size(); i++) {
-      ReachingDefs::Definition &d = r.defs[i];
-      if (d.node == node) {
-        for (int j = 0; j < d.size(); j++) {
-// @todo range - I think this needs to be fixed for swizzling?
-//               it's been fixed above in isDisabled
-         // if (!r.defs[i].disable_mask[j]) {
-          if (!d.isDisabled(j)) {
-            r.gen[node][d.off(j)] = true;
-          }
-        }
+    if (node == ssa.entry) {
+      for (ProgramNode::VarList::const_iterator I = ssa.p->inputs.begin();
+           I != ssa.p->inputs.end(); ++I) {
+        for (int i = 0; i < (*I)->size(); ++i) define(ssa.element(*I, i), node);
       }
     }
 
-    if(!block) return;
-
-    // Initialize prsv
+    BasicBlockPtr block = node->block;
+    if (!block) return;
     for (BasicBlock::StmtList::iterator I = block->begin(); I != block->end(); ++I) {
-      if (I->dest.null() 
-          || I->op == OP_KIL
-          || I->op == OP_OPTBRA
-          /*|| I->dest.node()->kind() != SH_TEMP*/) continue;
-      for (unsigned int i = 0; i < r.defs.size(); i++) {
-        ReachingDefs::Definition &d = r.defs[i];
-        if (d.varnode != I->dest.node()) continue;
-
-        for (int j = 0; j < I->dest.size(); ++j) {
-          for (int k = 0; k < d.size(); ++k) {
-            if (d.index(k) == I->dest.swizzle()[j]) {
-              r.prsv[node][d.off(k)] = false;
-            }
-          }
+      for (int j = 0; j < opInfo[I->op].arity; j++) {
+        for (int i = 0; i < I->src[j].size(); i++) {
+          int e = ssa.element(I->src[j].node(), I->src[j].swizzle()[i]);
+          if (ssa.last_def[e] != node) ssa.global[e] = true;
         }
       }
+      // KIL and OPTBRA only "define" their destination for the rest of
+      // their block
+      if (I->dest.null() || I->op == OP_KIL || I->op == OP_OPTBRA) continue;
+      for (int i = 0; i < I->dest.size(); ++i) {
+        define(ssa.element(I->dest.node(), I->dest.swizzle()[i]), node);
+      }
     }
   }
 
-  ReachingDefs& r;
-};
-
-struct IterateRch {
-  IterateRch(ReachingDefs& r, bool& changed)
-    : r(r), changed(changed)
+  void define(int e, CtrlGraphNode* node)
   {
+    if (ssa.last_def[e] == node) return;
+    ssa.last_def[e] = node;
+    ssa.def_blocks[e].push_back(node);
   }
 
-  // assignment operator could not be generated: declaration only
-  IterateRch& operator=(IterateRch const&);
+  Ssa& ssa;
+};
 
-  void operator()(CtrlGraphNode* node)
+// Gives every definition its own value, walking the dominator tree in
+// preorder, and records which value each use sees.
+struct Renamer {
+  Renamer(Ssa& ssa)
+    : ssa(ssa)
   {
-    if (!node) return;
-    SH_DEBUG_ASSERT(r.rchin.find(node) != r.rchin.end());
-    BitSet newRchIn(r.defsize);
-    
-    for (CtrlGraphNode::PredecessorIt I = node->predecessors_begin();
-         I != node->predecessors_end(); ++I) {
-      SH_DEBUG_ASSERT(r.gen.find(*I) != r.gen.end());
-      SH_DEBUG_ASSERT(r.prsv.find(*I) != r.prsv.end());
-      SH_DEBUG_ASSERT(r.rchin.find(*I) != r.rchin.end());
-      
-      newRchIn |= (r.gen[*I] | (r.rchin[*I] & r.prsv[*I]));
-    }
-    if (newRchIn != r.rchin[node]) {
-      r.rchin[node] = newRchIn;
-      changed = true;
-    }
   }
 
-  ReachingDefs& r;
-  bool& changed;
-};
+  // assignment operator could not be generated: declaration only
+  Renamer& operator=(Renamer const&);
 
-// Builds ud and du chains per statement and
-// also gathers input du and output ud chains into the program
-struct UdDuBuilder {
-  UdDuBuilder(ReachingDefs& r, const ProgramNodePtr& p) 
-    : r(r), m_exit(p->ctrlGraph->exit()), p(p),
-      intrack(new InputValueTracking()),
-      outtrack(new OutputValueTracking())
+  void operator()(CtrlGraphNode* node, int level)
   {
-    p->destroy_info<InputValueTracking>();
-    p->destroy_info<OutputValueTracking>();
-    p->add_info(intrack);
-    p->add_info(outtrack);
-  }
-
-  struct TupleElement {
-    TupleElement(const VariableNodePtr& node, int index)
-      : node(node), index(index)
-    {
+    // Leave the subtrees of the previous siblings and their descendants
+    while ((int)marks.size() > level) {
+      for (std::size_t i = undo.size(); i > marks.back(); --i) {
+        ssa.current[undo[i - 1].first] = undo[i - 1].second;
+      }
+      undo.resize(marks.back());
+      marks.pop_back();
     }
+    marks.push_back(undo.size());
 
-    bool operator<(const TupleElement& other) const
-    {
-      if (node < other.node) return true;
-      if (node == other.node) return index < other.index;
-      return false;
+    Ssa::PhiMap::const_iterator P = ssa.phis.find(node);
+    if (P != ssa.phis.end()) {
+      for (std::size_t i = 0; i < P->second.size(); ++i) {
+        set(ssa.values[P->second[i]].element, P->second[i]);
+      }
     }
-    
-    VariableNodePtr node;
-    int index;
-  };
-
-  // assignment operator could not be generated: declaration only
-  UdDuBuilder& operator=(UdDuBuilder const&);
-
-  void operator()(CtrlGraphNode* node) {
-    typedef std::set<ValueTracking::Def> DefSet;
-    typedef std::map<TupleElement, DefSet> DefMap;
 
-    // defs contains all of the possible contributors to the key's
-    // definition at the current point.
-    DefMap defs;
-    
-    if (!node) return;
-    BasicBlockPtr block = node->block;
-
-    // TODO: Handle "non assigning" statements like KIL
-
-    // initialize defs at the start of the block, using the reaching
-    // definitions solution.
-    for (std::size_t i = 0; i < r.defs.size(); i++) {
-      for (int j = 0; j < r.defs[i].size(); j++) {
-        if (r.rchin[node][r.defs[i].offset + j]) {
-          ValueTracking::Def def(r.defs[i].toDef(j));
-          defs[TupleElement(r.defs[i].varnode,
-                            r.defs[i].index(j))].insert(def);
+    if (node == ssa.entry) {
+      for (ProgramNode::VarList::const_iterator I = ssa.p->inputs.begin();
+           I != ssa.p->inputs.end(); ++I) {
+        for (int i = 0; i < (*I)->size(); ++i) {
+          set(ssa.element(*I, i), ssa.add_value(ValueTracking::Def(*I, i)));
         }
       }
     }
 
-    if(block) {
-      // Now consider each statement in turn.
+    // Values of KIL and OPTBRA destinations, seen only in this block
+    std::map<int, int> local;
+
+    BasicBlockPtr block = node->block;
+    if (block) {
       for (BasicBlock::StmtList::iterator I = block->begin(); I != block->end(); ++I) {
-        // Compute the ud chains for the statement's source variables,
-        // and contribute to the du chains of the source variables' definitions.
-        for (int j = 0; j < opInfo[I->op].arity; j++) {
-          //if (I->src[j].node()->kind() == SH_TEMP) {
-            ValueTracking* vt = I->get_info<ValueTracking>();
-            if (!vt) {
-              vt = new ValueTracking(&(*I));
-              I->add_info(vt);
-            }
-            VariableNodePtr srcNode = I->src[j].node();
+        if (opInfo[I->op].arity > 0) {
+          ValueTracking* vt = I->get_info<ValueTracking>();
+          if (!vt) {
+            vt = new ValueTracking(&(*I));
+            I->add_info(vt);
+          }
+          for (int j = 0; j < opInfo[I->op].arity; j++) {
             for (int i = 0; i < I->src[j].size(); i++) {
-              const DefSet& ds = defs[TupleElement(srcNode, I->src[j].swizzle()[i])];
-
-              vt->defs[j][i] = ds;
-              ValueTracking::Use srcUse(&(*I), j, i);
-              for (DefSet::const_iterator J = ds.begin(); J != ds.end(); J++) {
-                switch(J->kind) {
-                  case ValueTracking::Def::SH_INPUT:
-                    {
-                      ValueTracking::TupleDefUseChain& inputDu = 
-                        intrack->inputUses[srcNode];
-                      if(inputDu.empty()) {
-                        inputDu.resize(srcNode->size());
-                      }
-                      inputDu[J->index].insert(srcUse);
-                      break;
-                    }
-                  case ValueTracking::Def::STMT:
-                    {
-                      ValueTracking* ut = J->stmt->get_info<ValueTracking>();
-                      if (!ut) {
-                        ut = new ValueTracking(J->stmt);
-                        J->stmt->add_info(ut);
-                      }
-                      ut->uses[J->index].insert(srcUse);
-                      break;
-                    }
-                }
-              }
-            //} 
+              int value = lookup(local, ssa.element(I->src[j].node(),
+                                                    I->src[j].swizzle()[i]));
+              if (value < 0) continue;
+              ssa.uses.push_back(PendingUse(value, ValueTracking::Use(&(*I), j, i),
+                                            vt->defs[j][i]));
+            }
           }
         }
-        // Now update the defs structure.
+
+        bool local_only = I->op == OP_KIL || I->op == OP_OPTBRA;
         for (int i = 0; i < I->dest.size(); ++i) {
-          defs[TupleElement(I->dest.node(), I->dest.swizzle()[i])].clear();
-          ValueTracking::Def def(&(*I), i);
-          defs[TupleElement(I->dest.node(), I->dest.swizzle()[i])].insert(def);
+          int e = ssa.element(I->dest.node(), I->dest.swizzle()[i]);
+          int value = ssa.add_value(ValueTracking::Def(&(*I), i));
+          if (local_only) {
+            local[e] = value;
+          } else {
+            local.erase(e);
+            set(e, value);
+          }
         }
       }
     }
 
-    // now find any output defs and add appropriate du chain to stmts 
-    // @todo range - note that this still doesn't show inputs that are
-    // immediately passed through to outputs, but that should be easy 
-    // to store somewhere if needed
-    if(node == m_exit) {
-      for(DefMap::iterator D = defs.begin(); D != defs.end(); ++D) {
-        VariableNodePtr node = D->first.node;
-        BindingType kind = node->kind();
-        int index = D->first.index;
-
-        if(kind == SH_INOUT || kind == SH_OUTPUT) {
-          DefSet& ds = D->second;
-
-          ValueTracking::TupleUseDefChain& outDef = outtrack->outputDefs[node];
-          if(outDef.empty()) {
-            outDef.resize(node->size());
-          }
-          outDef[index] = ds;
-
-          for(DefSet::iterator S = ds.begin(); S != ds.end(); ++S) {
-            if(S->kind != ValueTracking::Def::STMT) continue; 
-            ValueTracking* vt = S->stmt->get_info<ValueTracking>();
-            if (!vt) {
-              vt = new ValueTracking(S->stmt);
-              S->stmt->add_info(vt);
-            }
-            SH_DEBUG_ASSERT(vt); // must have added it above somewhere
-            ValueTracking::Use use(node, S->stmt->dest.swizzle()[S->index]);
-            vt->uses[S->index].insert(use);
-          }
+    // Pass the values on to the phis of the successors
+    for (CtrlGraphNode::SuccessorIt S = node->successors_begin();
+         S != node->successors_end(); ++S) {
+      add_args(S->node);
+    }
+    if (node->follower()) add_args(node->follower());
+
+    if (node == ssa.exit) {
+      for (ProgramNode::VarList::const_iterator I = ssa.p->outputs.begin();
+           I != ssa.p->outputs.end(); ++I) {
+        ValueTracking::TupleUseDefChain& outDef = ssa.outtrack->outputDefs[*I];
+        outDef.resize((*I)->size());
+        for (int i = 0; i < (*I)->size(); ++i) {
+          int value = lookup(local, ssa.element(*I, i));
+          if (value < 0) continue;
+          ssa.uses.push_back(PendingUse(value, ValueTracking::Use(*I, i), outDef[i]));
         }
       }
     }
   }
 
-  ReachingDefs& r;
-  CtrlGraphNode* m_exit;
-  ProgramNodePtr p;
-  InputValueTracking* intrack;
-  OutputValueTracking* outtrack;
+  int lookup(const std::map<int, int>& local, int e) const
+  {
+    std::map<int, int>::const_iterator L = local.find(e);
+    return L == local.end() ? ssa.current[e] : L->second;
+  }
+
+  void set(int e, int value)
+  {
+    undo.push_back(std::make_pair(e, ssa.current[e]));
+    ssa.current[e] = value;
+  }
+
+  void add_args(CtrlGraphNode* succ)
+  {
+    Ssa::PhiMap::iterator P = ssa.phis.find(succ);
+    if (P == ssa.phis.end()) return;
+    for (std::size_t i = 0; i < P->second.size(); ++i) {
+      SsaValue& phi = ssa.values[P->second[i]];
+      phi.args.push_back(ssa.current[phi.element]);
+    }
+  }
+
+  Ssa& ssa;
+  std::vector< std::pair<int, int> > undo; ///< element and its previous value
+  std::vector<std::size_t> marks; ///< size of undo on entering each level
 };
 
 struct UdDuClearer {
@@ -619,48 +608,30 @@ std::ostream& operator<<(std::ostream& out, const OutputValueTracking& ovt)
 
 void add_value_tracking(Program& p)
 {
-  ReachingDefs r;
-
   CtrlGraphPtr graph = p.node()->ctrlGraph;
+
+  UdDuClearer clearer;
+  graph->dfs(clearer);
   
-  DefFinder finder(r, graph->entry(), p.node()->inputs);
+  Ssa ssa(p.node());
+  DefBlockFinder finder(ssa);
   graph->dfs(finder);
 
-  InitRch init(r);
-  graph->dfs(init);
-
-  bool changed;
-  IterateRch iter(r, changed);
-  do {
-    changed = false;
-    graph->dfs(iter);
-  } while (changed);
-
-#ifdef SH_DEBUG_VALUETRACK
-  SH_DEBUG_PRINT("Dumping Reaching Defs");
-  SH_DEBUG_PRINT("defsize = " << r.defsize);
-  SH_DEBUG_PRINT("defs.size() = " << r.defs.size());
-  for(unsigned int i = 0; i < r.defs.size(); ++i) {
-    SH_DEBUG_PRINT("  " << i << ": " << r.defs[i]);
-  }
-  std::cerr << std::endl;
-
-  for (ReachingDefs::ReachingMap::const_iterator I = r.rchin.begin(); I != r.rchin.end(); ++I) {
-    CtrlGraphNode* node = I->first;
-    SH_DEBUG_PRINT(" rchin[" << node << "]: " << I->second);
-    SH_DEBUG_PRINT("   gen[" << node << "]: " << r.gen[I->first]);
-    SH_DEBUG_PRINT("  prsv[" << node << "]: " << r.prsv[I->first]);
-    std::cerr << std::endl;
+  // Outputs are used at the exit
+  for (ProgramNode::VarList::const_iterator I = p.node()->outputs.begin();
+       I != p.node()->outputs.end(); ++I) {
+    for (int i = 0; i < (*I)->size(); ++i) ssa.global[ssa.element(*I, i)] = true;
   }
-#endif
 
-  UdDuClearer clearer;
-  graph->dfs(clearer);
-  
-  UdDuBuilder builder(r, p.node());
-  graph->dfs(builder);
+  ssa.place_phis();
+  Renamer renamer(ssa);
+  ssa.dom.preorder(renamer);
+  ssa.build_chains();
 
 #ifdef SH_DEBUG_VALUETRACK
+  SH_DEBUG_PRINT("SSA with " << ssa.global.size() << " elements, "
+                 << ssa.values.size() << " values, "
+                 << ssa.uses.size() << " uses");
   SH_DEBUG_PRINT("Uddu Dump");
   UdDuDumper dumper;
   graph->dfs(dumper);
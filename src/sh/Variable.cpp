@@ -105,26 +105,6 @@ VariantPtr Variable::highBoundVariant() const
   return m_node->highBoundVariant()->get(m_neg, m_swizzle);
 }
 
-const Swizzle& Variable::swizzle() const
-{
-  return m_swizzle;
-}
-
-const VariableNodePtr& Variable::node() const
-{
-  return m_node;
-}
-
-bool Variable::neg() const
-{
-  return m_neg;
-}
-
-bool& Variable::neg()
-{
-  return m_neg;
-}
-
 VariantPtr Variable::getVariant() const
 {
   return m_node->getVariant()->get(m_neg, m_swizzle);
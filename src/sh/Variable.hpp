@@ -89,15 +89,15 @@ public:
   //@}
   
   /// Obtain the swizzling (if any) applied to this variable.
-  const Swizzle& swizzle() const;
+  const Swizzle& swizzle() const { return m_swizzle; }
 
   /// Obtain the actual node this variable refers to.
-  const VariableNodePtr& node() const;
+  const VariableNodePtr& node() const { return m_node; }
 
   /// Return true if this variable is negated
-  bool neg() const;
+  bool neg() const { return m_neg; }
 
-  bool& neg();
+  bool& neg() { return m_neg; }
 
   ///
   
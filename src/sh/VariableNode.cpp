@@ -28,18 +28,19 @@
 #include "ProgramNode.hpp"
 #include "Evaluate.hpp"
 #include "Record.hpp"
+#include "DependentGraph.hpp"
 
 namespace SH {
 
 struct VariableNodeEval {
   Pointer<ProgramNode> value;
+  EvaluatorPtr evaluator; ///< value compiled for update(), made on first use
 
 #ifdef USE_MEMORY_POOL
   // Memory pool stuff.
   void* operator new(std::size_t size)
   {
-    if (!m_pool) m_pool = new Pool(sizeof(VariableNodeEval), 32768);
-    return m_pool->alloc();
+    return Pool::get(m_pool, sizeof(VariableNodeEval), 32768)->alloc();
   }
   void operator delete(void* ptr)
   {
@@ -59,9 +60,10 @@ VariableNode::VariableNode(BindingType kind, int size, ValueType valueType, Sema
     m_kind(kind), m_specialType(type),
     m_valueType(valueType), 
     m_size(size), 
-    m_id(m_maxID++), m_locked(0),
+    m_id(atomic_increment(m_maxID) - 1), m_locked(0),
     m_variant(0),
-    m_eval(0)
+    m_eval(0),
+    m_stale(false)
 {
   if (m_uniform || m_kind == SH_CONST) addVariant();
   programVarListInit();
@@ -75,9 +77,10 @@ VariableNode::VariableNode(const VariableNode& old, BindingType newKind,
     m_uniform(old.m_uniform), m_kind(newKind), m_specialType(newType),
     m_valueType(newValueType), 
     m_size(newSize), 
-    m_id(m_maxID++), m_locked(0),
+    m_id(atomic_increment(m_maxID) - 1), m_locked(0),
     m_variant(0),
-    m_eval(new VariableNodeEval)
+    m_eval(new VariableNodeEval),
+    m_stale(false)
 {
   if(!keepUniform) {
     m_uniform = !Context::current()->parsing() && m_kind == SH_TEMP;
@@ -323,17 +326,6 @@ void VariableNode::setVariant(const VariantCPtr& other, bool neg, const Swizzle
   setVariant(other.object(), neg, writemask);
 }
 
-const Variant* VariableNode::getVariant() const
-{
-  return m_variant.object();
-}
-
-
-Variant* VariableNode::getVariant() 
-{
-  return m_variant.object();
-}
-
 Variant* VariableNode::makeLow() const
 {
   const VariantFactory* factory = variantFactory(m_valueType);
@@ -371,7 +363,11 @@ void VariableNode::update_all()
       if (i->second.node()) i->second.updateUniform(this);
     }
 
-    update_dependents();
+    if (Context::current()->lazy_dependents()) {
+      DependentGraph::instance()->mark(this);
+    } else {
+      update_dependents();
+    }
   }
 }
 
@@ -431,6 +427,7 @@ void VariableNode::attach(const ProgramNodePtr& evaluator)
   detach_dependencies();
 
   m_eval->value = evaluator;
+  m_eval->evaluator = 0;
 
   if (m_eval->value) {
     for (ProgramNode::VarList::const_iterator I = m_eval->value->begin_parameters();
@@ -451,10 +448,22 @@ void VariableNode::update()
   // Evaluate ourselves (dependent) using the interpretor
   // Make sure the update occurs as if it were happening outside of a program definition.
   // Otherwise the program will be evaluated into the currently parsing program if there is one.
-  Context::current()->enter(0); {
+  Context::current()->enter(0);
+  const ProgramNodePtr& program = m_eval->value;
+  if (program->inputs.empty() && program->outputs.size() == 1 &&
+      program->outputs.front()->size() == m_size) {
+    // The common case, so skip the general record assignment and rerun
+    // the statements compiled the first time
+    if (!m_eval->evaluator) m_eval->evaluator = new Evaluator(program);
+    m_eval->evaluator->run();
+    addVariant();
+    m_variant->set(program->outputs.front()->getVariant());
+    update_all();
+  } else {
     Record record(Variable(this));
-    record = m_eval->value;
-  } Context::current()->exit();
+    record = program;
+  }
+  Context::current()->exit();
 }
 
 const Pointer<ProgramNode>& VariableNode::evaluator() const
@@ -467,8 +476,7 @@ const Pointer<ProgramNode>& VariableNode::evaluator() const
 void* VariableNode::operator new(std::size_t size)
 {
   if (size != sizeof(VariableNode)) return ::operator new(size);
-  if (!m_pool) m_pool = new Pool(sizeof(VariableNode), 32768);
-  return m_pool->alloc();
+  return Pool::get(m_pool, sizeof(VariableNode), 32768)->alloc();
 }
 
 void VariableNode::operator delete(void* ptr, std::size_t size)
@@ -501,6 +509,11 @@ void VariableNode::update_dependents()
   }
 }
 
+void VariableNode::refresh() const
+{
+  DependentGraph::instance()->flush();
+}
+
 void VariableNode::detach_dependencies()
 {
   if (!m_eval) return;
@@ -511,10 +524,11 @@ void VariableNode::detach_dependencies()
       (*I)->remove_dependent(this);
     }
     m_eval->value = 0;
+    m_eval->evaluator = 0;
   }
 }
 
-int VariableNode::m_maxID = 0;
+volatile int VariableNode::m_maxID = 0;
 #ifdef USE_MEMORY_POOL
 Pool* VariableNode::m_pool = 0;
 #endif
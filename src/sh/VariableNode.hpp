@@ -131,11 +131,19 @@ public:
   // @}
 
   /// Retrieve the variant 
-  const Variant* getVariant() const;
+  const Variant* getVariant() const
+  {
+    if (m_stale) refresh();
+    return m_variant.object();
+  }
 
   /// Retrieve the variant.  This should probably only be used internally.
   // You need to call update_all if you change the values here
-  Variant* getVariant();
+  Variant* getVariant()
+  {
+    if (m_stale) refresh();
+    return m_variant.object();
+  }
 
   /// Ensure this node has space to store host-side values.
   /// Normally this is not necessary, but when uniforms are given
@@ -162,6 +170,10 @@ public:
 
   /// Obtain the program defining this uniform, if any.
   const Pointer<ProgramNode>& evaluator() const;
+
+  /// Whether this dependent uniform is waiting to be reevaluated
+  /// @see DependentGraph
+  bool stale() const { return m_stale; }
   
   /** @} */
 
@@ -206,6 +218,9 @@ protected:
 
   void update_dependents();
   void detach_dependencies();
+
+  /// Reevaluates the stale dependents, this one among them
+  void refresh() const;
   
   
    
@@ -225,12 +240,15 @@ protected:
   // Dependent uniform evaluation
   mutable VariableNodeEval* m_eval;
   std::list<VariableNode*> m_dependents;
+  bool m_stale; ///< Whether DependentGraph has yet to reevaluate this
   
-  static int m_maxID;
+  static volatile int m_maxID;
 
 #ifdef USE_MEMORY_POOL
   static Pool* m_pool;
 #endif
+
+  friend class DependentGraph;
 };
 
 }
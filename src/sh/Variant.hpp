@@ -135,6 +135,10 @@ Variant: public RefCountable {
     /// swizzle.m_srcSize must equal size()
     virtual Pointer<Variant> get(bool neg, const Swizzle &swizzle, int count=1) const = 0; 
 
+    /// Like get(neg, swizzle), but puts the values in dest instead of a
+    /// new Variant.  dest.size() must equal swizzle.size()
+    virtual void get(Variant* dest, bool neg, const Swizzle &swizzle) const = 0;
+
     /// Returns true iff other is the same size, type, and has the same values
     // This uses dataTypeEquals
     //
@@ -189,6 +193,10 @@ class DataVariant: public Variant {
     typedef CppDataType* iterator;
     typedef const CppDataType* const_iterator;
 
+    /// Arrays of up to this many elements are kept inside the variant
+    /// instead of being allocated separately
+    static const int inline_size = 16;
+
     /// Constructs a data array and sets the value to a default value
     /// (typically zero)
     DataVariant(int N); 
@@ -240,6 +248,7 @@ class DataVariant: public Variant {
     VariantPtr get() const; 
     VariantPtr get(int index) const; 
     VariantPtr get(bool neg, const Swizzle &swizzle, int count=1) const; 
+    void get(Variant* dest, bool neg, const Swizzle &swizzle) const;
 
     bool equals(const VariantCPtr& other) const; 
     bool equals(const Variant* other) const; 
@@ -285,6 +294,8 @@ class DataVariant: public Variant {
 
     bool m_managed; ///< true iff we are responsible for array alloc/delete 
 
+    CppDataType m_inline[inline_size]; ///< The array when it is small enough
+
     /// allocates an array of size N and sets m_begin, m_end
     void alloc(int N);
 
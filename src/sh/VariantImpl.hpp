@@ -110,7 +110,7 @@ DataVariant<T, DT>::DataVariant(const DataVariant<T, DT> &other,
 template<typename T, DataType DT>
 DataVariant<T, DT>::~DataVariant() 
 {
-  if(m_managed) delete[] m_begin;
+  if(m_managed && m_begin != m_inline) delete[] m_begin;
 }
 
 template<typename T, DataType DT>
@@ -186,10 +186,9 @@ void DataVariant<T, DT>::set(const Variant* other, int index)
   if(cast_other) {
     m_begin[index] = (*cast_other)[0];
   } else {
-    // make a new DataVariant that uses the index element as it's array 
-    DataVariant *temp = new DataVariant(1, m_begin + index, false);
-    CastManager::instance()->doCast(temp, other);
-    delete temp; // okay - it doesn't delete its array
+    // make a DataVariant that uses the index element as its array 
+    DataVariant temp(1, m_begin + index, false);
+    CastManager::instance()->doCast(&temp, other);
   }
 }
 
@@ -220,12 +219,11 @@ void DataVariant<T, DT>::set(const Variant* other, bool neg, const Swizzle &writ
     if(neg) negate();
   } else {
   // otherwise we need a temp buffer variant...doh
-    DataVariant *temp = new DataVariant(wmsize);
-    CastManager::instance()->doCast(temp, other);
+    DataVariant temp(wmsize);
+    CastManager::instance()->doCast(&temp, other);
     for(int i = 0; i < wmsize; ++i) {
-      m_begin[writemask[i]] = neg ? -(*temp)[i] : (*temp)[i];
+      m_begin[writemask[i]] = neg ? -temp[i] : temp[i];
     }
-    delete temp;
   }
 }
 
@@ -253,6 +251,21 @@ VariantPtr DataVariant<T, DT>::get(bool neg, const Swizzle &swizzle, int count)
   return new DataVariant<T, DT>(*this, neg, swizzle, count);
 }
 
+template<typename T, DataType DT>
+void DataVariant<T, DT>::get(Variant* dest, bool neg, const Swizzle &swizzle) const
+{
+  SH_DEBUG_ASSERT(dest->size() == swizzle.size());
+  PtrType cast_dest = variant_cast<T, DT>(dest);
+  if(cast_dest) {
+    for(int i = 0; i < swizzle.size(); ++i) {
+      (*cast_dest)[i] = neg ? -m_begin[swizzle[i]] : m_begin[swizzle[i]];
+    }
+  } else {
+    DataVariant temp(*this, neg, swizzle);
+    dest->set(&temp);
+  }
+}
+
 
 template<typename T, DataType DT>
 bool DataVariant<T, DT>::equals(const Variant* other) const 
@@ -377,7 +390,7 @@ std::string DataVariant<T, DT>::encodeArray() const {
 template<typename T, DataType DT>
 void DataVariant<T, DT>::alloc(int N) {
   // SH_DEBUG_PRINT("alloc " << valueTypeName[V] << " " << dataTypeName[DT]);
-  m_begin = new CppDataType[N];
+  m_begin = N <= inline_size ? m_inline : new CppDataType[N];
   m_end = m_begin + N;
 }
 
@@ -386,10 +399,7 @@ template<typename T, DataType DT>
 void* DataVariant<T, DT>::operator new(std::size_t size)
 {
   if (size != sizeof(DataVariant)) return ::operator new(size);
-  if (!m_pool) {
-    m_pool = new Pool(sizeof(DataVariant), 32768);
-  }
-  return m_pool->alloc();
+  return Pool::get(m_pool, sizeof(DataVariant), 32768)->alloc();
 }
 
 template<typename T, DataType DT>
@@ -23,6 +23,7 @@
 #include "DllExport.hpp"
 #include "Exception.hpp"
 #include "Context.hpp"
+#include "Threads.hpp"
 #include "ProgramNode.hpp"
 #include "ProgramSet.hpp"
 #include "Program.hpp"
@@ -47,6 +48,8 @@
 #include "LibNormal.hpp"
 #include "LibPosition.hpp"
 #include "Memory.hpp"
+#include "BufferPool.hpp"
+#include "FileMemory.hpp"
 #include "Array.hpp"
 #include "Table.hpp"
 #include "Texture.hpp"
@@ -62,6 +65,8 @@
 #include "FixedManipulator.hpp"
 #include "Channel.hpp"
 #include "Stream.hpp"
+#include "StreamGraph.hpp"
+#include "DependentGraph.hpp"
 #include "Record.hpp"
 #include "Quaternion.hpp"
 #include "Variant.hpp"
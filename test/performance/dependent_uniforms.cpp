@@ -0,0 +1,50 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+// 
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <sh.hpp>
+
+using namespace SH;
+using namespace std;
+
+int main() 
+{
+  init();
+
+  const int dependents = 200;
+
+  Attrib3f base(1, 2, 3);
+  Attrib3f scale(0.5, 0.25, 2);
+  Attrib3f derived[dependents];
+  for(int i = 0; i < dependents; ++i) {
+    float offset = i;
+    Program prg = SH_BEGIN_PROGRAM() {
+      OutputAttrib3f out;
+      Attrib3f t = mad(base, scale, Attrib1f(offset));
+      out = t(2, 1, 0) * base;
+    } SH_END;
+    derived[i].attach(prg);
+  }
+
+  for(int i = 0; i < 5000; ++i) {
+    base(0) = i;
+  }
+  std::cout << derived[dependents - 1] << std::endl;
+  return 0;
+}
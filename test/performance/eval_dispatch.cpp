@@ -0,0 +1,46 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+// 
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <sh.hpp>
+#include <Eval.hpp>
+
+using namespace SH;
+using namespace std;
+
+int main() 
+{
+  init();
+  Eval* eval = Eval::instance();
+
+  DataVariant<float, HOST> a(3, 1.0f);
+  DataVariant<float, HOST> b(3, 0.5f);
+  DataVariant<int, HOST> c(3, 2);
+  DataVariant<float, HOST> dest(3);
+
+  int found = 0;
+  for(int i = 0; i < 1000000; ++i) {
+    // same types, and a source that needs a cast
+    (*eval)(OP_ADD, &dest, &a, &b, 0);
+    (*eval)(OP_MAD, &dest, &a, &c, &b);
+    if(eval->getEvalOpInfo(OP_MUL, SH_FLOAT, SH_FLOAT, SH_INT)) ++found;
+  }
+  std::cout << dest.encode() << " " << found << std::endl;
+  return 0;
+}
@@ -0,0 +1,55 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+// 
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <sh.hpp>
+
+using namespace SH;
+using namespace std;
+
+// Builds (and so optimizes) a larger program with branches, constants,
+// copies and dead code over and over
+int main() 
+{
+  init();
+
+  Attrib4f scale(1, 2, 3, 4);
+  Attrib4f bias(0.5, 0.25, 0.125, 1);
+
+  for(int i = 0; i < 20; ++i) {
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib4f in;
+      OutputAttrib4f out;
+      Attrib4f acc = in;
+      for(int j = 0; j < 40; ++j) {
+        Attrib4f t = acc * scale + Attrib4f(j, j, j, j);
+        Attrib4f unused = t * t;
+        Attrib4f copy = t;
+        SH_IF(copy(0) > 10.0f) {
+          acc = copy - bias;
+        } SH_ELSE {
+          acc = copy + bias * Attrib1f(2);
+        } SH_ENDIF;
+      }
+      out = acc;
+    } SH_END;
+  }
+  cout << Context::current()->optimizer_stats();
+  return 0;
+}
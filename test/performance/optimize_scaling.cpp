@@ -0,0 +1,61 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+// 
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <sh.hpp>
+
+using namespace SH;
+using namespace std;
+
+// Builds programs of growing size (an unrolled filter, with a branch
+// every few taps) and prints how long value tracking took for each, to
+// show how optimization time scales with program size
+int main() 
+{
+  init();
+
+  Attrib4f weight(0.25, 0.5, 0.125, 1);
+  Attrib4f threshold(10, 20, 30, 40);
+
+  for(int taps = 100; taps <= 1600; taps *= 2) {
+    Context::current()->reset_optimizer_stats();
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib4f in;
+      OutputAttrib4f out;
+      Attrib4f acc = in;
+      for(int j = 0; j < taps; ++j) {
+        Attrib4f t = mad(acc, weight, Attrib4f(j, j, j, j));
+        Attrib4f unused = t * in;
+        acc = t(1, 2, 3, 0) + in;
+        if(j % 20 == 19) {
+          SH_IF(acc(0) > threshold(0)) {
+            acc -= threshold;
+          } SH_ENDIF;
+        }
+      }
+      out = acc;
+    } SH_END;
+
+    const OptimizerStats& stats = Context::current()->optimizer_stats();
+    const PassStats* tracking = stats.pass("value tracking");
+    cout << taps << " taps: " << stats.seconds << "s optimizing, "
+         << (tracking ? tracking->seconds : 0) << "s in value tracking" << endl;
+  }
+  return 0;
+}
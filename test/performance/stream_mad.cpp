@@ -0,0 +1,55 @@
+// Sh: A GPU metaprogramming language.
+//
+// Copyright 2003-2006 Serious Hack Inc.
+// 
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, 
+// MA  02110-1301, USA
+//////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <sh.hpp>
+
+using namespace SH;
+using namespace std;
+
+int main() 
+{
+  init();
+  setBackend("cc");
+
+  const int elements = 1000000;
+
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib3f SH_DECL(a);
+    InputAttrib3f SH_DECL(b);
+    OutputAttrib3f SH_DECL(out);
+    out = mad(a, b, a * 0.5f);
+  } SH_END;
+
+  Array1D<Attrib3f> a(elements), b(elements), out(elements);
+  float* a_data = a.write_data();
+  float* b_data = b.write_data();
+  for (int i = 0; i < elements * 3; ++i) {
+    a_data[i] = i % 17;
+    b_data[i] = i % 5;
+  }
+
+  Program bound = prg << a << b;
+  for (int i = 0; i < 50; ++i) {
+    out = bound;
+  }
+
+  std::cout << out.read_data()[elements * 3 - 1] << std::endl;
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <ctime>
+#include "test.hpp"
+
+// With asynchronous compilation on, the first runs of a program are
+// interpreted while its kernel compiles, the later ones use the kernel.
+// Both must give the same results.
+
+#define ELEMENTS 101
+#define RUNS 8
+// Seconds to keep running the program for, which is long enough for
+// its kernel to be compiled
+#define SECONDS 3
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  Context::current()->async_compile(true);
+
+  Attrib1f scale;
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    InputAttrib1f b;
+    OutputAttrib1f c;
+    OutputAttrib1fub d;
+    c = a * scale + b;
+    SH_IF(a > b) {
+      c = -c;
+    } SH_ENDIF;
+    d = a / 100.0f;
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("a"); inputs.push_back("b");
+
+  Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+  float* a_data = a.write_data();
+  float* b_data = b.write_data();
+  for (int i = 0; i < ELEMENTS; ++i) {
+    a_data[i] = i;
+    b_data[i] = ELEMENTS - i;
+  }
+
+  time_t end = time(0) + SECONDS;
+  for (int run = 0; run < RUNS || time(0) < end; ++run) {
+    scale = (run % RUNS) * 0.5f;
+
+    float expected_c[ELEMENTS], expected_d[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      expected_c[i] = a_data[i] * (run % RUNS) * 0.5f + b_data[i];
+      if (a_data[i] > b_data[i]) expected_c[i] = -expected_c[i];
+      expected_d[i] = FracUByte(std::min(a_data[i] / 100.0f, 1.0f));
+    }
+
+    Array1D<Attrib1f> c(ELEMENTS);
+    Array1D<Attrib1fub> d(ELEMENTS);
+    c & d = prg << a << b;
+
+    const FracUByte* d_data = d.read_data();
+    float d_values[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) d_values[i] = d_data[i];
+
+    ostringstream name;
+    name << "async run " << run;
+    if (test.output_result<const float*>(name.str() + " c", inputs, c.read_data(),
+                                         expected_c, ELEMENTS, 0.001)) errors++;
+    if (test.output_result<const float*>(name.str() + " d", inputs, d_values,
+                                         expected_d, ELEMENTS, 0.005)) errors++;
+    total_tests += 2;
+  }
+
+  {
+    // A kernel that fails to compile keeps being interpreted
+    Context::current()->add_compile_profile("broken", "-no-such-compiler-flag");
+    Context::current()->compile_profile("broken");
+    Program broken = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f a;
+      OutputAttrib1f c;
+      c = a * 3.0f;
+    } SH_END;
+
+    float expected_c[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) expected_c[i] = a_data[i] * 3;
+
+    end = time(0) + SECONDS;
+    for (int run = 0; run < RUNS || time(0) < end; ++run) {
+      Array1D<Attrib1f> c(ELEMENTS);
+      c = broken << a;
+
+      ostringstream name;
+      name << "failed compile run " << run;
+      if (test.output_result<const float*>(name.str(), inputs, c.read_data(),
+                                           expected_c, ELEMENTS, 0.001)) errors++;
+      ++total_tests;
+    }
+    Context::current()->compile_profile("default");
+  }
+
+  // Interpreting left the values of the program's own inputs and
+  // outputs alone
+  ++total_tests;
+  float with_values[1] = {0};
+  float with_values_expected[1] = {0};
+  ProgramNode::VarList::const_iterator I;
+  for (I = prg.node()->begin_inputs(); I != prg.node()->end_inputs(); ++I) {
+    if ((*I)->hasValues()) ++with_values[0];
+  }
+  for (I = prg.node()->begin_outputs(); I != prg.node()->end_outputs(); ++I) {
+    if ((*I)->hasValues()) ++with_values[0];
+  }
+  if (test.output_result<const float*>("program untouched", inputs, with_values,
+                                       with_values_expected, 1, 0.0)) errors++;
+
+  if (errors !=0) {
+    std::cout << "Total Errors: " << errors << "/" << total_tests << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cmath>
+#include "test.hpp"
+
+// A program compiled with a custom profile and autotuned, which must
+// compute the same results whichever kernel is picked
+
+#define ELEMENTS 1003
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  Context::current()->add_compile_profile("test", "-O1");
+  Context::current()->compile_profile("test");
+  Context::current()->autotune(true);
+
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    InputAttrib1f b;
+    OutputAttrib1f c;
+    c = a * b + 1.0f;
+    SH_IF(a > b) {
+      c = sqrt(a - b);
+    } SH_ENDIF;
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("a"); inputs.push_back("b");
+
+  // The second run uses the kernel the first one picked
+  for (int run = 0; run < 2; ++run) {
+    Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS), c(ELEMENTS);
+    float* a_data = a.write_data();
+    float* b_data = b.write_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = (i * 7 + run) % 50;
+      b_data[i] = (i % 30) - 5;
+      if (a_data[i] > b_data[i]) {
+        expected[i] = sqrt(a_data[i] - b_data[i]);
+      } else {
+        expected[i] = a_data[i] * b_data[i] + 1.0f;
+      }
+    }
+    c = prg << a << b;
+
+    ostringstream name;
+    name << "autotune run " << run;
+    if (test.output_result<const float*>(name.str(), inputs, c.read_data(),
+                                         expected, ELEMENTS, 0.001)) errors++;
+    total_tests++;
+  }
+
+  if (errors !=0) {
+    std::cout << "Total Errors: " << errors << "/" << total_tests << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include "test.hpp"
+
+// Odd so that the element count is not a multiple of any vector width
+#define ELEMENTS 1003
+
+using namespace std;
+using namespace SH;
+
+float expected_value(float a, float b)
+{
+  float result;
+  if (a > 500) {
+    if (b > 0) {
+      result = a * b;
+    } else {
+      result = -a;
+    }
+  } else if (a > 100) {
+    result = a + b;
+  } else {
+    result = b - 1;
+  }
+  return result + 1;
+}
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    InputAttrib1f b;
+    OutputAttrib1f c;
+    SH_IF(a > 500.0f) {
+      SH_IF(b > 0.0f) {
+        c = a * b;
+      } SH_ELSE {
+        c = -a;
+      } SH_ENDIF;
+    } SH_ELSE {
+      SH_IF(a > 100.0f) {
+        c = a + b;
+      } SH_ELSE {
+        c = b - 1.0f;
+      } SH_ENDIF;
+    } SH_ENDIF;
+    c += 1.0f;
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("a"); inputs.push_back("b");
+
+  Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+  float* a_data = a.write_data();
+  float* b_data = b.write_data();
+  float expected[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    a_data[i] = (i * 7) % ELEMENTS;
+    b_data[i] = (i % 3) - 1;
+    expected[i] = expected_value(a_data[i], b_data[i]);
+  }
+
+  for (int count = 1; ; count = std::min(count * 2 + 1, ELEMENTS)) {
+    Array1D<Attrib1f> c(count);
+    c = prg << a << b;
+
+    ostringstream name;
+    name << "branches " << count;
+    if (test.output_result<const float*>(name.str(), inputs, c.read_data(),
+                                         expected, count, 0.001)) errors++;
+    total_tests++;
+    if (count == ELEMENTS) break;
+  }
+
+  // Killed elements stop before writing their outputs, which stay zero
+  Program killing = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    InputAttrib1f b;
+    OutputAttrib1f c;
+    kill(b > 0.0f);
+    c = a + 1.0f;
+  } SH_END;
+
+  float expected_kill[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    expected_kill[i] = b_data[i] > 0 ? 0 : a_data[i] + 1;
+  }
+
+  Array1D<Attrib1f> c(ELEMENTS);
+  c = killing << a << b;
+  if (test.output_result<const float*>("kill", inputs, c.read_data(),
+                                       expected_kill, ELEMENTS, 0.001)) errors++;
+  total_tests++;
+
+  if (errors !=0) {
+    std::cout << "Total Errors: " << errors << "/" << total_tests << std::endl;
+    return 1;
+  }
+  return 0;
+}
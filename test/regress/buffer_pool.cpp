@@ -0,0 +1,88 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Running the same streams frame after frame should reuse the buffers
+// of the previous frames
+
+#define ELEMENTS 1000
+#define FRAMES 5
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  Attrib1f scale = 2.0f;
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    OutputAttrib1f b;
+    b = a * scale + 1.0f;
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("a");
+
+  BufferPool* pool = BufferPool::instance();
+  BufferPool::Stats warm = pool->stats();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    if (frame == 2) warm = pool->stats();
+
+    Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+    float* a_data = a.write_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = i + frame;
+      expected[i] = (i + frame) * 2.0f + 1.0f;
+    }
+
+    b = prg << a;
+
+    ++total_tests;
+    if (test.output_result<const float*>("frame", inputs, b.read_data(),
+                                         expected, ELEMENTS, 0.0)) {
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    BufferPool::Stats done = pool->stats();
+    if (done.allocations != warm.allocations || done.reuses <= warm.reuses) {
+      cout << "frames allocated " << done.allocations - warm.allocations
+           << " buffers after warming up" << endl;
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    void* buffer = pool->allocate(3 * BufferPool::HugePage / 2);
+    if (reinterpret_cast<size_t>(buffer) % BufferPool::HugePage != 0) {
+      cout << "huge buffer is not aligned to a huge page" << endl;
+      ++errors;
+    }
+    pool->release(buffer, 3 * BufferPool::HugePage / 2);
+    void* reused = pool->allocate(2 * BufferPool::HugePage);
+    if (reused != buffer) {
+      cout << "huge buffer of the same size class was not reused" << endl;
+      ++errors;
+    }
+    pool->release(reused, 2 * BufferPool::HugePage);
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
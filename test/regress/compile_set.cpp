@@ -0,0 +1,75 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <list>
+#include <vector>
+#include <string>
+#include <sstream>
+#include "test.hpp"
+
+// Programs compiled together as a set, which the cc backend builds with
+// several kernels to a compiler run
+
+#define PROGRAMS 9
+#define ELEMENTS 100
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  list<Program> programs;
+  for (int p = 0; p < PROGRAMS; ++p) {
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f a;
+      InputAttrib1f b;
+      OutputAttrib1f c;
+      SH_IF(a > static_cast<float>(p * 10)) {
+        c = a * static_cast<float>(p) + b;
+      } SH_ELSE {
+        c = b - static_cast<float>(p);
+      } SH_ENDIF;
+    } SH_END;
+    programs.push_back(prg);
+  }
+  compile(ProgramSet(programs));
+
+  vector<string> inputs;
+  inputs.push_back("a"); inputs.push_back("b");
+
+  Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+  float* a_data = a.write_data();
+  float* b_data = b.write_data();
+  for (int i = 0; i < ELEMENTS; ++i) {
+    a_data[i] = i;
+    b_data[i] = i % 7;
+  }
+
+  int p = 0;
+  for (list<Program>::iterator I = programs.begin(); I != programs.end(); ++I, ++p) {
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      expected[i] = a_data[i] > p * 10 ? a_data[i] * p + b_data[i] : b_data[i] - p;
+    }
+
+    Array1D<Attrib1f> c(ELEMENTS);
+    c = *I << a << b;
+
+    ostringstream name;
+    name << "compile_set " << p;
+    if (test.output_result<const float*>(name.str(), inputs, c.read_data(),
+                                         expected, ELEMENTS, 0.001)) errors++;
+    total_tests++;
+  }
+
+  if (errors !=0) {
+    std::cout << "Total Errors: " << errors << "/" << total_tests << std::endl;
+    return 1;
+  }
+  return 0;
+}
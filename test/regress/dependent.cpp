@@ -0,0 +1,109 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Uniforms attached to a program are reevaluated on the host whenever a
+// uniform the program uses changes.  The compiled evaluation must give
+// the same results as evaluating the program directly, including
+// swizzles, negation, writemasks, casts, branches and loops.
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  vector<string> inputs;
+  inputs.push_back("a");
+  inputs.push_back("s");
+
+  {
+    Attrib3f a(1, 2, 3);
+    Attrib1f s(2);
+    Attrib3f r;
+    Program prg = SH_BEGIN_PROGRAM() {
+      OutputAttrib3f out;
+      Attrib3d t = a;
+      out = t(2, 1, 0);
+      out(0, 1) = -a(1, 2) * s;
+    } SH_END;
+    r.attach(prg);
+
+    ++total_tests;
+    float expected1[3] = {-4, -6, 1};
+    if (test.check_value("attach", inputs, r, expected1)) ++errors;
+
+    ++total_tests;
+    a(0) = 4.0f;
+    float expected2[3] = {-4, -6, 4};
+    if (test.check_value("swizzle cast", inputs, r, expected2)) ++errors;
+
+    ++total_tests;
+    s = 3.0f;
+    float expected3[3] = {-6, -9, 4};
+    if (test.check_value("writemask negate", inputs, r, expected3)) ++errors;
+  }
+
+  {
+    Attrib1f a(1000);
+    Attrib1f s(2);
+    Attrib1f r;
+    Program prg = SH_BEGIN_PROGRAM() {
+      OutputAttrib1f out;
+      SH_IF(a > 500.0f) {
+        out = a * s;
+      } SH_ELSE {
+        out = -a;
+        SH_WHILE(out < s) {
+          out += 10.0f;
+        } SH_ENDWHILE;
+      } SH_ENDIF;
+    } SH_END;
+    r.attach(prg);
+
+    ++total_tests;
+    float expected1[1] = {2000};
+    if (test.check_value("branch taken", inputs, r, expected1)) ++errors;
+
+    ++total_tests;
+    a = 25.0f;
+    float expected2[1] = {5};
+    if (test.check_value("branch loop", inputs, r, expected2)) ++errors;
+  }
+
+  {
+    // Dependents of dependents update in turn
+    Attrib1f a(1);
+    Attrib1f s(2);
+    Attrib1f r1, r2;
+    Program sum = SH_BEGIN_PROGRAM() {
+      OutputAttrib1f out;
+      out = a + s;
+    } SH_END;
+    r1.attach(sum);
+    Program square = SH_BEGIN_PROGRAM() {
+      OutputAttrib1f out;
+      out = r1 * r1;
+    } SH_END;
+    r2.attach(square);
+
+    ++total_tests;
+    a = 4.0f;
+    float expected[1] = {36};
+    if (test.check_value("chain", inputs, r2, expected)) ++errors;
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Storages that were up to date before only copy the values written
+// since
+
+#define ELEMENTS 100
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+
+  vector<string> inputs;
+  inputs.push_back("values");
+
+  HostMemoryPtr memory = new HostMemory(sizeof(float) * ELEMENTS, SH_FLOAT);
+  HostStoragePtr host = memory->hostStorage();
+  HostStoragePtr copy = new HostStorage(memory.object(), sizeof(float) * ELEMENTS, SH_FLOAT);
+  HostStoragePtr converted = new HostStorage(memory.object(), sizeof(double) * ELEMENTS, SH_DOUBLE);
+
+  host->dirty();
+  float* host_data = reinterpret_cast<float*>(host->data());
+  for (int i = 0; i < ELEMENTS; ++i) host_data[i] = i;
+  copy->sync();
+  converted->sync();
+
+  // Values the transfers must leave alone, since they were not written
+  float* copy_data = reinterpret_cast<float*>(copy->data());
+  double* converted_data = reinterpret_cast<double*>(converted->data());
+  copy_data[50] = -1;
+  converted_data[50] = -1;
+
+  host->dirty(10 * sizeof(float), 3 * sizeof(float));
+  host_data[10] = host_data[11] = host_data[12] = 1000;
+  host->dirty(12 * sizeof(float), 2 * sizeof(float));
+  host_data[13] = 2000;
+
+  float expected[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) expected[i] = i;
+  expected[10] = expected[11] = expected[12] = 1000;
+  expected[13] = 2000;
+  expected[50] = -1;
+
+  {
+    ++total_tests;
+    copy->sync();
+    if (test.output_result<const float*>("same type", inputs, copy_data,
+                                         expected, ELEMENTS, 0.0)) {
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    converted->sync();
+    vector<float> result(converted_data, converted_data + ELEMENTS);
+    if (test.output_result<const float*>("converted", inputs, &result[0],
+                                         expected, ELEMENTS, 0.0)) {
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    // Writing everything again makes the next sync copy everything
+    host->dirty();
+    copy_data[50] = -1;
+    copy->sync();
+    expected[50] = 50;
+    if (test.output_result<const float*>("whole", inputs, copy_data,
+                                         expected, ELEMENTS, 0.0)) {
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    // A stream output only dirties its own elements
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f a;
+      OutputAttrib1f b;
+      b = a + 1.0f;
+    } SH_END;
+    Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+    float* a_data = a.write_data();
+    for (int i = 0; i < ELEMENTS; ++i) a_data[i] = i;
+    b.write_data();
+
+    MemoryPtr b_memory = b.node()->memory(0);
+    int before = b_memory->timestamp();
+    offset(count(b, 5), 20) = prg << count(a, 5);
+    ValueRanges ranges;
+    float written[2] = {-1, -1};
+    if (b_memory->changes(before, b_memory->timestamp(), ranges) && ranges.size() == 1) {
+      written[0] = ranges[0].first;
+      written[1] = ranges[0].second;
+    }
+    float expected_written[2] = {20, 25};
+    if (test.output_result<const float*>("stream window", inputs, written,
+                                         expected_written, 2, 0.0)) {
+      ++errors;
+    }
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <sh/sh.hpp>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Stream programs reading and writing memory-mapped files
+
+#define ELEMENTS 1000
+
+using namespace std;
+using namespace SH;
+
+void read_file(const char* name, float* data)
+{
+  for (int i = 0; i < ELEMENTS; ++i) {
+    data[i] = -1;
+  }
+  FILE* file = fopen(name, "rb");
+  if (!file) return;
+  fread(data, sizeof(float), ELEMENTS, file);
+  fclose(file);
+}
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+
+  const char* in_name = "file_memory_in.dat";
+  const char* out_name = "file_memory_out.dat";
+
+  float in_data[ELEMENTS];
+  float expected[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    in_data[i] = i * 0.5f;
+    expected[i] = in_data[i] * 2.0f + 1.0f;
+  }
+  FILE* in_file = fopen(in_name, "wb");
+  fwrite(in_data, sizeof(float), ELEMENTS, in_file);
+  fclose(in_file);
+
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    OutputAttrib1f b;
+    b = a * 2.0f + 1.0f;
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("a");
+
+  {
+    FileMemoryPtr in_mem = new FileMemory(in_name, SH_FLOAT);
+    FileMemoryPtr out_mem = new FileMemory(out_name, sizeof(float) * ELEMENTS, SH_FLOAT);
+    Array1D<Attrib1f> a(in_mem, ELEMENTS), b(out_mem, ELEMENTS);
+
+    BufferPool::Stats before = BufferPool::instance()->stats();
+    b = prg << a;
+    BufferPool::Stats after = BufferPool::instance()->stats();
+
+    // The results went into the mapping, without a buffer for them
+    const float* mapping = static_cast<const float*>(out_mem->fileStorage()->data());
+    if (test.output_result<const float*>("written to mapping", inputs, mapping,
+                                         expected, ELEMENTS, 0.001)) errors++;
+    total_tests++;
+    float buffers[1] = {static_cast<float>(after.allocations + after.reuses
+                                           - before.allocations - before.reuses)};
+    float no_buffers[1] = {0};
+    if (test.output_result<const float*>("no output buffer", inputs, buffers,
+                                         no_buffers, 1, 0)) errors++;
+    total_tests++;
+
+    if (test.output_result<const float*>("file to file", inputs, b.read_data(),
+                                         expected, ELEMENTS, 0.001)) errors++;
+    total_tests++;
+
+    // The input is mapped privately, so writing to it leaves the file alone
+    a = prg << a;
+    a.read_data();
+  }
+
+  // The output was written back to its file when its memory went away
+  float file_data[ELEMENTS];
+  read_file(out_name, file_data);
+  if (test.output_result<const float*>("written file", inputs, file_data, expected,
+                                       ELEMENTS, 0.001)) errors++;
+  total_tests++;
+
+  read_file(in_name, file_data);
+  if (test.output_result<const float*>("read-only file", inputs, file_data, in_data,
+                                       ELEMENTS, 0.001)) errors++;
+  total_tests++;
+
+  remove(in_name);
+  remove(out_name);
+
+  if (errors !=0) {
+    std::cout << "Total Errors: " << errors << "/" << total_tests << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "test.hpp"
+
+// Streams of fractions, halves and integers, which are computed in their
+// own types and must saturate or wrap around like the host types do
+
+#define ELEMENTS 11
+
+using namespace std;
+using namespace SH;
+
+template<typename T>
+int check(Test& test, const string& name, const vector<string>& inputs,
+          Array1D<T>& result, const float* expected, int size, double epsilon)
+{
+  vector<float> values(size);
+  const typename T::mem_type* data = result.read_data();
+  for (int i = 0; i < size; ++i) {
+    values[i] = static_cast<typename T::host_type>(data[i]);
+  }
+  return test.output_result<const float*>(name, inputs, &values[0], expected, size, epsilon);
+}
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  vector<string> inputs;
+  inputs.push_back("a"); inputs.push_back("b");
+
+  float a_values[ELEMENTS], b_values[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    a_values[i] = i / 10.0f;
+    b_values[i] = 1.0f - i / 5.0f;
+  }
+
+  {
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1fub a;
+      InputAttrib1fub b;
+      OutputAttrib1fub sum;
+      OutputAttrib1fub product;
+      OutputAttrib1fub difference;
+      sum = a + b;
+      product = a * b;
+      difference = a - b;
+    } SH_END;
+
+    Array1D<Attrib1fub> a(ELEMENTS), b(ELEMENTS), sum(ELEMENTS), product(ELEMENTS), difference(ELEMENTS);
+    FracUByte* a_data = a.write_data();
+    FracUByte* b_data = b.write_data();
+    float expected_sum[ELEMENTS], expected_product[ELEMENTS], expected_difference[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = a_values[i];
+      b_data[i] = max(b_values[i], 0.0f);
+      float a = a_data[i], b = b_data[i];
+      expected_sum[i] = min(a + b, 1.0f);
+      expected_product[i] = a * b;
+      expected_difference[i] = max(a - b, 0.0f);
+    }
+    sum & product & difference = prg << a << b;
+
+    if (check(test, "fub sum", inputs, sum, expected_sum, ELEMENTS, 0.005)) errors++;
+    if (check(test, "fub product", inputs, product, expected_product, ELEMENTS, 0.005)) errors++;
+    if (check(test, "fub difference", inputs, difference, expected_difference, ELEMENTS, 0.005)) errors++;
+    total_tests += 3;
+  }
+
+  {
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1fs a;
+      InputAttrib1fs b;
+      OutputAttrib1fs sum;
+      OutputAttrib1fs negated;
+      OutputAttrib1fs quotient;
+      sum = a + b;
+      negated = -b;
+      quotient = a / b;
+    } SH_END;
+
+    Array1D<Attrib1fs> a(ELEMENTS), b(ELEMENTS), sum(ELEMENTS), negated(ELEMENTS), quotient(ELEMENTS);
+    FracShort* a_data = a.write_data();
+    FracShort* b_data = b.write_data();
+    float expected_sum[ELEMENTS], expected_negated[ELEMENTS], expected_quotient[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = -a_values[i];
+      b_data[i] = b_values[i];
+      float a = a_data[i], b = b_data[i];
+      expected_sum[i] = max(a + b, -1.0f);
+      expected_negated[i] = -b;
+      expected_quotient[i] = b == 0 ? (a < 0 ? -1 : 0) : min(max(a / b, -1.0f), 1.0f);
+    }
+    sum & negated & quotient = prg << a << b;
+
+    if (check(test, "fs sum", inputs, sum, expected_sum, ELEMENTS, 0.001)) errors++;
+    if (check(test, "fs negated", inputs, negated, expected_negated, ELEMENTS, 0.001)) errors++;
+    if (check(test, "fs quotient", inputs, quotient, expected_quotient, ELEMENTS, 0.001)) errors++;
+    total_tests += 3;
+  }
+
+  {
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1h a;
+      InputAttrib1f b;
+      OutputAttrib1h result;
+      result = a * b + 0.5f;
+    } SH_END;
+
+    Array1D<Attrib1h> a(ELEMENTS), result(ELEMENTS);
+    Array1D<Attrib1f> b(ELEMENTS);
+    Half* a_data = a.write_data();
+    float* b_data = b.write_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = a_values[i] * 100;
+      b_data[i] = b_values[i];
+      expected[i] = Half(static_cast<float>(a_data[i]) * b_data[i] + 0.5f);
+    }
+    result = prg << a << b;
+
+    if (check(test, "half", inputs, result, expected, ELEMENTS, 0.001)) errors++;
+    total_tests++;
+  }
+
+  {
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1s a;
+      InputAttrib1s b;
+      OutputAttrib1s sum;
+      sum = a + b;
+    } SH_END;
+
+    Array1D<Attrib1s> a(ELEMENTS), b(ELEMENTS), sum(ELEMENTS);
+    short* a_data = a.write_data();
+    short* b_data = b.write_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = 30000;
+      b_data[i] = i * 500;
+      expected[i] = static_cast<short>(a_data[i] + b_data[i]);
+    }
+    sum = prg << a << b;
+
+    if (check(test, "short wraparound", inputs, sum, expected, ELEMENTS, 0)) errors++;
+    total_tests++;
+  }
+
+  if (errors !=0) {
+    std::cout << "Total Errors: " << errors << "/" << total_tests << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  vector<string> inputs;
+  inputs.push_back("src"); inputs.push_back("index");
+
+  Array2D<Attrib1f> image(4, 4);
+  float* image_data = image.write_data();
+  for (int i = 0; i < 16; ++i) image_data[i] = i;
+
+  {
+    ++total_tests;
+    // Transpose through short coordinates
+    Array2D<Attrib2s> index(4, 4);
+    short* index_data = index.write_data();
+    float expected[16];
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        index_data[2*(y*4 + x) + 0] = y;
+        index_data[2*(y*4 + x) + 1] = x;
+        expected[y*4 + x] = x*4 + y;
+      }
+    }
+    Array2D<Attrib1f> result(4, 4);
+    try {
+      gather(result, image, index);
+      if (test.output_result<const float*>("2D coordinates", inputs,
+                                           result.read_data(), expected, 16, 0.0))
+        ++errors;
+    } catch (const Exception& e) {
+      cout << "SH Exception '" << e.message() << "'" << endl;
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    // Positions read from bytes, from a 2x2 slice of the image
+    Array2D<Attrib1ub> index(2, 2);
+    unsigned char* index_data = index.write_data();
+    index_data[0] = 3; index_data[1] = 2; index_data[2] = 1; index_data[3] = 0;
+    float expected[4] = {11, 10, 7, 6};
+    Array2D<Attrib1f> result(2, 2);
+    try {
+      gather(result, slice(image, 2, 1, 2, 2), index);
+      if (test.output_result<const float*>("2D slice positions", inputs,
+                                           result.read_data(), expected, 4, 0.0))
+        ++errors;
+    } catch (const Exception& e) {
+      cout << "SH Exception '" << e.message() << "'" << endl;
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    // Mirror a volume along z
+    Array3D<Attrib1f> src(2, 2, 2);
+    Array3D<Attrib3s> index(2, 2, 2);
+    Array3D<Attrib1f> result(2, 2, 2);
+    float* src_data = src.write_data();
+    short* index_data = index.write_data();
+    float expected[8];
+    for (int i = 0; i < 8; ++i) {
+      src_data[i] = 10 + i;
+      index_data[3*i + 0] = i % 2;
+      index_data[3*i + 1] = (i / 2) % 2;
+      index_data[3*i + 2] = 1 - i / 4;
+      expected[(1 - i / 4)*4 + i % 4] = 10 + i;
+    }
+    try {
+      scatter(result, index, src);
+      if (test.output_result<const float*>("3D scatter", inputs,
+                                           result.read_data(), expected, 8, 0.0))
+        ++errors;
+    } catch (const Exception& e) {
+      cout << "SH Exception '" << e.message() << "'" << endl;
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    // Enough elements to be split across threads, with repeated indices
+    // where the last write wins
+    const int n = 40000;
+    Array1D<Attrib1f> src(n);
+    Array1D<Attrib1ui> index(n);
+    Array1D<Attrib1f> result(n);
+    float* src_data = src.write_data();
+    unsigned int* index_data = index.write_data();
+    float* result_data = result.write_data();
+    vector<float> expected(n, -1);
+    for (int i = 0; i < n; ++i) {
+      src_data[i] = i;
+      index_data[i] = (n - 1 - i) / 2 * 2;
+      result_data[i] = -1;
+    }
+    for (int i = 0; i < n; ++i) expected[index_data[i]] = src_data[i];
+    Context::current()->threads(4);
+    try {
+      scatter(result, index, src);
+      if (test.output_result<const float*>("threaded scatter", inputs,
+                                           result.read_data(), &expected[0], n, 0.0))
+        ++errors;
+    } catch (const Exception& e) {
+      cout << "SH Exception '" << e.message() << "'" << endl;
+      ++errors;
+    }
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Immediate mode instructions on operands of one value type compute on
+// the host values directly.  They must give the same results as the
+// general path, including swizzles, negation, writemasks and aliasing.
+
+#define ELEMENTS 10
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  vector<string> inputs;
+  inputs.push_back("a");
+  inputs.push_back("b");
+
+  Attrib3f a(1, 2, 3);
+  Attrib3f b(4, 5, 6);
+
+  {
+    ++total_tests;
+    Attrib3f r = -a(2, 1, 0) + b;
+    float expected[3] = {1, 3, 5};
+    if (test.check_value("swizzle negate", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    Attrib3f r = a * 2.0f;
+    float expected[3] = {2, 4, 6};
+    if (test.check_value("scalar", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    Attrib3f r = b / a(0);
+    float expected[3] = {4, 5, 6};
+    if (test.check_value("scalar swizzle", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    Attrib3f r(7, 8, 9);
+    r(2, 0) = a(0, 1);
+    float expected[3] = {2, 8, 1};
+    if (test.check_value("writemask", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    Attrib3f r(1, 2, 3);
+    r(0, 1, 2) = r(2, 1, 0);
+    float expected[3] = {3, 2, 1};
+    if (test.check_value("aliasing", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    Attrib3f r = mad(a, b, a(0));
+    float expected[3] = {5, 11, 19};
+    if (test.check_value("mad", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    Attrib3i c(1, 2, 3);
+    Attrib3i r = c * c + c;
+    float expected[3] = {2, 6, 12};
+    if (test.check_value("int", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    // Mixed types take the general path
+    Attrib3d d(0.5, 0.5, 0.5);
+    Attrib3f r = a + d;
+    float expected[3] = {1.5, 2.5, 3.5};
+    if (test.check_value("mixed types", inputs, r, expected)) ++errors;
+  }
+
+  {
+    ++total_tests;
+    // Uniforms updated in immediate mode reach the programs using them
+    Attrib1f scale(2);
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f in;
+      OutputAttrib1f out;
+      out = in * scale;
+    } SH_END;
+
+    Array1D<Attrib1f> in(ELEMENTS), out(ELEMENTS);
+    float* in_data = in.write_data();
+    for (int i = 0; i < ELEMENTS; ++i) in_data[i] = i;
+    out = prg << in;
+    out.read_data();
+
+    scale = scale * 3.0f;
+    out = prg << in;
+    const float* out_data = out.read_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) expected[i] = i * 6;
+    if (test.output_result<const float*>("uniform", inputs, out_data,
+                                         expected, ELEMENTS, 0.0)) {
+      ++errors;
+    }
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
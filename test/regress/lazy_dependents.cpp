@@ -0,0 +1,127 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Dependent uniforms marked stale and reevaluated once each, in order,
+// when their values are needed
+
+#define ELEMENTS 10
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  vector<string> inputs;
+  inputs.push_back("a");
+  inputs.push_back("b");
+
+  Attrib1f a(1), b(2);
+  Attrib1f sum, product, total;
+
+  // total depends on sum both directly and through product
+  Program sum_prg = SH_BEGIN_PROGRAM() {
+    OutputAttrib1f out;
+    out = a + b;
+  } SH_END;
+  sum.attach(sum_prg);
+  Program product_prg = SH_BEGIN_PROGRAM() {
+    OutputAttrib1f out;
+    out = sum * a;
+  } SH_END;
+  product.attach(product_prg);
+  Program total_prg = SH_BEGIN_PROGRAM() {
+    OutputAttrib1f out;
+    out = sum + product;
+  } SH_END;
+  total.attach(total_prg);
+
+  Context::current()->lazy_dependents(true);
+  DependentGraph* graph = DependentGraph::instance();
+
+  {
+    DependentGraph::Stats before = graph->stats();
+    a = 3.0f;
+    b = 4.0f;
+    a = 5.0f;
+    DependentGraph::Stats after = graph->stats();
+
+    // Nothing is reevaluated until a value is looked at
+    ++total_tests;
+    float stale[2] = {(float)(after.updates - before.updates), total.node()->stale()};
+    float stale_expected[2] = {0, 1};
+    if (test.output_result<const float*>("deferred", inputs, stale,
+                                         stale_expected, 2, 0.0)) ++errors;
+
+    ++total_tests;
+    float values[3] = {sum.getValue(0), product.getValue(0), total.getValue(0)};
+    float expected[3] = {9, 45, 54};
+    if (test.output_result<const float*>("flushed", inputs, values,
+                                         expected, 3, 0.0)) ++errors;
+
+    // Each is reevaluated once, not once per change and path
+    ++total_tests;
+    after = graph->stats();
+    float counts[2] = {(float)(after.updates - before.updates),
+                       (float)(after.avoided - before.avoided)};
+    float counts_expected[2] = {3, 5};
+    if (test.output_result<const float*>("counts", inputs, counts,
+                                         counts_expected, 2, 0.0)) ++errors;
+  }
+
+  {
+    // Running a stream program flushes the dependents it uses first
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f in;
+      OutputAttrib1f out;
+      out = in * total;
+    } SH_END;
+
+    Array1D<Attrib1f> in(ELEMENTS), out(ELEMENTS);
+    float* in_data = in.write_data();
+    for (int i = 0; i < ELEMENTS; ++i) in_data[i] = i;
+
+    b = 1.0f;
+    out = prg << in;
+
+    ++total_tests;
+    const float* out_data = out.read_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) expected[i] = i * 36;
+    if (test.output_result<const float*>("stream", inputs, out_data,
+                                         expected, ELEMENTS, 0.0)) ++errors;
+  }
+
+  {
+    // Turning it off reevaluates what is stale
+    a = 2.0f;
+    Context::current()->lazy_dependents(false);
+
+    ++total_tests;
+    float stale[1] = {total.node()->stale()};
+    float stale_expected[1] = {0};
+    if (test.output_result<const float*>("off", inputs, stale,
+                                         stale_expected, 1, 0.0)) ++errors;
+
+    ++total_tests;
+    float values[1] = {total.getValue(0)};
+    float expected[1] = {9};
+    if (test.output_result<const float*>("off values", inputs, values,
+                                         expected, 1, 0.0)) ++errors;
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Stream assignments recorded and run (fused) when their results are read
+
+#define ELEMENTS 100
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  Attrib1f scale(2.0f);
+
+  Program double_it = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    OutputAttrib1f b;
+    b = a * scale;
+  } SH_END;
+
+  Program add_one = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    OutputAttrib1f b;
+    b = a + 1.0f;
+  } SH_END;
+
+  Program add = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    InputAttrib1f b;
+    OutputAttrib1f c;
+    c = a + b;
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("a");
+
+  HostMemoryPtr in_mem = new HostMemory(sizeof(float) * ELEMENTS, SH_FLOAT);
+  float* in_data = reinterpret_cast<float*>(in_mem->hostStorage()->data());
+  for (int i = 0; i < ELEMENTS; ++i) {
+    in_data[i] = i;
+  }
+  Array1D<Attrib1f> a(in_mem, ELEMENTS);
+
+  Context::current()->lazy_streams(true);
+
+  {float expected[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    expected[i] = (2 * i + 1) * 2 + i;
+  }
+  Array1D<Attrib1f> result(ELEMENTS);
+  {
+    // Neither intermediate is seen by anyone but the next stage
+    Array1D<Attrib1f> doubled(ELEMENTS), plus_one(ELEMENTS), doubled_again(ELEMENTS);
+    doubled = double_it << a;
+    plus_one = add_one << doubled;
+    doubled_again = double_it << plus_one;
+    result = add << doubled_again << a;
+  }
+  if (test.output_result<const float*>("fused chain", inputs, result.read_data(),
+                                       expected, ELEMENTS, 0.001)) errors++;
+  total_tests++;}
+
+  {float expected[ELEMENTS], kept_expected[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    kept_expected[i] = 2 * i;
+    expected[i] = 2 * i + 1;
+  }
+  // The intermediate is still around, so it is written
+  Array1D<Attrib1f> doubled(ELEMENTS), result(ELEMENTS);
+  doubled = double_it << a;
+  result = add_one << doubled;
+  if (test.output_result<const float*>("kept intermediate", inputs, doubled.read_data(),
+                                       kept_expected, ELEMENTS, 0.001)) errors++;
+  if (test.output_result<const float*>("after kept intermediate", inputs, result.read_data(),
+                                       expected, ELEMENTS, 0.001)) errors++;
+  total_tests += 2;}
+
+  {float expected[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    expected[i] = 2 * i + 1;
+  }
+  // Uniforms and inputs changed after the assignment are not seen by it
+  Array1D<Attrib1f> result(ELEMENTS);
+  {
+    Array1D<Attrib1f> doubled(ELEMENTS);
+    doubled = double_it << a;
+    result = add_one << doubled;
+  }
+  scale = 3.0f;
+  float* data = reinterpret_cast<float*>(a.write_data());
+  data[0] = 100;
+  if (test.output_result<const float*>("changed after", inputs, result.read_data(),
+                                       expected, ELEMENTS, 0.001)) errors++;
+  total_tests++;
+  data[0] = 0;
+  scale = 2.0f;}
+
+  {float expected[ELEMENTS];
+  for (int i = 0; i < ELEMENTS; ++i) {
+    expected[i] = i * 6;
+  }
+  // Connected programs go away with the programs they connect
+  std::size_t fused = StreamGraph::instance()->fused_programs();
+  {
+    Program twice = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f a;
+      OutputAttrib1f b;
+      b = a * 2.0f;
+    } SH_END;
+    Program thrice = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f a;
+      OutputAttrib1f b;
+      b = a * 3.0f;
+    } SH_END;
+
+    Array1D<Attrib1f> result(ELEMENTS);
+    {
+      Array1D<Attrib1f> doubled(ELEMENTS);
+      doubled = twice << a;
+      result = thrice << doubled;
+    }
+    if (test.output_result<const float*>("temporary programs", inputs, result.read_data(),
+                                         expected, ELEMENTS, 0.001)) errors++;
+    total_tests++;
+
+    float kept[1] = {static_cast<float>(StreamGraph::instance()->fused_programs() - fused)};
+    float one[1] = {1};
+    if (test.output_result<const float*>("fused program kept", inputs, kept, one,
+                                         1, 0)) errors++;
+    total_tests++;
+  }
+  Array1D<Attrib1f> other(ELEMENTS);
+  other = add_one << a;
+  other.read_data();
+  float left[1] = {static_cast<float>(StreamGraph::instance()->fused_programs() - fused)};
+  float none[1] = {0};
+  if (test.output_result<const float*>("fused program evicted", inputs, left, none,
+                                       1, 0)) errors++;
+  total_tests++;}
+
+  Context::current()->lazy_streams(false);
+
+  if (errors !=0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+  return 0;
+}
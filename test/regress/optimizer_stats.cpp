@@ -0,0 +1,111 @@
+#include <sh/sh.hpp>
+#include <sh/Optimizations.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// The optimizer passes record what they did in the context, and value
+// tracking is only rebuilt when a pass changed the program
+
+#define ELEMENTS 10
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+
+  vector<string> inputs;
+  inputs.push_back("a");
+
+  Context::current()->reset_optimizer_stats();
+
+  Attrib1f scale(3);
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    OutputAttrib1f b;
+    Attrib1f unused = a * a;
+    Attrib1f t = a;
+    SH_IF(t > 4.0f) {
+      b = t * scale;
+    } SH_ELSE {
+      b = t + 1.0f;
+    } SH_ENDIF;
+  } SH_END;
+
+  {
+    ++total_tests;
+    Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+    float* a_data = a.write_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = i;
+      expected[i] = i > 4 ? i * 3 : i + 1;
+    }
+    b = prg << a;
+    if (test.output_result<const float*>("results", inputs, b.read_data(),
+                                         expected, ELEMENTS, 0.0)) ++errors;
+  }
+
+  {
+    const OptimizerStats& stats = Context::current()->optimizer_stats();
+    const PassStats* deadcode = stats.pass("deadcode");
+    const PassStats* tracking = stats.pass("value tracking");
+
+    ++total_tests;
+    float counts[3] = {(float)(stats.programs > 0), (float)(stats.iterations >= stats.programs),
+                       (float)(deadcode && deadcode->statements_removed > 0)};
+    float counts_expected[3] = {1, 1, 1};
+    if (test.output_result<const float*>("counts", inputs, counts,
+                                         counts_expected, 3, 0.0)) {
+      cout << stats;
+      ++errors;
+    }
+
+    // Propagation and dead code run on the same value tracking when
+    // propagation changes nothing, and at most once per iteration
+    // otherwise
+    ++total_tests;
+    float tracked[2] = {(float)(tracking && tracking->runs <= 2 * stats.iterations),
+                        (float)(tracking && tracking->runs + stats.analyses_reused
+                                == 2 * stats.iterations)};
+    float tracked_expected[2] = {1, 1};
+    if (test.output_result<const float*>("value tracking", inputs, tracked,
+                                         tracked_expected, 2, 0.0)) {
+      cout << stats;
+      ++errors;
+    }
+  }
+
+  {
+    // Disabled passes do not run
+    Context::current()->reset_optimizer_stats();
+    Context::current()->disable_optimization("deadcode");
+    Program copy(prg.node()->clone());
+    optimize(copy);
+    Context::current()->enable_optimization("deadcode");
+
+    const OptimizerStats& stats = Context::current()->optimizer_stats();
+    ++total_tests;
+    float ran[3] = {(float)stats.programs, (float)(stats.pass("deadcode") != 0),
+                    (float)(stats.pass("copy propagation") != 0)};
+    float ran_expected[3] = {1, 0, 1};
+    if (test.output_result<const float*>("disabled", inputs, ran,
+                                         ran_expected, 3, 0.0)) {
+      cout << stats;
+      ++errors;
+    }
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
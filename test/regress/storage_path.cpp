@@ -0,0 +1,112 @@
+#include <sh/sh.hpp>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Syncing storages that have no transfer between them, through the
+// other storages of their memory
+
+#define ELEMENTS 100
+
+using namespace std;
+using namespace SH;
+
+// A storage that can only be copied to the host
+class ArrayStorage : public Storage {
+public:
+  ArrayStorage(Memory* memory)
+    : Storage(memory, SH_FLOAT), data(ELEMENTS)
+  {
+  }
+
+  string id() const { return "test:array"; }
+
+  vector<float> data;
+};
+
+class ArrayHostTransfer : public Transfer {
+public:
+  ArrayHostTransfer()
+    : Transfer("test:array", "host")
+  {
+  }
+
+  bool transfer(const Storage* from, Storage* to)
+  {
+    const ArrayStorage* array = dynamic_cast<const ArrayStorage*>(from);
+    HostStorage* host = dynamic_cast<HostStorage*>(to);
+    if (!array || !host) return false;
+    std::copy(array->data.begin(), array->data.end(), reinterpret_cast<float*>(host->data()));
+    return true;
+  }
+
+  int cost(const Storage* from, const Storage* to)
+  {
+    return 10;
+  }
+};
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+
+  ArrayHostTransfer array_host;
+
+  vector<string> inputs;
+  inputs.push_back("array");
+
+  {
+    ++total_tests;
+    vector<int> path = Storage::path(Storage::intern("test:array"), Storage::intern("file"));
+    vector<int> expected;
+    expected.push_back(Storage::intern("test:array"));
+    expected.push_back(Storage::intern("host"));
+    expected.push_back(Storage::intern("file"));
+    if (path != expected) {
+      cout << "test:array to file does not go through host" << endl;
+      ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    HostMemoryPtr memory = new HostMemory(sizeof(float) * ELEMENTS, SH_FLOAT);
+    Pointer<ArrayStorage> array = new ArrayStorage(memory.object());
+    MmapStoragePtr file = new MmapStorage(memory.object(), "storage_path.dat",
+                                          sizeof(float) * ELEMENTS, SH_FLOAT);
+
+    float expected[ELEMENTS];
+    array->dirtyall();
+    for (int i = 0; i < ELEMENTS; ++i) {
+      array->data[i] = expected[i] = i * 0.25f;
+    }
+
+    // There is no transfer from the array to the file, it has to go
+    // through the host
+    file->sync();
+    if (test.output_result<const float*>("file through host", inputs,
+                                         reinterpret_cast<const float*>(file->data()),
+                                         expected, ELEMENTS, 0.0)) {
+      ++errors;
+    }
+
+    if (Storage::intern("test:array") != array->interned_id()
+        || memory->findStorage(Storage::intern("file")) != file) {
+      cout << "storages not found by interned id" << endl;
+      ++errors;
+    }
+  }
+  remove("storage_path.dat");
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <sh/sh.hpp>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Streams in files run a window at a time
+
+#define ELEMENTS 1000
+#define WINDOW 64
+
+using namespace std;
+using namespace SH;
+
+void reset_memory(FileMemoryPtr mem, int elements)
+{
+  float* data = reinterpret_cast<float*>(mem->hostStorage()->data());
+  for (int i = 0; i < elements; ++i) {
+    data[i] = i;
+  }
+  mem->hostStorage()->dirtyall();
+}
+
+float* result(FileMemoryPtr mem)
+{
+  mem->hostStorage()->sync();
+  return reinterpret_cast<float*>(mem->hostStorage()->data());
+}
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    InputAttrib1f b;
+    OutputAttrib1f c;
+    c = a * 2.0f + b;
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("a"); inputs.push_back("b");
+
+  const char* names[3] = {"stream_window_a.dat", "stream_window_b.dat", "stream_window_c.dat"};
+  FileMemoryPtr mem[3];
+  for (int i = 0; i < 3; ++i) {
+    mem[i] = new FileMemory(names[i], sizeof(float) * 3 * ELEMENTS, SH_FLOAT);
+  }
+  Array1D<Attrib1f> a(mem[0], 3 * ELEMENTS),
+                    b(mem[1], 3 * ELEMENTS),
+                    c(mem[2], 3 * ELEMENTS);
+  a = count(a, ELEMENTS);
+  b = count(b, ELEMENTS);
+  c = count(c, ELEMENTS);
+
+  Context::current()->stream_window(WINDOW);
+
+  {vector<float> expected(3 * ELEMENTS);
+  for (int i = 0; i < 3 * ELEMENTS; ++i) {
+    expected[i] = i < ELEMENTS ? 3 * i : i;
+  }
+  for (int i = 0; i < 3; ++i) reset_memory(mem[i], 3 * ELEMENTS);
+  c = prg << a << b;
+  if (test.output_result<float*>("windows", inputs, result(mem[2]),
+                                 &expected[0], 3 * ELEMENTS, 0.001)) errors++;
+  total_tests++;}
+
+  {vector<float> expected(3 * ELEMENTS);
+  for (int i = 0; i < 3 * ELEMENTS; ++i) {
+    expected[i] = i;
+  }
+  for (int i = 0; i < ELEMENTS; ++i) {
+    expected[5 + 2 * i] = 2 * (2 + 3 * i) + (1 + i);
+  }
+  for (int i = 0; i < 3; ++i) reset_memory(mem[i], 3 * ELEMENTS);
+  Array1D<Attrib1f> wide_a(mem[0], 3 * ELEMENTS),
+                    wide_b(mem[1], 3 * ELEMENTS),
+                    wide_c(mem[2], 3 * ELEMENTS);
+  stride(offset(count(wide_c, 2 * ELEMENTS), 5), 2) =
+    prg << stride(offset(wide_a, 2), 3) << offset(count(wide_b, ELEMENTS), 1);
+  if (test.output_result<float*>("offset stride windows", inputs, result(mem[2]),
+                                 &expected[0], 3 * ELEMENTS, 0.001)) errors++;
+  total_tests++;}
+
+  {vector<float> expected(3 * ELEMENTS);
+  for (int i = 0; i < 3 * ELEMENTS; ++i) {
+    expected[i] = i < WINDOW / 2 ? 3 * i : i;
+  }
+  for (int i = 0; i < 3; ++i) reset_memory(mem[i], 3 * ELEMENTS);
+  count(c, WINDOW / 2) = prg << count(a, WINDOW / 2) << count(b, WINDOW / 2);
+  if (test.output_result<float*>("one window", inputs, result(mem[2]),
+                                 &expected[0], 3 * ELEMENTS, 0.001)) errors++;
+  total_tests++;}
+
+  Context::current()->stream_window(0);
+
+  for (int i = 0; i < 3; ++i) {
+    mem[i] = 0;
+    remove(names[i]);
+  }
+
+  if (errors !=0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+  return 0;
+}
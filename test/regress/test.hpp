@@ -123,6 +123,16 @@ public:
     return 0;
   }
 
+  /// Check the value of a variable on the host
+  template<int N, typename T>
+  int check_value(const std::string& name, const std::vector<std::string>& inputs,
+                  const SH::Generic<N, T>& result, const float expected[N])
+  {
+    float values[N];
+    for (int i = 0; i < N; ++i) values[i] = result.getValue(i);
+    return output_result<const float*>(name, inputs, values, expected, N, 0.0);
+  }
+
   /// Run stream test on current backend (1 input parameter)
   template <class SH_INPUT1, class SH_OUTPUT>
   int run(SH::Program& program, const SH_INPUT1& in1, const SH_OUTPUT& res, const double epsilon)
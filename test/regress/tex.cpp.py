@@ -3,7 +3,6 @@
 import shtest, sys
 
 test = shtest.StreamTest('tex', 1)
-test.broken_backend("cc")
 
 # all the tests use nearest-neighbour lookup right now
 
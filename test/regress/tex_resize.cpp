@@ -0,0 +1,71 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include "test.hpp"
+
+// Lookups in a texture that is resized between runs of the same program
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  ArrayRect<Attrib1f> tex(4, 4);
+
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib2f coord;
+    OutputAttrib1f value;
+    value = tex[coord];
+  } SH_END;
+
+  vector<string> inputs;
+  inputs.push_back("coord");
+
+  const int sizes[][2] = { {4, 4}, {8, 2}, {3, 5}, {16, 16} };
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    int width = sizes[s][0], height = sizes[s][1];
+    int count = width * height;
+
+    tex.size(width, height);
+    tex.memory(new HostMemory(count * sizeof(float), SH_FLOAT));
+    float* tex_data = tex.write_data();
+    for (int j = 0; j < height; ++j) {
+      for (int i = 0; i < width; ++i) {
+        tex_data[i + width * j] = i + 100 * j;
+      }
+    }
+
+    Array1D<Attrib2f> coord(count);
+    Array1D<Attrib1f> value(count);
+    float* coord_data = coord.write_data();
+    vector<float> expected(count);
+    for (int k = 0; k < count; ++k) {
+      // visit the texels in a different order than they are stored in
+      int i = (k * 7) % width, j = (k / width) % height;
+      coord_data[2 * k] = i;
+      coord_data[2 * k + 1] = j;
+      expected[k] = i + 100 * j;
+    }
+    value = prg << coord;
+
+    ostringstream name;
+    name << "tex_resize " << width << "x" << height;
+    if (test.output_result<const float*>(name.str(), inputs, value.read_data(),
+                                         &expected[0], count, 0.001)) errors++;
+    total_tests++;
+  }
+
+  if (errors !=0) {
+    std::cout << "Total Errors: " << errors << "/" << total_tests << std::endl;
+    return 1;
+  }
+  return 0;
+}
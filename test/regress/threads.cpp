@@ -0,0 +1,168 @@
+#include <sh/sh.hpp>
+#include <pthread.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Several threads building, optimizing, compiling and running their
+// own programs at the same time, then running one shared program
+
+#define THREADS 4
+#define ROUNDS 3
+#define ELEMENTS 1000
+#define SHARED_ROUNDS 20
+#define SHARED_ELEMENTS 20000
+
+using namespace std;
+using namespace SH;
+
+struct Work {
+  int index;
+  vector<float> result;
+  vector<float> expected;
+};
+
+void* run(void* data)
+{
+  Work& work = *static_cast<Work*>(data);
+  float scale = work.index + 1;
+
+  for (int round = 0; round < ROUNDS; ++round) {
+    // Differs between threads and rounds, so no two programs are the same
+    float bias = work.index * 10 + round;
+
+    Program prg = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f a;
+      OutputAttrib1f b;
+      Attrib1f t = a * scale;
+      b = t + bias;
+    } SH_END;
+
+    Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+    float* a_data = a.write_data();
+    for (int i = 0; i < ELEMENTS; ++i) a_data[i] = i;
+    b = prg << a;
+
+    const float* b_data = b.read_data();
+    work.result.insert(work.result.end(), b_data, b_data + ELEMENTS);
+    for (int i = 0; i < ELEMENTS; ++i) {
+      work.expected.push_back(i * scale + bias);
+    }
+  }
+  return 0;
+}
+
+struct SharedWork {
+  Program* prg;
+  int index;
+  vector<float> result;
+  vector<float> expected;
+};
+
+void* run_shared(void* data)
+{
+  SharedWork& work = *static_cast<SharedWork*>(data);
+
+  for (int round = 0; round < SHARED_ROUNDS; ++round) {
+    Array1D<Attrib1f> a(SHARED_ELEMENTS), b(SHARED_ELEMENTS);
+    float* a_data = a.write_data();
+    for (int i = 0; i < SHARED_ELEMENTS; ++i) a_data[i] = (i + work.index) % 7;
+    b = *work.prg << a;
+
+    const float* b_data = b.read_data();
+    work.result.insert(work.result.end(), b_data, b_data + SHARED_ELEMENTS);
+    for (int i = 0; i < SHARED_ELEMENTS; ++i) {
+      float x = a_data[i];
+      work.expected.push_back(x > 3 ? x * 2 : x + 100);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  vector<string> inputs;
+  inputs.push_back("a");
+
+  Work work[THREADS];
+  pthread_t threads[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    work[i].index = i;
+    pthread_create(&threads[i], 0, run, &work[i]);
+  }
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], 0);
+  }
+
+  // Generated and compiled before the threads start, so that they all
+  // run the same code at once
+  Context::current()->async_compile(false);
+  Program shared = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    OutputAttrib1f b;
+    SH_IF(a > 3.0f) {
+      b = a * 2.0f;
+    } SH_ELSE {
+      b = a + 100.0f;
+    } SH_ENDIF;
+  } SH_END;
+  {
+    Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+    float* a_data = a.write_data();
+    for (int i = 0; i < ELEMENTS; ++i) a_data[i] = i;
+    b = shared << a;
+    b.read_data();
+  }
+
+  SharedWork shared_work[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    shared_work[i].prg = &shared;
+    shared_work[i].index = i;
+    pthread_create(&threads[i], 0, run_shared, &shared_work[i]);
+  }
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], 0);
+  }
+
+  for (int i = 0; i < THREADS; ++i) {
+    ++total_tests;
+    if (shared_work[i].result.size() != shared_work[i].expected.size()) {
+      cout << "shared thread " << i << " did not finish" << endl;
+      ++errors;
+      continue;
+    }
+    if (test.output_result<const float*>("shared thread", inputs, &shared_work[i].result[0],
+                                         &shared_work[i].expected[0],
+                                         shared_work[i].result.size(), 0.0)) {
+      ++errors;
+    }
+  }
+
+  for (int i = 0; i < THREADS; ++i) {
+    ++total_tests;
+    if (work[i].result.size() != work[i].expected.size()) {
+      cout << "thread " << i << " did not finish" << endl;
+      ++errors;
+      continue;
+    }
+    if (test.output_result<const float*>("thread", inputs, &work[i].result[0],
+                                         &work[i].expected[0],
+                                         work[i].result.size(), 0.0)) {
+      ++errors;
+    }
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
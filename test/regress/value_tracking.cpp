@@ -0,0 +1,125 @@
+#include <sh/sh.hpp>
+#include <sh/Optimizations.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "test.hpp"
+
+// Use-def and def-use chains across a loop: a use in the loop is
+// reached both by the definition before the loop and by the one in it
+
+#define ELEMENTS 10
+
+using namespace std;
+using namespace SH;
+
+struct StatementFinder {
+  void operator()(CtrlGraphNode* node)
+  {
+    if (!node || !node->block) return;
+    for (BasicBlock::StmtList::iterator I = node->block->begin();
+         I != node->block->end(); ++I) {
+      if (I->op == OP_MUL) mul = &*I;
+      if (I->op == OP_ASN && I->dest.node()->kind() == SH_OUTPUT) out = &*I;
+      if (I->op == OP_ASN && I->src[0].node()->kind() == SH_INPUT) in = &*I;
+    }
+  }
+
+  Statement* mul;
+  Statement* out;
+  Statement* in;
+};
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+
+  vector<string> inputs;
+  inputs.push_back("a");
+
+  // Left unoptimized, so that the statements are as written
+  int level = Context::current()->optimization();
+  Context::current()->optimization(0);
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    OutputAttrib1f b;
+    Attrib1f acc = a;
+    SH_WHILE(acc < 10.0f) {
+      acc = acc * 2.0f;
+    } SH_ENDWHILE;
+    b = acc;
+  } SH_END;
+  Context::current()->optimization(level);
+
+  {
+    add_value_tracking(prg);
+    StatementFinder finder = {0, 0, 0};
+    prg.node()->ctrlGraph->dfs(finder);
+
+    ++total_tests;
+    float found[3] = {finder.mul != 0, finder.out != 0, finder.in != 0};
+    float found_expected[3] = {1, 1, 1};
+    if (test.output_result<const float*>("statements", inputs, found,
+                                         found_expected, 3, 0.0)) {
+      ++errors;
+    } else {
+      ValueTracking* mul = finder.mul->get_info<ValueTracking>();
+      ValueTracking* out = finder.out->get_info<ValueTracking>();
+      ValueTracking* in = finder.in->get_info<ValueTracking>();
+
+      // acc is reached by both of its definitions in the loop and after it
+      ++total_tests;
+      float defs[4] = {mul->defs[0][0].size(),
+                       mul->defs[0][0].count(ValueTracking::Def(finder.in, 0)),
+                       out->defs[0][0].size(),
+                       in->defs[0][0].begin()->kind == ValueTracking::Def::SH_INPUT};
+      float defs_expected[4] = {2, 1, 2, 1};
+      if (test.output_result<const float*>("use-def", inputs, defs,
+                                           defs_expected, 4, 0.0)) ++errors;
+
+      // The definition before the loop is used by the loop condition,
+      // the multiply and the output; the multiply's only by the
+      // assignment back to acc
+      ++total_tests;
+      float uses[2] = {in->uses[0].size(), mul->uses[0].size()};
+      float uses_expected[2] = {3, 1};
+      if (test.output_result<const float*>("def-use", inputs, uses,
+                                           uses_expected, 2, 0.0)) ++errors;
+    }
+  }
+
+  {
+    ++total_tests;
+    Program optimized = SH_BEGIN_PROGRAM("stream") {
+      InputAttrib1f a;
+      OutputAttrib1f b;
+      Attrib1f acc = a;
+      SH_WHILE(acc < 10.0f) {
+        acc = acc * 2.0f;
+      } SH_ENDWHILE;
+      b = acc;
+    } SH_END;
+
+    Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+    float* a_data = a.write_data();
+    float expected[ELEMENTS];
+    for (int i = 0; i < ELEMENTS; ++i) {
+      a_data[i] = i + 1;
+      expected[i] = i + 1;
+      while (expected[i] < 10) expected[i] *= 2;
+    }
+    b = optimized << a;
+    if (test.output_result<const float*>("results", inputs, b.read_data(),
+                                         expected, ELEMENTS, 0.0)) ++errors;
+  }
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
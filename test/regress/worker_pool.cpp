@@ -0,0 +1,86 @@
+#include <sh/sh.hpp>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include "test.hpp"
+
+// Streams long enough to be split between worker threads give the same
+// results whatever the number of threads
+
+// More than 8 threads' worth of 4096 elements, and not a multiple of it
+#define ELEMENTS (8 * 4096 + 123)
+
+using namespace std;
+using namespace SH;
+
+int main(int argc, char* argv[])
+{
+  int errors = 0;
+  int total_tests = 0;
+
+  Test test(argc, argv);
+  test.ignore_backend("host");
+
+  vector<string> inputs;
+  inputs.push_back("a");
+  inputs.push_back("b");
+
+  Attrib1f scale(0.5f);
+  Program prg = SH_BEGIN_PROGRAM("stream") {
+    InputAttrib1f a;
+    InputAttrib1f b;
+    OutputAttrib2f c;
+    c(0) = a * scale + b;
+    c(1) = a - b * b;
+  } SH_END;
+
+  Array1D<Attrib1f> a(ELEMENTS), b(ELEMENTS);
+  float* a_data = a.write_data();
+  float* b_data = b.write_data();
+  for (int i = 0; i < ELEMENTS; ++i) {
+    a_data[i] = i;
+    b_data[i] = (i % 97) * 0.25f;
+  }
+
+  // Compiled right away, so that no run is interpreted instead
+  bool async = Context::current()->async_compile();
+  Context::current()->async_compile(false);
+  int threads = Context::current()->threads();
+
+  // The serial run everything else is compared with
+  Context::current()->threads(1);
+  Array1D<Attrib2f> serial(ELEMENTS);
+  serial = prg << a << b;
+  vector<float> expected(serial.read_data(), serial.read_data() + 2 * ELEMENTS);
+
+  ++total_tests;
+  float first[4] = {expected[0], expected[1],
+                    expected[2 * ELEMENTS - 2], expected[2 * ELEMENTS - 1]};
+  float last = ELEMENTS - 1, last_b = ((ELEMENTS - 1) % 97) * 0.25f;
+  float first_expected[4] = {0, 0, last * 0.5f + last_b, last - last_b * last_b};
+  if (test.output_result<const float*>("serial", inputs, first,
+                                       first_expected, 4, 0.0)) ++errors;
+
+  int counts[] = {2, 3, 8};
+  for (int k = 0; k < 3; ++k) {
+    Context::current()->threads(counts[k]);
+    Array1D<Attrib2f> result(ELEMENTS);
+    result = prg << a << b;
+
+    ++total_tests;
+    ostringstream name;
+    name << counts[k] << " threads";
+    if (test.output_result<const float*>(name.str(), inputs, result.read_data(),
+                                         &expected[0], 2 * ELEMENTS, 0.0)) ++errors;
+  }
+  Context::current()->threads(threads);
+  Context::current()->async_compile(async);
+
+  if (errors != 0) {
+    cout << "Total Errors: " << errors << "/" << total_tests << endl;
+    return 1;
+  }
+
+  return 0;
+}
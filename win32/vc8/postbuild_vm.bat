@@ -0,0 +1,5 @@
+IF EXIST "Debug\libshvm_debug.dll" xcopy /D /Q /Y /K "Debug\libshvm_debug.dll" "..\..\..\install\bin\vc8"
+IF EXIST "Debug\libshvm_debug.pdb" xcopy /D /Q /Y /K "Debug\libshvm_debug.pdb" "..\..\..\install\bin\vc8"
+
+IF EXIST "Release\libshvm.dll" xcopy /D /Q /Y /K "Release\libshvm.dll" "..\..\..\install\bin\vc8"
+IF EXIST "Release\libshvm.pdb" xcopy /D /Q /Y /K "Release\libshvm.pdb" "..\..\..\install\bin\vc8"